@@ -0,0 +1,163 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/*
+ *  AsyncWavefileWriter.cpp
+ *  iDiMP
+ *
+ */
+
+#include "AsyncWavefileWriter.h"
+
+#include <unistd.h>
+
+static const UInt32 BYTES_PER_FRAME = AUDIO_BIT_DEPTH_IN_BYTES * AUDIO_NUM_CHANNELS;
+
+// ---- AsyncWavefileWriter public methods ----
+
+AsyncWavefileWriter::AsyncWavefileWriter(const char* filename, bool compressLossless) :
+    m_encoder(NULL),
+    m_ring(ASYNC_WAVEFILE_RING_BYTES),
+    m_chunk(new char[ASYNC_WAVEFILE_CHUNK_BYTES]),
+    m_writerThreadStarted(false),
+    m_isRunning(1),
+    m_numDroppedFrames(0),
+    m_numReportedDroppedFrames(0)
+{
+    bool opened;
+    if (compressLossless)
+    {
+        m_encoder = new LosslessEncoder();
+        opened = m_encoder->open(filename, (uint32_t)AUDIO_SAMPLE_RATE, AUDIO_NUM_CHANNELS, AUDIO_BIT_DEPTH);
+    }
+    else
+    {
+        opened = m_file.openForWriting(filename, (uint32_t)AUDIO_SAMPLE_RATE, AUDIO_NUM_CHANNELS, PortableWavefile::Int16);
+    }
+    
+    if (!opened)
+    {
+        printf("AsyncWavefileWriter::AsyncWavefileWriter could not create %s\n", filename);
+    }
+    else if (pthread_create(&m_writerThread, NULL, writer_thread_main, this) != 0)
+    {
+        printf("AsyncWavefileWriter::AsyncWavefileWriter could not create writer thread\n");
+    }
+    else
+    {
+        m_writerThreadStarted = true;
+    }
+}
+
+AsyncWavefileWriter::~AsyncWavefileWriter()
+{
+    AtomicStore32(&m_isRunning, 0);
+    if (m_writerThreadStarted)
+    {
+        pthread_join(m_writerThread, NULL);
+    }
+    
+    // whatever the thread didn't get to
+    write_pending(true);
+    
+    if (m_encoder != NULL)
+    {
+        if (m_encoder->getNumFrames() > 0)
+        {
+            printf("AsyncWavefileWriter::~AsyncWavefileWriter compressed to %.0f%% of PCM size\n", 
+                   100.0 * m_encoder->getNumBytesWritten() / ((double)m_encoder->getNumFrames() * BYTES_PER_FRAME));
+        }
+        delete m_encoder;
+        m_encoder = NULL;
+    }
+    
+    if (m_numDroppedFrames > 0)
+    {
+        printf("AsyncWavefileWriter::~AsyncWavefileWriter %d frames were dropped in total\n", (int)m_numDroppedFrames);
+    }
+    
+    delete[] m_chunk;
+    m_chunk = NULL;
+}
+
+void AsyncWavefileWriter::WriteAudioBuffers(const AudioBufferList* bufferList)
+{
+    for (UInt32 i = 0; i < bufferList->mNumberBuffers; i++)
+    {
+        UInt32 numBytes = bufferList->mBuffers[i].mDataByteSize;
+        if (!m_ring.write(bufferList->mBuffers[i].mData, numBytes))
+        {
+            // disk can't keep up - drop the whole buffer so the file stays frame aligned
+            AtomicAdd32(numBytes / BYTES_PER_FRAME, &m_numDroppedFrames);
+        }
+    }
+}
+
+// ---- AsyncWavefileWriter private methods ----
+
+void* AsyncWavefileWriter::writer_thread_main(void* arg)
+{
+    AsyncWavefileWriter* writer = (AsyncWavefileWriter*)arg;
+    int numPolls = 0;
+    while (AtomicLoad32(&writer->m_isRunning))
+    {
+        writer->write_pending(false);
+        
+        if (++numPolls == ASYNC_WAVEFILE_POLLS_PER_HEADER_UPDATE)
+        {
+            // (a FLAC stream header is only finished when the encoder is closed)
+            if (writer->m_encoder == NULL)
+            {
+                writer->m_file.updateHeader();
+            }
+            numPolls = 0;
+        }
+        
+        int32_t dropped = AtomicLoad32(&writer->m_numDroppedFrames);
+        if (dropped != writer->m_numReportedDroppedFrames)
+        {
+            printf("AsyncWavefileWriter: disk is not keeping up - %d frames dropped so far\n", (int)dropped);
+            writer->m_numReportedDroppedFrames = dropped;
+        }
+        
+        usleep(ASYNC_WAVEFILE_POLL_USEC);
+    }
+    return NULL;
+}
+
+void AsyncWavefileWriter::write_pending(bool flushAll)
+{
+    // write whole chunks only, unless we are closing
+    while (m_ring.getReadAvailable() >= ASYNC_WAVEFILE_CHUNK_BYTES || (flushAll && m_ring.getReadAvailable() > 0))
+    {
+        UInt32 numBytes = m_ring.read(m_chunk, ASYNC_WAVEFILE_CHUNK_BYTES);
+        if (m_encoder != NULL)
+        {
+            m_encoder->writeShort((const short*)m_chunk, numBytes / BYTES_PER_FRAME);
+        }
+        else
+        {
+            m_file.writeBytes(m_chunk, numBytes);
+        }
+    }
+}
@@ -0,0 +1,109 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/**
+ *  @file AsyncWavefileWriter.h
+ *  iDiMP
+ *
+ *  This file defines the interface for the AsyncWavefileWriter class.
+ */
+
+#ifndef ASYNC_WAVEFILE_WRITER_H
+#define ASYNC_WAVEFILE_WRITER_H
+
+#include <pthread.h>
+
+#import "AudioBasics.h"
+#import "AtomicOps.h"
+#import "LockFreeRingBuffer.h"
+#import "LosslessCodec.h"
+#import "PortableWavefile.h"
+
+static const UInt32 ASYNC_WAVEFILE_RING_BYTES   = 1 << 20;  ///< audio buffered between the audio thread and the disk (about 6 seconds)
+static const UInt32 ASYNC_WAVEFILE_CHUNK_BYTES  = 64 * 1024; ///< size of each write to disk
+static const int    ASYNC_WAVEFILE_POLL_USEC    = 20000;     ///< how often the writer thread checks for a full chunk
+static const int    ASYNC_WAVEFILE_POLLS_PER_HEADER_UPDATE = 50; ///< how often (in polls) the file header is brought up to date, so an interrupted recording is still readable
+
+/** AsyncWavefileWriter class.
+ * AsyncWavefileWriter records audio to a PortableWavefile without doing file I/O on the audio thread.
+ * The audio thread only copies samples into a lock-free ring buffer; a writer thread drains 
+ * the ring in large sequential chunks.  If the disk falls so far behind that the ring fills up, 
+ * whole buffers are dropped and counted instead of blocking the audio thread.
+ * Optionally the recording is compressed losslessly (to FLAC) by a LosslessEncoder instead, 
+ * which roughly halves the disk space a long session takes.
+ */
+class AsyncWavefileWriter
+{
+public:
+   /**
+    * AsyncWavefileWriter constructor.
+    * Creates (or overwrites) the file and starts the writer thread.
+    * Check isOpen afterwards - if the file could not be created, nothing is recorded.
+    * @param filename output audio file path
+    * @param compressLossless true to write a FLAC file instead of a wave file
+    */
+    AsyncWavefileWriter(const char* filename, bool compressLossless = false);
+    
+   /**
+    * AsyncWavefileWriter destructor.
+    * Stops the writer thread, writes everything still buffered, and closes the file.
+    * Must not be called from the audio thread.
+    */
+    ~AsyncWavefileWriter();
+    
+   /**
+    * Queue the contents of the given audio buffers to be written.  Safe to call from the audio thread.
+    * @param bufferList a pointer to the AudioBufferList object which contains the audio data to be written.
+    */
+    void WriteAudioBuffers(const AudioBufferList* bufferList);
+    
+   /**
+    * @return true if the file was created and the writer thread is running, false if nothing will be recorded
+    */
+    bool isOpen() const { return m_writerThreadStarted; }
+    
+   /**
+    * @return the number of frames that were dropped because the disk could not keep up
+    */
+    UInt32 getNumDroppedFrames() const { return AtomicLoad32(&m_numDroppedFrames); }
+    
+private:
+    AsyncWavefileWriter(const AsyncWavefileWriter&);
+    AsyncWavefileWriter& operator= (const AsyncWavefileWriter&);
+    
+    static void* writer_thread_main(void* arg);
+    
+    void write_pending(bool flushAll);
+    
+    PortableWavefile m_file;
+    LosslessEncoder* m_encoder; ///< used instead of m_file when compressing
+    LockFreeRingBuffer m_ring;
+    char* m_chunk;
+    pthread_t m_writerThread;
+    bool m_writerThreadStarted;
+    volatile int32_t m_isRunning;
+    volatile int32_t m_numDroppedFrames;
+    int32_t m_numReportedDroppedFrames;
+};
+
+#endif // ASYNC_WAVEFILE_WRITER_H
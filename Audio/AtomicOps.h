@@ -0,0 +1,166 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/**
+ *  @file AtomicOps.h
+ *  iDiMP
+ *
+ *  Lock-free primitives shared by code that runs on the audio thread.
+ *  On Apple platforms these map onto the libkern OSAtomic functions; elsewhere
+ *  the equivalent GCC __sync builtins are used.
+ */
+
+#ifndef ATOMIC_OPS_H
+#define ATOMIC_OPS_H
+
+#include <stdint.h>
+
+#ifdef __APPLE__
+#include <libkern/OSAtomic.h>
+#endif
+
+/**
+ * Issue a full memory barrier.
+ */
+inline void AtomicMemoryBarrier()
+{
+#ifdef __APPLE__
+    OSMemoryBarrier();
+#else
+    __sync_synchronize();
+#endif
+}
+
+/**
+ * Atomically add to a 32-bit value.
+ * @param amount the amount to add
+ * @param value the value to be modified
+ * @return the new value
+ */
+inline int32_t AtomicAdd32(int32_t amount, volatile int32_t* value)
+{
+#ifdef __APPLE__
+    return OSAtomicAdd32Barrier(amount, value);
+#else
+    return __sync_add_and_fetch(value, amount);
+#endif
+}
+
+/**
+ * Atomically increment a 32-bit value.
+ * @param value the value to be incremented
+ * @return the new value
+ */
+inline int32_t AtomicIncrement32(volatile int32_t* value)
+{
+    return AtomicAdd32(1, value);
+}
+
+/**
+ * Atomically replace a 32-bit value if it still holds the expected value.
+ * @param oldValue the expected current value
+ * @param newValue the replacement value
+ * @param value the value to be modified
+ * @return true if the swap took place, false otherwise
+ */
+inline bool AtomicCompareAndSwap32(int32_t oldValue, int32_t newValue, volatile int32_t* value)
+{
+#ifdef __APPLE__
+    return OSAtomicCompareAndSwap32Barrier(oldValue, newValue, value);
+#else
+    return __sync_bool_compare_and_swap(value, oldValue, newValue);
+#endif
+}
+
+/**
+ * Atomically replace a pointer if it still holds the expected value.
+ * @param oldValue the expected current pointer
+ * @param newValue the replacement pointer
+ * @param value the pointer to be modified
+ * @return true if the swap took place, false otherwise
+ */
+inline bool AtomicCompareAndSwapPtr(void* oldValue, void* newValue, void* volatile* value)
+{
+#ifdef __APPLE__
+    return OSAtomicCompareAndSwapPtrBarrier(oldValue, newValue, value);
+#else
+    return __sync_bool_compare_and_swap(value, oldValue, newValue);
+#endif
+}
+
+/**
+ * Read a 32-bit value written by another thread.
+ * Reads made after this call will not be reordered before it.
+ * @param value the value to read
+ * @return the current value
+ */
+inline int32_t AtomicLoad32(const volatile int32_t* value)
+{
+    int32_t result = *value;
+    AtomicMemoryBarrier();
+    return result;
+}
+
+/**
+ * Publish a 32-bit value to other threads.
+ * Writes made before this call will be visible before the new value is.
+ * @param value the value to be modified
+ * @param newValue the value to store
+ */
+inline void AtomicStore32(volatile int32_t* value, int32_t newValue)
+{
+    AtomicMemoryBarrier();
+    *value = newValue;
+}
+
+/**
+ * Read a pointer published by another thread.
+ * @param location the pointer to read
+ * @return the current pointer
+ */
+template <typename T>
+inline T* AtomicLoadPtr(T* const volatile* location)
+{
+    T* result = *location;
+    AtomicMemoryBarrier();
+    return result;
+}
+
+/**
+ * Atomically replace a pointer, returning the pointer it held before.
+ * @param location the pointer to be modified
+ * @param newValue the replacement pointer
+ * @return the previous pointer
+ */
+template <typename T>
+inline T* AtomicExchangePtr(T* volatile* location, T* newValue)
+{
+    T* oldValue;
+    do
+    {
+        oldValue = *location;
+    } while (!AtomicCompareAndSwapPtr(oldValue, newValue, reinterpret_cast<void* volatile*>(location)));
+    return oldValue;
+}
+
+#endif // ATOMIC_OPS_H
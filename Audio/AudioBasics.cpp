@@ -31,6 +31,10 @@
 
 #include "AudioBasics.h"
 
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 void AudioSamplesFloatToShort(const float* in, short* out, int numSamples)
 {
     const float* pIn = in;
@@ -97,6 +101,77 @@ void AudioSamplesMixFloat3ToShort(const float* in1, const float* in2, const floa
     }
 }
 
+void AudioSamplesStereoToMidSide(const short* in, short* mid, short* side, int numFrames)
+{
+    int n = 0;
+#if defined(__ARM_NEON__)
+    for (; n + 8 <= numFrames; n += 8)
+    {
+        int16x8x2_t leftRight = vld2q_s16(in + 2 * n);
+        vst1q_s16(mid + n, vhaddq_s16(leftRight.val[0], leftRight.val[1]));
+        vst1q_s16(side + n, vhsubq_s16(leftRight.val[0], leftRight.val[1]));
+    }
+#endif
+    for (; n < numFrames; n++)
+    {
+        int left = in[2 * n];
+        int right = in[2 * n + 1];
+        mid[n] = (short)((left + right) >> 1);
+        side[n] = (short)((left - right) >> 1);
+    }
+}
+
+void AudioSamplesMidSideToStereo(const short* mid, const short* side, short* out, int numFrames)
+{
+    int n = 0;
+#if defined(__ARM_NEON__)
+    for (; n + 8 <= numFrames; n += 8)
+    {
+        int16x8_t m = vld1q_s16(mid + n);
+        int16x8_t s = vld1q_s16(side + n);
+        int16x8x2_t leftRight;
+        leftRight.val[0] = vqaddq_s16(m, s);
+        leftRight.val[1] = vqsubq_s16(m, s);
+        vst2q_s16(out + 2 * n, leftRight);
+    }
+#endif
+    for (; n < numFrames; n++)
+    {
+        int left = mid[n] + side[n];
+        int right = mid[n] - side[n];
+        out[2 * n] = (short)((left > 32767) ? 32767 : ((left < -32768) ? -32768 : left));
+        out[2 * n + 1] = (short)((right > 32767) ? 32767 : ((right < -32768) ? -32768 : right));
+    }
+}
+
+void AudioSamplesMixShortNToShort(const short* const* in, const float* gains, int numInputs, short* out1, int numSamples)
+{
+    int n = 0;
+#if defined(__ARM_NEON__)
+    for (; n + 8 <= numSamples; n += 8)
+    {
+        float32x4_t sumLow = vdupq_n_f32(0.0f);
+        float32x4_t sumHigh = vdupq_n_f32(0.0f);
+        for (int i = 0; i < numInputs; i++)
+        {
+            int16x8_t x = vld1q_s16(in[i] + n);
+            sumLow = vmlaq_n_f32(sumLow, vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), gains[i]);
+            sumHigh = vmlaq_n_f32(sumHigh, vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))), gains[i]);
+        }
+        vst1q_s16(out1 + n, vcombine_s16(vqmovn_s32(vcvtq_s32_f32(sumLow)), vqmovn_s32(vcvtq_s32_f32(sumHigh))));
+    }
+#endif
+    for (; n < numSamples; n++)
+    {
+        float sum = 0.0f;
+        for (int i = 0; i < numInputs; i++)
+        {
+            sum += in[i][n] * gains[i];
+        }
+        out1[n] = (short)((sum > 32767.0f) ? 32767.0f : ((sum < -32768.0f) ? -32768.0f : sum));
+    }
+}
+
 void PopulateAudioDescription(AudioStreamBasicDescription& desc)
 {
     // describe format
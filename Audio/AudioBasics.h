@@ -135,6 +135,47 @@ void AudioSamplesMixFloat3ToShort(const float* in1,
                                   short* out1, 
                                   int numSamples);
                               
+/** 
+ * This function splits interleaved stereo 16-bit samples into mid (L + R) / 2 and side (L - R) / 2 
+ * arrays.  It uses NEON where available.
+ * @param in the input array of interleaved left/right shorts
+ * @param mid the output array of mid shorts
+ * @param side the output array of side shorts
+ * @param numFrames the number of stereo frames to convert.
+ */
+void AudioSamplesStereoToMidSide(const short* in, 
+                                 short* mid, 
+                                 short* side, 
+                                 int numFrames);
+                                 
+/** 
+ * This function joins mid and side 16-bit samples back into interleaved stereo (L = M + S, R = M - S,
+ * saturated).  Where L + R was odd, the left channel comes back one lower.  It uses NEON where available.
+ * @param mid the input array of mid shorts
+ * @param side the input array of side shorts
+ * @param out the output array of interleaved left/right shorts
+ * @param numFrames the number of stereo frames to convert.
+ */
+void AudioSamplesMidSideToStereo(const short* mid, 
+                                 const short* side, 
+                                 short* out, 
+                                 int numFrames);
+                              
+/** 
+ * This function mixes any number of arrays of 16-bit samples into one, scaling each by its own gain 
+ * and saturating the sum.  It uses NEON where available.
+ * @param in the input arrays of shorts to be mixed
+ * @param gains the gain applied to each input array
+ * @param numInputs the number of input arrays (the output is silent if there are none)
+ * @param out1 the output array of mixed shorts
+ * @param numSamples the number of samples to mix.
+ */
+void AudioSamplesMixShortNToShort(const short* const* in, 
+                                  const float* gains, 
+                                  int numInputs, 
+                                  short* out1, 
+                                  int numSamples);
+                              
 /** 
  * This is a helper function that populates the given AudioStreamBasicDescription struct with 
  * the correct parameters based on the format constants defined in AudioBasics.h
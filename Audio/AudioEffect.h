@@ -34,6 +34,7 @@
 #define AUDIO_EFFECT_H
 
 #import "Oscillator.h"
+#import "RealtimeLog.h"
 
 /** AudioEffectParameter class.
  * The AudioEffectParameter class is a generic interface for parameters of an AudioEffect.
@@ -175,6 +176,12 @@ public:
     */
     virtual void Process(float* buffer, int numSamplesPerChannel, int numChannels) = 0;
     
+   /**
+    * get the name of this kind of AudioEffect, for diagnostics such as traces
+    * @return the name of this AudioEffect's class
+    */
+    virtual const char* getName() const { return "AudioEffect"; }
+    
     AudioEffectParameter* getParameter(int index) const
     {
         if (m_params == NULL || index >= m_numParams)
@@ -253,6 +260,12 @@ public:
         }
         m_oldAmp = goalAmp;
     }
+    
+   /**
+    * get the name of this kind of AudioEffect, for diagnostics such as traces
+    * @return "AmplitudeScale"
+    */
+    virtual const char* getName() const { return "AmplitudeScale"; }
 
 private:
     float m_oldAmp;
@@ -317,7 +330,7 @@ public:
         // protect against buffer size mismatch
         else if (m_bufferSamples != numSamplesPerChannel)
         {
-            printf("RingMod::Process expected buffer of %d samples but was given %d samples\n", m_bufferSamples, numSamplesPerChannel);
+            RT_LOG("RingMod::Process expected buffer of %d samples but was given %d samples\n", m_bufferSamples, numSamplesPerChannel);
             return;
         }
         
@@ -344,6 +357,12 @@ public:
         }
     }
     
+   /**
+    * get the name of this kind of AudioEffect, for diagnostics such as traces
+    * @return "RingMod"
+    */
+    virtual const char* getName() const { return "RingMod"; }
+    
 private:
     Oscillator m_osc;
     int m_bufferSamples;
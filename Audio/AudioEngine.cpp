@@ -31,6 +31,10 @@
 
 #import "AudioEngine.h"
 
+#import <unistd.h>
+
+static const useconds_t RENDER_GRACE_PERIOD_POLL_USEC = 1000; ///< how often an effect chain edit checks whether the playback callback has moved on
+
 //#define WRITE_DEBUG_FILE
 #ifdef WRITE_DEBUG_FILE
     static const char* DEBUG_FILE_NAME = "debug.wav";
@@ -63,11 +67,16 @@ AudioEngine::~AudioEngine()
         m_recordedData = NULL;
     }
     
-    if (m_debugFile != NULL)
-    {
-        delete m_debugFile;
-        m_debugFile = NULL;
-    }
+    // finish writing any performance recording
+    stopRecordingToFile();
+    pthread_mutex_destroy(&m_performanceRecorderLock);
+    
+    // free effect chains (the effects themselves belong to whoever added them)
+    delete m_recordingEffects;
+    delete m_synthEffects;
+    delete m_networkEffects;
+    delete m_masterEffects;
+    pthread_mutex_destroy(&m_effectChainWriteLock);
     
     // free temp buffers
     if (m_tempRecordedBuffer != NULL)
@@ -116,95 +125,66 @@ AudioEngine* AudioEngine::getInstance()
 
 void AudioEngine::addRecordingEffect(AudioEffect* e)
 {
-    m_recordingEffects.push_back(e);
+    add_effect_to_chain(&m_recordingEffects, e);
 }
 
 bool AudioEngine::removeRecordingEffect(AudioEffect* e)
 {
-    for (std::vector<AudioEffect*>::iterator it = m_recordingEffects.begin(); it != m_recordingEffects.end(); it++) 
+    if (remove_effect_from_chain(&m_recordingEffects, e))
     {
-        if ((*it) == e)
-        {
-            // effect found
-            m_recordingEffects.erase(it);
-            printf("AudioEngine::removeRecordingEffect effect found!\n");
-            return true;
-        }
+        printf("AudioEngine::removeRecordingEffect effect found!\n");
+        return true;
     }
-    // effect not found
     printf("AudioEngine::removeRecordingEffect effect NOT found!\n");
     return false;
 }
 
 void AudioEngine::addSynthesisEffect(AudioEffect* e)
 {
-    m_synthEffects.push_back(e);
+    add_effect_to_chain(&m_synthEffects, e);
 }
 
 bool AudioEngine::removeSynthesisEffect(AudioEffect* e)
 {
-    for (std::vector<AudioEffect*>::iterator it = m_synthEffects.begin(); it != m_synthEffects.end(); it++) 
-    {
-        if ((*it) == e)
-        {
-            // effect found
-            m_synthEffects.erase(it);
-            return true;
-        }
-    }
-    // effect not found
-    return false;
+    return remove_effect_from_chain(&m_synthEffects, e);
 }
 
 void AudioEngine::addNetworkEffect(AudioEffect* e)
 {
-    m_networkEffects.push_back(e);
+    add_effect_to_chain(&m_networkEffects, e);
 }
 
 bool AudioEngine::removeNetworkEffect(AudioEffect* e)
 {
-    for (std::vector<AudioEffect*>::iterator it = m_networkEffects.begin(); it != m_networkEffects.end(); it++) 
+    if (remove_effect_from_chain(&m_networkEffects, e))
     {
-        if ((*it) == e)
-        {
-            // effect found
-            m_networkEffects.erase(it);
-            printf("AudioEngine::removeNetworkEffect effect found!\n");
-            return true;
-        }
+        printf("AudioEngine::removeNetworkEffect effect found!\n");
+        return true;
     }
-    // effect not found
     printf("AudioEngine::removeNetworkEffect effect NOT found!\n");
     return false;
 }
 
 void AudioEngine::addMasterEffect(AudioEffect* e)
 {
-    m_masterEffects.push_back(e);
+    add_effect_to_chain(&m_masterEffects, e);
 }
 
 AudioEffect* AudioEngine::getMasterEffect(int index)
 {
-    if (index < 0 || index >= m_masterEffects.size())
-    {
-        return NULL;
-    }
-    else return m_masterEffects[index];
+    pthread_mutex_lock(&m_effectChainWriteLock);
+    AudioEffect* e = m_masterEffects->getEffect(index);
+    pthread_mutex_unlock(&m_effectChainWriteLock);
+    return e;
 }
 
 bool AudioEngine::removeMasterEffect(AudioEffect* e)
 {
-    for (std::vector<AudioEffect*>::iterator it = m_masterEffects.begin(); it != m_masterEffects.end(); it++) 
+    if (remove_effect_from_chain(&m_masterEffects, e))
     {
-        if ((*it) == e)
-        {
-            // effect found
-            m_masterEffects.erase(it);
-            printf("AudioEngine::removeMasterEffect effect found!\n");
-            return true;
-        }
+        printf("AudioEngine::removeMasterEffect effect found!\n");
+        return true;
     }
-    // effect not found
     printf("AudioEngine::removeMasterEffect effect NOT found!\n");
     return false;
 }
@@ -239,6 +219,77 @@ OSStatus AudioEngine::playbackCallback(void *inRefCon,
                                      ioData);
 }
 
+bool AudioEngine::getDspProfile(DspProfiler::Snapshot& snapshot) const
+{
+#ifdef ENABLE_DSP_PROFILING
+    m_dspProfiler.getSnapshot(snapshot);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AudioEngine::resetDspProfile()
+{
+#ifdef ENABLE_DSP_PROFILING
+    m_dspProfiler.requestReset();
+#endif
+}
+
+double AudioEngine::getSessionSeconds() const
+{
+    double hostSeconds = HostTimeToSeconds(HostTimeNow());
+    return m_sessionClock ? m_sessionClock->toSessionSeconds(hostSeconds) : hostSeconds;
+}
+
+double AudioEngine::sessionToHostSeconds(double sessionSeconds) const
+{
+    return m_sessionClock ? m_sessionClock->toLocalSeconds(sessionSeconds) : sessionSeconds;
+}
+
+bool AudioEngine::startRecordingToFile(const char* filename, bool compressLossless)
+{
+    pthread_mutex_lock(&m_performanceRecorderLock);
+    bool started = false;
+    if (m_performanceRecorder == NULL)
+    {
+        AsyncWavefileWriter* recorder = new AsyncWavefileWriter(filename, compressLossless);
+        if (recorder->isOpen())
+        {
+            AtomicExchangePtr(&m_performanceRecorder, recorder);
+            started = true;
+        }
+        else
+        {
+            // never published, so the playback callback can't be using it
+            delete recorder;
+        }
+    }
+    pthread_mutex_unlock(&m_performanceRecorderLock);
+    return started;
+}
+
+void AudioEngine::stopRecordingToFile()
+{
+    pthread_mutex_lock(&m_performanceRecorderLock);
+    AsyncWavefileWriter* recorder = AtomicExchangePtr(&m_performanceRecorder, (AsyncWavefileWriter*)NULL);
+    if (recorder != NULL)
+    {
+        // the playback callback may be queueing audio to it right now
+        wait_for_render_grace_period();
+        delete recorder;
+    }
+    pthread_mutex_unlock(&m_performanceRecorderLock);
+}
+
+UInt32 AudioEngine::getRecordingDroppedFrames()
+{
+    pthread_mutex_lock(&m_performanceRecorderLock);
+    UInt32 numDroppedFrames = (m_performanceRecorder != NULL) ? m_performanceRecorder->getNumDroppedFrames() : 0;
+    pthread_mutex_unlock(&m_performanceRecorderLock);
+    return numDroppedFrames;
+}
+
 void AudioEngine::start()
 {
     printf("AudioEngine::start\n");
@@ -273,7 +324,7 @@ AudioEngine::AudioEngine() :
     m_inputBufferList(NULL),
     m_recordedData(NULL),
     m_recordedDataSizeInBytes(0),
-    m_debugFile(NULL),
+    m_performanceRecorder(NULL),
     m_recordingIsMuted(false),
     m_synthIsMuted(false),
     m_networkIsMuted(false),
@@ -285,11 +336,23 @@ AudioEngine::AudioEngine() :
     m_tempMixedPlaybackBuffer(NULL),
     m_tempMixedNetworkOutputBuffer(NULL),
     m_tempMixedNetworkOutputBufferShort(NULL),
+    m_recordingEffects(new EffectChain()),
+    m_synthEffects(new EffectChain()),
+    m_networkEffects(new EffectChain()),
+    m_masterEffects(new EffectChain()),
+    m_renderEpoch(0),
     m_networkController(nil),
+    m_sessionClock(NULL),
     m_isStarted(false)
 {
     printf("AudioEngine::AudioEngine\n");
     
+    // audio thread messages are queued and printed from this background thread
+    RealtimeLog::getInstance()->startDrainThread();
+    
+    pthread_mutex_init(&m_effectChainWriteLock, NULL);
+    pthread_mutex_init(&m_performanceRecorderLock, NULL);
+    
     // Describe audio component
     AudioComponentDescription desc;
     desc.componentType = kAudioUnitType_Output;
@@ -330,13 +393,58 @@ AudioEngine::AudioEngine() :
     print_audio_unit_properties(m_audioUnit, "REMOTE IO");
     
 #ifdef WRITE_DEBUG_FILE
-    m_debugFile = new Wavefile(DEBUG_FILE_NAME);
+    startRecordingToFile(DEBUG_FILE_NAME);
 #endif
 }
 
 
 /* ---- AudioEngine private methods ---- */
 
+void AudioEngine::add_effect_to_chain(EffectChain* volatile* chain, AudioEffect* e)
+{
+    pthread_mutex_lock(&m_effectChainWriteLock);
+    publish_effect_chain(chain, EffectChain::createWithEffectAdded(*chain, e));
+    pthread_mutex_unlock(&m_effectChainWriteLock);
+}
+
+bool AudioEngine::remove_effect_from_chain(EffectChain* volatile* chain, AudioEffect* e)
+{
+    pthread_mutex_lock(&m_effectChainWriteLock);
+    EffectChain* newChain = EffectChain::createWithEffectRemoved(*chain, e);
+    if (newChain != NULL)
+    {
+        publish_effect_chain(chain, newChain);
+    }
+    pthread_mutex_unlock(&m_effectChainWriteLock);
+    return (newChain != NULL);
+}
+
+void AudioEngine::publish_effect_chain(EffectChain* volatile* chain, EffectChain* newChain)
+{
+    // must be called with m_effectChainWriteLock held - never from the audio thread
+    EffectChain* oldChain = AtomicExchangePtr(chain, newChain);
+    
+    // the playback callback may still be iterating the old chain, so wait it out before freeing
+    wait_for_render_grace_period();
+    delete oldChain;
+}
+
+void AudioEngine::wait_for_render_grace_period()
+{
+    // m_renderEpoch is odd while a playback callback is in progress.  Any callback that starts
+    // after the pointer swap will see the new chain, so we only have to wait for the one (if any) 
+    // that is running right now to finish.
+    int32_t epoch = AtomicLoad32(&m_renderEpoch);
+    if ((epoch & 1) == 0)
+    {
+        return;
+    }
+    while (AtomicLoad32(&m_renderEpoch) == epoch)
+    {
+        usleep(RENDER_GRACE_PERIOD_POLL_USEC);
+    }
+}
+
 void AudioEngine::allocate_input_buffers(UInt32 inNumberFrames)
 {
     printf("AudioEngine::allocate_input_buffers: inNumberFrames = %d\n", inNumberFrames);
@@ -440,7 +548,7 @@ void AudioEngine::get_recorded_data_for_playback(float* buffer, int numSamplesAl
     {
         if (m_recordedData == NULL || m_recordedDataSizeInBytes <= 0)
         {
-            printf("AudioEngine::get_recorded_data_for_playback: no recorded data to play - substituting silence!\n");
+            RT_LOG("AudioEngine::get_recorded_data_for_playback: no recorded data to play - substituting silence!\n");
         }
         fill_buffer_with_silence(buffer, numSamplesAllChannels);
     }
@@ -449,10 +557,7 @@ void AudioEngine::get_recorded_data_for_playback(float* buffer, int numSamplesAl
         AudioSamplesShortToFloat((short*)m_recordedData, buffer, numSamplesAllChannels);
         
         // do processing on recorded data
-        for (int effect = 0; effect < m_recordingEffects.size(); effect++)
-        {
-            m_recordingEffects[effect]->Process(buffer, numSamplesAllChannels / AUDIO_NUM_CHANNELS, AUDIO_NUM_CHANNELS);
-        }
+        AtomicLoadPtr(&m_recordingEffects)->Process(buffer, numSamplesAllChannels / AUDIO_NUM_CHANNELS, AUDIO_NUM_CHANNELS);
     }
 }
 
@@ -468,10 +573,7 @@ void AudioEngine::get_synthesized_data_for_playback(float* buffer, int numSample
         m_synth.renderAudioBuffer(buffer, numSamplesAllChannels / AUDIO_NUM_CHANNELS, AUDIO_NUM_CHANNELS);
         
         // do processing on synthesized data
-        for (int effect = 0; effect < m_synthEffects.size(); effect++)
-        {
-            m_synthEffects[effect]->Process(buffer, numSamplesAllChannels / AUDIO_NUM_CHANNELS, AUDIO_NUM_CHANNELS);
-        }
+        AtomicLoadPtr(&m_synthEffects)->Process(buffer, numSamplesAllChannels / AUDIO_NUM_CHANNELS, AUDIO_NUM_CHANNELS);
     }
 }
 
@@ -487,19 +589,18 @@ void AudioEngine::get_network_data_for_playback(float* buffer, int numSamplesAll
         // fill buffer of shorts from network - data is expected to be interleaved (sample1_left, sample1_right, sample2_left, sample2_right, etc.)
         if (m_networkController != nil)
         {
+            AUDIO_TRACE_BEGIN("NetworkController fillAudioBuffer");
             [m_networkController fillAudioBuffer:m_tempNetworkBufferShort
                 samplesPerChannel:numSamplesAllChannels / AUDIO_NUM_CHANNELS
                 channels:AUDIO_NUM_CHANNELS];
+            AUDIO_TRACE_END("NetworkController fillAudioBuffer");
         }
         
         // convert shorts to floats for processing
         AudioSamplesShortToFloat(m_tempNetworkBufferShort, buffer, numSamplesAllChannels);
         
         // do processing on network data
-        for (int effect = 0; effect < m_networkEffects.size(); effect++)
-        {
-            m_networkEffects[effect]->Process(buffer, numSamplesAllChannels / AUDIO_NUM_CHANNELS, AUDIO_NUM_CHANNELS);
-        }
+        AtomicLoadPtr(&m_networkEffects)->Process(buffer, numSamplesAllChannels / AUDIO_NUM_CHANNELS, AUDIO_NUM_CHANNELS);
     }
 }
 
@@ -571,6 +672,14 @@ OSStatus AudioEngine::playback_callback(AudioUnitRenderActionFlags *ioActionFlag
                                         UInt32 inNumberFrames, 
                                         AudioBufferList *ioData) 
 {    
+    // enter the read-side critical section for effect chains (see wait_for_render_grace_period)
+    AtomicIncrement32(&m_renderEpoch);
+    
+    AUDIO_TRACE_SET_SAMPLE_CLOCK(inTimeStamp->mSampleTime);
+    AUDIO_TRACE_SCOPE("AudioEngine::playback_callback");
+    
+    DSP_PROFILE_BEGIN_CALLBACK(m_dspProfiler, inTimeStamp, inNumberFrames);
+    
     for (int i = 0; i < ioData->mNumberBuffers; i++)
     {
         ioData->mBuffers[i].mNumberChannels = AUDIO_FORMAT_IS_NONINTERLEAVED ? 1: AUDIO_NUM_CHANNELS;
@@ -580,11 +689,24 @@ OSStatus AudioEngine::playback_callback(AudioUnitRenderActionFlags *ioActionFlag
         // if needed, allocate buffers for temporary storage of recorded and synthesized data
         allocate_temp_buffers(numSamplesAllChannels);
         
+        DSP_PROFILE_BEGIN_STAGE(m_dspProfiler, StageRecorded);
         get_recorded_data_for_playback(m_tempRecordedBuffer, numSamplesAllChannels);
+        DSP_PROFILE_END_STAGE(m_dspProfiler, StageRecorded);
         
+        DSP_PROFILE_BEGIN_STAGE(m_dspProfiler, StageSynth);
         get_synthesized_data_for_playback(m_tempSynthesizedBuffer, numSamplesAllChannels);
+        DSP_PROFILE_END_STAGE(m_dspProfiler, StageSynth);
+        
+        // backing tracks and one-shots go out with the synth, so remote players hear them too
+        DSP_PROFILE_BEGIN_STAGE(m_dspProfiler, StageSamples);
+        m_samplePlayer.renderAddToBuffer(m_tempSynthesizedBuffer, numSamplesAllChannels / AUDIO_NUM_CHANNELS, AUDIO_NUM_CHANNELS);
+        DSP_PROFILE_END_STAGE(m_dspProfiler, StageSamples);
         
+        DSP_PROFILE_BEGIN_STAGE(m_dspProfiler, StageNetwork);
         get_network_data_for_playback(m_tempNetworkBuffer, numSamplesAllChannels);
+        DSP_PROFILE_END_STAGE(m_dspProfiler, StageNetwork);
+        
+        DSP_PROFILE_BEGIN_STAGE(m_dspProfiler, StageMix);
         
         // mix recorded, synthesized, and networked data to be processed with master effects for playback
         AudioSamplesMixFloat3ToFloat(m_tempRecordedBuffer, 
@@ -599,12 +721,21 @@ OSStatus AudioEngine::playback_callback(AudioUnitRenderActionFlags *ioActionFlag
                                      m_tempMixedNetworkOutputBuffer, 
                                      numSamplesAllChannels);
                                      
+        DSP_PROFILE_END_STAGE(m_dspProfiler, StageMix);
+        
         // apply master effects
-        for (int effect = 0; effect < m_masterEffects.size(); effect++)
+        DSP_PROFILE_BEGIN_STAGE(m_dspProfiler, StageMaster);
+        const EffectChain* masterEffects = AtomicLoadPtr(&m_masterEffects);
+        for (int effect = 0; effect < masterEffects->size(); effect++)
         {
-            m_masterEffects[effect]->Process(m_tempMixedPlaybackBuffer, numSamplesAllChannels / AUDIO_NUM_CHANNELS, AUDIO_NUM_CHANNELS);
-            m_masterEffects[effect]->Process(m_tempMixedNetworkOutputBuffer, numSamplesAllChannels / AUDIO_NUM_CHANNELS, AUDIO_NUM_CHANNELS);
+            AUDIO_TRACE_BEGIN(masterEffects->getEffect(effect)->getName());
+            masterEffects->getEffect(effect)->Process(m_tempMixedPlaybackBuffer, numSamplesAllChannels / AUDIO_NUM_CHANNELS, AUDIO_NUM_CHANNELS);
+            masterEffects->getEffect(effect)->Process(m_tempMixedNetworkOutputBuffer, numSamplesAllChannels / AUDIO_NUM_CHANNELS, AUDIO_NUM_CHANNELS);
+            AUDIO_TRACE_END(masterEffects->getEffect(effect)->getName());
         }
+        DSP_PROFILE_END_STAGE(m_dspProfiler, StageMaster);
+        
+        DSP_PROFILE_BEGIN_STAGE(m_dspProfiler, StageConvert);
                                      
         // convert to shorts for playback to DAC
         AudioSamplesFloatToShort(m_tempMixedPlaybackBuffer, 
@@ -614,16 +745,29 @@ OSStatus AudioEngine::playback_callback(AudioUnitRenderActionFlags *ioActionFlag
         // convert to shorts for network output
         AudioSamplesFloatToShort(m_tempMixedNetworkOutputBuffer, m_tempMixedNetworkOutputBufferShort, numSamplesAllChannels);
         
+        DSP_PROFILE_END_STAGE(m_dspProfiler, StageConvert);
+        
         if (m_networkController != nil)
         {
+            DSP_PROFILE_BEGIN_STAGE(m_dspProfiler, StageNetworkSend);
+            AUDIO_TRACE_BEGIN("NetworkController sendAudioBuffer");
             [m_networkController sendAudioBuffer:m_tempMixedNetworkOutputBufferShort length:numSamplesAllChannels channels:AUDIO_NUM_CHANNELS];
+            AUDIO_TRACE_END("NetworkController sendAudioBuffer");
+            DSP_PROFILE_END_STAGE(m_dspProfiler, StageNetworkSend);
         }
     }
     
-#ifdef WRITE_DEBUG_FILE
-    // write what we sent to the DAC to a file for debugging
-    m_debugFile->WriteAudioBuffers(ioData);
-#endif
+    // queue what we sent to the DAC for the performance recording (written to disk on another thread)
+    AsyncWavefileWriter* recorder = AtomicLoadPtr(&m_performanceRecorder);
+    if (recorder != NULL)
+    {
+        recorder->WriteAudioBuffers(ioData);
+    }
+    
+    DSP_PROFILE_END_CALLBACK(m_dspProfiler);
+    
+    // leave the read-side critical section
+    AtomicIncrement32(&m_renderEpoch);
     
     return noErr;
 }
@@ -634,6 +778,8 @@ OSStatus AudioEngine::recording_callback(AudioUnitRenderActionFlags *ioActionFla
                                          UInt32 inNumberFrames, 
                                          AudioBufferList *ioData) 
 {
+    AUDIO_TRACE_SCOPE("AudioEngine::recording_callback");
+    
     if (m_inputBufferList == NULL)
     {
         allocate_input_buffers(inNumberFrames);
@@ -650,7 +796,7 @@ OSStatus AudioEngine::recording_callback(AudioUnitRenderActionFlags *ioActionFla
     {
         // -- error codes --
         // paramErr = -50,  /*error in user parameter list*/
-        printf("AudioEngine::recording_callback could not render audio unit: status = %d\n", status);
+        RT_LOG("AudioEngine::recording_callback could not render audio unit: status = %d\n", status);
     }
     
     memcpy(m_recordedData, m_inputBufferList->mBuffers[0].mData, m_inputBufferList->mBuffers[0].mDataByteSize);
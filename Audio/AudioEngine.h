@@ -33,17 +33,28 @@
 #ifndef AUDIO_ENGINE_H
 #define AUDIO_ENGINE_H
 
-#import <vector>
+#import <pthread.h>
 
 #import "AudioBasics.h"
 #import "AudioEffect.h"
-#import "Wavefile.h"
+#import "AtomicOps.h"
+#import "EffectChain.h"
+#import "DspProfiler.h"
+#import "RealtimeLog.h"
+#import "AudioTracer.h"
+#import "AsyncWavefileWriter.h"
 #import "TouchSynth.h"
+#import "SamplePlayer.h"
 #import "NetworkController.h"
 
 /** AudioEngine class.
  * The AudioEngine class controls all audio recording, playback, and processing.
  * It follows the singleton pattern.
+ *
+ * Effect chains may be edited from any non-audio thread while audio is running.  Each edit
+ * builds a new EffectChain and publishes it with a single atomic pointer swap; the old chain is
+ * deleted once the playback callback is known to no longer be using it.  The playback callback
+ * never locks or allocates to read a chain.
  */
 class AudioEngine
 {
@@ -70,6 +81,7 @@ public:
    /** 
     * Remove a recording effect from this AudioEngine.
     * Recording effects are only applied to audio recorded from the microphone.
+    * Once this returns, the playback callback no longer references the effect, so it may be deleted.
     * @param e A pointer to the AudioEffect to be removed.
     * @return true if the requested AudioEffect was found and removed, false otherwise.
     * @see addRecordingEffect
@@ -87,6 +99,7 @@ public:
    /** 
     * Remove a synthesis effect from this AudioEngine.
     * Synthesis effects are only applied to the synthesized audio.
+    * Once this returns, the playback callback no longer references the effect, so it may be deleted.
     * @param e A pointer to the AudioEffect to be removed.
     * @return true if the requested AudioEffect was found and removed, false otherwise.
     * @see addSynthesisEffect
@@ -104,6 +117,7 @@ public:
    /** 
     * Remove a network effect from this AudioEngine.
     * Network effects are only applied to the audio input from the network.
+    * Once this returns, the playback callback no longer references the effect, so it may be deleted.
     * @param e A pointer to the AudioEffect to be removed.
     * @return true if the requested AudioEffect was found and removed, false otherwise.
     * @see addNetworkEffect
@@ -135,6 +149,7 @@ public:
    /** 
     * Remove a master effect from this AudioEngine.
     * Master effects are applied to the mixed audio immediately before playback.
+    * Once this returns, the playback callback no longer references the effect, so it may be deleted.
     * @param e A pointer to the AudioEffect to be removed.
     * @return true if the requested AudioEffect was found and removed, false otherwise.
     * @see addMasterEffect
@@ -148,6 +163,13 @@ public:
     */
     TouchSynth* getSynth() { return &m_synth; }
     
+   /** 
+    * Get a pointer to the SamplePlayer object associated with this AudioEngine.
+    * Sample playback is mixed with the synthesized audio, so it is also sent to the network.
+    * @return A pointer to the SamplePlayer object associated with this AudioEngine.
+    */
+    SamplePlayer* getSamplePlayer() { return &m_samplePlayer; }
+    
    /**
     * Find out whether or not recording input is muted.
     * @return true if recording input is muted, false otherwise.
@@ -194,7 +216,30 @@ public:
     * Establish connection to network controller.
     * If this connection happens too early on startup, we get crashes when publishing Bonjour services.
     */
-    void connectToNetworkController() { m_networkController = [NetworkController sharedInstance]; }
+    void connectToNetworkController()
+    {
+        m_networkController = [NetworkController sharedInstance];
+        m_synth.setListener([m_networkController synthListener]);
+        m_sessionClock = [m_networkController sessionClock];
+    }
+    
+   /**
+    * Get the time now on the session clock, which every device in the network session shares, so 
+    * that they can all do something at the same instant.  Until the network controller is connected,
+    * and with no peers, it is the host clock.  This is safe to call from any thread.
+    * @return the session clock in seconds
+    * @see sessionToHostSeconds
+    */
+    double getSessionSeconds() const;
+    
+   /**
+    * Convert a time on the session clock to the host clock, e.g. to play something at the same 
+    * instant as the other devices in the session.  This is safe to call from any thread.
+    * @param sessionSeconds a time on the session clock
+    * @return the same time on the host clock, in seconds
+    * @see getSessionSeconds
+    */
+    double sessionToHostSeconds(double sessionSeconds) const;
       
    /**
     * Find out whether audio playback and recording have been started.
@@ -204,6 +249,46 @@ public:
     */
     bool isStarted() { return m_isStarted; }
     
+   /**
+    * Get the DSP load and per-stage timing statistics for the playback callback.
+    * This is safe to call from any thread and never blocks the audio thread.
+    * Statistics are only gathered when ENABLE_DSP_PROFILING is defined in DspProfiler.h.
+    * @param snapshot the snapshot to be filled in
+    * @return true if profiling is compiled in and the snapshot was filled in, false otherwise
+    * @see resetDspProfile
+    */
+    bool getDspProfile(DspProfiler::Snapshot& snapshot) const;
+    
+   /**
+    * Clear the DSP load and per-stage timing statistics.  The reset takes effect at the end of the next playback callback.
+    * @see getDspProfile
+    */
+    void resetDspProfile();
+    
+   /**
+    * Start recording everything sent to the speaker to a wave file.
+    * File I/O happens on a background thread, so this is safe while audio is running.
+    * If the disk cannot keep up, audio is dropped from the file (never from playback).
+    * @param filename output audio file path - an existing file is overwritten
+    * @param compressLossless true to record to a (roughly half size) FLAC file instead of a wave file
+    * @return true if recording started, false if a recording is already in progress or the file could not be created
+    * @see stopRecordingToFile
+    */
+    bool startRecordingToFile(const char* filename, bool compressLossless = false);
+    
+   /**
+    * Stop recording to a wave file, writing out everything still buffered.
+    * @see startRecordingToFile
+    */
+    void stopRecordingToFile();
+    
+   /**
+    * Find out how much audio the current recording has lost because the disk could not keep up.
+    * @return the number of dropped frames, or 0 if there is no recording in progress
+    * @see startRecordingToFile
+    */
+    UInt32 getRecordingDroppedFrames();
+    
    /**
     * Start audio playback and recording.
     * @see stop
@@ -267,6 +352,17 @@ protected:
 
 private:
 
+    void add_effect_to_chain(EffectChain* volatile* chain, 
+                             AudioEffect* e);
+        
+    bool remove_effect_from_chain(EffectChain* volatile* chain, 
+                                  AudioEffect* e);
+        
+    void publish_effect_chain(EffectChain* volatile* chain, 
+                              EffectChain* newChain);
+        
+    void wait_for_render_grace_period();
+        
     void allocate_input_buffers(UInt32 inNumberFrames);
         
     void allocate_temp_buffers(int numSamplesAllChannels);
@@ -316,7 +412,8 @@ private:
     AudioBufferList* m_inputBufferList;
     void* m_recordedData;
     UInt32 m_recordedDataSizeInBytes;
-    Wavefile* m_debugFile;
+    AsyncWavefileWriter* volatile m_performanceRecorder;
+    pthread_mutex_t m_performanceRecorderLock;
     bool m_recordingIsMuted;
     bool m_synthIsMuted;
     bool m_networkIsMuted;
@@ -328,12 +425,19 @@ private:
     float* m_tempMixedPlaybackBuffer;
     float* m_tempMixedNetworkOutputBuffer;
     short* m_tempMixedNetworkOutputBufferShort;
-    std::vector<AudioEffect*> m_recordingEffects;
-    std::vector<AudioEffect*> m_synthEffects;
-    std::vector<AudioEffect*> m_networkEffects;
-    std::vector<AudioEffect*> m_masterEffects;
+    EffectChain* volatile m_recordingEffects;
+    EffectChain* volatile m_synthEffects;
+    EffectChain* volatile m_networkEffects;
+    EffectChain* volatile m_masterEffects;
+    pthread_mutex_t m_effectChainWriteLock;
+    volatile int32_t m_renderEpoch; // odd while the playback callback is running
+#ifdef ENABLE_DSP_PROFILING
+    DspProfiler m_dspProfiler;
+#endif
     TouchSynth m_synth;
+    SamplePlayer m_samplePlayer;
     NetworkController *m_networkController;
+    SessionClock* m_sessionClock;
     bool m_isStarted;
 };
 
@@ -0,0 +1,114 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/*
+ *  AudioTracer.cpp
+ *  iDiMP
+ *
+ */
+
+#include "AudioTracer.h"
+
+static const int AUDIO_TRACE_MAX_THREADS = 16; ///< distinct threads given their own track in a written trace
+
+// ---- AudioTracer public methods ----
+
+AudioTracer* AudioTracer::getInstance()
+{
+    static AudioTracer instance;
+    return &instance;
+}
+
+void AudioTracer::start()
+{
+    AtomicStore32(&m_isTracing, 0);
+    AtomicStore32(&m_numEvents, 0);
+    AtomicStore32(&m_isTracing, 1);
+}
+
+bool AudioTracer::writeChromeTrace(const char* path) const
+{
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+    {
+        printf("AudioTracer::writeChromeTrace could not open %s\n", path);
+        return false;
+    }
+    
+    // the buffer wraps, so only the newest AUDIO_TRACE_NUM_EVENTS events are available
+    int32_t numRecorded = AtomicLoad32(&m_numEvents);
+    int32_t numEvents = (numRecorded < AUDIO_TRACE_NUM_EVENTS) ? numRecorded : AUDIO_TRACE_NUM_EVENTS;
+    int32_t first = numRecorded - numEvents;
+    
+    pthread_t threads[AUDIO_TRACE_MAX_THREADS];
+    int numThreads = 0;
+    uint64_t startTicks = (numEvents > 0) ? m_events[first & (AUDIO_TRACE_NUM_EVENTS - 1)].ticks : 0;
+    
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (int32_t i = 0; i < numEvents; i++)
+    {
+        const Event& event = m_events[(first + i) & (AUDIO_TRACE_NUM_EVENTS - 1)];
+        
+        // give each thread a small, stable track number
+        int tid = 0;
+        while (tid < numThreads && !pthread_equal(threads[tid], event.thread))
+        {
+            tid++;
+        }
+        if (tid == numThreads && numThreads < AUDIO_TRACE_MAX_THREADS)
+        {
+            threads[numThreads++] = event.thread;
+        }
+        
+        double micros = (event.ticks >= startTicks) ? HostTimeToSeconds(event.ticks - startTicks) * 1.0e6 : 0.0;
+        fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+                (i > 0) ? ",\n" : "", event.name, event.phase, micros, tid + 1);
+    }
+    fprintf(file, "\n]}\n");
+    
+    bool ok = (ferror(file) == 0);
+    fclose(file);
+    printf("AudioTracer::writeChromeTrace wrote %d events to %s\n", numEvents, path);
+    return ok;
+}
+
+// ---- AudioTracer private methods ----
+
+AudioTracer::AudioTracer() :
+    m_numEvents(0),
+    m_isTracing(0),
+    m_useSampleClock(false),
+    m_sampleClockTicks(0)
+{ }
+
+void AudioTracer::record(const char* name, char phase)
+{
+    int32_t index = AtomicIncrement32(&m_numEvents) - 1;
+    Event& event = m_events[index & (AUDIO_TRACE_NUM_EVENTS - 1)];
+    event.name = name;
+    
+    // on the sample clock, successive events get successive ticks so they stay in order
+    event.ticks = m_useSampleClock ? m_sampleClockTicks++ : HostTimeNow();
+    event.thread = pthread_self();
+    event.phase = phase;
+}
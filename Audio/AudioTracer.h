@@ -0,0 +1,164 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/**
+ *  @file AudioTracer.h
+ *  iDiMP
+ *
+ *  This file defines the interface for the AudioTracer class and the AUDIO_TRACE_* macros.
+ */
+
+#ifndef AUDIO_TRACER_H
+#define AUDIO_TRACER_H
+
+#include <pthread.h>
+
+#import "AudioBasics.h"
+#import "AtomicOps.h"
+#import "HostTime.h"
+
+// Uncomment to compile trace points into the audio code.  When this is not defined the
+// AUDIO_TRACE_* macros below expand to nothing.  Tracing must also be started at runtime.
+//#define ENABLE_AUDIO_TRACING
+
+static const int AUDIO_TRACE_NUM_EVENTS = 32768; ///< capacity of the trace buffer (must be a power of two) - the newest events are kept
+
+/** AudioTracer class.
+ * AudioTracer records begin/end events from the audio code into a preallocated buffer so that
+ * individual callbacks can be inspected on a timeline.  Recording an event is a few stores and
+ * one atomic increment, and is safe from any thread.  The buffer can be written out in the
+ * Chrome trace event JSON format, which chrome://tracing and Perfetto can open.
+ *
+ * By default events are stamped with the host clock.  A driver that renders audio faster or
+ * slower than real time can switch to the sample clock instead, so the same input always 
+ * produces the same trace.
+ */
+class AudioTracer
+{
+public:
+   /**
+    * @return A pointer to the singleton instance of AudioTracer.
+    */
+    static AudioTracer* getInstance();
+    
+   /**
+    * Discard any recorded events and start recording.
+    * @see stop
+    */
+    void start();
+    
+   /**
+    * Stop recording.  Events already recorded are kept until the next start().
+    * @see start
+    */
+    void stop() { AtomicStore32(&m_isTracing, 0); }
+    
+   /**
+    * @return true if events are being recorded, false otherwise
+    */
+    bool isTracing() const { return AtomicLoad32(&m_isTracing) != 0; }
+    
+   /**
+    * Record the start of a named span on the calling thread.
+    * @param name the span name - must be a string literal or otherwise outlive the tracer
+    * @see end
+    */
+    void begin(const char* name) { if (m_isTracing) record(name, 'B'); }
+    
+   /**
+    * Record the end of a named span on the calling thread.
+    * @param name the span name passed to begin
+    * @see begin
+    */
+    void end(const char* name) { if (m_isTracing) record(name, 'E'); }
+    
+   /**
+    * Switch between host clock and sample clock timestamps.  Call before start().
+    * @param on true to stamp events with the sample clock, false to use the host clock
+    * @see setSampleClock
+    */
+    void useSampleClock(bool on) { m_useSampleClock = on; }
+    
+   /**
+    * Set the sample clock, normally at the start of each rendered buffer.
+    * Events recorded after this are stamped with this position (in order) until the next call.
+    * @param sampleTime the number of frames rendered so far
+    * @see useSampleClock
+    */
+    void setSampleClock(double sampleTime) { m_sampleClockTicks = HostTimeFromSeconds(sampleTime / AUDIO_SAMPLE_RATE); }
+    
+   /**
+    * Write the recorded events to a file in Chrome trace event JSON format.
+    * Call stop() first so the buffer is not being written to.
+    * @param path the file to create (overwritten if it exists)
+    * @return true if the file was written, false otherwise
+    */
+    bool writeChromeTrace(const char* path) const;
+    
+private:
+    AudioTracer();
+    AudioTracer(const AudioTracer&);
+    AudioTracer& operator= (const AudioTracer&);
+    
+    struct Event
+    {
+        const char* name;
+        uint64_t ticks;
+        pthread_t thread;
+        char phase;
+    };
+    
+    void record(const char* name, char phase);
+    
+    Event m_events[AUDIO_TRACE_NUM_EVENTS];
+    volatile int32_t m_numEvents;
+    volatile int32_t m_isTracing;
+    bool m_useSampleClock;
+    uint64_t m_sampleClockTicks;
+};
+
+/** AudioTraceScope class.
+ * Records a begin event when constructed and the matching end event when destroyed.
+ */
+class AudioTraceScope
+{
+public:
+    AudioTraceScope(const char* name) : m_name(name) { AudioTracer::getInstance()->begin(m_name); }
+    ~AudioTraceScope() { AudioTracer::getInstance()->end(m_name); }
+private:
+    const char* m_name;
+};
+
+#ifdef ENABLE_AUDIO_TRACING
+    #define AUDIO_TRACE_SCOPE(name) AudioTraceScope audioTraceScope(name)
+    #define AUDIO_TRACE_BEGIN(name) AudioTracer::getInstance()->begin(name)
+    #define AUDIO_TRACE_END(name)   AudioTracer::getInstance()->end(name)
+    #define AUDIO_TRACE_SET_SAMPLE_CLOCK(sampleTime) AudioTracer::getInstance()->setSampleClock(sampleTime)
+#else
+    #define AUDIO_TRACE_SCOPE(name)
+    #define AUDIO_TRACE_BEGIN(name)
+    #define AUDIO_TRACE_END(name)
+    #define AUDIO_TRACE_SET_SAMPLE_CLOCK(sampleTime)
+#endif
+
+#endif // AUDIO_TRACER_H
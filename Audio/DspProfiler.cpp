@@ -0,0 +1,139 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/*
+ *  DspProfiler.cpp
+ *  iDiMP
+ *
+ */
+
+#include "DspProfiler.h"
+
+static const float DSP_LOAD_SMOOTHING = 0.05; ///< weight given to the newest callback in the rolling DSP load average
+
+// ---- DspProfiler public methods ----
+
+DspProfiler::DspProfiler() :
+    m_callbackStartTicks(0),
+    m_callbackDeadlineSeconds(0.0),
+    m_expectedSampleTime(-1.0),
+    m_sampleTimeGap(false),
+    m_publishSequence(0),
+    m_resetRequested(0)
+{
+    memset(m_stageStartTicks, 0, sizeof(m_stageStartTicks));
+    clear();
+}
+
+void DspProfiler::beginCallback(const AudioTimeStamp* timeStamp, UInt32 numFrames)
+{
+    m_callbackStartTicks = HostTimeNow();
+    m_callbackDeadlineSeconds = numFrames / AUDIO_SAMPLE_RATE;
+    
+    // a jump in the sample timeline means the output unit dropped at least one buffer
+    if (timeStamp != NULL && (timeStamp->mFlags & kAudioTimeStampSampleTimeValid))
+    {
+        m_sampleTimeGap = (m_expectedSampleTime >= 0.0 && timeStamp->mSampleTime != m_expectedSampleTime);
+        m_expectedSampleTime = timeStamp->mSampleTime + numFrames;
+    }
+}
+
+void DspProfiler::endCallback()
+{
+    double callbackSeconds = HostTimeToSeconds(HostTimeNow() - m_callbackStartTicks);
+    float load = (m_callbackDeadlineSeconds > 0.0) ? callbackSeconds / m_callbackDeadlineSeconds : 0.0;
+    
+    if (AtomicLoad32(&m_resetRequested))
+    {
+        AtomicStore32(&m_resetRequested, 0);
+        clear();
+    }
+    
+    // readers retry while the sequence number is odd or has changed underneath them
+    AtomicIncrement32(&m_publishSequence);
+    
+    m_published.numCallbacks++;
+    if (load > 1.0 || m_sampleTimeGap)
+    {
+        m_published.numXruns++;
+    }
+    m_published.dspLoad = (m_published.numCallbacks == 1) ? load : m_published.dspLoad + DSP_LOAD_SMOOTHING * (load - m_published.dspLoad);
+    if (load > m_published.peakDspLoad)
+    {
+        m_published.peakDspLoad = load;
+    }
+    
+    for (int stage = 0; stage < NumStages; stage++)
+    {
+        if (m_callbackStageRuns[stage] == 0) continue;
+        
+        StageStats& stats = m_published.stages[stage];
+        double seconds = HostTimeToSeconds(m_callbackStageTicks[stage]);
+        stats.count += m_callbackStageRuns[stage];
+        stats.totalSeconds += seconds;
+        if (seconds > stats.maxSeconds)
+        {
+            stats.maxSeconds = seconds;
+        }
+        
+        // find the power-of-two microsecond bucket
+        UInt32 micros = (UInt32)(seconds * 1.0e6);
+        int bucket = 0;
+        while (micros > 1 && bucket < DSP_PROFILE_NUM_BUCKETS - 1)
+        {
+            micros >>= 1;
+            bucket++;
+        }
+        stats.histogram[bucket]++;
+        
+        m_callbackStageTicks[stage] = 0;
+        m_callbackStageRuns[stage] = 0;
+    }
+    
+    AtomicIncrement32(&m_publishSequence);
+    
+    m_sampleTimeGap = false;
+}
+
+void DspProfiler::getSnapshot(Snapshot& snapshot) const
+{
+    int32_t sequence;
+    do
+    {
+        sequence = AtomicLoad32(&m_publishSequence);
+        snapshot = m_published;
+        AtomicMemoryBarrier();
+    } while ((sequence & 1) != 0 || sequence != m_publishSequence);
+}
+
+// ---- DspProfiler private methods ----
+
+void DspProfiler::clear()
+{
+    AtomicIncrement32(&m_publishSequence);
+    memset(&m_published, 0, sizeof(m_published));
+    AtomicIncrement32(&m_publishSequence);
+    
+    memset(m_callbackStageTicks, 0, sizeof(m_callbackStageTicks));
+    memset(m_callbackStageRuns, 0, sizeof(m_callbackStageRuns));
+}
@@ -0,0 +1,161 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/**
+ *  @file DspProfiler.h
+ *  iDiMP
+ *
+ *  This file defines the interface for the DspProfiler class, which measures how much of each
+ *  playback callback deadline is spent in each processing stage.
+ */
+
+#ifndef DSP_PROFILER_H
+#define DSP_PROFILER_H
+
+#import "AudioBasics.h"
+#import "AtomicOps.h"
+#import "HostTime.h"
+
+// Uncomment to compile DSP profiling into the playback callback.  When this is not defined,
+// the DSP_PROFILE_* macros below expand to nothing and profiling costs nothing.
+//#define ENABLE_DSP_PROFILING
+
+static const int DSP_PROFILE_NUM_BUCKETS = 16; ///< number of histogram buckets per stage (bucket i counts durations in [2^i, 2^(i+1)) microseconds)
+
+/** DspProfiler class.
+ * DspProfiler accumulates per-stage timings for the playback callback using the host's cycle
+ * counter.  All of the begin/end methods must be called from the audio thread; getSnapshot and 
+ * requestReset may be called from any other thread and never block the audio thread.
+ */
+class DspProfiler
+{
+public:
+   /**
+    * Enum of the stages of the playback callback that are timed.
+    */
+    enum Stage {
+        StageRecorded = 0, /*!< Fetching and processing recorded audio */
+        StageSynth,        /*!< Synthesizing and processing TouchSynth audio */
+        StageSamples,      /*!< Playing SamplePlayer voices */
+        StageNetwork,      /*!< Fetching and processing network audio */
+        StageMix,          /*!< Mixing the playback and network output buffers */
+        StageMaster,       /*!< Applying master effects */
+        StageConvert,      /*!< Converting mixed audio back to shorts */
+        StageNetworkSend,  /*!< Handing audio to the NetworkController */
+        NumStages          /*!< Number of stages */
+    };
+    
+   /**
+    * Timing statistics for one processing stage.
+    */
+    struct StageStats
+    {
+        UInt32 count;                              ///< number of times the stage ran
+        double totalSeconds;                       ///< total time spent in the stage
+        double maxSeconds;                         ///< longest time spent in the stage during one callback
+        UInt32 histogram[DSP_PROFILE_NUM_BUCKETS]; ///< time spent in the stage per callback, bucketed by powers of two microseconds
+    };
+    
+   /**
+    * A consistent copy of the statistics gathered by a DspProfiler.
+    */
+    struct Snapshot
+    {
+        UInt32 numCallbacks;          ///< number of playback callbacks measured
+        UInt32 numXruns;              ///< callbacks that overran their deadline or followed a gap in the sample timeline
+        float dspLoad;                ///< rolling average fraction of the callback deadline used (1.0 = 100%)
+        float peakDspLoad;            ///< highest fraction of the callback deadline used by a single callback
+        StageStats stages[NumStages]; ///< per-stage statistics, indexed by Stage
+    };
+    
+   /**
+    * DspProfiler constructor
+    */
+    DspProfiler();
+    
+   /**
+    * Mark the start of a playback callback.
+    * @param timeStamp the time stamp passed to the callback
+    * @param numFrames the number of frames the callback must produce
+    */
+    void beginCallback(const AudioTimeStamp* timeStamp, UInt32 numFrames);
+    
+   /**
+    * Mark the end of a playback callback and publish its measurements.
+    */
+    void endCallback();
+    
+   /**
+    * Mark the start of a stage.
+    * @param stage the stage that is starting
+    */
+    void beginStage(Stage stage) { m_stageStartTicks[stage] = HostTimeNow(); }
+    
+   /**
+    * Mark the end of a stage.  Stages may run more than once per callback.
+    * @param stage the stage that is ending
+    */
+    void endStage(Stage stage) { m_callbackStageTicks[stage] += HostTimeNow() - m_stageStartTicks[stage]; m_callbackStageRuns[stage]++; }
+    
+   /**
+    * Copy the most recently published statistics.
+    * @param snapshot the snapshot to be filled in
+    */
+    void getSnapshot(Snapshot& snapshot) const;
+    
+   /**
+    * Ask the audio thread to clear all statistics at the end of its next callback.
+    */
+    void requestReset() { AtomicStore32(&m_resetRequested, 1); }
+    
+private:
+    void clear();
+    
+    // used only by the audio thread
+    UInt64 m_callbackStartTicks;
+    double m_callbackDeadlineSeconds;
+    double m_expectedSampleTime;
+    bool m_sampleTimeGap;
+    UInt64 m_stageStartTicks[NumStages];
+    UInt64 m_callbackStageTicks[NumStages];
+    UInt32 m_callbackStageRuns[NumStages];
+    
+    // published to other threads under m_publishSequence (odd while being updated)
+    volatile int32_t m_publishSequence;
+    Snapshot m_published;
+    volatile int32_t m_resetRequested;
+};
+
+#ifdef ENABLE_DSP_PROFILING
+    #define DSP_PROFILE_BEGIN_CALLBACK(profiler, timeStamp, numFrames) (profiler).beginCallback((timeStamp), (numFrames))
+    #define DSP_PROFILE_END_CALLBACK(profiler)                         (profiler).endCallback()
+    #define DSP_PROFILE_BEGIN_STAGE(profiler, stage)                   (profiler).beginStage(DspProfiler::stage)
+    #define DSP_PROFILE_END_STAGE(profiler, stage)                     (profiler).endStage(DspProfiler::stage)
+#else
+    #define DSP_PROFILE_BEGIN_CALLBACK(profiler, timeStamp, numFrames)
+    #define DSP_PROFILE_END_CALLBACK(profiler)
+    #define DSP_PROFILE_BEGIN_STAGE(profiler, stage)
+    #define DSP_PROFILE_END_STAGE(profiler, stage)
+#endif
+
+#endif // DSP_PROFILER_H
@@ -0,0 +1,174 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/**
+ *  @file EffectChain.h
+ *  iDiMP
+ *
+ *  This file defines the interface for the EffectChain class.
+ */
+
+#ifndef EFFECT_CHAIN_H
+#define EFFECT_CHAIN_H
+
+#import "AudioEffect.h"
+#import "AudioTracer.h"
+
+/** EffectChain class.
+ * An EffectChain is an immutable, ordered list of AudioEffects.  Editing a chain means building
+ * a new one, so the audio thread can keep processing the old chain while the new one is 
+ * published.  An EffectChain does not own the AudioEffects it references.
+ */
+class EffectChain
+{
+public:
+
+   /**
+    * EffectChain constructor.  Creates an empty chain.
+    */
+    EffectChain() :
+        m_effects(NULL),
+        m_numEffects(0)
+    { }
+    
+   /**
+    * EffectChain destructor.  The referenced AudioEffects are not deleted.
+    */
+    ~EffectChain()
+    {
+        if (m_effects != NULL)
+        {
+            delete[] m_effects;
+            m_effects = NULL;
+        }
+    }
+    
+   /**
+    * Create a new chain containing the effects of the given chain followed by one more effect.
+    * @param chain the chain to copy
+    * @param e a pointer to the AudioEffect to be appended
+    * @return the new chain - the caller is responsible for deleting it
+    */
+    static EffectChain* createWithEffectAdded(const EffectChain* chain, AudioEffect* e)
+    {
+        EffectChain* newChain = new EffectChain(chain->m_numEffects + 1);
+        for (int i = 0; i < chain->m_numEffects; i++)
+        {
+            newChain->m_effects[i] = chain->m_effects[i];
+        }
+        newChain->m_effects[chain->m_numEffects] = e;
+        return newChain;
+    }
+    
+   /**
+    * Create a new chain containing the effects of the given chain without the first occurrence of the given effect.
+    * @param chain the chain to copy
+    * @param e a pointer to the AudioEffect to be left out
+    * @return the new chain, or NULL if the effect was not found - the caller is responsible for deleting it
+    */
+    static EffectChain* createWithEffectRemoved(const EffectChain* chain, AudioEffect* e)
+    {
+        int index = chain->indexOf(e);
+        if (index < 0)
+        {
+            return NULL;
+        }
+        
+        EffectChain* newChain = new EffectChain(chain->m_numEffects - 1);
+        for (int i = 0, j = 0; i < chain->m_numEffects; i++)
+        {
+            if (i != index)
+            {
+                newChain->m_effects[j++] = chain->m_effects[i];
+            }
+        }
+        return newChain;
+    }
+    
+   /**
+    * @return the number of effects in this chain
+    */
+    int size() const { return m_numEffects; }
+    
+   /**
+    * Get the effect at the given index.
+    * @param index the position of the effect in this chain
+    * @return a pointer to the AudioEffect, or NULL if the index is out of range
+    */
+    AudioEffect* getEffect(int index) const
+    {
+        if (index < 0 || index >= m_numEffects)
+        {
+            return NULL;
+        }
+        return m_effects[index];
+    }
+    
+   /**
+    * Find the position of an effect in this chain.
+    * @param e a pointer to the AudioEffect to look for
+    * @return the index of the first occurrence of the effect, or -1 if it is not in this chain
+    */
+    int indexOf(const AudioEffect* e) const
+    {
+        for (int i = 0; i < m_numEffects; i++)
+        {
+            if (m_effects[i] == e)
+            {
+                return i;
+            }
+        }
+        return -1;
+    }
+    
+   /**
+    * Apply each effect in this chain, in order, to the given buffer.
+    * @param buffer the buffer containing the samples to be processed (in-place)
+    * @param numSamplesPerChannel the number of samples per channel in the buffer
+    * @param numChannels the number of interleaved channels in the buffer
+    */
+    void Process(float* buffer, int numSamplesPerChannel, int numChannels) const
+    {
+        for (int i = 0; i < m_numEffects; i++)
+        {
+            AUDIO_TRACE_BEGIN(m_effects[i]->getName());
+            m_effects[i]->Process(buffer, numSamplesPerChannel, numChannels);
+            AUDIO_TRACE_END(m_effects[i]->getName());
+        }
+    }
+    
+private:
+    EffectChain(int numEffects) :
+        m_effects(new AudioEffect*[numEffects]),
+        m_numEffects(numEffects)
+    { }
+    
+    // chains are immutable and are never copied
+    EffectChain(const EffectChain&);
+    EffectChain& operator= (const EffectChain&);
+    
+    AudioEffect** m_effects;
+    int m_numEffects;
+};
+
+#endif // EFFECT_CHAIN_H
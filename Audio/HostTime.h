@@ -0,0 +1,79 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/**
+ *  @file HostTime.h
+ *  iDiMP
+ *
+ *  Monotonic host clock shared by the profiling, logging, and network timing code.
+ *  Reading the clock is cheap enough to do many times per audio callback.
+ */
+
+#ifndef HOST_TIME_H
+#define HOST_TIME_H
+
+#include <stdint.h>
+
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+extern const double HOST_SECONDS_PER_TICK; ///< length of one host clock tick in seconds
+
+/**
+ * @return the current value of the monotonic host clock, in ticks
+ */
+inline uint64_t HostTimeNow()
+{
+#ifdef __APPLE__
+    return mach_absolute_time();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/**
+ * Convert a number of host clock ticks to seconds.
+ * @param ticks the number of ticks
+ * @return the equivalent number of seconds
+ */
+inline double HostTimeToSeconds(uint64_t ticks)
+{
+    return ticks * HOST_SECONDS_PER_TICK;
+}
+
+/**
+ * Convert a number of seconds to host clock ticks.
+ * @param seconds the number of seconds
+ * @return the equivalent number of ticks
+ */
+inline uint64_t HostTimeFromSeconds(double seconds)
+{
+    return (uint64_t)(seconds / HOST_SECONDS_PER_TICK);
+}
+
+#endif // HOST_TIME_H
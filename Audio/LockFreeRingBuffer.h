@@ -0,0 +1,181 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/**
+ *  @file LockFreeRingBuffer.h
+ *  iDiMP
+ *
+ *  This file defines the interface for the LockFreeRingBuffer class.
+ */
+
+#ifndef LOCK_FREE_RING_BUFFER_H
+#define LOCK_FREE_RING_BUFFER_H
+
+#include <stdint.h>
+#include <string.h>
+
+#import "AtomicOps.h"
+
+/** LockFreeRingBuffer class.
+ * A fixed-size byte FIFO for passing data from exactly one writer thread to exactly one reader 
+ * thread without locks.  Neither side ever blocks or allocates, so either side may be the audio
+ * thread.
+ */
+class LockFreeRingBuffer
+{
+public:
+   /**
+    * LockFreeRingBuffer constructor.  All memory is allocated here.
+    * @param capacityInBytes the minimum capacity - it is rounded up to a power of two
+    */
+    LockFreeRingBuffer(uint32_t capacityInBytes) :
+        m_buffer(NULL),
+        m_capacity(1),
+        m_writePosition(0),
+        m_readPosition(0)
+    {
+        while (m_capacity < capacityInBytes)
+        {
+            m_capacity <<= 1;
+        }
+        m_buffer = new char[m_capacity];
+    }
+    
+   /**
+    * LockFreeRingBuffer destructor
+    */
+    ~LockFreeRingBuffer()
+    {
+        if (m_buffer != NULL)
+        {
+            delete[] m_buffer;
+            m_buffer = NULL;
+        }
+    }
+    
+   /**
+    * @return the capacity of this buffer in bytes
+    */
+    uint32_t getCapacity() const { return m_capacity; }
+    
+   /**
+    * @return the number of bytes that can be read right now (reader side)
+    */
+    uint32_t getReadAvailable() const
+    {
+        return (uint32_t)AtomicLoad32(&m_writePosition) - (uint32_t)m_readPosition;
+    }
+    
+   /**
+    * @return the number of bytes that can be written right now (writer side)
+    */
+    uint32_t getWriteAvailable() const
+    {
+        return m_capacity - ((uint32_t)m_writePosition - (uint32_t)AtomicLoad32(&m_readPosition));
+    }
+    
+   /**
+    * Append data to the buffer.  Either all of the data is written or none of it is.
+    * Must only be called from the writer thread.
+    * @param data the bytes to append
+    * @param numBytes the number of bytes to append
+    * @return true if the data was written, false if there was not enough room
+    */
+    bool write(const void* data, uint32_t numBytes)
+    {
+        if (numBytes > getWriteAvailable())
+        {
+            return false;
+        }
+        
+        uint32_t position = (uint32_t)m_writePosition;
+        copy_in(position, (const char*)data, numBytes);
+        
+        // publish the data
+        AtomicStore32(&m_writePosition, (int32_t)(position + numBytes));
+        return true;
+    }
+    
+   /**
+    * Remove data from the buffer.  Must only be called from the reader thread.
+    * @param data where to copy the bytes
+    * @param maxBytes the most bytes to copy
+    * @return the number of bytes copied
+    */
+    uint32_t read(void* data, uint32_t maxBytes)
+    {
+        uint32_t numBytes = getReadAvailable();
+        if (numBytes > maxBytes)
+        {
+            numBytes = maxBytes;
+        }
+        
+        uint32_t position = (uint32_t)m_readPosition;
+        copy_out(position, (char*)data, numBytes);
+        
+        // hand the space back to the writer
+        AtomicStore32(&m_readPosition, (int32_t)(position + numBytes));
+        return numBytes;
+    }
+    
+private:
+    LockFreeRingBuffer(const LockFreeRingBuffer&);
+    LockFreeRingBuffer& operator= (const LockFreeRingBuffer&);
+    
+    void copy_in(uint32_t position, const char* data, uint32_t numBytes)
+    {
+        uint32_t offset = position & (m_capacity - 1);
+        uint32_t firstPart = m_capacity - offset;
+        if (firstPart >= numBytes)
+        {
+            memcpy(m_buffer + offset, data, numBytes);
+        }
+        else
+        {
+            memcpy(m_buffer + offset, data, firstPart);
+            memcpy(m_buffer, data + firstPart, numBytes - firstPart);
+        }
+    }
+    
+    void copy_out(uint32_t position, char* data, uint32_t numBytes) const
+    {
+        uint32_t offset = position & (m_capacity - 1);
+        uint32_t firstPart = m_capacity - offset;
+        if (firstPart >= numBytes)
+        {
+            memcpy(data, m_buffer + offset, numBytes);
+        }
+        else
+        {
+            memcpy(data, m_buffer + offset, firstPart);
+            memcpy(data + firstPart, m_buffer, numBytes - firstPart);
+        }
+    }
+    
+    char* m_buffer;
+    uint32_t m_capacity;
+    volatile int32_t m_writePosition; // free-running byte counts - only the writer changes this
+    volatile int32_t m_readPosition;  // only the reader changes this
+};
+
+#endif // LOCK_FREE_RING_BUFFER_H
@@ -0,0 +1,1624 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/*
+ *  LosslessCodec.cpp
+ *  iDiMP
+ *
+ *  The bitstream written and read here is FLAC (see https://xiph.org/flac/format.html).
+ */
+
+#include "LosslessCodec.h"
+
+#include <math.h>
+#include <string.h>
+
+static const uint32_t STREAMINFO_BYTES       = 34;        ///< size of the STREAMINFO metadata block body
+static const uint32_t STREAM_HEADER_BYTES    = 4 + 4 + STREAMINFO_BYTES; ///< "fLaC" + block header + STREAMINFO
+static const uint32_t DECODER_READ_BYTES     = 64 * 1024; ///< size of each read from the file when decoding
+static const uint32_t MAX_RICE_PARTITIONS    = 1 << LOSSLESS_MAX_PARTITION_ORDER;
+static const int      MAX_RICE_PARAMETER     = 14;        ///< largest parameter with 4-bit Rice coding (15 is the escape code)
+static const int      MAX_RICE2_PARAMETER    = 30;        ///< largest parameter with 5-bit Rice coding (31 is the escape code)
+
+// subframe types
+static const int SUBFRAME_CONSTANT = 0;
+static const int SUBFRAME_VERBATIM = 1;
+static const int SUBFRAME_FIXED    = 8;  ///< | predictor order
+static const int SUBFRAME_LPC      = 32; ///< | (predictor order - 1)
+
+// channel assignments
+static const int CHANNELS_LEFT_SIDE  = 8;
+static const int CHANNELS_SIDE_RIGHT = 9;
+static const int CHANNELS_MID_SIDE   = 10;
+
+// ---- CRCs
+
+/** CRC tables, built once at static initialization time so encoder threads can share them */
+struct CrcTables
+{
+    uint8_t crc8[256];   ///< polynomial x^8 + x^2 + x + 1, used for frame headers
+    uint16_t crc16[256]; ///< polynomial x^16 + x^15 + x^2 + 1, used for whole frames
+    
+    CrcTables()
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            uint8_t c8 = (uint8_t)i;
+            uint16_t c16 = (uint16_t)(i << 8);
+            for (int bit = 0; bit < 8; bit++)
+            {
+                c8 = (uint8_t)((c8 & 0x80) ? (c8 << 1) ^ 0x07 : (c8 << 1));
+                c16 = (uint16_t)((c16 & 0x8000) ? (c16 << 1) ^ 0x8005 : (c16 << 1));
+            }
+            crc8[i] = c8;
+            crc16[i] = c16;
+        }
+    }
+};
+
+static const CrcTables s_crc;
+
+static uint8_t update_crc8(uint8_t crc, uint8_t byte)
+{
+    return s_crc.crc8[crc ^ byte];
+}
+
+static uint16_t update_crc16(uint16_t crc, uint8_t byte)
+{
+    return (uint16_t)((crc << 8) ^ s_crc.crc16[(crc >> 8) ^ byte]);
+}
+
+// ---- encoder helpers
+
+/** writes a big-endian bitstream into a caller-supplied buffer */
+class BitWriter
+{
+public:
+    BitWriter(unsigned char* output) : m_output(output), m_position(0), m_accumulator(0), m_bitCount(0) {}
+    
+    void put(uint32_t value, int numBits)
+    {
+        if (numBits == 0)
+        {
+            return;
+        }
+        if (numBits < 32)
+        {
+            value &= (1u << numBits) - 1;
+        }
+        m_accumulator = (m_accumulator << numBits) | value;
+        m_bitCount += numBits;
+        while (m_bitCount >= 8)
+        {
+            m_bitCount -= 8;
+            m_output[m_position++] = (unsigned char)(m_accumulator >> m_bitCount);
+        }
+    }
+    
+    void putRice(uint32_t value, int parameter)
+    {
+        uint32_t quotient = value >> parameter;
+        while (quotient >= 16)
+        {
+            put(0, 16);
+            quotient -= 16;
+        }
+        if (quotient + 1 + parameter <= 32)
+        {
+            // the unary quotient's stop bit and the low bits can go out together
+            put((1u << parameter) | (value & ((1u << parameter) - 1)), quotient + 1 + parameter);
+        }
+        else
+        {
+            put(1, quotient + 1);
+            put(value, parameter);
+        }
+    }
+    
+    void alignToByte()
+    {
+        if (m_bitCount > 0)
+        {
+            put(0, 8 - m_bitCount);
+        }
+    }
+    
+    uint32_t getPosition() const { return m_position; }
+    
+private:
+    unsigned char* m_output;
+    uint32_t m_position;
+    uint64_t m_accumulator;
+    int m_bitCount;
+};
+
+static uint32_t fold_signed(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+/** the partitioning and parameters chosen for Rice coding one residual */
+struct RiceChoice
+{
+    int method;                               ///< 0 for 4-bit parameters, 1 for 5-bit
+    int partitionOrder;
+    int parameters[MAX_RICE_PARTITIONS];
+};
+
+/** cost in bits of Rice coding numSamples values which sum to sum, with the best parameter up to maxParameter */
+static uint64_t best_rice_parameter(uint64_t sum, uint32_t numSamples, int maxParameter, int& parameter)
+{
+    uint64_t bestBits = ~(uint64_t)0;
+    parameter = 0;
+    for (int k = 0; k <= maxParameter; k++)
+    {
+        // sum >> k is an upper bound for the sum of the quotients
+        uint64_t bits = (uint64_t)numSamples * (k + 1) + (sum >> k);
+        if (bits < bestBits)
+        {
+            bestBits = bits;
+            parameter = k;
+        }
+    }
+    return bestBits;
+}
+
+/** choose how to Rice code a residual, returning the (upper bound) size in bits */
+static uint64_t choose_rice(const uint32_t* folded, uint32_t numFrames, int predictorOrder, RiceChoice& choice)
+{
+    uint64_t bestBits = ~(uint64_t)0;
+    for (int order = 0; order <= LOSSLESS_MAX_PARTITION_ORDER; order++)
+    {
+        uint32_t partitionSize = numFrames >> order;
+        if ((numFrames & ((1u << order) - 1)) != 0 || partitionSize < (uint32_t)predictorOrder)
+        {
+            break;
+        }
+        
+        int parameters4[MAX_RICE_PARTITIONS];
+        int parameters5[MAX_RICE_PARTITIONS];
+        uint64_t bits4 = 0;
+        uint64_t bits5 = 0;
+        uint32_t sample = predictorOrder;
+        for (int partition = 0; partition < (1 << order); partition++)
+        {
+            uint32_t end = (partition + 1) * partitionSize;
+            uint32_t count = end - sample;
+            uint64_t sum = 0;
+            for (; sample < end; sample++)
+            {
+                sum += folded[sample];
+            }
+            bits4 += 4 + best_rice_parameter(sum, count, MAX_RICE_PARAMETER, parameters4[partition]);
+            bits5 += 5 + best_rice_parameter(sum, count, MAX_RICE2_PARAMETER, parameters5[partition]);
+        }
+        
+        uint64_t bits = 2 + 4 + ((bits4 <= bits5) ? bits4 : bits5);
+        if (bits < bestBits)
+        {
+            bestBits = bits;
+            choice.method = (bits4 <= bits5) ? 0 : 1;
+            choice.partitionOrder = order;
+            memcpy(choice.parameters, (bits4 <= bits5) ? parameters4 : parameters5, sizeof(int) << order);
+        }
+    }
+    return bestBits;
+}
+
+static void write_residual(BitWriter& writer, const uint32_t* folded, uint32_t numFrames, int predictorOrder, const RiceChoice& choice)
+{
+    writer.put(choice.method, 2);
+    writer.put(choice.partitionOrder, 4);
+    uint32_t partitionSize = numFrames >> choice.partitionOrder;
+    uint32_t sample = predictorOrder;
+    for (int partition = 0; partition < (1 << choice.partitionOrder); partition++)
+    {
+        int parameter = choice.parameters[partition];
+        writer.put(parameter, choice.method == 0 ? 4 : 5);
+        for (uint32_t end = (partition + 1) * partitionSize; sample < end; sample++)
+        {
+            writer.putRice(folded[sample], parameter);
+        }
+    }
+}
+
+/** compute the residual of a fixed polynomial predictor */
+static void fixed_residual(const int32_t* x, uint32_t numFrames, int order, uint32_t* folded)
+{
+    for (uint32_t i = order; i < numFrames; i++)
+    {
+        int32_t residual = 0;
+        switch (order)
+        {
+            case 0: residual = x[i]; break;
+            case 1: residual = x[i] - x[i-1]; break;
+            case 2: residual = x[i] - 2 * x[i-1] + x[i-2]; break;
+            case 3: residual = x[i] - 3 * x[i-1] + 3 * x[i-2] - x[i-3]; break;
+            case 4: residual = x[i] - 4 * x[i-1] + 6 * x[i-2] - 4 * x[i-3] + x[i-4]; break;
+        }
+        folded[i] = fold_signed(residual);
+    }
+}
+
+/** pick the fixed predictor order with the smallest total residual magnitude */
+static int best_fixed_order(const int32_t* x, uint32_t numFrames, uint64_t& bestSum)
+{
+    uint64_t sums[LOSSLESS_MAX_FIXED_ORDER + 1] = { 0, 0, 0, 0, 0 };
+    for (uint32_t i = LOSSLESS_MAX_FIXED_ORDER; i < numFrames; i++)
+    {
+        int64_t e0 = x[i];
+        int64_t e1 = e0 - x[i-1];
+        int64_t e2 = e1 - (x[i-1] - x[i-2]);
+        int64_t e3 = e2 - (x[i-1] - 2 * (int64_t)x[i-2] + x[i-3]);
+        int64_t e4 = e3 - (x[i-1] - 3 * (int64_t)x[i-2] + 3 * (int64_t)x[i-3] - x[i-4]);
+        sums[0] += (e0 < 0) ? -e0 : e0;
+        sums[1] += (e1 < 0) ? -e1 : e1;
+        sums[2] += (e2 < 0) ? -e2 : e2;
+        sums[3] += (e3 < 0) ? -e3 : e3;
+        sums[4] += (e4 < 0) ? -e4 : e4;
+    }
+    int bestOrder = 0;
+    for (int order = 1; order <= LOSSLESS_MAX_FIXED_ORDER; order++)
+    {
+        if (sums[order] < sums[bestOrder])
+        {
+            bestOrder = order;
+        }
+    }
+    bestSum = sums[bestOrder];
+    return bestOrder;
+}
+
+/** 
+ * Find LPC coefficients for x (Welch window, autocorrelation, Levinson-Durbin), choosing the 
+ * order with the smallest estimated size.  Returns the order, or 0 if LPC isn't usable.
+ */
+static int compute_lpc(const int32_t* x, uint32_t numFrames, int bitsPerSample, double* windowed, double coefficients[LOSSLESS_MAX_LPC_ORDER])
+{
+    int maxOrder = LOSSLESS_MAX_LPC_ORDER;
+    if (numFrames <= (uint32_t)maxOrder * 2)
+    {
+        return 0;
+    }
+    
+    double halfLength = 0.5 * (numFrames - 1);
+    for (uint32_t i = 0; i < numFrames; i++)
+    {
+        double t = (i - halfLength) / (halfLength + 1.0);
+        windowed[i] = x[i] * (1.0 - t * t);
+    }
+    
+    double autocorrelation[LOSSLESS_MAX_LPC_ORDER + 1];
+    for (int lag = 0; lag <= maxOrder; lag++)
+    {
+        double sum = 0.0;
+        for (uint32_t i = lag; i < numFrames; i++)
+        {
+            sum += windowed[i] * windowed[i - lag];
+        }
+        autocorrelation[lag] = sum;
+    }
+    if (autocorrelation[0] == 0.0)
+    {
+        return 0;
+    }
+    
+    // Levinson-Durbin recursion, keeping the coefficients for every order
+    double lpc[LOSSLESS_MAX_LPC_ORDER][LOSSLESS_MAX_LPC_ORDER];
+    double error[LOSSLESS_MAX_LPC_ORDER];
+    double current[LOSSLESS_MAX_LPC_ORDER];
+    double e = autocorrelation[0];
+    for (int i = 0; i < maxOrder; i++)
+    {
+        double r = -autocorrelation[i + 1];
+        for (int j = 0; j < i; j++)
+        {
+            r -= current[j] * autocorrelation[i - j];
+        }
+        r /= e;
+        
+        current[i] = r;
+        for (int j = 0; j < i / 2; j++)
+        {
+            double tmp = current[j];
+            current[j] += r * current[i - 1 - j];
+            current[i - 1 - j] += r * tmp;
+        }
+        if (i & 1)
+        {
+            current[i / 2] += current[i / 2] * r;
+        }
+        e *= 1.0 - r * r;
+        
+        // the predictor is the negated reflection form
+        for (int j = 0; j <= i; j++)
+        {
+            lpc[i][j] = -current[j];
+        }
+        error[i] = e;
+    }
+    
+    // estimate the size at each order and take the smallest
+    int bestOrder = 0;
+    double bestBits = 1e32;
+    for (int order = 1; order <= maxOrder; order++)
+    {
+        double errorPerSample = error[order - 1] * 0.5 / numFrames;
+        double bitsPerResidual = (errorPerSample > 0.0) ? 0.5 * log(errorPerSample) / M_LN2 : 0.0;
+        if (bitsPerResidual < 0.0)
+        {
+            bitsPerResidual = 0.0;
+        }
+        double bits = bitsPerResidual * (numFrames - order) + order * (LOSSLESS_LPC_PRECISION + bitsPerSample);
+        if (bits < bestBits)
+        {
+            bestBits = bits;
+            bestOrder = order;
+        }
+    }
+    for (int j = 0; j < bestOrder; j++)
+    {
+        coefficients[j] = lpc[bestOrder - 1][j];
+    }
+    return bestOrder;
+}
+
+/** quantize LPC coefficients; returns the shift, or -1 if they can't be represented */
+static int quantize_lpc(const double* coefficients, int order, int32_t* quantized)
+{
+    double maxMagnitude = 0.0;
+    for (int j = 0; j < order; j++)
+    {
+        double magnitude = fabs(coefficients[j]);
+        if (magnitude > maxMagnitude)
+        {
+            maxMagnitude = magnitude;
+        }
+    }
+    if (maxMagnitude <= 0.0)
+    {
+        return -1;
+    }
+    
+    int log2Max;
+    frexp(maxMagnitude, &log2Max);
+    int shift = (LOSSLESS_LPC_PRECISION - 1) - log2Max;
+    if (shift > 15)
+    {
+        shift = 15;
+    }
+    if (shift < 0)
+    {
+        return -1;
+    }
+    
+    // carry the rounding error forward so it doesn't accumulate
+    int32_t maxQuantized = (1 << (LOSSLESS_LPC_PRECISION - 1)) - 1;
+    double error = 0.0;
+    for (int j = 0; j < order; j++)
+    {
+        error += coefficients[j] * (1 << shift);
+        int32_t q = (int32_t)floor(error + 0.5);
+        if (q > maxQuantized)
+        {
+            q = maxQuantized;
+        }
+        else if (q < -maxQuantized - 1)
+        {
+            q = -maxQuantized - 1;
+        }
+        error -= q;
+        quantized[j] = q;
+    }
+    return shift;
+}
+
+/** compute the residual of an LPC predictor; returns false if it overflows 32 bits */
+static bool lpc_residual(const int32_t* x, uint32_t numFrames, const int32_t* quantized, int order, int shift, uint32_t* folded)
+{
+    for (uint32_t i = order; i < numFrames; i++)
+    {
+        int64_t prediction = 0;
+        for (int j = 0; j < order; j++)
+        {
+            prediction += (int64_t)quantized[j] * x[i - j - 1];
+        }
+        int64_t residual = x[i] - (prediction >> shift);
+        if (residual > (int64_t)0x7FFFFFFF || residual < -(int64_t)0x80000000)
+        {
+            return false;
+        }
+        folded[i] = fold_signed((int32_t)residual);
+    }
+    return true;
+}
+
+/** scratch memory for encoding one channel */
+struct SubframeScratch
+{
+    uint32_t* fixedResidual;
+    uint32_t* lpcResidual;
+    double* windowed;
+};
+
+/** pick the smallest encoding for one channel and write it */
+static void encode_subframe(BitWriter& writer, const int32_t* x, uint32_t numFrames, int bitsPerSample, SubframeScratch& scratch)
+{
+    bool isConstant = true;
+    for (uint32_t i = 1; i < numFrames && isConstant; i++)
+    {
+        isConstant = (x[i] == x[0]);
+    }
+    if (isConstant)
+    {
+        writer.put(SUBFRAME_CONSTANT << 1, 8);
+        writer.put(x[0], bitsPerSample);
+        return;
+    }
+    
+    uint64_t verbatimBits = (uint64_t)numFrames * bitsPerSample;
+    
+    // best fixed predictor
+    uint64_t fixedSum;
+    int fixedOrder = best_fixed_order(x, numFrames, fixedSum);
+    if ((uint32_t)fixedOrder > numFrames)
+    {
+        fixedOrder = 0;
+    }
+    fixed_residual(x, numFrames, fixedOrder, scratch.fixedResidual);
+    RiceChoice fixedRice;
+    uint64_t fixedBits = fixedOrder * bitsPerSample + choose_rice(scratch.fixedResidual, numFrames, fixedOrder, fixedRice);
+    
+    // best LPC predictor
+    double coefficients[LOSSLESS_MAX_LPC_ORDER];
+    int32_t quantized[LOSSLESS_MAX_LPC_ORDER];
+    int lpcOrder = compute_lpc(x, numFrames, bitsPerSample, scratch.windowed, coefficients);
+    int lpcShift = (lpcOrder > 0) ? quantize_lpc(coefficients, lpcOrder, quantized) : -1;
+    RiceChoice lpcRice;
+    uint64_t lpcBits = ~(uint64_t)0;
+    if (lpcShift >= 0 && lpc_residual(x, numFrames, quantized, lpcOrder, lpcShift, scratch.lpcResidual))
+    {
+        lpcBits = lpcOrder * bitsPerSample + 4 + 5 + lpcOrder * LOSSLESS_LPC_PRECISION
+                + choose_rice(scratch.lpcResidual, numFrames, lpcOrder, lpcRice);
+    }
+    
+    if (verbatimBits <= fixedBits && verbatimBits <= lpcBits)
+    {
+        writer.put(SUBFRAME_VERBATIM << 1, 8);
+        for (uint32_t i = 0; i < numFrames; i++)
+        {
+            writer.put(x[i], bitsPerSample);
+        }
+    }
+    else if (fixedBits <= lpcBits)
+    {
+        writer.put((SUBFRAME_FIXED | fixedOrder) << 1, 8);
+        for (int i = 0; i < fixedOrder; i++)
+        {
+            writer.put(x[i], bitsPerSample);
+        }
+        write_residual(writer, scratch.fixedResidual, numFrames, fixedOrder, fixedRice);
+    }
+    else
+    {
+        writer.put((SUBFRAME_LPC | (lpcOrder - 1)) << 1, 8);
+        for (int i = 0; i < lpcOrder; i++)
+        {
+            writer.put(x[i], bitsPerSample);
+        }
+        writer.put(LOSSLESS_LPC_PRECISION - 1, 4);
+        writer.put(lpcShift, 5);
+        for (int j = 0; j < lpcOrder; j++)
+        {
+            writer.put(quantized[j], LOSSLESS_LPC_PRECISION);
+        }
+        write_residual(writer, scratch.lpcResidual, numFrames, lpcOrder, lpcRice);
+    }
+}
+
+static int block_size_code(uint32_t numFrames)
+{
+    for (int code = 8; code <= 15; code++)
+    {
+        if (numFrames == (256u << (code - 8)))
+        {
+            return code;
+        }
+    }
+    return (numFrames <= 256) ? 6 : 7; // size follows the header in 8 or 16 bits
+}
+
+static int sample_rate_code(uint32_t sampleRate)
+{
+    switch (sampleRate)
+    {
+        case 88200:  return 1;
+        case 176400: return 2;
+        case 192000: return 3;
+        case 8000:   return 4;
+        case 16000:  return 5;
+        case 22050:  return 6;
+        case 24000:  return 7;
+        case 32000:  return 8;
+        case 44100:  return 9;
+        case 48000:  return 10;
+        case 96000:  return 11;
+    }
+    return 0; // from the stream header
+}
+
+static int sample_size_code(int bitsPerSample)
+{
+    switch (bitsPerSample)
+    {
+        case 8:  return 1;
+        case 12: return 2;
+        case 16: return 4;
+        case 20: return 5;
+        case 24: return 6;
+    }
+    return 0; // from the stream header
+}
+
+// ---- LosslessEncoder public methods ----
+
+LosslessEncoder::LosslessEncoder(int numThreads) :
+    m_file(NULL),
+    m_sampleRate(0),
+    m_numChannels(0),
+    m_bitsPerSample(0),
+    m_numFrames(0),
+    m_numBytesWritten(0),
+    m_minFrameBytes(0),
+    m_maxFrameBytes(0),
+    m_submitIndex(0),
+    m_writeIndex(0),
+    m_ioError(false),
+    m_numThreads(numThreads),
+    m_threads(NULL),
+    m_workersRunning(false)
+{
+    for (int i = 0; i < LOSSLESS_MAX_PENDING_BLOCKS; i++)
+    {
+        m_jobs[i].samples = NULL;
+        m_jobs[i].output = NULL;
+        m_jobs[i].state = JobFree;
+    }
+    pthread_mutex_init(&m_jobLock, NULL);
+    pthread_cond_init(&m_jobReady, NULL);
+    pthread_cond_init(&m_jobDone, NULL);
+}
+
+LosslessEncoder::~LosslessEncoder()
+{
+    close();
+    pthread_cond_destroy(&m_jobDone);
+    pthread_cond_destroy(&m_jobReady);
+    pthread_mutex_destroy(&m_jobLock);
+}
+
+uint32_t LosslessEncoder::getMaxFrameBytes(int numChannels, uint32_t numFrames, int bitsPerSample)
+{
+    // a frame is never bigger than its verbatim encoding (side channels need one extra bit)
+    return 16 + 2 + numChannels * (1 + (numFrames * (bitsPerSample + 1) + 7) / 8);
+}
+
+bool LosslessEncoder::open(const char* path, uint32_t sampleRate, int numChannels, int bitsPerSample)
+{
+    close();
+    
+    if (numChannels < 1 || numChannels > LOSSLESS_MAX_CHANNELS || bitsPerSample < 8 || bitsPerSample > 24 
+        || sampleRate == 0 || sampleRate >= (1 << 20))
+    {
+        printf("LosslessEncoder::open unsupported format (%d channels, %d bits, %u Hz)\n", numChannels, bitsPerSample, sampleRate);
+        return false;
+    }
+    
+    m_file = fopen(path, "wb");
+    if (m_file == NULL)
+    {
+        printf("LosslessEncoder::open could not create %s\n", path);
+        return false;
+    }
+    
+    m_sampleRate = sampleRate;
+    m_numChannels = numChannels;
+    m_bitsPerSample = bitsPerSample;
+    m_numFrames = 0;
+    m_numBytesWritten = 0;
+    m_minFrameBytes = 0;
+    m_maxFrameBytes = 0;
+    m_submitIndex = 0;
+    m_writeIndex = 0;
+    m_ioError = false;
+    
+    uint32_t maxFrameBytes = getMaxFrameBytes(numChannels, LOSSLESS_BLOCK_SIZE, bitsPerSample);
+    for (int i = 0; i < LOSSLESS_MAX_PENDING_BLOCKS; i++)
+    {
+        m_jobs[i].samples = new int32_t[LOSSLESS_BLOCK_SIZE * numChannels];
+        m_jobs[i].output = new unsigned char[maxFrameBytes];
+        m_jobs[i].numFrames = 0;
+        m_jobs[i].state = JobFree;
+    }
+    
+    if (m_numThreads > 0)
+    {
+        m_workersRunning = true;
+        m_threads = new pthread_t[m_numThreads];
+        for (int i = 0; i < m_numThreads; i++)
+        {
+            if (pthread_create(&m_threads[i], NULL, worker_thread_main, this) != 0)
+            {
+                printf("LosslessEncoder::open could not create worker thread - encoding on the calling thread instead\n");
+                m_numThreads = i;
+                break;
+            }
+        }
+    }
+    
+    // placeholder until close() knows the totals
+    return write_stream_header();
+}
+
+void LosslessEncoder::close()
+{
+    if (m_file == NULL)
+    {
+        return;
+    }
+    
+    // encode the last partial block and wait for everything to reach the file
+    if (get_filling_job().numFrames > 0)
+    {
+        submit_filling_job();
+    }
+    write_finished_jobs(true);
+    
+    if (m_threads != NULL)
+    {
+        pthread_mutex_lock(&m_jobLock);
+        m_workersRunning = false;
+        pthread_cond_broadcast(&m_jobReady);
+        pthread_mutex_unlock(&m_jobLock);
+        for (int i = 0; i < m_numThreads; i++)
+        {
+            pthread_join(m_threads[i], NULL);
+        }
+        delete[] m_threads;
+        m_threads = NULL;
+    }
+    
+    // fill in the stream header now that we know the totals
+    if (fseek(m_file, 0, SEEK_SET) != 0 || !write_stream_header())
+    {
+        printf("LosslessEncoder::close could not update the stream header\n");
+    }
+    fclose(m_file);
+    m_file = NULL;
+    
+    for (int i = 0; i < LOSSLESS_MAX_PENDING_BLOCKS; i++)
+    {
+        delete[] m_jobs[i].samples;
+        delete[] m_jobs[i].output;
+        m_jobs[i].samples = NULL;
+        m_jobs[i].output = NULL;
+    }
+}
+
+bool LosslessEncoder::writeShort(const short* samples, uint32_t numFrames)
+{
+    if (m_file == NULL)
+    {
+        return false;
+    }
+    
+    int shift = m_bitsPerSample - 16;
+    while (numFrames > 0)
+    {
+        BlockJob& job = get_filling_job();
+        uint32_t count = LOSSLESS_BLOCK_SIZE - job.numFrames;
+        if (count > numFrames)
+        {
+            count = numFrames;
+        }
+        
+        // deinterleave straight into the block
+        for (int channel = 0; channel < m_numChannels; channel++)
+        {
+            int32_t* out = job.samples + channel * LOSSLESS_BLOCK_SIZE + job.numFrames;
+            const short* in = samples + channel;
+            for (uint32_t i = 0; i < count; i++, in += m_numChannels)
+            {
+                out[i] = (shift >= 0) ? ((int32_t)*in << shift) : ((int32_t)*in >> -shift);
+            }
+        }
+        job.numFrames += count;
+        samples += count * m_numChannels;
+        numFrames -= count;
+        
+        if (job.numFrames == LOSSLESS_BLOCK_SIZE && !submit_filling_job())
+        {
+            return false;
+        }
+    }
+    return !m_ioError;
+}
+
+bool LosslessEncoder::writeInt(const int32_t* samples, uint32_t numFrames)
+{
+    if (m_file == NULL)
+    {
+        return false;
+    }
+    
+    while (numFrames > 0)
+    {
+        BlockJob& job = get_filling_job();
+        uint32_t count = LOSSLESS_BLOCK_SIZE - job.numFrames;
+        if (count > numFrames)
+        {
+            count = numFrames;
+        }
+        for (int channel = 0; channel < m_numChannels; channel++)
+        {
+            int32_t* out = job.samples + channel * LOSSLESS_BLOCK_SIZE + job.numFrames;
+            const int32_t* in = samples + channel;
+            for (uint32_t i = 0; i < count; i++, in += m_numChannels)
+            {
+                out[i] = *in;
+            }
+        }
+        job.numFrames += count;
+        samples += count * m_numChannels;
+        numFrames -= count;
+        
+        if (job.numFrames == LOSSLESS_BLOCK_SIZE && !submit_filling_job())
+        {
+            return false;
+        }
+    }
+    return !m_ioError;
+}
+
+uint32_t LosslessEncoder::encodeFrame(int32_t* const* channels, int numChannels, uint32_t numFrames, int bitsPerSample, 
+                                      uint32_t sampleRate, uint64_t frameNumber, unsigned char* output)
+{
+    SubframeScratch scratch;
+    scratch.fixedResidual = new uint32_t[numFrames];
+    scratch.lpcResidual = new uint32_t[numFrames];
+    scratch.windowed = new double[numFrames];
+    
+    // for stereo, see whether coding the difference between the channels is cheaper
+    int assignment = numChannels - 1;
+    int32_t* subframes[LOSSLESS_MAX_CHANNELS];
+    int subframeBits[LOSSLESS_MAX_CHANNELS];
+    int32_t* mid = NULL;
+    int32_t* side = NULL;
+    for (int channel = 0; channel < numChannels; channel++)
+    {
+        subframes[channel] = channels[channel];
+        subframeBits[channel] = bitsPerSample;
+    }
+    if (numChannels == 2)
+    {
+        mid = new int32_t[numFrames];
+        side = new int32_t[numFrames];
+        for (uint32_t i = 0; i < numFrames; i++)
+        {
+            mid[i] = (channels[0][i] + channels[1][i]) >> 1;
+            side[i] = channels[0][i] - channels[1][i];
+        }
+        
+        uint64_t left, right, midCost, sideCost;
+        best_fixed_order(channels[0], numFrames, left);
+        best_fixed_order(channels[1], numFrames, right);
+        best_fixed_order(mid, numFrames, midCost);
+        best_fixed_order(side, numFrames, sideCost);
+        
+        uint64_t best = left + right;
+        if (left + sideCost < best)
+        {
+            best = left + sideCost;
+            assignment = CHANNELS_LEFT_SIDE;
+            subframes[1] = side;
+            subframeBits[1] = bitsPerSample + 1;
+        }
+        if (sideCost + right < best)
+        {
+            best = sideCost + right;
+            assignment = CHANNELS_SIDE_RIGHT;
+            subframes[0] = side;
+            subframes[1] = channels[1];
+            subframeBits[0] = bitsPerSample + 1;
+            subframeBits[1] = bitsPerSample;
+        }
+        if (midCost + sideCost < best)
+        {
+            assignment = CHANNELS_MID_SIDE;
+            subframes[0] = mid;
+            subframes[1] = side;
+            subframeBits[0] = bitsPerSample;
+            subframeBits[1] = bitsPerSample + 1;
+        }
+    }
+    
+    // frame header
+    BitWriter writer(output);
+    int blockCode = block_size_code(numFrames);
+    writer.put(0xFFF8, 16); // sync code, fixed block size
+    writer.put(blockCode, 4);
+    writer.put(sample_rate_code(sampleRate), 4);
+    writer.put(assignment, 4);
+    writer.put(sample_size_code(bitsPerSample), 3);
+    writer.put(0, 1);
+    
+    // frame number, UTF-8 style
+    if (frameNumber < 0x80)
+    {
+        writer.put((uint32_t)frameNumber, 8);
+    }
+    else
+    {
+        int numContinuation = 1;
+        while (numContinuation < 6 && frameNumber >= (1ULL << (5 * numContinuation + 6)))
+        {
+            numContinuation++;
+        }
+        uint32_t leadingOnes = (0xFF00 >> (numContinuation + 1)) & 0xFF;
+        writer.put(leadingOnes | (uint32_t)(frameNumber >> (6 * numContinuation)), 8);
+        for (int i = numContinuation - 1; i >= 0; i--)
+        {
+            writer.put(0x80 | (uint32_t)((frameNumber >> (6 * i)) & 0x3F), 8);
+        }
+    }
+    if (blockCode == 6)
+    {
+        writer.put(numFrames - 1, 8);
+    }
+    else if (blockCode == 7)
+    {
+        writer.put(numFrames - 1, 16);
+    }
+    
+    uint8_t crc8 = 0;
+    for (uint32_t i = 0; i < writer.getPosition(); i++)
+    {
+        crc8 = update_crc8(crc8, output[i]);
+    }
+    writer.put(crc8, 8);
+    
+    for (int channel = 0; channel < numChannels; channel++)
+    {
+        encode_subframe(writer, subframes[channel], numFrames, subframeBits[channel], scratch);
+    }
+    
+    // frame footer
+    writer.alignToByte();
+    uint16_t crc16 = 0;
+    for (uint32_t i = 0; i < writer.getPosition(); i++)
+    {
+        crc16 = update_crc16(crc16, output[i]);
+    }
+    writer.put(crc16, 16);
+    
+    delete[] mid;
+    delete[] side;
+    delete[] scratch.fixedResidual;
+    delete[] scratch.lpcResidual;
+    delete[] scratch.windowed;
+    return writer.getPosition();
+}
+
+// ---- LosslessEncoder private methods ----
+
+void* LosslessEncoder::worker_thread_main(void* arg)
+{
+    ((LosslessEncoder*)arg)->run_worker();
+    return NULL;
+}
+
+void LosslessEncoder::run_worker()
+{
+    pthread_mutex_lock(&m_jobLock);
+    while (true)
+    {
+        // take the oldest block that's ready
+        BlockJob* job = NULL;
+        for (uint64_t index = m_writeIndex; index < m_submitIndex && job == NULL; index++)
+        {
+            BlockJob& candidate = m_jobs[index % LOSSLESS_MAX_PENDING_BLOCKS];
+            if (candidate.state == JobReady)
+            {
+                job = &candidate;
+            }
+        }
+        
+        if (job == NULL)
+        {
+            if (!m_workersRunning)
+            {
+                break;
+            }
+            pthread_cond_wait(&m_jobReady, &m_jobLock);
+            continue;
+        }
+        
+        job->state = JobEncoding;
+        pthread_mutex_unlock(&m_jobLock);
+        
+        encode_job(*job);
+        
+        pthread_mutex_lock(&m_jobLock);
+        job->state = JobDone;
+        pthread_cond_broadcast(&m_jobDone);
+    }
+    pthread_mutex_unlock(&m_jobLock);
+}
+
+void LosslessEncoder::encode_job(BlockJob& job)
+{
+    int32_t* channels[LOSSLESS_MAX_CHANNELS];
+    for (int channel = 0; channel < m_numChannels; channel++)
+    {
+        channels[channel] = job.samples + channel * LOSSLESS_BLOCK_SIZE;
+    }
+    job.outputBytes = encodeFrame(channels, m_numChannels, job.numFrames, m_bitsPerSample, m_sampleRate, job.frameNumber, job.output);
+}
+
+LosslessEncoder::BlockJob& LosslessEncoder::get_filling_job()
+{
+    BlockJob& job = m_jobs[m_submitIndex % LOSSLESS_MAX_PENDING_BLOCKS];
+    if (job.state == JobFree)
+    {
+        // only this thread moves jobs out of JobFree, so no lock is needed
+        job.state = JobFilling;
+        job.numFrames = 0;
+        job.frameNumber = m_submitIndex;
+    }
+    return job;
+}
+
+bool LosslessEncoder::submit_filling_job()
+{
+    BlockJob& job = m_jobs[m_submitIndex % LOSSLESS_MAX_PENDING_BLOCKS];
+    m_numFrames += job.numFrames;
+    
+    if (m_numThreads == 0)
+    {
+        encode_job(job);
+        job.state = JobDone;
+        m_submitIndex++;
+    }
+    else
+    {
+        pthread_mutex_lock(&m_jobLock);
+        job.state = JobReady;
+        m_submitIndex++;
+        pthread_cond_signal(&m_jobReady);
+        pthread_mutex_unlock(&m_jobLock);
+    }
+    
+    // write whatever is finished, and make sure the next job slot is free
+    if (!write_finished_jobs(false))
+    {
+        return false;
+    }
+    if (m_submitIndex - m_writeIndex == LOSSLESS_MAX_PENDING_BLOCKS)
+    {
+        // the workers are behind - wait for the oldest block
+        pthread_mutex_lock(&m_jobLock);
+        while (m_jobs[m_writeIndex % LOSSLESS_MAX_PENDING_BLOCKS].state != JobDone)
+        {
+            pthread_cond_wait(&m_jobDone, &m_jobLock);
+        }
+        pthread_mutex_unlock(&m_jobLock);
+        return write_finished_jobs(false);
+    }
+    return true;
+}
+
+bool LosslessEncoder::write_finished_jobs(bool waitForAll)
+{
+    while (m_writeIndex < m_submitIndex)
+    {
+        BlockJob& job = m_jobs[m_writeIndex % LOSSLESS_MAX_PENDING_BLOCKS];
+        
+        pthread_mutex_lock(&m_jobLock);
+        while (waitForAll && job.state != JobDone)
+        {
+            pthread_cond_wait(&m_jobDone, &m_jobLock);
+        }
+        bool isDone = (job.state == JobDone);
+        pthread_mutex_unlock(&m_jobLock);
+        if (!isDone)
+        {
+            break;
+        }
+        
+        if (!m_ioError && fwrite(job.output, 1, job.outputBytes, m_file) != job.outputBytes)
+        {
+            printf("LosslessEncoder::write_finished_jobs error writing to file\n");
+            m_ioError = true;
+        }
+        m_numBytesWritten += job.outputBytes;
+        if (m_minFrameBytes == 0 || job.outputBytes < m_minFrameBytes)
+        {
+            m_minFrameBytes = job.outputBytes;
+        }
+        if (job.outputBytes > m_maxFrameBytes)
+        {
+            m_maxFrameBytes = job.outputBytes;
+        }
+        
+        pthread_mutex_lock(&m_jobLock);
+        job.state = JobFree;
+        m_writeIndex++;
+        pthread_mutex_unlock(&m_jobLock);
+    }
+    return !m_ioError;
+}
+
+bool LosslessEncoder::write_stream_header()
+{
+    unsigned char header[STREAM_HEADER_BYTES];
+    memset(header, 0, sizeof(header));
+    memcpy(header, "fLaC", 4);
+    
+    // metadata block header: last block, type 0 (STREAMINFO), length
+    BitWriter writer(header + 4);
+    writer.put(1, 1);
+    writer.put(0, 7);
+    writer.put(STREAMINFO_BYTES, 24);
+    
+    writer.put(LOSSLESS_BLOCK_SIZE, 16);
+    writer.put(LOSSLESS_BLOCK_SIZE, 16);
+    writer.put(m_minFrameBytes, 24);
+    writer.put(m_maxFrameBytes, 24);
+    writer.put(m_sampleRate, 20);
+    writer.put(m_numChannels - 1, 3);
+    writer.put(m_bitsPerSample - 1, 5);
+    writer.put((uint32_t)(m_numFrames >> 32), 4);
+    writer.put((uint32_t)m_numFrames, 32);
+    // the MD5 signature is left as zero ("not computed")
+    
+    if (fwrite(header, 1, sizeof(header), m_file) != sizeof(header))
+    {
+        printf("LosslessEncoder::write_stream_header error writing to file\n");
+        return false;
+    }
+    if (m_numBytesWritten == 0)
+    {
+        m_numBytesWritten = sizeof(header);
+    }
+    return true;
+}
+
+// ---- LosslessDecoder public methods ----
+
+LosslessDecoder::LosslessDecoder() :
+    m_file(NULL),
+    m_sampleRate(0),
+    m_numChannels(0),
+    m_bitsPerSample(0),
+    m_totalFrames(0),
+    m_maxBlockSize(0),
+    m_blockFrames(0),
+    m_blockPosition(0),
+    m_readBuffer(new unsigned char[DECODER_READ_BYTES]),
+    m_readBufferFill(0),
+    m_readBufferPosition(0),
+    m_bitAccumulator(0),
+    m_bitCount(0),
+    m_endOfStream(false),
+    m_crc16(0),
+    m_crc8(0)
+{
+    for (int i = 0; i < LOSSLESS_MAX_CHANNELS; i++)
+    {
+        m_block[i] = NULL;
+    }
+}
+
+LosslessDecoder::~LosslessDecoder()
+{
+    close();
+    delete[] m_readBuffer;
+    m_readBuffer = NULL;
+}
+
+bool LosslessDecoder::open(const char* path)
+{
+    close();
+    
+    m_file = fopen(path, "rb");
+    if (m_file == NULL)
+    {
+        printf("LosslessDecoder::open could not open %s\n", path);
+        return false;
+    }
+    
+    if (get_bits(32) != 0x664C6143) // "fLaC"
+    {
+        printf("LosslessDecoder::open %s is not a FLAC file\n", path);
+        close();
+        return false;
+    }
+    
+    // metadata blocks - only STREAMINFO matters to us
+    bool isLast = false;
+    bool foundStreamInfo = false;
+    while (!isLast && !m_endOfStream)
+    {
+        isLast = get_bits(1) != 0;
+        uint32_t type = get_bits(7);
+        uint32_t length = get_bits(24);
+        if (type == 0 && length >= STREAMINFO_BYTES)
+        {
+            get_bits(16); // min block size
+            m_maxBlockSize = get_bits(16);
+            get_bits(24); // min frame size
+            get_bits(24); // max frame size
+            m_sampleRate = get_bits(20);
+            m_numChannels = get_bits(3) + 1;
+            m_bitsPerSample = get_bits(5) + 1;
+            m_totalFrames = ((uint64_t)get_bits(4) << 32) | get_bits(32);
+            length -= 18;
+            foundStreamInfo = true;
+        }
+        while (length-- > 0 && !m_endOfStream)
+        {
+            get_bits(8);
+        }
+    }
+    
+    if (!foundStreamInfo || m_endOfStream || m_numChannels > LOSSLESS_MAX_CHANNELS || m_bitsPerSample > 32)
+    {
+        printf("LosslessDecoder::open %s has no usable stream header\n", path);
+        close();
+        return false;
+    }
+    
+    if (m_maxBlockSize < 16)
+    {
+        m_maxBlockSize = 65536;
+    }
+    for (int channel = 0; channel < m_numChannels; channel++)
+    {
+        m_block[channel] = new int32_t[m_maxBlockSize];
+    }
+    return true;
+}
+
+void LosslessDecoder::close()
+{
+    if (m_file != NULL)
+    {
+        fclose(m_file);
+        m_file = NULL;
+    }
+    for (int i = 0; i < LOSSLESS_MAX_CHANNELS; i++)
+    {
+        delete[] m_block[i];
+        m_block[i] = NULL;
+    }
+    m_sampleRate = 0;
+    m_numChannels = 0;
+    m_bitsPerSample = 0;
+    m_totalFrames = 0;
+    m_maxBlockSize = 0;
+    m_blockFrames = 0;
+    m_blockPosition = 0;
+    m_readBufferFill = 0;
+    m_readBufferPosition = 0;
+    m_bitAccumulator = 0;
+    m_bitCount = 0;
+    m_endOfStream = false;
+}
+
+uint32_t LosslessDecoder::readInt(int32_t* samples, uint32_t numFrames)
+{
+    uint32_t numFramesRead = 0;
+    while (numFramesRead < numFrames && m_file != NULL)
+    {
+        if (m_blockPosition == m_blockFrames && !decode_next_frame())
+        {
+            break;
+        }
+        
+        uint32_t count = m_blockFrames - m_blockPosition;
+        if (count > numFrames - numFramesRead)
+        {
+            count = numFrames - numFramesRead;
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            for (int channel = 0; channel < m_numChannels; channel++)
+            {
+                *samples++ = m_block[channel][m_blockPosition + i];
+            }
+        }
+        m_blockPosition += count;
+        numFramesRead += count;
+    }
+    return numFramesRead;
+}
+
+uint32_t LosslessDecoder::readFloat(float* samples, uint32_t numFrames)
+{
+    // decode in place - an int32_t is the same size as a float
+    int32_t* ints = (int32_t*)samples;
+    uint32_t numFramesRead = readInt(ints, numFrames);
+    
+    float scale = 1.0f / (float)(1u << (m_bitsPerSample - 1));
+    for (uint32_t i = 0; i < numFramesRead * m_numChannels; i++)
+    {
+        samples[i] = ints[i] * scale;
+    }
+    return numFramesRead;
+}
+
+// ---- LosslessDecoder private methods ----
+
+bool LosslessDecoder::decode_next_frame()
+{
+    m_blockFrames = 0;
+    m_blockPosition = 0;
+    
+    // frames are byte aligned
+    align_to_byte();
+    m_crc8 = 0;
+    m_crc16 = 0;
+    
+    uint32_t sync = get_bits(16);
+    if (m_endOfStream)
+    {
+        return false;
+    }
+    if ((sync & 0xFFFE) != 0xFFF8)
+    {
+        printf("LosslessDecoder::decode_next_frame lost sync\n");
+        return false;
+    }
+    
+    uint32_t blockCode = get_bits(4);
+    uint32_t rateCode = get_bits(4);
+    uint32_t assignment = get_bits(4);
+    uint32_t sizeCode = get_bits(3);
+    get_bits(1);
+    
+    // frame or sample number, UTF-8 style - we don't need its value
+    uint32_t first = get_bits(8);
+    for (uint32_t mask = 0x80; (first & mask) && mask > 0x01; mask >>= 1)
+    {
+        if (mask != 0x80)
+        {
+            get_bits(8);
+        }
+    }
+    
+    uint32_t numFrames = 0;
+    if (blockCode == 1)
+    {
+        numFrames = 192;
+    }
+    else if (blockCode >= 2 && blockCode <= 5)
+    {
+        numFrames = 576 << (blockCode - 2);
+    }
+    else if (blockCode == 6)
+    {
+        numFrames = get_bits(8) + 1;
+    }
+    else if (blockCode == 7)
+    {
+        numFrames = get_bits(16) + 1;
+    }
+    else if (blockCode >= 8)
+    {
+        numFrames = 256 << (blockCode - 8);
+    }
+    
+    if (rateCode == 12)
+    {
+        get_bits(8);
+    }
+    else if (rateCode == 13 || rateCode == 14)
+    {
+        get_bits(16);
+    }
+    
+    static const int sampleSizes[8] = { 0, 8, 12, 0, 16, 20, 24, 32 };
+    int bitsPerSample = (sizeCode == 0) ? m_bitsPerSample : sampleSizes[sizeCode];
+    int numChannels = (assignment < 8) ? (int)assignment + 1 : 2;
+    
+    uint8_t expectedCrc8 = m_crc8;
+    if (get_bits(8) != expectedCrc8 || numFrames == 0 || numFrames > m_maxBlockSize 
+        || numChannels != m_numChannels || bitsPerSample == 0 || assignment > CHANNELS_MID_SIDE)
+    {
+        printf("LosslessDecoder::decode_next_frame bad frame header\n");
+        return false;
+    }
+    
+    for (int channel = 0; channel < numChannels; channel++)
+    {
+        bool isSide = (assignment == CHANNELS_LEFT_SIDE && channel == 1) 
+                   || (assignment == CHANNELS_SIDE_RIGHT && channel == 0) 
+                   || (assignment == CHANNELS_MID_SIDE && channel == 1);
+        if (!decode_subframe(channel, bitsPerSample + (isSide ? 1 : 0), numFrames))
+        {
+            printf("LosslessDecoder::decode_next_frame bad subframe\n");
+            return false;
+        }
+    }
+    
+    align_to_byte();
+    uint16_t expectedCrc16 = m_crc16;
+    if (get_bits(16) != expectedCrc16)
+    {
+        printf("LosslessDecoder::decode_next_frame CRC mismatch\n");
+        return false;
+    }
+    
+    // undo the stereo decorrelation
+    int32_t* left = m_block[0];
+    int32_t* right = (numChannels > 1) ? m_block[1] : NULL;
+    for (uint32_t i = 0; i < numFrames && assignment >= 8; i++)
+    {
+        if (assignment == CHANNELS_LEFT_SIDE)
+        {
+            right[i] = left[i] - right[i];
+        }
+        else if (assignment == CHANNELS_SIDE_RIGHT)
+        {
+            left[i] += right[i];
+        }
+        else
+        {
+            int32_t side = right[i];
+            int32_t mid = (left[i] << 1) | (side & 1);
+            left[i] = (mid + side) >> 1;
+            right[i] = (mid - side) >> 1;
+        }
+    }
+    
+    m_blockFrames = numFrames;
+    return true;
+}
+
+bool LosslessDecoder::decode_subframe(int channel, int bitsPerSample, uint32_t numFrames)
+{
+    int32_t* x = m_block[channel];
+    
+    get_bits(1); // zero padding
+    uint32_t type = get_bits(6);
+    int wastedBits = 0;
+    if (get_bits(1))
+    {
+        wastedBits = get_unary() + 1;
+        bitsPerSample -= wastedBits;
+    }
+    
+    if (type == SUBFRAME_CONSTANT)
+    {
+        int32_t value = get_signed_bits(bitsPerSample);
+        for (uint32_t i = 0; i < numFrames; i++)
+        {
+            x[i] = value;
+        }
+    }
+    else if (type == SUBFRAME_VERBATIM)
+    {
+        for (uint32_t i = 0; i < numFrames; i++)
+        {
+            x[i] = get_signed_bits(bitsPerSample);
+        }
+    }
+    else if ((type & 0x38) == SUBFRAME_FIXED && (type & 0x07) <= LOSSLESS_MAX_FIXED_ORDER)
+    {
+        int order = type & 0x07;
+        for (int i = 0; i < order; i++)
+        {
+            x[i] = get_signed_bits(bitsPerSample);
+        }
+        if (!decode_residual(x, order, numFrames))
+        {
+            return false;
+        }
+        for (uint32_t i = order; i < numFrames; i++)
+        {
+            switch (order)
+            {
+                case 1: x[i] += x[i-1]; break;
+                case 2: x[i] += 2 * x[i-1] - x[i-2]; break;
+                case 3: x[i] += 3 * x[i-1] - 3 * x[i-2] + x[i-3]; break;
+                case 4: x[i] += 4 * x[i-1] - 6 * x[i-2] + 4 * x[i-3] - x[i-4]; break;
+            }
+        }
+    }
+    else if (type & SUBFRAME_LPC)
+    {
+        int order = (type & 0x1F) + 1;
+        for (int i = 0; i < order; i++)
+        {
+            x[i] = get_signed_bits(bitsPerSample);
+        }
+        int precision = get_bits(4) + 1;
+        int shift = get_signed_bits(5);
+        if (precision == 16 || shift < 0)
+        {
+            return false;
+        }
+        int32_t coefficients[32];
+        for (int j = 0; j < order; j++)
+        {
+            coefficients[j] = get_signed_bits(precision);
+        }
+        if (!decode_residual(x, order, numFrames))
+        {
+            return false;
+        }
+        for (uint32_t i = order; i < numFrames; i++)
+        {
+            int64_t prediction = 0;
+            for (int j = 0; j < order; j++)
+            {
+                prediction += (int64_t)coefficients[j] * x[i - j - 1];
+            }
+            x[i] += (int32_t)(prediction >> shift);
+        }
+    }
+    else
+    {
+        return false;
+    }
+    
+    if (wastedBits > 0)
+    {
+        for (uint32_t i = 0; i < numFrames; i++)
+        {
+            x[i] <<= wastedBits;
+        }
+    }
+    return !m_endOfStream;
+}
+
+bool LosslessDecoder::decode_residual(int32_t* residual, int predictorOrder, uint32_t numFrames)
+{
+    uint32_t method = get_bits(2);
+    if (method > 1)
+    {
+        return false;
+    }
+    int parameterBits = (method == 0) ? 4 : 5;
+    uint32_t escape = (1u << parameterBits) - 1;
+    
+    uint32_t partitionOrder = get_bits(4);
+    uint32_t partitionSize = numFrames >> partitionOrder;
+    if ((partitionSize << partitionOrder) != numFrames || partitionSize < (uint32_t)predictorOrder)
+    {
+        return false;
+    }
+    
+    uint32_t sample = predictorOrder;
+    for (uint32_t partition = 0; partition < (1u << partitionOrder); partition++)
+    {
+        uint32_t end = (partition + 1) * partitionSize;
+        uint32_t parameter = get_bits(parameterBits);
+        if (parameter == escape)
+        {
+            int numBits = get_bits(5);
+            for (; sample < end; sample++)
+            {
+                residual[sample] = (numBits > 0) ? get_signed_bits(numBits) : 0;
+            }
+        }
+        else
+        {
+            for (; sample < end; sample++)
+            {
+                uint32_t folded = (get_unary() << parameter) | get_bits(parameter);
+                residual[sample] = (int32_t)(folded >> 1) ^ -(int32_t)(folded & 1);
+            }
+        }
+        if (m_endOfStream)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LosslessDecoder::fill(int numBits)
+{
+    // take only the bytes needed, so a byte aligned reader has nothing buffered past its position
+    while (m_bitCount < numBits)
+    {
+        if (m_readBufferPosition == m_readBufferFill)
+        {
+            m_readBufferFill = (m_file != NULL) ? (uint32_t)fread(m_readBuffer, 1, DECODER_READ_BYTES, m_file) : 0;
+            m_readBufferPosition = 0;
+            if (m_readBufferFill == 0)
+            {
+                m_endOfStream = true;
+                return false;
+            }
+        }
+        uint8_t byte = m_readBuffer[m_readBufferPosition++];
+        m_crc8 = update_crc8(m_crc8, byte);
+        m_crc16 = update_crc16(m_crc16, byte);
+        m_bitAccumulator = (m_bitAccumulator << 8) | byte;
+        m_bitCount += 8;
+    }
+    return true;
+}
+
+uint32_t LosslessDecoder::get_bits(int numBits)
+{
+    if (numBits == 0 || !fill(numBits))
+    {
+        return 0;
+    }
+    m_bitCount -= numBits;
+    uint64_t value = m_bitAccumulator >> m_bitCount;
+    return (numBits < 32) ? (uint32_t)(value & ((1u << numBits) - 1)) : (uint32_t)value;
+}
+
+int32_t LosslessDecoder::get_signed_bits(int numBits)
+{
+    uint32_t value = get_bits(numBits);
+    if (numBits > 0 && numBits < 32 && (value & (1u << (numBits - 1))))
+    {
+        value |= ~((1u << numBits) - 1);
+    }
+    return (int32_t)value;
+}
+
+uint32_t LosslessDecoder::get_unary()
+{
+    uint32_t count = 0;
+    while (true)
+    {
+        if (m_bitCount == 0 && !fill(8))
+        {
+            return count;
+        }
+        uint32_t bits = (uint32_t)(m_bitAccumulator & ((1u << m_bitCount) - 1));
+        if (bits == 0)
+        {
+            count += m_bitCount;
+            m_bitCount = 0;
+            continue;
+        }
+        
+        // leading zeros within the m_bitCount unread bits
+        int highestBit = 31 - __builtin_clz(bits);
+        count += m_bitCount - 1 - highestBit;
+        m_bitCount = highestBit;
+        return count;
+    }
+}
+
+void LosslessDecoder::align_to_byte()
+{
+    m_bitCount -= m_bitCount % 8;
+}
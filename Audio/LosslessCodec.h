@@ -0,0 +1,294 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/**
+ *  @file LosslessCodec.h
+ *  iDiMP
+ *
+ *  The interfaces for the LosslessEncoder and LosslessDecoder classes are defined here.
+ */
+
+#ifndef LOSSLESS_CODEC_H
+#define LOSSLESS_CODEC_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+static const uint32_t LOSSLESS_BLOCK_SIZE           = 4096; ///< Frames per compressed block
+static const int      LOSSLESS_MAX_CHANNELS         = 8;    ///< Most channels a stream may have
+static const int      LOSSLESS_MAX_FIXED_ORDER      = 4;    ///< Highest order fixed polynomial predictor
+static const int      LOSSLESS_MAX_LPC_ORDER        = 12;   ///< Highest order LPC predictor (the FLAC subset limit for <= 48 kHz)
+static const int      LOSSLESS_LPC_PRECISION        = 12;   ///< Bits per quantized LPC coefficient
+static const int      LOSSLESS_MAX_PARTITION_ORDER  = 6;    ///< Most residual partitions is 2^this
+static const int      LOSSLESS_DEFAULT_NUM_THREADS  = 2;    ///< Default number of encoder worker threads
+static const int      LOSSLESS_MAX_PENDING_BLOCKS   = 8;    ///< Blocks which may be queued for or held by the workers
+
+/** LosslessEncoder class.
+ * LosslessEncoder compresses PCM audio into a FLAC stream: each block is predicted with the best 
+ * of several fixed polynomial and LPC predictors, and the prediction residual is Rice coded.
+ * Typical music and speech recordings come out at roughly half their PCM size, and any FLAC 
+ * decoder (or LosslessDecoder) can play the result.
+ *
+ * Blocks are independent, so they are encoded in parallel on worker threads and written to the 
+ * file in order by the thread calling write.  The encoder does file I/O and must not be used 
+ * from the audio thread (see AsyncWavefileWriter).
+ */
+class LosslessEncoder
+{
+public:
+   /**
+    * LosslessEncoder constructor.  Use open to start a stream.
+    * @param numThreads the number of worker threads - 0 encodes on the calling thread
+    */
+    LosslessEncoder(int numThreads = LOSSLESS_DEFAULT_NUM_THREADS);
+    
+   /**
+    * LosslessEncoder destructor.  Closes the stream.
+    */
+    ~LosslessEncoder();
+    
+   /**
+    * Create a FLAC file.  If the file already exists, it will be overwritten.
+    * @param path the path of the file to create
+    * @param sampleRate the sample rate in Hz
+    * @param numChannels the number of channels (1 to LOSSLESS_MAX_CHANNELS)
+    * @param bitsPerSample the sample resolution (8 to 24)
+    * @return true if the file was created
+    */
+    bool open(const char* path, uint32_t sampleRate, int numChannels, int bitsPerSample);
+    
+   /**
+    * Encode everything still buffered, finish the stream header, and close the file.
+    * Closing an encoder which is not open does nothing.
+    */
+    void close();
+    
+   /**
+    * @return true if a stream is open
+    */
+    bool isOpen() const { return m_file != NULL; }
+    
+   /**
+    * Append interleaved 16-bit samples.  If the stream has a higher resolution they are scaled up.
+    * @param samples the samples to encode
+    * @param numFrames the number of frames
+    * @return true if successful
+    */
+    bool writeShort(const short* samples, uint32_t numFrames);
+    
+   /**
+    * Append interleaved samples which are already at the stream's resolution.
+    * @param samples the samples to encode, right justified
+    * @param numFrames the number of frames
+    * @return true if successful
+    */
+    bool writeInt(const int32_t* samples, uint32_t numFrames);
+    
+   /**
+    * @return the number of frames written so far
+    */
+    uint64_t getNumFrames() const { return m_numFrames; }
+    
+   /**
+    * @return the number of compressed bytes written so far
+    */
+    uint64_t getNumBytesWritten() const { return m_numBytesWritten; }
+    
+   /**
+    * Encode one block into a FLAC frame.  Does no I/O and uses no shared state, so it may be 
+    * called from any thread.
+    * @param channels one array of numFrames samples per channel
+    * @param numChannels the number of channels
+    * @param numFrames the number of frames (1 to 65536)
+    * @param bitsPerSample the sample resolution
+    * @param sampleRate the sample rate, used only to pick a frame header code
+    * @param frameNumber the index of this block in the stream
+    * @param output receives the frame - must hold at least getMaxFrameBytes(numChannels, numFrames, bitsPerSample) bytes
+    * @return the number of bytes written to output
+    */
+    static uint32_t encodeFrame(int32_t* const* channels, int numChannels, uint32_t numFrames, int bitsPerSample, 
+                                uint32_t sampleRate, uint64_t frameNumber, unsigned char* output);
+    
+   /**
+    * @return an upper bound on the size of a frame produced by encodeFrame
+    */
+    static uint32_t getMaxFrameBytes(int numChannels, uint32_t numFrames, int bitsPerSample);
+    
+private:
+    LosslessEncoder(const LosslessEncoder&);
+    LosslessEncoder& operator= (const LosslessEncoder&);
+    
+    /** the life cycle of a BlockJob */
+    enum JobState
+    {
+        JobFree = 0,  /*!< available to the writing thread */
+        JobFilling,   /*!< being filled with samples by the writing thread */
+        JobReady,     /*!< waiting for a worker */
+        JobEncoding,  /*!< being encoded by a worker */
+        JobDone       /*!< encoded and waiting to be written to the file */
+    };
+    
+    /** one block of audio on its way through the workers */
+    struct BlockJob
+    {
+        int32_t* samples;        ///< planar input, LOSSLESS_BLOCK_SIZE per channel
+        uint32_t numFrames;      ///< frames in samples
+        uint64_t frameNumber;    ///< index of this block in the stream
+        unsigned char* output;   ///< the encoded frame
+        uint32_t outputBytes;    ///< bytes in output
+        JobState state;
+    };
+    
+    static void* worker_thread_main(void* arg);
+    void run_worker();
+    void encode_job(BlockJob& job);
+    BlockJob& get_filling_job();
+    bool submit_filling_job();
+    bool write_finished_jobs(bool waitForAll);
+    bool write_stream_header();
+    
+    FILE* m_file;
+    uint32_t m_sampleRate;
+    int m_numChannels;
+    int m_bitsPerSample;
+    uint64_t m_numFrames;
+    uint64_t m_numBytesWritten;
+    uint32_t m_minFrameBytes;
+    uint32_t m_maxFrameBytes;
+    
+    BlockJob m_jobs[LOSSLESS_MAX_PENDING_BLOCKS];
+    uint64_t m_submitIndex;  ///< the job being filled is m_jobs[m_submitIndex % LOSSLESS_MAX_PENDING_BLOCKS]
+    uint64_t m_writeIndex;   ///< the next job to be written to the file
+    bool m_ioError;
+    
+    int m_numThreads;
+    pthread_t* m_threads;
+    pthread_mutex_t m_jobLock;
+    pthread_cond_t m_jobReady;
+    pthread_cond_t m_jobDone;
+    bool m_workersRunning;
+};
+
+/** LosslessDecoder class.
+ * LosslessDecoder plays back FLAC streams, including (but not limited to) those written by 
+ * LosslessEncoder.  Like PortableWavefile, it does file I/O and must not be used from the audio thread.
+ */
+class LosslessDecoder
+{
+public:
+   /**
+    * LosslessDecoder constructor.  Use open to start decoding a file.
+    */
+    LosslessDecoder();
+    
+   /**
+    * LosslessDecoder destructor.  Closes the file.
+    */
+    ~LosslessDecoder();
+    
+   /**
+    * Open a FLAC file and read its stream header.
+    * @param path the path of the file
+    * @return true if successful
+    */
+    bool open(const char* path);
+    
+   /**
+    * Close the file.
+    */
+    void close();
+    
+   /**
+    * @return the sample rate of the stream
+    */
+    uint32_t getSampleRate() const { return m_sampleRate; }
+    
+   /**
+    * @return the number of channels in the stream
+    */
+    int getNumChannels() const { return m_numChannels; }
+    
+   /**
+    * @return the sample resolution of the stream
+    */
+    int getBitsPerSample() const { return m_bitsPerSample; }
+    
+   /**
+    * @return the total number of frames according to the stream header, or 0 if it is unknown
+    */
+    uint64_t getNumFrames() const { return m_totalFrames; }
+    
+   /**
+    * Decode interleaved samples, converting to floats in the range [-1.0, 1.0].
+    * @param samples the buffer to receive the samples - must hold numFrames * getNumChannels() floats
+    * @param numFrames the maximum number of frames to decode
+    * @return the number of frames decoded, which is less than numFrames at the end of the stream or on an error
+    */
+    uint32_t readFloat(float* samples, uint32_t numFrames);
+    
+   /**
+    * Decode interleaved samples at the stream's resolution.
+    * @param samples the buffer to receive the samples - must hold numFrames * getNumChannels() values
+    * @param numFrames the maximum number of frames to decode
+    * @return the number of frames decoded, which is less than numFrames at the end of the stream or on an error
+    */
+    uint32_t readInt(int32_t* samples, uint32_t numFrames);
+    
+private:
+    LosslessDecoder(const LosslessDecoder&);
+    LosslessDecoder& operator= (const LosslessDecoder&);
+    
+    bool decode_next_frame();
+    bool decode_subframe(int channel, int bitsPerSample, uint32_t numFrames);
+    bool decode_residual(int32_t* residual, int predictorOrder, uint32_t numFrames);
+    
+    // bit reader over the file
+    bool fill(int numBits);
+    uint32_t get_bits(int numBits);
+    int32_t get_signed_bits(int numBits);
+    uint32_t get_unary();
+    void align_to_byte();
+    
+    FILE* m_file;
+    uint32_t m_sampleRate;
+    int m_numChannels;
+    int m_bitsPerSample;
+    uint64_t m_totalFrames;
+    uint32_t m_maxBlockSize;
+    
+    int32_t* m_block[LOSSLESS_MAX_CHANNELS];
+    uint32_t m_blockFrames;
+    uint32_t m_blockPosition;
+    
+    unsigned char* m_readBuffer;
+    uint32_t m_readBufferFill;
+    uint32_t m_readBufferPosition;
+    uint64_t m_bitAccumulator;
+    int m_bitCount;
+    bool m_endOfStream;
+    uint16_t m_crc16;
+    uint8_t m_crc8;
+};
+
+#endif // LOSSLESS_CODEC_H
@@ -42,14 +42,14 @@ Oscillator::Oscillator() :
     m_amp(DEFAULT_AMPLITUDE),
     m_oldAmp(DEFAULT_AMPLITUDE)
 {
-    printf("Oscillator::Oscillator\n");
+    RT_LOG("Oscillator::Oscillator\n");
     m_wavetable = new float[WAVETABLE_POINTS];
     setWaveform(m_waveform);
 }
 
 Oscillator::~Oscillator()
 {
-    printf("Oscillator::~Oscillator\n");
+    RT_LOG("Oscillator::~Oscillator\n");
     if (m_wavetable != NULL)
     {
         delete m_wavetable;
@@ -70,7 +70,7 @@ void Oscillator::setFreq(float freq)
     // check for valid range
     if (freq < -20000 || freq > 20000)
     {
-        printf("Oscillator::setFreq frequency out of range: %f\n", freq);
+        RT_LOG("Oscillator::setFreq frequency out of range: %f\n", freq);
         return;
     }
     m_freq = freq;
@@ -34,6 +34,7 @@
 #define OSCILLATOR_H
 
 #import "AudioBasics.h"
+#import "RealtimeLog.h"
 
 static const float DEFAULT_FREQUENCY_IN_HZ  = 440.0; ///< Default (initial) Oscillator frequency in Hz
 static const float DEFAULT_AMPLITUDE = 1.0;          ///< Default (initial) Oscillator amplitude in Hz
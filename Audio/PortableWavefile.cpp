@@ -0,0 +1,682 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/*
+ *  PortableWavefile.cpp
+ *  iDiMP
+ *
+ */
+
+#include "PortableWavefile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint32_t SCRATCH_BYTES           = 64 * 1024;  ///< size of the buffer used for sample format conversion
+static const uint32_t RIFF_HEADER_BYTES       = 12;         ///< "RIFF" + size + "WAVE"
+static const uint32_t CHUNK_HEADER_BYTES      = 8;          ///< chunk ID + chunk size
+static const uint32_t DS64_BODY_BYTES         = 28;         ///< RIFF size, data size, sample count (64 bits each), table length
+static const uint32_t MAX_HEADER_BYTES        = 128;        ///< more than enough for any header this class writes
+static const uint64_t MAX_RIFF_SIZE           = 0xFFFFFFFFULL; ///< largest size a 32-bit RIFF field can hold
+static const uint16_t WAVE_FORMAT_PCM         = 0x0001;
+static const uint16_t WAVE_FORMAT_IEEE_FLOAT  = 0x0003;
+static const uint16_t WAVE_FORMAT_EXTENSIBLE  = 0xFFFE;
+
+// ---- little endian helpers
+
+static void put_u16(unsigned char* p, uint16_t value)
+{
+    p[0] = (unsigned char)(value);
+    p[1] = (unsigned char)(value >> 8);
+}
+
+static void put_u32(unsigned char* p, uint32_t value)
+{
+    p[0] = (unsigned char)(value);
+    p[1] = (unsigned char)(value >> 8);
+    p[2] = (unsigned char)(value >> 16);
+    p[3] = (unsigned char)(value >> 24);
+}
+
+static void put_u64(unsigned char* p, uint64_t value)
+{
+    put_u32(p, (uint32_t)value);
+    put_u32(p + 4, (uint32_t)(value >> 32));
+}
+
+static uint16_t get_u16(const unsigned char* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const unsigned char* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_u64(const unsigned char* p)
+{
+    return (uint64_t)get_u32(p) | ((uint64_t)get_u32(p + 4) << 32);
+}
+
+static int32_t float_to_int(float sample, double scale)
+{
+    double value = sample * scale;
+    if (value > scale - 1.0)
+    {
+        value = scale - 1.0;
+    }
+    else if (value < -scale)
+    {
+        value = -scale;
+    }
+    // round to nearest
+    return (int32_t)(value < 0.0 ? value - 0.5 : value + 0.5);
+}
+
+// ---- PortableWavefile public methods ----
+
+PortableWavefile::PortableWavefile() :
+    m_fd(-1),
+    m_buffer(NULL),
+    m_scratch(new unsigned char[SCRATCH_BYTES])
+{
+    reset();
+}
+
+PortableWavefile::~PortableWavefile()
+{
+    close();
+    delete[] m_scratch;
+    m_scratch = NULL;
+}
+
+int PortableWavefile::getBytesPerSample(SampleFormat format)
+{
+    switch (format)
+    {
+        case Int16:   return 2;
+        case Int24:   return 3;
+        case Int32:   return 4;
+        case Float32: return 4;
+    }
+    return 0;
+}
+
+bool PortableWavefile::openForWriting(const char* path, uint32_t sampleRate, int numChannels, SampleFormat format)
+{
+    close();
+    
+    if (numChannels <= 0 || sampleRate == 0)
+    {
+        printf("PortableWavefile::openForWriting invalid format (%d channels at %u Hz)\n", numChannels, sampleRate);
+        return false;
+    }
+    
+    void* buffer = NULL;
+    if (posix_memalign(&buffer, PORTABLE_WAVEFILE_IO_ALIGNMENT, PORTABLE_WAVEFILE_IO_BUFFER_BYTES) != 0)
+    {
+        printf("PortableWavefile::openForWriting could not allocate I/O buffer\n");
+        return false;
+    }
+    
+    m_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0)
+    {
+        printf("PortableWavefile::openForWriting error creating %s: %s\n", path, strerror(errno));
+        free(buffer);
+        return false;
+    }
+    
+    m_buffer = (unsigned char*)buffer;
+    m_isWriting = true;
+    m_sampleRate = sampleRate;
+    m_numChannels = numChannels;
+    m_format = format;
+    m_bytesPerFrame = numChannels * getBytesPerSample(format);
+    
+    // header goes at the start of the first buffer, so sample data follows it with no extra write
+    m_dataOffset = RIFF_HEADER_BYTES + CHUNK_HEADER_BYTES + DS64_BODY_BYTES 
+                 + CHUNK_HEADER_BYTES + (format == Float32 ? 18 : 16)
+                 + CHUNK_HEADER_BYTES;
+    m_bufferFill = (uint32_t)m_dataOffset;
+    return write_header();
+}
+
+bool PortableWavefile::openForReading(const char* path)
+{
+    close();
+    
+    m_fd = open(path, O_RDONLY);
+    if (m_fd < 0)
+    {
+        printf("PortableWavefile::openForReading error opening %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    
+    if (!parse_header())
+    {
+        printf("PortableWavefile::openForReading %s is not a supported WAV file\n", path);
+        close();
+        return false;
+    }
+    return true;
+}
+
+void PortableWavefile::close()
+{
+    if (m_fd < 0)
+    {
+        return;
+    }
+    
+    if (m_isWriting)
+    {
+        // RIFF chunks must have an even size
+        if (m_dataBytes & 1)
+        {
+            unsigned char pad = 0;
+            writeBytes(&pad, 1);
+            m_dataBytes--;
+        }
+        updateHeader();
+    }
+    
+    ::close(m_fd);
+    free(m_buffer);
+    reset();
+}
+
+bool PortableWavefile::writeFloat(const float* samples, uint32_t numFrames)
+{
+    int bytesPerSample = getBytesPerSample(m_format);
+    uint32_t samplesPerPass = SCRATCH_BYTES / bytesPerSample;
+    uint32_t numSamples = numFrames * m_numChannels;
+    
+    while (numSamples > 0)
+    {
+        uint32_t count = (numSamples < samplesPerPass) ? numSamples : samplesPerPass;
+        unsigned char* out = m_scratch;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            switch (m_format)
+            {
+                case Int16:
+                    put_u16(out, (uint16_t)float_to_int(samples[i], 32768.0));
+                    break;
+                case Int24:
+                {
+                    uint32_t value = (uint32_t)float_to_int(samples[i], 8388608.0);
+                    out[0] = (unsigned char)(value);
+                    out[1] = (unsigned char)(value >> 8);
+                    out[2] = (unsigned char)(value >> 16);
+                    break;
+                }
+                case Int32:
+                    put_u32(out, (uint32_t)float_to_int(samples[i], 2147483648.0));
+                    break;
+                case Float32:
+                {
+                    uint32_t bits;
+                    memcpy(&bits, &samples[i], 4);
+                    put_u32(out, bits);
+                    break;
+                }
+            }
+            out += bytesPerSample;
+        }
+        if (!writeBytes(m_scratch, count * bytesPerSample))
+        {
+            return false;
+        }
+        samples += count;
+        numSamples -= count;
+    }
+    return true;
+}
+
+bool PortableWavefile::writeShort(const short* samples, uint32_t numFrames)
+{
+    int bytesPerSample = getBytesPerSample(m_format);
+    uint32_t samplesPerPass = SCRATCH_BYTES / bytesPerSample;
+    uint32_t numSamples = numFrames * m_numChannels;
+    
+    while (numSamples > 0)
+    {
+        uint32_t count = (numSamples < samplesPerPass) ? numSamples : samplesPerPass;
+        unsigned char* out = m_scratch;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            // integer formats are left justified, so widening is just a shift
+            uint32_t value = (uint32_t)(int32_t)samples[i];
+            switch (m_format)
+            {
+                case Int16:
+                    put_u16(out, (uint16_t)value);
+                    break;
+                case Int24:
+                    out[0] = 0;
+                    out[1] = (unsigned char)(value);
+                    out[2] = (unsigned char)(value >> 8);
+                    break;
+                case Int32:
+                    put_u32(out, value << 16);
+                    break;
+                case Float32:
+                {
+                    float sample = samples[i] / 32768.0f;
+                    uint32_t bits;
+                    memcpy(&bits, &sample, 4);
+                    put_u32(out, bits);
+                    break;
+                }
+            }
+            out += bytesPerSample;
+        }
+        if (!writeBytes(m_scratch, count * bytesPerSample))
+        {
+            return false;
+        }
+        samples += count;
+        numSamples -= count;
+    }
+    return true;
+}
+
+bool PortableWavefile::writeBytes(const void* data, uint32_t numBytes)
+{
+    if (m_fd < 0 || !m_isWriting)
+    {
+        return false;
+    }
+    
+    const unsigned char* in = (const unsigned char*)data;
+    while (numBytes > 0)
+    {
+        uint32_t count = PORTABLE_WAVEFILE_IO_BUFFER_BYTES - m_bufferFill;
+        if (count > numBytes)
+        {
+            count = numBytes;
+        }
+        memcpy(m_buffer + m_bufferFill, in, count);
+        m_bufferFill += count;
+        m_dataBytes += count;
+        in += count;
+        numBytes -= count;
+        
+        if (m_bufferFill == PORTABLE_WAVEFILE_IO_BUFFER_BYTES && !flush_buffer(false))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PortableWavefile::updateHeader()
+{
+    if (m_fd < 0 || !m_isWriting)
+    {
+        return false;
+    }
+    return flush_buffer(true) && write_header();
+}
+
+uint32_t PortableWavefile::readFloat(float* samples, uint32_t numFrames)
+{
+    if (m_fd < 0 || m_isWriting)
+    {
+        return 0;
+    }
+    
+    uint64_t framesLeft = getNumFrames() - m_readPosition;
+    if (numFrames > framesLeft)
+    {
+        numFrames = (uint32_t)framesLeft;
+    }
+    
+    uint32_t framesPerPass = SCRATCH_BYTES / m_bytesPerFrame;
+    uint32_t numFramesRead = 0;
+    while (numFramesRead < numFrames)
+    {
+        uint32_t count = numFrames - numFramesRead;
+        if (count > framesPerPass)
+        {
+            count = framesPerPass;
+        }
+        if (!read_fully(m_scratch, count * m_bytesPerFrame, m_dataOffset + m_readPosition * m_bytesPerFrame))
+        {
+            break;
+        }
+        convertToFloat(m_format, m_scratch, samples, count * m_numChannels);
+        samples += count * m_numChannels;
+        m_readPosition += count;
+        numFramesRead += count;
+    }
+    return numFramesRead;
+}
+
+void PortableWavefile::seekToFrame(uint64_t frame)
+{
+    m_readPosition = (frame < getNumFrames()) ? frame : getNumFrames();
+}
+
+void PortableWavefile::convertToFloat(SampleFormat format, const void* in, float* out, uint32_t numSamples)
+{
+    const unsigned char* p = (const unsigned char*)in;
+    switch (format)
+    {
+        case Int16:
+            for (uint32_t i = 0; i < numSamples; i++, p += 2)
+            {
+                out[i] = (int16_t)get_u16(p) * (1.0f / 32768.0f);
+            }
+            break;
+        case Int24:
+            for (uint32_t i = 0; i < numSamples; i++, p += 3)
+            {
+                // assemble in the top 24 bits so the sign comes along
+                int32_t value = (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24));
+                out[i] = value * (1.0f / 2147483648.0f);
+            }
+            break;
+        case Int32:
+            for (uint32_t i = 0; i < numSamples; i++, p += 4)
+            {
+                out[i] = (float)((int32_t)get_u32(p) * (1.0 / 2147483648.0));
+            }
+            break;
+        case Float32:
+            for (uint32_t i = 0; i < numSamples; i++, p += 4)
+            {
+                uint32_t bits = get_u32(p);
+                memcpy(&out[i], &bits, 4);
+            }
+            break;
+    }
+}
+
+// ---- PortableWavefile private methods ----
+
+void PortableWavefile::reset()
+{
+    m_fd = -1;
+    m_isWriting = false;
+    m_isRF64 = false;
+    m_sampleRate = 0;
+    m_numChannels = 0;
+    m_format = Int16;
+    m_bytesPerFrame = 1;
+    m_dataOffset = 0;
+    m_dataBytes = 0;
+    m_readPosition = 0;
+    m_buffer = NULL;
+    m_bufferFill = 0;
+    m_bufferFileOffset = 0;
+}
+
+bool PortableWavefile::write_header()
+{
+    unsigned char header[MAX_HEADER_BYTES];
+    memset(header, 0, sizeof(header));
+    
+    uint64_t riffSize = m_dataOffset + m_dataBytes + (m_dataBytes & 1) - 8;
+    
+    // switch to RF64 as soon as either size stops fitting, and never switch back
+    if (riffSize > MAX_RIFF_SIZE || m_dataBytes > MAX_RIFF_SIZE)
+    {
+        m_isRF64 = true;
+    }
+    
+    unsigned char* p = header;
+    memcpy(p, m_isRF64 ? "RF64" : "RIFF", 4);
+    put_u32(p + 4, m_isRF64 ? (uint32_t)MAX_RIFF_SIZE : (uint32_t)riffSize);
+    memcpy(p + 8, "WAVE", 4);
+    p += RIFF_HEADER_BYTES;
+    
+    // reserved space for the ds64 chunk, which is a JUNK chunk until it's needed
+    memcpy(p, m_isRF64 ? "ds64" : "JUNK", 4);
+    put_u32(p + 4, DS64_BODY_BYTES);
+    if (m_isRF64)
+    {
+        put_u64(p + 8, riffSize);
+        put_u64(p + 16, m_dataBytes);
+        put_u64(p + 24, m_dataBytes / m_bytesPerFrame);
+        put_u32(p + 32, 0); // no table entries
+    }
+    p += CHUNK_HEADER_BYTES + DS64_BODY_BYTES;
+    
+    int bytesPerSample = getBytesPerSample(m_format);
+    uint32_t fmtSize = (m_format == Float32) ? 18 : 16;
+    memcpy(p, "fmt ", 4);
+    put_u32(p + 4, fmtSize);
+    put_u16(p + 8, (m_format == Float32) ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM);
+    put_u16(p + 10, (uint16_t)m_numChannels);
+    put_u32(p + 12, m_sampleRate);
+    put_u32(p + 16, m_sampleRate * m_bytesPerFrame);
+    put_u16(p + 20, (uint16_t)m_bytesPerFrame);
+    put_u16(p + 22, (uint16_t)(8 * bytesPerSample));
+    if (fmtSize == 18)
+    {
+        put_u16(p + 24, 0); // no extension
+    }
+    p += CHUNK_HEADER_BYTES + fmtSize;
+    
+    memcpy(p, "data", 4);
+    put_u32(p + 4, m_isRF64 ? (uint32_t)MAX_RIFF_SIZE : (uint32_t)m_dataBytes);
+    p += CHUNK_HEADER_BYTES;
+    
+    size_t headerBytes = p - header;
+    
+    // if the first buffer hasn't gone to disk yet, it holds the header too - keep it current
+    if (m_bufferFileOffset == 0)
+    {
+        memcpy(m_buffer, header, headerBytes);
+    }
+    return write_fully(header, headerBytes, 0);
+}
+
+bool PortableWavefile::flush_buffer(bool keepPartial)
+{
+    if (m_bufferFill == 0)
+    {
+        return true;
+    }
+    
+    if (!write_fully(m_buffer, m_bufferFill, m_bufferFileOffset))
+    {
+        return false;
+    }
+    
+    // a partial buffer stays put so the next write of this region is still a whole aligned buffer
+    if (!(keepPartial && m_bufferFill < PORTABLE_WAVEFILE_IO_BUFFER_BYTES))
+    {
+        m_bufferFileOffset += m_bufferFill;
+        m_bufferFill = 0;
+    }
+    return true;
+}
+
+bool PortableWavefile::write_fully(const void* data, size_t numBytes, off_t offset)
+{
+    const char* p = (const char*)data;
+    while (numBytes > 0)
+    {
+        ssize_t result = pwrite(m_fd, p, numBytes, offset);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            printf("PortableWavefile::write_fully error writing file: %s\n", strerror(errno));
+            return false;
+        }
+        p += result;
+        offset += result;
+        numBytes -= result;
+    }
+    return true;
+}
+
+bool PortableWavefile::read_fully(void* data, size_t numBytes, off_t offset)
+{
+    char* p = (char*)data;
+    while (numBytes > 0)
+    {
+        ssize_t result = pread(m_fd, p, numBytes, offset);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result <= 0)
+        {
+            return false;
+        }
+        p += result;
+        offset += result;
+        numBytes -= result;
+    }
+    return true;
+}
+
+bool PortableWavefile::parse_header()
+{
+    unsigned char riff[RIFF_HEADER_BYTES];
+    if (!read_fully(riff, RIFF_HEADER_BYTES, 0) || memcmp(riff + 8, "WAVE", 4) != 0)
+    {
+        return false;
+    }
+    if (memcmp(riff, "RF64", 4) == 0)
+    {
+        m_isRF64 = true;
+    }
+    else if (memcmp(riff, "RIFF", 4) != 0)
+    {
+        return false;
+    }
+    
+    struct stat fileInfo;
+    if (fstat(m_fd, &fileInfo) != 0)
+    {
+        return false;
+    }
+    uint64_t fileSize = fileInfo.st_size;
+    
+    uint64_t ds64DataSize = 0;
+    bool foundFormat = false;
+    uint64_t offset = RIFF_HEADER_BYTES;
+    while (offset + CHUNK_HEADER_BYTES <= fileSize)
+    {
+        unsigned char chunk[CHUNK_HEADER_BYTES];
+        if (!read_fully(chunk, CHUNK_HEADER_BYTES, offset))
+        {
+            return false;
+        }
+        uint64_t chunkSize = get_u32(chunk + 4);
+        uint64_t body = offset + CHUNK_HEADER_BYTES;
+        
+        if (memcmp(chunk, "ds64", 4) == 0)
+        {
+            unsigned char ds64[DS64_BODY_BYTES];
+            if (chunkSize < 24 || !read_fully(ds64, 24, body))
+            {
+                return false;
+            }
+            ds64DataSize = get_u64(ds64 + 8);
+        }
+        else if (memcmp(chunk, "fmt ", 4) == 0)
+        {
+            unsigned char fmt[40];
+            memset(fmt, 0, sizeof(fmt));
+            if (chunkSize < 16 || !read_fully(fmt, (chunkSize < sizeof(fmt)) ? chunkSize : sizeof(fmt), body))
+            {
+                return false;
+            }
+            uint16_t tag = get_u16(fmt);
+            m_numChannels = get_u16(fmt + 2);
+            m_sampleRate = get_u32(fmt + 4);
+            uint16_t blockAlign = get_u16(fmt + 12);
+            uint16_t bitsPerSample = get_u16(fmt + 14);
+            if (tag == WAVE_FORMAT_EXTENSIBLE && chunkSize >= 40)
+            {
+                // the first two bytes of the sub format GUID are the actual format tag
+                tag = get_u16(fmt + 24);
+            }
+            
+            if (tag == WAVE_FORMAT_PCM && bitsPerSample == 16)
+            {
+                m_format = Int16;
+            }
+            else if (tag == WAVE_FORMAT_PCM && bitsPerSample == 24)
+            {
+                m_format = Int24;
+            }
+            else if (tag == WAVE_FORMAT_PCM && bitsPerSample == 32)
+            {
+                m_format = Int32;
+            }
+            else if (tag == WAVE_FORMAT_IEEE_FLOAT && bitsPerSample == 32)
+            {
+                m_format = Float32;
+            }
+            else
+            {
+                printf("PortableWavefile::parse_header unsupported format %d with %d bits\n", tag, bitsPerSample);
+                return false;
+            }
+            if (m_numChannels == 0 || blockAlign != m_numChannels * getBytesPerSample(m_format))
+            {
+                return false;
+            }
+            m_bytesPerFrame = blockAlign;
+            foundFormat = true;
+        }
+        else if (memcmp(chunk, "data", 4) == 0)
+        {
+            if (!foundFormat)
+            {
+                return false;
+            }
+            m_dataOffset = body;
+            m_dataBytes = (m_isRF64 && chunkSize == MAX_RIFF_SIZE) ? ds64DataSize : chunkSize;
+            
+            // a recording that was never finished has a stale size - trust the file instead
+            uint64_t available = fileSize - body;
+            if (m_dataBytes == 0 || m_dataBytes > available)
+            {
+                m_dataBytes = available;
+            }
+            m_dataBytes -= m_dataBytes % m_bytesPerFrame;
+            return true;
+        }
+        
+        // chunks are padded to an even size
+        offset = body + chunkSize + (chunkSize & 1);
+    }
+    return false;
+}
@@ -0,0 +1,234 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/**
+ *  @file PortableWavefile.h
+ *  iDiMP
+ *
+ *  This file defines the interface for the PortableWavefile class.
+ */
+
+#ifndef PORTABLE_WAVEFILE_H
+#define PORTABLE_WAVEFILE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+static const uint32_t PORTABLE_WAVEFILE_IO_BUFFER_BYTES = 1 << 20; ///< size (and file alignment) of each write to disk
+static const uint32_t PORTABLE_WAVEFILE_IO_ALIGNMENT    = 4096;    ///< memory alignment of the I/O buffer
+
+/** PortableWavefile class.
+ * PortableWavefile reads and writes WAV files using only POSIX file I/O, so unlike Wavefile it 
+ * works without AudioToolbox (e.g. on Linux).  
+ *
+ * Writing streams: the header is written up front with placeholder sizes and back-patched by 
+ * updateHeader() and close(), so a file that is still being recorded (or that was interrupted) 
+ * can be repaired by its size fields.  A JUNK chunk is reserved after the RIFF header, and files 
+ * that grow past 4 GB are converted in place to RF64 (EBU Tech 3306) by turning it into a ds64 chunk.
+ * Sample data is collected in a large aligned buffer that always maps to an aligned region of the 
+ * file, so the disk sees big sequential aligned writes.
+ *
+ * Reading supports RIFF and RF64 files in any of the supported sample formats, including 
+ * WAVE_FORMAT_EXTENSIBLE headers.
+ *
+ * A PortableWavefile is not thread safe, and it does file I/O - keep it off the audio thread.
+ */
+class PortableWavefile
+{
+public:
+   /**
+    * Sample formats which can be read and written.
+    */
+    enum SampleFormat
+    {
+        Int16,   ///< 16-bit signed integer PCM
+        Int24,   ///< 24-bit (packed) signed integer PCM
+        Int32,   ///< 32-bit signed integer PCM
+        Float32  ///< 32-bit IEEE float
+    };
+    
+   /**
+    * PortableWavefile constructor.  Use openForWriting or openForReading before doing anything else.
+    */
+    PortableWavefile();
+    
+   /**
+    * PortableWavefile destructor.  Closes the file (finishing its header if it is being written).
+    */
+    ~PortableWavefile();
+    
+   /**
+    * Create a WAV file for writing.  If the file already exists, it will be overwritten.
+    * @param path the path of the file to create
+    * @param sampleRate the sample rate in Hz
+    * @param numChannels the number of interleaved channels
+    * @param format the sample format to store in the file
+    * @return true if the file was created
+    */
+    bool openForWriting(const char* path, uint32_t sampleRate, int numChannels, SampleFormat format);
+    
+   /**
+    * Open an existing WAV or RF64 file for reading.
+    * @param path the path of the file to open
+    * @return true if the file was opened and its format is supported
+    */
+    bool openForReading(const char* path);
+    
+   /**
+    * Close the file.  When writing, any buffered data is written and the header is finalized.
+    * Closing a file that is not open does nothing.
+    */
+    void close();
+    
+   /**
+    * @return true if a file is open
+    */
+    bool isOpen() const { return m_fd >= 0; }
+    
+   /**
+    * @return true if the open file is being written
+    */
+    bool isWriting() const { return m_isWriting; }
+    
+   /**
+    * @return the sample rate of the open file
+    */
+    uint32_t getSampleRate() const { return m_sampleRate; }
+    
+   /**
+    * @return the number of channels in the open file
+    */
+    int getNumChannels() const { return m_numChannels; }
+    
+   /**
+    * @return the sample format of the open file
+    */
+    SampleFormat getSampleFormat() const { return m_format; }
+    
+   /**
+    * @return the number of bytes in one frame (one sample for every channel)
+    */
+    uint32_t getBytesPerFrame() const { return m_bytesPerFrame; }
+    
+   /**
+    * @return the number of frames in the file (so far, if writing)
+    */
+    uint64_t getNumFrames() const { return m_dataBytes / m_bytesPerFrame; }
+    
+   /**
+    * @return the offset in bytes from the start of the file to the first sample
+    */
+    uint64_t getDataOffset() const { return m_dataOffset; }
+    
+   /**
+    * Append interleaved float samples in the range [-1.0, 1.0], converting to the file's format.
+    * @param samples the samples to write
+    * @param numFrames the number of frames to write
+    * @return true if all frames were written
+    */
+    bool writeFloat(const float* samples, uint32_t numFrames);
+    
+   /**
+    * Append interleaved 16-bit samples, converting to the file's format.
+    * @param samples the samples to write
+    * @param numFrames the number of frames to write
+    * @return true if all frames were written
+    */
+    bool writeShort(const short* samples, uint32_t numFrames);
+    
+   /**
+    * Append sample data which is already in the file's format (little endian, interleaved).
+    * @param data the sample data to write
+    * @param numBytes the number of bytes to write - should be a whole number of frames
+    * @return true if all bytes were written
+    */
+    bool writeBytes(const void* data, uint32_t numBytes);
+    
+   /**
+    * Write any buffered data and back-patch the header sizes, so the file on disk is valid 
+    * up to this point.  This is done automatically by close().
+    * @return true if successful
+    */
+    bool updateHeader();
+    
+   /**
+    * Read interleaved samples from the current read position, converting to floats in the range [-1.0, 1.0].
+    * @param samples the buffer to receive the samples - must hold numFrames * getNumChannels() floats
+    * @param numFrames the maximum number of frames to read
+    * @return the number of frames read, which is less than numFrames at the end of the file
+    */
+    uint32_t readFloat(float* samples, uint32_t numFrames);
+    
+   /**
+    * Move the read position.
+    * @param frame the frame to read next - clamped to the end of the file
+    */
+    void seekToFrame(uint64_t frame);
+    
+   /**
+    * Convert raw sample data from a file in the given format to floats.
+    * @param format the sample format of the data
+    * @param in the little endian sample data
+    * @param out the output floats
+    * @param numSamples the number of samples (not frames) to convert
+    */
+    static void convertToFloat(SampleFormat format, const void* in, float* out, uint32_t numSamples);
+    
+   /**
+    * @param format a sample format
+    * @return the number of bytes in one sample of that format
+    */
+    static int getBytesPerSample(SampleFormat format);
+    
+private:
+    PortableWavefile(const PortableWavefile&);
+    PortableWavefile& operator= (const PortableWavefile&);
+    
+    void reset();
+    bool write_header();
+    bool flush_buffer(bool keepPartial);
+    bool write_fully(const void* data, size_t numBytes, off_t offset);
+    bool read_fully(void* data, size_t numBytes, off_t offset);
+    bool parse_header();
+    
+    int m_fd;
+    bool m_isWriting;
+    bool m_isRF64;
+    uint32_t m_sampleRate;
+    int m_numChannels;
+    SampleFormat m_format;
+    uint32_t m_bytesPerFrame;
+    uint64_t m_dataOffset;
+    uint64_t m_dataBytes;
+    uint64_t m_readPosition;
+    
+    // write buffer - m_buffer[0] always corresponds to file offset m_bufferFileOffset
+    unsigned char* m_buffer;
+    uint32_t m_bufferFill;
+    uint64_t m_bufferFileOffset;
+    
+    // scratch space for format conversion
+    unsigned char* m_scratch;
+};
+
+#endif // PORTABLE_WAVEFILE_H
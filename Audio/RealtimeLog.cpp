@@ -0,0 +1,280 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/*
+ *  RealtimeLog.cpp
+ *  iDiMP
+ *
+ */
+
+#include "RealtimeLog.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static const int RT_LOG_MAX_LINE = 512; ///< longest line the background thread will print
+
+// ---- RealtimeLog public methods ----
+
+RealtimeLog* RealtimeLog::getInstance()
+{
+    static RealtimeLog instance;
+    return &instance;
+}
+
+void RealtimeLog::startDrainThread()
+{
+    pthread_mutex_lock(&m_drainLock);
+    if (!m_drainThreadRunning)
+    {
+        AtomicStore32(&m_drainThreadRunning, 1);
+        if (pthread_create(&m_drainThread, NULL, drain_thread_main, this) != 0)
+        {
+            printf("RealtimeLog::startDrainThread could not create thread\n");
+            AtomicStore32(&m_drainThreadRunning, 0);
+        }
+    }
+    pthread_mutex_unlock(&m_drainLock);
+}
+
+void RealtimeLog::stopDrainThread()
+{
+    pthread_mutex_lock(&m_drainLock);
+    if (m_drainThreadRunning)
+    {
+        AtomicStore32(&m_drainThreadRunning, 0);
+        pthread_join(m_drainThread, NULL);
+    }
+    pthread_mutex_unlock(&m_drainLock);
+    
+    drain();
+}
+
+void RealtimeLog::drain()
+{
+    // single consumer: the drain thread, or whoever stopped it
+    for (;;)
+    {
+        Record& record = m_records[m_readPosition & (RT_LOG_NUM_RECORDS - 1)];
+        if (AtomicLoad32(&record.sequence) != m_readPosition + 1)
+        {
+            // nothing more has been published
+            break;
+        }
+        
+        print_record(record);
+        
+        // hand the slot back to writers for the next lap around the ring
+        AtomicStore32(&record.sequence, m_readPosition + RT_LOG_NUM_RECORDS);
+        m_readPosition++;
+    }
+    
+    int32_t dropped = AtomicLoad32(&m_numDropped);
+    if (dropped > 0)
+    {
+        AtomicAdd32(-dropped, &m_numDropped);
+        printf("RealtimeLog: %d messages dropped (log ring full)\n", dropped);
+    }
+    fflush(stdout);
+}
+
+void RealtimeLog::write(RealtimeLogSite& site, const char* format, int numArgs, const RealtimeLogArg* args)
+{
+    uint64_t now = HostTimeNow();
+    if (site.lastLogTicks != 0 && HostTimeToSeconds(now - site.lastLogTicks) < RT_LOG_MIN_INTERVAL_SECONDS)
+    {
+        AtomicIncrement32(&site.suppressed);
+        return;
+    }
+    site.lastLogTicks = now;
+    
+    // claim a slot (bounded multi-producer ring - each slot's sequence says whose turn it is)
+    int32_t position;
+    Record* record;
+    for (;;)
+    {
+        position = AtomicLoad32(&m_writePosition);
+        record = &m_records[position & (RT_LOG_NUM_RECORDS - 1)];
+        int32_t difference = AtomicLoad32(&record->sequence) - position;
+        if (difference == 0)
+        {
+            if (AtomicCompareAndSwap32(position, position + 1, &m_writePosition))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            // the reader hasn't caught up - drop rather than wait
+            AtomicIncrement32(&m_numDropped);
+            return;
+        }
+    }
+    
+    record->format = format;
+    record->ticks = now;
+    record->suppressed = AtomicAdd32(0, &site.suppressed);
+    AtomicAdd32(-record->suppressed, &site.suppressed);
+    record->numArgs = (numArgs < RT_LOG_MAX_ARGS) ? numArgs : RT_LOG_MAX_ARGS;
+    for (int i = 0; i < record->numArgs; i++)
+    {
+        record->args[i] = args[i];
+    }
+    
+    // publish
+    AtomicStore32(&record->sequence, position + 1);
+}
+
+// ---- RealtimeLog private methods ----
+
+RealtimeLog::RealtimeLog() :
+    m_writePosition(0),
+    m_readPosition(0),
+    m_numDropped(0),
+    m_drainThreadRunning(0)
+{
+    for (int i = 0; i < RT_LOG_NUM_RECORDS; i++)
+    {
+        m_records[i].sequence = i;
+    }
+    pthread_mutex_init(&m_drainLock, NULL);
+}
+
+RealtimeLog::~RealtimeLog()
+{
+    stopDrainThread();
+    pthread_mutex_destroy(&m_drainLock);
+}
+
+void* RealtimeLog::drain_thread_main(void* arg)
+{
+    RealtimeLog* log = (RealtimeLog*)arg;
+    while (AtomicLoad32(&log->m_drainThreadRunning))
+    {
+        log->drain();
+        usleep(RT_LOG_DRAIN_INTERVAL_USEC);
+    }
+    return NULL;
+}
+
+void RealtimeLog::print_record(const Record& record)
+{
+    char line[RT_LOG_MAX_LINE];
+    int length = 0;
+    int argIndex = 0;
+    
+    // walk the format string, formatting one conversion at a time with the stored argument
+    const char* f = record.format;
+    while (*f != '\0' && length < RT_LOG_MAX_LINE - 1)
+    {
+        if (*f != '%')
+        {
+            line[length++] = *f++;
+            continue;
+        }
+        if (f[1] == '%')
+        {
+            line[length++] = '%';
+            f += 2;
+            continue;
+        }
+        
+        // copy flags, width, and precision but drop any length modifier - we supply our own
+        char spec[32];
+        int specLength = 0;
+        spec[specLength++] = *f++;
+        while (*f != '\0' && strchr("-+ #0123456789.", *f) != NULL && specLength < 24)
+        {
+            spec[specLength++] = *f++;
+        }
+        while (*f != '\0' && strchr("hlLqjzt", *f) != NULL)
+        {
+            f++;
+        }
+        char conversion = *f;
+        if (conversion == '\0')
+        {
+            break;
+        }
+        f++;
+        
+        int remaining = RT_LOG_MAX_LINE - length;
+        if (argIndex >= record.numArgs)
+        {
+            length += snprintf(line + length, remaining, "<?>");
+        }
+        else
+        {
+            const RealtimeLogArg& arg = record.args[argIndex++];
+            if (strchr("diouxXc", conversion) != NULL)
+            {
+                if (conversion != 'c')
+                {
+                    spec[specLength++] = 'l';
+                    spec[specLength++] = 'l';
+                }
+                spec[specLength++] = conversion;
+                spec[specLength] = '\0';
+                long long value = (arg.type == RealtimeLogArg::Float) ? (long long)arg.f : 
+                                  (arg.type == RealtimeLogArg::Pointer || arg.type == RealtimeLogArg::String) ? (long long)(uintptr_t)arg.p : arg.i;
+                if (conversion == 'c')
+                {
+                    length += snprintf(line + length, remaining, spec, (int)value);
+                }
+                else
+                {
+                    length += snprintf(line + length, remaining, spec, value);
+                }
+            }
+            else if (strchr("fFeEgGaA", conversion) != NULL)
+            {
+                spec[specLength++] = conversion;
+                spec[specLength] = '\0';
+                double value = (arg.type == RealtimeLogArg::Float) ? arg.f : (double)arg.i;
+                length += snprintf(line + length, remaining, spec, value);
+            }
+            else if (conversion == 's' && arg.type == RealtimeLogArg::String)
+            {
+                spec[specLength++] = conversion;
+                spec[specLength] = '\0';
+                length += snprintf(line + length, remaining, spec, (const char*)arg.p);
+            }
+            else
+            {
+                length += snprintf(line + length, remaining, "%p", arg.p);
+            }
+        }
+        if (length > RT_LOG_MAX_LINE - 1)
+        {
+            length = RT_LOG_MAX_LINE - 1;
+        }
+    }
+    line[length] = '\0';
+    
+    printf("[%.3f] %s", HostTimeToSeconds(record.ticks), line);
+    if (record.suppressed > 0)
+    {
+        printf("  (%d similar messages suppressed)\n", record.suppressed);
+    }
+}
@@ -0,0 +1,206 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/**
+ *  @file RealtimeLog.h
+ *  iDiMP
+ *
+ *  This file defines the interface for the RealtimeLog class and the RT_LOG macro.
+ */
+
+#ifndef REALTIME_LOG_H
+#define REALTIME_LOG_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#import "AtomicOps.h"
+#import "HostTime.h"
+
+static const int    RT_LOG_MAX_ARGS             = 4;      ///< maximum number of arguments to one RT_LOG call
+static const int    RT_LOG_NUM_RECORDS          = 256;    ///< capacity of the log ring (must be a power of two)
+static const double RT_LOG_MIN_INTERVAL_SECONDS = 1.0;    ///< each call site logs at most once per interval; the rest are counted and reported
+static const int    RT_LOG_DRAIN_INTERVAL_USEC  = 50000;  ///< how often the background thread prints queued records
+
+/**
+ * One argument to an RT_LOG call, stored in binary form until it is formatted.
+ */
+struct RealtimeLogArg
+{
+   /**
+    * Enum of the argument types that can be stored.
+    */
+    enum Type {
+        Integer = 0, /*!< any integer type */
+        Unsigned,    /*!< any unsigned integer type */
+        Float,       /*!< float or double */
+        Pointer,     /*!< an object pointer */
+        String       /*!< a string literal or other string that outlives the log */
+    };
+    
+    RealtimeLogArg(int value)            : type(Integer)  { i = value; }
+    RealtimeLogArg(long value)           : type(Integer)  { i = value; }
+    RealtimeLogArg(unsigned int value)   : type(Unsigned) { i = value; }
+    RealtimeLogArg(unsigned long value)  : type(Unsigned) { i = value; }
+    RealtimeLogArg(double value)         : type(Float)    { f = value; }
+    RealtimeLogArg(const void* value)    : type(Pointer)  { p = value; }
+    RealtimeLogArg(const char* value)    : type(String)   { p = value; }
+    RealtimeLogArg()                     : type(Integer)  { i = 0; }
+    
+    Type type; ///< the type of the stored value
+    union
+    {
+        long long i;
+        double f;
+        const void* p;
+    };
+};
+
+/**
+ * Per-call-site state used to rate limit RT_LOG.  One of these is declared (statically) by each RT_LOG.
+ */
+struct RealtimeLogSite
+{
+    uint64_t lastLogTicks;     ///< host time of the last record written from this site
+    volatile int32_t suppressed; ///< number of calls dropped since then
+};
+
+/** RealtimeLog class.
+ * RealtimeLog lets code on the audio thread log without calling printf.  Writing a record copies a 
+ * format string pointer and a few binary arguments into a preallocated lock-free ring; a background 
+ * thread formats and prints them.  Any thread may write.  If the ring is full the record is 
+ * dropped and counted rather than blocking the writer.
+ *
+ * Use the RT_LOG macro rather than calling write() directly.
+ */
+class RealtimeLog
+{
+public:
+   /**
+    * @return A pointer to the singleton instance of RealtimeLog.
+    */
+    static RealtimeLog* getInstance();
+    
+   /**
+    * Start the background thread that prints queued records.  Until this is called records stay
+    * queued (up to RT_LOG_NUM_RECORDS of them).
+    * @see stopDrainThread
+    */
+    void startDrainThread();
+    
+   /**
+    * Stop the background thread, printing anything still queued.
+    * @see startDrainThread
+    */
+    void stopDrainThread();
+    
+   /**
+    * Format and print every queued record on the calling thread.
+    */
+    void drain();
+    
+   /**
+    * Queue a record.  Never blocks and never allocates.
+    * @param site the rate limiting state for the calling site
+    * @param format a printf-style format string - must be a string literal
+    * @param numArgs the number of entries in args
+    * @param args the arguments for format
+    */
+    void write(RealtimeLogSite& site, const char* format, int numArgs, const RealtimeLogArg* args);
+    
+   /**
+    * @return the number of records dropped because the ring was full
+    */
+    int32_t getNumDropped() const { return AtomicLoad32(&m_numDropped); }
+    
+private:
+    RealtimeLog();
+    ~RealtimeLog();
+    RealtimeLog(const RealtimeLog&);
+    RealtimeLog& operator= (const RealtimeLog&);
+    
+    struct Record
+    {
+        volatile int32_t sequence;
+        const char* format;
+        uint64_t ticks;
+        int32_t suppressed;
+        int numArgs;
+        RealtimeLogArg args[RT_LOG_MAX_ARGS];
+    };
+    
+    static void* drain_thread_main(void* arg);
+    
+    static void print_record(const Record& record);
+    
+    Record m_records[RT_LOG_NUM_RECORDS];
+    volatile int32_t m_writePosition;
+    int32_t m_readPosition;
+    volatile int32_t m_numDropped;
+    pthread_t m_drainThread;
+    volatile int32_t m_drainThreadRunning;
+    pthread_mutex_t m_drainLock;
+};
+
+/**
+ * Log a printf-style message from any thread, including the audio thread.
+ * The format must be a string literal, and at most RT_LOG_MAX_ARGS arguments are supported.
+ * %s arguments must outlive the log (e.g. string literals).
+ */
+#define RT_LOG(...) \
+    do \
+    { \
+        static RealtimeLogSite rtLogSite = { 0, 0 }; \
+        RealtimeLogWrite(rtLogSite, __VA_ARGS__); \
+    } while (0)
+
+inline void RealtimeLogWrite(RealtimeLogSite& site, const char* format)
+{
+    RealtimeLog::getInstance()->write(site, format, 0, NULL);
+}
+
+inline void RealtimeLogWrite(RealtimeLogSite& site, const char* format, RealtimeLogArg a0)
+{
+    RealtimeLogArg args[] = { a0 };
+    RealtimeLog::getInstance()->write(site, format, 1, args);
+}
+
+inline void RealtimeLogWrite(RealtimeLogSite& site, const char* format, RealtimeLogArg a0, RealtimeLogArg a1)
+{
+    RealtimeLogArg args[] = { a0, a1 };
+    RealtimeLog::getInstance()->write(site, format, 2, args);
+}
+
+inline void RealtimeLogWrite(RealtimeLogSite& site, const char* format, RealtimeLogArg a0, RealtimeLogArg a1, RealtimeLogArg a2)
+{
+    RealtimeLogArg args[] = { a0, a1, a2 };
+    RealtimeLog::getInstance()->write(site, format, 3, args);
+}
+
+inline void RealtimeLogWrite(RealtimeLogSite& site, const char* format, RealtimeLogArg a0, RealtimeLogArg a1, RealtimeLogArg a2, RealtimeLogArg a3)
+{
+    RealtimeLogArg args[] = { a0, a1, a2, a3 };
+    RealtimeLog::getInstance()->write(site, format, 4, args);
+}
+
+#endif // REALTIME_LOG_H
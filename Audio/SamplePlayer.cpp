@@ -0,0 +1,473 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/*
+ *  SamplePlayer.cpp
+ *  iDiMP
+ *
+ */
+
+#include "SamplePlayer.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static const useconds_t UNLOAD_POLL_USEC = 1000; ///< how often unloadSample checks whether the audio thread has moved on
+static const int32_t GENERATION_MASK = 0x7FFFFF;  ///< keeps (generation << 8) | index a non-negative int voice handle
+
+// ---- MappedSample public methods ----
+
+MappedSample::MappedSample() :
+    m_mapping(NULL),
+    m_mappingBytes(0),
+    m_data(NULL),
+    m_numFrames(0),
+    m_numChannels(0),
+    m_sampleRate(0),
+    m_format(PortableWavefile::Int16),
+    m_bytesPerFrame(0)
+{
+}
+
+MappedSample::~MappedSample()
+{
+    unmap();
+}
+
+bool MappedSample::map(const char* path)
+{
+    unmap();
+    
+    // let PortableWavefile find the format and where the samples are
+    PortableWavefile file;
+    if (!file.openForReading(path))
+    {
+        return false;
+    }
+    if (file.getNumChannels() > SAMPLE_PLAYER_MAX_CHANNELS || file.getNumFrames() == 0 || file.getNumFrames() > 0x7FFFFFFF)
+    {
+        printf("MappedSample::map %s has an unsupported number of channels or frames\n", path);
+        return false;
+    }
+    
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        printf("MappedSample::map could not open %s\n", path);
+        return false;
+    }
+    size_t mappingBytes = (size_t)(file.getDataOffset() + file.getNumFrames() * file.getBytesPerFrame());
+    void* mapping = mmap(NULL, mappingBytes, PROT_READ, MAP_SHARED, fd, 0);
+    
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+    
+    if (mapping == MAP_FAILED)
+    {
+        printf("MappedSample::map could not map %s\n", path);
+        return false;
+    }
+    
+    m_mapping = mapping;
+    m_mappingBytes = mappingBytes;
+    m_data = (const unsigned char*)mapping + file.getDataOffset();
+    m_numFrames = (uint32_t)file.getNumFrames();
+    m_numChannels = file.getNumChannels();
+    m_sampleRate = file.getSampleRate();
+    m_format = file.getSampleFormat();
+    m_bytesPerFrame = file.getBytesPerFrame();
+    return true;
+}
+
+void MappedSample::unmap()
+{
+    if (m_mapping != NULL)
+    {
+        munmap(m_mapping, m_mappingBytes);
+        m_mapping = NULL;
+        m_mappingBytes = 0;
+        m_data = NULL;
+        m_numFrames = 0;
+    }
+}
+
+void MappedSample::prefetch(uint32_t startFrame, uint32_t numFrames) const
+{
+    if (m_mapping == NULL || startFrame >= m_numFrames)
+    {
+        return;
+    }
+    if (numFrames > m_numFrames - startFrame)
+    {
+        numFrames = m_numFrames - startFrame;
+    }
+    
+    // madvise wants a page aligned start address
+    static const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = (size_t)(getFrame(startFrame) - (const unsigned char*)m_mapping);
+    size_t end = start + (size_t)numFrames * m_bytesPerFrame;
+    start -= start % pageSize;
+    madvise((char*)m_mapping + start, end - start, MADV_WILLNEED);
+}
+
+// ---- SamplePlayer public methods ----
+
+SamplePlayer::SamplePlayer() :
+    m_scratch(new float[SAMPLE_PLAYER_BLOCK_FRAMES * SAMPLE_PLAYER_MAX_CHANNELS]),
+    m_prefetchThreadStarted(false),
+    m_isRunning(1),
+    m_renderEpoch(0)
+{
+    for (int i = 0; i < SAMPLE_PLAYER_MAX_SAMPLES; i++)
+    {
+        m_samples[i] = NULL;
+    }
+    memset(m_voices, 0, sizeof(m_voices));
+    
+    pthread_mutex_init(&m_controlLock, NULL);
+    
+    if (pthread_create(&m_prefetchThread, NULL, prefetch_thread_main, this) != 0)
+    {
+        printf("SamplePlayer::SamplePlayer could not create prefetch thread\n");
+    }
+    else
+    {
+        m_prefetchThreadStarted = true;
+    }
+}
+
+SamplePlayer::~SamplePlayer()
+{
+    AtomicStore32(&m_isRunning, 0);
+    if (m_prefetchThreadStarted)
+    {
+        pthread_join(m_prefetchThread, NULL);
+    }
+    
+    for (int i = 0; i < SAMPLE_PLAYER_MAX_SAMPLES; i++)
+    {
+        delete m_samples[i];
+        m_samples[i] = NULL;
+    }
+    pthread_mutex_destroy(&m_controlLock);
+    
+    delete[] m_scratch;
+    m_scratch = NULL;
+}
+
+int SamplePlayer::loadSample(const char* path)
+{
+    MappedSample* sample = new MappedSample();
+    if (!sample->map(path))
+    {
+        delete sample;
+        return -1;
+    }
+    if (sample->getSampleRate() != (uint32_t)AUDIO_SAMPLE_RATE)
+    {
+        printf("SamplePlayer::loadSample warning: %s is %u Hz and will play at the wrong speed\n", path, sample->getSampleRate());
+    }
+    
+    // get the attack of the sample into memory before anyone triggers it
+    sample->prefetch(0, (uint32_t)(SAMPLE_PLAYER_PREFETCH_SECONDS * sample->getSampleRate()));
+    
+    pthread_mutex_lock(&m_controlLock);
+    int sampleId = -1;
+    for (int i = 0; i < SAMPLE_PLAYER_MAX_SAMPLES; i++)
+    {
+        if (m_samples[i] == NULL)
+        {
+            m_samples[i] = sample;
+            sampleId = i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m_controlLock);
+    
+    if (sampleId < 0)
+    {
+        printf("SamplePlayer::loadSample no room to load %s\n", path);
+        delete sample;
+    }
+    return sampleId;
+}
+
+void SamplePlayer::unloadSample(int sampleId)
+{
+    if (sampleId < 0 || sampleId >= SAMPLE_PLAYER_MAX_SAMPLES)
+    {
+        return;
+    }
+    
+    pthread_mutex_lock(&m_controlLock);
+    MappedSample* sample = m_samples[sampleId];
+    m_samples[sampleId] = NULL;
+    
+    if (sample != NULL)
+    {
+        // every render that starts from now on sees the stop request before touching the sample...
+        for (int i = 0; i < SAMPLE_PLAYER_MAX_VOICES; i++)
+        {
+            PlayerVoice& voice = m_voices[i];
+            if (AtomicLoad32(&voice.state) != VoiceIdle && voice.sample == sample)
+            {
+                AtomicStore32(&voice.stopGeneration, voice.generation);
+            }
+        }
+        
+        // ...so we only have to wait out the one that might be running now
+        wait_for_render_grace_period();
+        
+        // free the voices ourselves - with audio stopped the audio thread never will
+        for (int i = 0; i < SAMPLE_PLAYER_MAX_VOICES; i++)
+        {
+            PlayerVoice& voice = m_voices[i];
+            if (voice.sample == sample)
+            {
+                voice.sample = NULL;
+                AtomicStore32(&voice.state, VoiceIdle);
+            }
+        }
+        delete sample;
+    }
+    pthread_mutex_unlock(&m_controlLock);
+}
+
+int SamplePlayer::trigger(int sampleId, float gain, bool loop)
+{
+    if (sampleId < 0 || sampleId >= SAMPLE_PLAYER_MAX_SAMPLES)
+    {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&m_controlLock);
+    int voiceHandle = -1;
+    if (m_samples[sampleId] != NULL)
+    {
+        for (int i = 0; i < SAMPLE_PLAYER_MAX_VOICES; i++)
+        {
+            PlayerVoice& voice = m_voices[i];
+            if (AtomicCompareAndSwap32(VoiceIdle, VoiceStarting, &voice.state))
+            {
+                int32_t generation = (voice.generation + 1) & GENERATION_MASK;
+                voice.sample = m_samples[sampleId];
+                voice.sampleId = sampleId;
+                voice.gain = gain;
+                voice.loop = loop;
+                voice.position = 0;
+                voice.prefetchedUntil = 0;
+                voice.stopGeneration = -1;
+                voice.generation = generation;
+                
+                // publish the set up voice to the audio thread
+                AtomicMemoryBarrier();
+                AtomicStore32(&voice.state, VoicePlaying);
+                
+                voiceHandle = (generation << 8) | i;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&m_controlLock);
+    return voiceHandle;
+}
+
+void SamplePlayer::stop(int voiceHandle)
+{
+    if (voiceHandle < 0)
+    {
+        return;
+    }
+    int index = voiceHandle & 0xFF;
+    if (index < SAMPLE_PLAYER_MAX_VOICES)
+    {
+        // harmless if the voice has since been retriggered - the generation won't match
+        AtomicStore32(&m_voices[index].stopGeneration, (voiceHandle >> 8) & GENERATION_MASK);
+    }
+}
+
+void SamplePlayer::stopAll()
+{
+    for (int i = 0; i < SAMPLE_PLAYER_MAX_VOICES; i++)
+    {
+        AtomicStore32(&m_voices[i].stopGeneration, AtomicLoad32(&m_voices[i].generation));
+    }
+}
+
+int SamplePlayer::getNumActiveVoices() const
+{
+    int numActive = 0;
+    for (int i = 0; i < SAMPLE_PLAYER_MAX_VOICES; i++)
+    {
+        if (AtomicLoad32(&m_voices[i].state) == VoicePlaying)
+        {
+            numActive++;
+        }
+    }
+    return numActive;
+}
+
+void SamplePlayer::renderAddToBuffer(float* output, int numSamplesPerChannel, int numChannels)
+{
+    AtomicIncrement32(&m_renderEpoch);
+    
+    for (int i = 0; i < SAMPLE_PLAYER_MAX_VOICES; i++)
+    {
+        PlayerVoice& voice = m_voices[i];
+        if (AtomicLoad32(&voice.state) != VoicePlaying)
+        {
+            continue;
+        }
+        
+        // check for a stop request before touching the sample - unloadSample relies on it
+        if (AtomicLoad32(&voice.stopGeneration) == voice.generation)
+        {
+            AtomicStore32(&voice.state, VoiceIdle);
+            continue;
+        }
+        
+        AUDIO_TRACE_SCOPE("SamplePlayer::render_voice");
+        render_voice(voice, output, numSamplesPerChannel, numChannels);
+    }
+    
+    AtomicIncrement32(&m_renderEpoch);
+}
+
+// ---- SamplePlayer private methods ----
+
+void* SamplePlayer::prefetch_thread_main(void* arg)
+{
+    SamplePlayer* player = (SamplePlayer*)arg;
+    while (AtomicLoad32(&player->m_isRunning))
+    {
+        player->prefetch_ahead_of_voices();
+        usleep(SAMPLE_PLAYER_PREFETCH_POLL_USEC);
+    }
+    return NULL;
+}
+
+void SamplePlayer::prefetch_ahead_of_voices()
+{
+    // the lock keeps samples from being unloaded while we look at them
+    pthread_mutex_lock(&m_controlLock);
+    for (int i = 0; i < SAMPLE_PLAYER_MAX_VOICES; i++)
+    {
+        PlayerVoice& voice = m_voices[i];
+        if (AtomicLoad32(&voice.state) != VoicePlaying)
+        {
+            continue;
+        }
+        
+        // a stopped voice's sample may be on its way out
+        const MappedSample* sample = voice.sample;
+        if (sample == NULL || AtomicLoad32(&voice.stopGeneration) == voice.generation)
+        {
+            continue;
+        }
+        
+        uint32_t window = (uint32_t)(SAMPLE_PLAYER_PREFETCH_SECONDS * sample->getSampleRate());
+        uint32_t position = (uint32_t)AtomicLoad32(&voice.position);
+        
+        // re-request once the play head is halfway through the last window (or has looped back)
+        if (position + window / 2 >= voice.prefetchedUntil || position < voice.prefetchedUntil - window)
+        {
+            sample->prefetch(position, window);
+            if (voice.loop && position + window > sample->getNumFrames())
+            {
+                sample->prefetch(0, position + window - sample->getNumFrames());
+            }
+            voice.prefetchedUntil = position + window;
+        }
+    }
+    pthread_mutex_unlock(&m_controlLock);
+}
+
+void SamplePlayer::render_voice(PlayerVoice& voice, float* output, int numSamplesPerChannel, int numChannels)
+{
+    const MappedSample* sample = voice.sample;
+    int sampleChannels = sample->getNumChannels();
+    uint32_t numFrames = sample->getNumFrames();
+    uint32_t position = (uint32_t)voice.position;
+    
+    int framesDone = 0;
+    while (framesDone < numSamplesPerChannel)
+    {
+        if (position >= numFrames)
+        {
+            if (!voice.loop)
+            {
+                AtomicStore32(&voice.state, VoiceIdle);
+                return;
+            }
+            position = 0;
+        }
+        
+        uint32_t count = numSamplesPerChannel - framesDone;
+        if (count > (uint32_t)SAMPLE_PLAYER_BLOCK_FRAMES)
+        {
+            count = SAMPLE_PLAYER_BLOCK_FRAMES;
+        }
+        if (count > numFrames - position)
+        {
+            count = numFrames - position;
+        }
+        
+        // read straight out of the mapped file
+        PortableWavefile::convertToFloat(sample->getSampleFormat(), sample->getFrame(position), m_scratch, count * sampleChannels);
+        
+        float* out = output + framesDone * numChannels;
+        const float* in = m_scratch;
+        for (uint32_t frame = 0; frame < count; frame++)
+        {
+            // mono samples go to every channel, extra sample channels are ignored
+            for (int channel = 0; channel < numChannels; channel++)
+            {
+                int sampleChannel = (channel < sampleChannels) ? channel : sampleChannels - 1;
+                out[channel] += voice.gain * in[sampleChannel];
+            }
+            out += numChannels;
+            in += sampleChannels;
+        }
+        
+        position += count;
+        framesDone += count;
+    }
+    AtomicStore32(&voice.position, (int32_t)position);
+}
+
+void SamplePlayer::wait_for_render_grace_period()
+{
+    // same scheme as AudioEngine::wait_for_render_grace_period
+    int32_t epoch = AtomicLoad32(&m_renderEpoch);
+    if ((epoch & 1) == 0)
+    {
+        return;
+    }
+    while (AtomicLoad32(&m_renderEpoch) == epoch)
+    {
+        usleep(UNLOAD_POLL_USEC);
+    }
+}
@@ -0,0 +1,242 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/**
+ *  @file SamplePlayer.h
+ *  iDiMP
+ *
+ *  The interfaces for the MappedSample and SamplePlayer classes are defined here.
+ */
+
+#ifndef SAMPLE_PLAYER_H
+#define SAMPLE_PLAYER_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#import "AudioBasics.h"
+#import "AtomicOps.h"
+#import "AudioTracer.h"
+#import "PortableWavefile.h"
+
+static const int   SAMPLE_PLAYER_MAX_SAMPLES         = 32;     ///< Number of samples which can be loaded at once
+static const int   SAMPLE_PLAYER_MAX_VOICES          = 32;     ///< Number of samples which can play at once
+static const int   SAMPLE_PLAYER_MAX_CHANNELS        = 8;      ///< Most channels a sample file may have
+static const int   SAMPLE_PLAYER_BLOCK_FRAMES        = 256;    ///< Frames converted to float at a time while rendering
+static const float SAMPLE_PLAYER_PREFETCH_SECONDS    = 2.0;    ///< How far ahead of each play head pages are requested from disk
+static const int   SAMPLE_PLAYER_PREFETCH_POLL_USEC  = 20000;  ///< How often the prefetch thread checks the play heads
+
+/** MappedSample class.
+ * A MappedSample is a WAV file mapped read-only into memory.  Its sample data is never copied:
+ * it lives in the page cache, and the kernel can evict and re-read it as needed, so large backing 
+ * tracks don't cost heap.
+ */
+class MappedSample
+{
+public:
+   /**
+    * MappedSample constructor.  Use map to load a file.
+    */
+    MappedSample();
+    
+   /**
+    * MappedSample destructor.  Unmaps the file.
+    */
+    ~MappedSample();
+    
+   /**
+    * Map a WAV file (any format PortableWavefile can read) into memory.
+    * @param path the path of the file to map
+    * @return true if successful
+    */
+    bool map(const char* path);
+    
+   /**
+    * Unmap the file, if there is one.
+    */
+    void unmap();
+    
+   /**
+    * @return the number of frames in the sample
+    */
+    uint32_t getNumFrames() const { return m_numFrames; }
+    
+   /**
+    * @return the number of channels in the sample
+    */
+    int getNumChannels() const { return m_numChannels; }
+    
+   /**
+    * @return the sample rate of the sample
+    */
+    uint32_t getSampleRate() const { return m_sampleRate; }
+    
+   /**
+    * @return the format of the sample data
+    */
+    PortableWavefile::SampleFormat getSampleFormat() const { return m_format; }
+    
+   /**
+    * Get a pointer to the mapped data for a frame.  Reading it may fault the page in from disk.
+    * @param frame the frame (must be less than getNumFrames())
+    * @return a pointer to the frame's little endian sample data
+    */
+    const unsigned char* getFrame(uint32_t frame) const { return m_data + (size_t)frame * m_bytesPerFrame; }
+    
+   /**
+    * Ask the kernel to start reading a range of frames from disk if they aren't already cached.
+    * This does not wait for the read to happen.
+    * @param startFrame the first frame of the range
+    * @param numFrames the number of frames in the range (clamped to the end of the sample)
+    */
+    void prefetch(uint32_t startFrame, uint32_t numFrames) const;
+    
+private:
+    MappedSample(const MappedSample&);
+    MappedSample& operator= (const MappedSample&);
+    
+    void* m_mapping;
+    size_t m_mappingBytes;
+    const unsigned char* m_data;
+    uint32_t m_numFrames;
+    int m_numChannels;
+    uint32_t m_sampleRate;
+    PortableWavefile::SampleFormat m_format;
+    uint32_t m_bytesPerFrame;
+};
+
+/** SamplePlayer class.
+ * The SamplePlayer plays backing tracks and one-shot samples from MappedSamples.
+ * Any number of voices (up to SAMPLE_PLAYER_MAX_VOICES) may play the same sample at once; 
+ * triggering a voice copies nothing, it only sets up a play head into the mapped file.
+ * A background thread asks the kernel to read ahead of every play head so the audio thread 
+ * rarely has to wait for a page fault.
+ *
+ * loadSample, unloadSample and trigger may block briefly and must not be called from the audio 
+ * thread.  stop and stopAll are lock-free.  renderAddToBuffer is called by the audio thread.
+ */
+class SamplePlayer
+{
+public:
+   /**
+    * SamplePlayer constructor.  Starts the prefetch thread.
+    */
+    SamplePlayer();
+    
+   /**
+    * SamplePlayer destructor.  Stops the prefetch thread and unloads all samples.
+    * The audio thread must no longer be rendering this player.
+    */
+    ~SamplePlayer();
+    
+   /**
+    * Load a WAV file so it can be triggered.  The beginning of the file is prefetched so 
+    * triggering it right away is unlikely to hit the disk.
+    * @param path the path of the file
+    * @return an ID for the sample, or -1 if it could not be loaded
+    */
+    int loadSample(const char* path);
+    
+   /**
+    * Stop all voices playing a sample and unload it.
+    * @param sampleId an ID returned by loadSample
+    */
+    void unloadSample(int sampleId);
+    
+   /**
+    * Start playing a sample from the beginning.
+    * @param sampleId an ID returned by loadSample
+    * @param gain the gain to apply to the sample
+    * @param loop true to repeat the sample until stopped (e.g. for a backing track)
+    * @return a handle for the new voice, or -1 if the sample doesn't exist or no voices are free
+    * @see stop
+    */
+    int trigger(int sampleId, float gain = 1.0, bool loop = false);
+    
+   /**
+    * Stop a voice.  Does nothing if the voice has already finished.
+    * @param voiceHandle a handle returned by trigger
+    */
+    void stop(int voiceHandle);
+    
+   /**
+    * Stop all voices.
+    */
+    void stopAll();
+    
+   /**
+    * @return the number of voices currently playing
+    */
+    int getNumActiveVoices() const;
+    
+   /** 
+    * Render all playing voices and add them to the audio in the given buffer.
+    * @param output the buffer into which the voices will be rendered/added
+    * @param numSamplesPerChannel the number of samples per channel to be rendered
+    * @param numChannels the number of channels to be rendered (Note: samples are interleaved) 
+    */
+    void renderAddToBuffer(float* output, int numSamplesPerChannel, int numChannels);
+    
+private:
+    SamplePlayer(const SamplePlayer&);
+    SamplePlayer& operator= (const SamplePlayer&);
+    
+    /** the life cycle of a PlayerVoice */
+    enum VoiceState
+    {
+        VoiceIdle = 0,  /*!< free to be triggered */
+        VoiceStarting,  /*!< being set up by trigger - not yet visible to the audio thread */
+        VoicePlaying    /*!< owned by the audio thread until it finishes */
+    };
+    
+    /** one play head into a MappedSample */
+    struct PlayerVoice
+    {
+        volatile int32_t state;          ///< a VoiceState
+        volatile int32_t generation;     ///< incremented on every trigger so stale handles can be ignored
+        volatile int32_t stopGeneration; ///< the audio thread stops the voice when this matches generation
+        volatile int32_t position;       ///< next frame to play - written by the audio thread
+        const MappedSample* sample;
+        int sampleId;
+        float gain;
+        bool loop;
+        uint32_t prefetchedUntil;        ///< end of the last range prefetched (prefetch thread only)
+    };
+    
+    static void* prefetch_thread_main(void* arg);
+    void prefetch_ahead_of_voices();
+    void render_voice(PlayerVoice& voice, float* output, int numSamplesPerChannel, int numChannels);
+    void wait_for_render_grace_period();
+    
+    MappedSample* m_samples[SAMPLE_PLAYER_MAX_SAMPLES];
+    PlayerVoice m_voices[SAMPLE_PLAYER_MAX_VOICES];
+    float* m_scratch;
+    pthread_mutex_t m_controlLock;
+    pthread_t m_prefetchThread;
+    bool m_prefetchThreadStarted;
+    volatile int32_t m_isRunning;
+    volatile int32_t m_renderEpoch; ///< odd while renderAddToBuffer is running
+};
+
+#endif // SAMPLE_PLAYER_H
@@ -101,7 +101,15 @@ void Voice::draw(CGContextRef contextRef, CGRect& bounds) const
 
 void Voice::turnOn(float x, float y) 
 { 
-    printf("Voice::turnOn %02X\n", this);
+    RT_LOG("Voice::turnOn %02X\n", this);
+    
+    m_turnOffRequested = false;
+    if (m_isOn)
+    {
+        // still sounding (perhaps ramping down to turn off), so carry on from where it is
+        setPosition(x, y);
+        return;
+    }
     
     // store new coordinates
     m_x = x;
@@ -121,7 +129,7 @@ void Voice::turnOn(float x, float y)
 
 void Voice::turnOff() 
 { 
-    printf("Voice::turnOff %02X\n", this);
+    RT_LOG("Voice::turnOff %02X\n", this);
     m_osc.setAmpSmooth(0.0);
     m_turnOffRequested = true; // don't turn off until after next callback - this allows smooth ramping down to zero
 }
@@ -130,6 +138,7 @@ void Voice::renderAddToBuffer(float* output, int numSamplesPerChannel, int numCh
 {
     if (m_isOn)
     {
+        AUDIO_TRACE_SCOPE("Voice::renderAddToBuffer");
         m_osc.addNextSamplesToBuffer(output, numSamplesPerChannel, numChannels);
     
         if (m_turnOffRequested)
@@ -154,7 +163,10 @@ void Voice::setPosition(float x, float y)
 
 // ---- TouchSynth public methods ----
 
-TouchSynth::TouchSynth()
+TouchSynth::TouchSynth() :
+    m_width(1.0),
+    m_height(1.0),
+    m_listener(NULL)
 { }
 
 bool TouchSynth::addTouchVoice(float xPos, float yPos)
@@ -166,6 +178,7 @@ bool TouchSynth::addTouchVoice(float xPos, float yPos)
         {
             // found an unused voice
             m_voices[i].turnOn(xPos, yPos);
+            if (m_listener) m_listener->voiceTurnedOn(i, xPos / m_width, yPos / m_height);
             return (true);
         }
     }
@@ -184,6 +197,7 @@ bool TouchSynth::updateTouchVoice(float xCurrent, float yCurrent, float xPrev, f
         {
             // found a match - update its position
             m_voices[i].setPosition(xCurrent, yCurrent);
+            if (m_listener) m_listener->voiceMoved(i, xCurrent / m_width, yCurrent / m_height);
             return true;
         }
     }
@@ -202,6 +216,7 @@ bool TouchSynth::removeTouchVoice(float xPos, float yPos)
         {
             // found a match - turn it off
             m_voices[i].turnOff();
+            if (m_listener) m_listener->voiceTurnedOff(i);
             return true;
         }
     }
@@ -214,6 +229,7 @@ void TouchSynth::removeAllVoices()
 {
     for (int i = 0; i < NUM_VOICES; i++)
     {
+        if (m_listener && m_voices[i].isOn()) m_listener->voiceTurnedOff(i);
         m_voices[i].turnOff();
     }
 }
@@ -269,6 +285,12 @@ bool TouchSynth::allVoicesAreOff() const
 
 void TouchSynth::setDisplayBounds(CGRect bounds)
 {
+    if (bounds.size.width > 0 && bounds.size.height > 0)
+    {
+        m_width = bounds.size.width;
+        m_height = bounds.size.height;
+    }
+    
     for (int i = 0; i < NUM_VOICES; i++)
     {
         m_voices[i].setMaxX(bounds.size.width);
@@ -283,6 +305,7 @@ void TouchSynth::incrementWaveform()
     {
         m_voices[i].incrementWaveform();
     }
+    if (m_listener) m_listener->waveformChanged(getWaveform());
 }
 
 Oscillator::Waveform TouchSynth::getWaveform() const
@@ -299,4 +322,29 @@ void TouchSynth::setWaveform(Oscillator::Waveform wave)
     {
         m_voices[i].setWaveform(wave);
     }
+    if (m_listener) m_listener->waveformChanged(wave);
+}
+
+void TouchSynth::turnOnVoice(int voice, float xPos, float yPos)
+{
+    if (voice < 0 || voice >= NUM_VOICES) return;
+    
+    m_voices[voice].turnOn(xPos, yPos);
+    if (m_listener) m_listener->voiceTurnedOn(voice, xPos / m_width, yPos / m_height);
+}
+
+void TouchSynth::moveVoice(int voice, float xPos, float yPos)
+{
+    if (voice < 0 || voice >= NUM_VOICES || !m_voices[voice].isOn()) return;
+    
+    m_voices[voice].setPosition(xPos, yPos);
+    if (m_listener) m_listener->voiceMoved(voice, xPos / m_width, yPos / m_height);
+}
+
+void TouchSynth::turnOffVoice(int voice)
+{
+    if (voice < 0 || voice >= NUM_VOICES || !m_voices[voice].isOn()) return;
+    
+    m_voices[voice].turnOff();
+    if (m_listener) m_listener->voiceTurnedOff(voice);
 }
\ No newline at end of file
@@ -37,6 +37,7 @@
 
 #import <UIKit/UIKit.h>
 #import "Oscillator.h"
+#import "AudioTracer.h"
 
 static const float DEFAULT_MIN_FREQUENCY_HZ = 20.0;   ///< Minimum frequency for a TouchSynth Voice (in Hz)
 static const float DEFAULT_MAX_FREQUENCY_HZ = 3000.0; ///< Maximum frequency for a TouchSynth Voice (in Hz)
@@ -179,6 +180,46 @@ protected:
     bool m_turnOffRequested;
 };
 
+/** TouchSynthListener class.
+ * A TouchSynthListener is told about every change to a TouchSynth's Voices as it is made, so that the
+ * changes can be played somewhere else.  Positions are given relative to the display bounds, from 0
+ * to 1, so they mean the same on any display.  The TouchSynth calls it from whichever thread made 
+ * the change.
+ */
+class TouchSynthListener
+{
+public:
+    virtual ~TouchSynthListener() {}
+    
+   /**
+    * A Voice has been turned on.
+    * @param voice the index of the Voice
+    * @param x its horizontal position (0 to 1)
+    * @param y its vertical position (0 to 1)
+    */
+    virtual void voiceTurnedOn(int voice, float x, float y) = 0;
+    
+   /**
+    * A Voice that is on has moved.
+    * @param voice the index of the Voice
+    * @param x its new horizontal position (0 to 1)
+    * @param y its new vertical position (0 to 1)
+    */
+    virtual void voiceMoved(int voice, float x, float y) = 0;
+    
+   /**
+    * A Voice has been turned off.
+    * @param voice the index of the Voice
+    */
+    virtual void voiceTurnedOff(int voice) = 0;
+    
+   /**
+    * Every Voice has switched to a new Waveform.
+    * @param wave the new Waveform
+    */
+    virtual void waveformChanged(Oscillator::Waveform wave) = 0;
+};
+
 /** TouchSynth class.
  * TouchSynth manages a collection of synthesized voices, encapsulating both 
  * audio synthesis and graphical rendering for the UI.
@@ -290,10 +331,44 @@ public:
     * @see getWaveform
     */
     void setWaveform(Oscillator::Waveform wave);
+    
+   /**
+    * Turn on the given Voice, or move it if it is already on.  Unlike addTouchVoice, the caller 
+    * chooses the Voice, so a TouchSynth can follow another one's changes exactly.
+    * @param voice the index of the Voice (0 to NUM_VOICES - 1)
+    * @param xPos the starting horizontal position of the Voice within the display bounds
+    * @param yPos the starting vertical position of the Voice within the display bounds
+    * @see turnOffVoice
+    */
+    void turnOnVoice(int voice, float xPos, float yPos);
+    
+   /**
+    * Move the given Voice, if it is on.
+    * @param voice the index of the Voice (0 to NUM_VOICES - 1)
+    * @param xPos the new horizontal position of the Voice within the display bounds
+    * @param yPos the new vertical position of the Voice within the display bounds
+    */
+    void moveVoice(int voice, float xPos, float yPos);
+    
+   /**
+    * Turn off the given Voice, if it is on.
+    * @param voice the index of the Voice (0 to NUM_VOICES - 1)
+    * @see turnOnVoice
+    */
+    void turnOffVoice(int voice);
+    
+   /**
+    * Set the listener told about every change to this TouchSynth's Voices.
+    * @param listener the listener, or NULL for none
+    */
+    void setListener(TouchSynthListener* listener) { m_listener = listener; }
         
 private:
 
     Voice m_voices[NUM_VOICES];
+    float m_width;  ///< display bounds, which the listener's positions are relative to
+    float m_height;
+    TouchSynthListener* m_listener;
 };
 
 #endif // TOUCH_SYNTH_H
\ No newline at end of file
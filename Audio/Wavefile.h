@@ -101,36 +101,43 @@ public:
     * Write the contents of the given audio buffers to the file.
     * @param bufferList a pointer to the AudioBufferList object which contains the audio data to be written.
     */
-    void WriteAudioBuffers(AudioBufferList* bufferList)
+    void WriteAudioBuffers(const AudioBufferList* bufferList)
     {
-        //printf("Wavefile::WriteAudioBuffers m_debugFileID = %d, m_debugFileByteOffset = %d, bufferList = %d\n", m_debugFileID, m_debugFileByteOffset, bufferList);
+        for (int i = 0; i < bufferList->mNumberBuffers; i++)
+        {
+            WriteBytes(bufferList->mBuffers[i].mData, bufferList->mBuffers[i].mDataByteSize);
+        }
+    }
+    
+   /**
+    * Append raw sample data to the file.  The data must already be in the file's format.
+    * @param data the sample data to be written
+    * @param numBytes the number of bytes to write
+    */
+    void WriteBytes(const void* data, UInt32 numBytes)
+    {
+        //printf("Wavefile::WriteBytes m_debugFileID = %d, m_debugFileByteOffset = %d, numBytes = %d\n", m_debugFileID, m_debugFileByteOffset, numBytes);
         if (m_debugFileID == 0)
         {
             // file was never properly initialized so we can't write to it
             return;
         }
-        for (int i = 0; i < bufferList->mNumberBuffers; i++)
+        
+        UInt32 numBytesWritten = numBytes; // this should hold actual num bytes written upon return
+        OSStatus result = AudioFileWriteBytes(m_debugFileID,
+                                              FALSE,
+                                              m_debugFileByteOffset,
+                                              &numBytesWritten,
+                                              data);
+        if (result != noErr)
+        {
+            printf("Wavefile::WriteBytes error writing to debug file: %d\n", result);
+        }
+        if (numBytesWritten < numBytes)
         {
-            // write to debug file
-            UInt32 numBytes = bufferList->mBuffers[i].mDataByteSize;
-            //printf("Wavefile::WriteAudioBuffers i = %d, numBytes = %d\n", i, numBytes);
-            OSStatus result = noErr;
-            result = AudioFileWriteBytes(m_debugFileID,
-                                         FALSE,
-                                         m_debugFileByteOffset,
-                                         &numBytes, // this should hold actual num bytes written upon return
-                                         bufferList->mBuffers[i].mData);
-            //printf("Wavefile::WriteAudioBuffers wrote bytes: numBytes = %d\n", numBytes);
-            if (result != noErr)
-            {
-                printf("Wavefile::WriteAudioBuffers error writing to debug file: %d\n", result);
-            }
-            if (numBytes < bufferList->mBuffers[i].mDataByteSize)
-            {
-                printf("Wavefile::WriteAudioBuffers warning: some bytes were not written to the debug file\n");
-            }
-            m_debugFileByteOffset += numBytes;
+            printf("Wavefile::WriteBytes warning: some bytes were not written to the debug file\n");
         }
+        m_debugFileByteOffset += numBytesWritten;
     }
     
 private:
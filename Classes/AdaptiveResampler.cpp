@@ -0,0 +1,157 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+/*
+ *  AdaptiveResampler.cpp
+ *  iDiMP
+ *
+ */
+
+#include "AdaptiveResampler.h"
+
+#include <math.h>
+#include <string.h>
+
+static const int HISTORY_FRAMES = 1; ///< frames kept before the read position for the interpolator
+static const int LOOKAHEAD_FRAMES = 2; ///< frames needed after the read position's frame
+
+// ---- AdaptiveResampler public methods ----
+
+AdaptiveResampler::AdaptiveResampler(int numChannels, int capacityFrames) :
+    m_numChannels(numChannels),
+    m_capacityFrames(capacityFrames + HISTORY_FRAMES + LOOKAHEAD_FRAMES + 1),
+    m_ratio(1.0)
+{
+    if (m_numChannels < 1)
+    {
+        m_numChannels = 1;
+    }
+    else if (m_numChannels > RESAMPLER_MAX_CHANNELS)
+    {
+        m_numChannels = RESAMPLER_MAX_CHANNELS;
+    }
+    m_buffer = new float[m_capacityFrames * m_numChannels];
+    reset();
+}
+
+AdaptiveResampler::~AdaptiveResampler()
+{
+    delete[] m_buffer;
+}
+
+void AdaptiveResampler::setRatio(double ratio)
+{
+    if (ratio > 1.0 + RESAMPLER_MAX_DEVIATION)
+    {
+        ratio = 1.0 + RESAMPLER_MAX_DEVIATION;
+    }
+    else if (ratio < 1.0 - RESAMPLER_MAX_DEVIATION)
+    {
+        ratio = 1.0 - RESAMPLER_MAX_DEVIATION;
+    }
+    m_ratio = ratio;
+}
+
+int AdaptiveResampler::getNumInputNeeded(int numOutputFrames) const
+{
+    if (numOutputFrames <= 0)
+    {
+        return 0;
+    }
+    double last = m_position + (numOutputFrames - 1) * m_ratio;
+    int needed = (int)floor(last) + LOOKAHEAD_FRAMES + 1 - m_numFrames;
+    return (needed > 0) ? needed : 0;
+}
+
+bool AdaptiveResampler::write(const short* samples, int numFrames)
+{
+    if (m_numFrames + numFrames > m_capacityFrames)
+    {
+        return false;
+    }
+    
+    float* destination = m_buffer + m_numFrames * m_numChannels;
+    int numSamples = numFrames * m_numChannels;
+    for (int i = 0; i < numSamples; i++)
+    {
+        destination[i] = (float)samples[i];
+    }
+    m_numFrames += numFrames;
+    return true;
+}
+
+void AdaptiveResampler::read(short* samples, int numFrames)
+{
+    for (int n = 0; n < numFrames; n++)
+    {
+        int index = (int)m_position;
+        float t = (float)(m_position - index);
+        
+        for (int c = 0; c < m_numChannels; c++)
+        {
+            float x[4];
+            for (int k = 0; k < 4; k++)
+            {
+                int frame = index - 1 + k;
+                x[k] = (frame < m_numFrames) ? m_buffer[frame * m_numChannels + c] : 0.0f;
+            }
+            
+            // Catmull-Rom spline through x[1] (t = 0) and x[2] (t = 1)
+            float a = -0.5f * x[0] + 1.5f * x[1] - 1.5f * x[2] + 0.5f * x[3];
+            float b = x[0] - 2.5f * x[1] + 2.0f * x[2] - 0.5f * x[3];
+            float d = -0.5f * x[0] + 0.5f * x[2];
+            float value = ((a * t + b) * t + d) * t + x[1];
+            
+            if (value > 32767.0f)
+            {
+                value = 32767.0f;
+            }
+            else if (value < -32768.0f)
+            {
+                value = -32768.0f;
+            }
+            *samples++ = (short)lrintf(value);
+        }
+        m_position += m_ratio;
+    }
+    
+    // drop what the interpolator no longer needs
+    int numUsed = (int)m_position - HISTORY_FRAMES;
+    if (numUsed > m_numFrames)
+    {
+        numUsed = m_numFrames;
+    }
+    if (numUsed > 0)
+    {
+        memmove(m_buffer, m_buffer + numUsed * m_numChannels, (m_numFrames - numUsed) * m_numChannels * sizeof(float));
+        m_numFrames -= numUsed;
+        m_position -= numUsed;
+    }
+}
+
+void AdaptiveResampler::reset()
+{
+    // start with a silent frame of history so the first output frame is the first input frame
+    memset(m_buffer, 0, HISTORY_FRAMES * m_numChannels * sizeof(float));
+    m_numFrames = HISTORY_FRAMES;
+    m_position = HISTORY_FRAMES;
+}
@@ -0,0 +1,116 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+/**
+ *  @file AdaptiveResampler.h
+ *  iDiMP
+ *
+ *  This file defines the interface for the AdaptiveResampler class, which plays audio slightly 
+ *  faster or slower than it was recorded to make up for clock drift.
+ */
+
+#ifndef ADAPTIVE_RESAMPLER_H
+#define ADAPTIVE_RESAMPLER_H
+
+static const int    RESAMPLER_MAX_CHANNELS  = 2;     ///< Most interleaved channels an AdaptiveResampler handles
+static const double RESAMPLER_MAX_DEVIATION = 0.005; ///< Furthest the ratio may be from 1 (0.5%, under 9 cents of pitch)
+
+/** AdaptiveResampler class.
+ * An AdaptiveResampler converts a stream of interleaved 16-bit frames at a ratio close to 1 that 
+ * may change at any time, with 4-point cubic (Catmull-Rom) interpolation.  The input is written in 
+ * whatever blocks it arrives in; getNumInputNeeded says how much must be written before a given 
+ * number of output frames can be read.
+ *
+ * All memory is allocated by the constructor.  Not thread-safe: it is meant to be used entirely 
+ * on the audio thread.
+ */
+class AdaptiveResampler
+{
+public:
+   /**
+    * AdaptiveResampler constructor
+    * @param numChannels the number of interleaved channels (1 to RESAMPLER_MAX_CHANNELS)
+    * @param capacityFrames the most input frames that will be held at once
+    */
+    AdaptiveResampler(int numChannels, int capacityFrames);
+    
+   /**
+    * AdaptiveResampler destructor
+    */
+    ~AdaptiveResampler();
+    
+   /**
+    * Set the number of input frames consumed per output frame, e.g. 1.0001 plays a sender whose 
+    * clock is 100 ppm fast.  Clamped to within RESAMPLER_MAX_DEVIATION of 1.
+    * @param ratio the ratio
+    */
+    void setRatio(double ratio);
+    
+   /**
+    * @return the current ratio
+    */
+    double getRatio() const { return m_ratio; }
+    
+   /**
+    * @param numOutputFrames the number of frames to be read
+    * @return the number of input frames that must be written first
+    */
+    int getNumInputNeeded(int numOutputFrames) const;
+    
+   /**
+    * Add input.
+    * @param samples interleaved input frames
+    * @param numFrames the number of frames - the total held must not exceed capacityFrames
+    * @return false if there wasn't room, in which case nothing was written
+    */
+    bool write(const short* samples, int numFrames);
+    
+   /**
+    * Produce output.  Call getNumInputNeeded first: frames that aren't there yet are read as silence.
+    * @param samples receives numFrames interleaved frames
+    * @param numFrames the number of frames
+    */
+    void read(short* samples, int numFrames);
+    
+   /**
+    * @return the number of input frames written but not yet consumed
+    */
+    double getNumBuffered() const { return m_numFrames - m_position; }
+    
+   /**
+    * Drop all input, and start again from silence.
+    */
+    void reset();
+    
+private:
+    AdaptiveResampler(const AdaptiveResampler&);
+    AdaptiveResampler& operator= (const AdaptiveResampler&);
+    
+    int m_numChannels;
+    int m_capacityFrames;
+    float* m_buffer;     ///< input frames, interleaved
+    int m_numFrames;     ///< frames in m_buffer
+    double m_position;   ///< where in m_buffer the next output frame is taken from
+    double m_ratio;
+};
+
+#endif // ADAPTIVE_RESAMPLER_H
@@ -0,0 +1,215 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+/*
+ *  AdpcmCodec.cpp
+ *  iDiMP
+ *
+ */
+
+#include "AdpcmCodec.h"
+
+static const int MAX_STEP_INDEX = 88;
+
+/** how the step index moves after each code (by the code's magnitude bits) */
+static const int INDEX_ADJUST[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+/** the IMA ADPCM quantizer step sizes */
+static const int STEP_SIZE[MAX_STEP_INDEX + 1] =
+{
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+/** the state of one channel: the current prediction and step index */
+struct ChannelState
+{
+    int predictor;
+    int stepIndex;
+};
+
+/** applies a code to the state, exactly as the decoder will */
+static inline void update_state(ChannelState& state, int code)
+{
+    int step = STEP_SIZE[state.stepIndex];
+    int delta = step >> 3;
+    if (code & 4) delta += step;
+    if (code & 2) delta += step >> 1;
+    if (code & 1) delta += step >> 2;
+    
+    state.predictor += (code & 8) ? -delta : delta;
+    if (state.predictor > 32767)
+    {
+        state.predictor = 32767;
+    }
+    else if (state.predictor < -32768)
+    {
+        state.predictor = -32768;
+    }
+    
+    state.stepIndex += INDEX_ADJUST[code & 7];
+    if (state.stepIndex < 0)
+    {
+        state.stepIndex = 0;
+    }
+    else if (state.stepIndex > MAX_STEP_INDEX)
+    {
+        state.stepIndex = MAX_STEP_INDEX;
+    }
+}
+
+static inline int encode_sample(ChannelState& state, int sample)
+{
+    int step = STEP_SIZE[state.stepIndex];
+    int difference = sample - state.predictor;
+    int code = 0;
+    if (difference < 0)
+    {
+        code = 8;
+        difference = -difference;
+    }
+    if (difference >= step)
+    {
+        code |= 4;
+        difference -= step;
+    }
+    if (difference >= (step >> 1))
+    {
+        code |= 2;
+        difference -= step >> 1;
+    }
+    if (difference >= (step >> 2))
+    {
+        code |= 1;
+    }
+    
+    update_state(state, code);
+    return code;
+}
+
+// ---- AdpcmEncoder public methods ----
+
+AdpcmEncoder::AdpcmEncoder()
+{
+    reset();
+}
+
+void AdpcmEncoder::reset()
+{
+    for (int i = 0; i < ADPCM_MAX_CHANNELS; i++)
+    {
+        m_stepIndex[i] = 0;
+    }
+}
+
+int AdpcmEncoder::encode(const short* samples, int numFrames, int numChannels, uint8_t* block)
+{
+    if (numFrames < 1 || numChannels < 1 || numChannels > ADPCM_MAX_CHANNELS)
+    {
+        return 0;
+    }
+    
+    ChannelState states[ADPCM_MAX_CHANNELS];
+    uint8_t* out = block;
+    for (int c = 0; c < numChannels; c++)
+    {
+        states[c].predictor = samples[c];
+        states[c].stepIndex = m_stepIndex[c];
+        *out++ = (uint8_t)(samples[c] & 0xFF);
+        *out++ = (uint8_t)((samples[c] >> 8) & 0xFF);
+        *out++ = (uint8_t)states[c].stepIndex;
+        *out++ = 0;
+    }
+    
+    // the channels are independent, so they are coded side by side through the frames
+    int numCodes = 0;
+    uint8_t pending = 0;
+    const short* frame = samples + numChannels;
+    for (int i = 1; i < numFrames; i++, frame += numChannels)
+    {
+        for (int c = 0; c < numChannels; c++)
+        {
+            int code = encode_sample(states[c], frame[c]);
+            if (numCodes++ & 1)
+            {
+                *out++ = pending | (uint8_t)(code << 4);
+            }
+            else
+            {
+                pending = (uint8_t)code;
+            }
+        }
+    }
+    if (numCodes & 1)
+    {
+        *out++ = pending;
+    }
+    
+    for (int c = 0; c < numChannels; c++)
+    {
+        m_stepIndex[c] = states[c].stepIndex;
+    }
+    return (int)(out - block);
+}
+
+int AdpcmEncoder::getEncodedSize(int numFrames, int numChannels)
+{
+    return ADPCM_CHANNEL_HEADER_SIZE * numChannels + ((numFrames - 1) * numChannels + 1) / 2;
+}
+
+// ---- AdpcmDecoder public methods ----
+
+bool AdpcmDecoder::decode(const uint8_t* block, int numBytes, short* samples, int numFrames, int numChannels)
+{
+    if (numFrames < 1 || numChannels < 1 || numChannels > ADPCM_MAX_CHANNELS ||
+        numBytes < AdpcmEncoder::getEncodedSize(numFrames, numChannels))
+    {
+        return false;
+    }
+    
+    ChannelState states[ADPCM_MAX_CHANNELS];
+    const uint8_t* in = block;
+    for (int c = 0; c < numChannels; c++)
+    {
+        states[c].predictor = (short)(in[0] | (in[1] << 8));
+        states[c].stepIndex = (in[2] > MAX_STEP_INDEX) ? MAX_STEP_INDEX : in[2];
+        samples[c] = (short)states[c].predictor;
+        in += ADPCM_CHANNEL_HEADER_SIZE;
+    }
+    
+    int numCodes = 0;
+    short* frame = samples + numChannels;
+    for (int i = 1; i < numFrames; i++, frame += numChannels)
+    {
+        for (int c = 0; c < numChannels; c++)
+        {
+            int code = (numCodes++ & 1) ? (*in++ >> 4) : (*in & 0x0F);
+            update_state(states[c], code);
+            frame[c] = (short)states[c].predictor;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,100 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+/**
+ *  @file AdpcmCodec.h
+ *  iDiMP
+ *
+ *  The interfaces for the AdpcmEncoder and AdpcmDecoder classes are defined here.
+ */
+
+#ifndef ADPCM_CODEC_H
+#define ADPCM_CODEC_H
+
+#include <stdint.h>
+
+static const int ADPCM_MAX_CHANNELS        = 8; ///< Most channels a block may have
+static const int ADPCM_CHANNEL_HEADER_SIZE = 4; ///< Bytes of state at the start of each block, per channel
+
+/** AdpcmEncoder class.
+ * AdpcmEncoder compresses 16-bit PCM to 4 bits per sample with the IMA ADPCM algorithm: each 
+ * sample is coded as the quantized difference from a prediction, with a step size that adapts 
+ * to the signal.
+ *
+ * Every block starts with each channel's predictor and step index, so blocks can be decoded on
+ * their own - a lost block doesn't upset the ones after it.  The encoder carries its step index 
+ * over from one block to the next so quality doesn't dip at block starts.
+ *
+ * Block layout: per channel, the first sample (16 bits, little-endian), the step index and a 
+ * zero byte; then for each later frame, one 4-bit code per channel, low nibble first.
+ */
+class AdpcmEncoder
+{
+public:
+   /**
+    * AdpcmEncoder constructor
+    */
+    AdpcmEncoder();
+    
+   /**
+    * Start again from the initial state.
+    */
+    void reset();
+    
+   /**
+    * Encode a block.
+    * @param samples the interleaved samples
+    * @param numFrames the number of frames (samples per channel) - at least 1
+    * @param numChannels the number of channels (1 to ADPCM_MAX_CHANNELS)
+    * @param block receives getEncodedSize(numFrames, numChannels) bytes
+    * @return the number of bytes written, or 0 if the arguments are out of range
+    */
+    int encode(const short* samples, int numFrames, int numChannels, uint8_t* block);
+    
+   /**
+    * @return the size of a block holding numFrames frames of numChannels channels
+    */
+    static int getEncodedSize(int numFrames, int numChannels);
+    
+private:
+    int m_stepIndex[ADPCM_MAX_CHANNELS];
+};
+
+/** AdpcmDecoder class.
+ * AdpcmDecoder expands blocks made by AdpcmEncoder.  It has no state of its own.
+ */
+class AdpcmDecoder
+{
+public:
+   /**
+    * Decode a block.
+    * @param block the encoded block
+    * @param numBytes the size of the block
+    * @param samples receives numFrames * numChannels interleaved samples
+    * @param numFrames the number of frames to decode
+    * @param numChannels the number of channels the block was encoded with
+    * @return false if the block is too small to hold numFrames frames
+    */
+    static bool decode(const uint8_t* block, int numBytes, short* samples, int numFrames, int numChannels);
+};
+
+#endif // ADPCM_CODEC_H
@@ -0,0 +1,146 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+/*
+ *  ClockDriftEstimator.cpp
+ *  iDiMP
+ *
+ */
+
+#include "ClockDriftEstimator.h"
+
+#include <math.h>
+
+// ---- ClockDriftEstimator public methods ----
+
+ClockDriftEstimator::ClockDriftEstimator()
+{
+    reset();
+}
+
+void ClockDriftEstimator::reset()
+{
+    m_hasReading = false;
+    m_lastOffset = 0.0;
+    m_windowStart = 0.0;
+    m_windowMinLocal = 0.0;
+    m_windowMinOffset = 0.0;
+    m_firstPoint = 0;
+    m_numPoints = 0;
+    m_drift = 0.0;
+    m_lineLocal = 0.0;
+    m_lineOffset = 0.0;
+}
+
+void ClockDriftEstimator::addReading(double localSeconds, double remoteSeconds)
+{
+    double offset = localSeconds - remoteSeconds;
+    
+    if (m_hasReading && fabs(offset - m_lastOffset) > DRIFT_RESET_SECONDS)
+    {
+        // one of the clocks has been restarted - the old readings are no use
+        reset();
+    }
+    m_lastOffset = offset;
+    
+    if (!m_hasReading)
+    {
+        m_hasReading = true;
+        m_windowStart = localSeconds;
+        m_windowMinLocal = localSeconds;
+        m_windowMinOffset = offset;
+        return;
+    }
+    
+    if (localSeconds - m_windowStart >= DRIFT_WINDOW_SECONDS)
+    {
+        // keep this window's least-delayed reading
+        int index = (m_firstPoint + m_numPoints) % DRIFT_NUM_WINDOWS;
+        if (m_numPoints == DRIFT_NUM_WINDOWS)
+        {
+            m_firstPoint = (m_firstPoint + 1) % DRIFT_NUM_WINDOWS;
+        }
+        else
+        {
+            m_numPoints++;
+        }
+        m_pointLocal[index] = m_windowMinLocal;
+        m_pointOffset[index] = m_windowMinOffset;
+        fit();
+        
+        m_windowStart = localSeconds;
+        m_windowMinLocal = localSeconds;
+        m_windowMinOffset = offset;
+    }
+    else if (offset < m_windowMinOffset)
+    {
+        m_windowMinLocal = localSeconds;
+        m_windowMinOffset = offset;
+    }
+}
+
+double ClockDriftEstimator::getExcessDelay(double localSeconds, double remoteSeconds) const
+{
+    double offset = localSeconds - remoteSeconds;
+    double floor = m_windowMinOffset;
+    if (m_numPoints > 0)
+    {
+        floor = m_lineOffset - m_drift * (localSeconds - m_lineLocal);
+        if (m_windowMinOffset < floor)
+        {
+            floor = m_windowMinOffset;
+        }
+    }
+    return offset - floor;
+}
+
+// ---- ClockDriftEstimator private methods ----
+
+void ClockDriftEstimator::fit()
+{
+    // least squares, relative to the means so the large clock values don't cost precision
+    double meanLocal = 0.0;
+    double meanOffset = 0.0;
+    for (int i = 0; i < m_numPoints; i++)
+    {
+        int index = (m_firstPoint + i) % DRIFT_NUM_WINDOWS;
+        meanLocal += m_pointLocal[index];
+        meanOffset += m_pointOffset[index];
+    }
+    meanLocal /= m_numPoints;
+    meanOffset /= m_numPoints;
+    
+    double covariance = 0.0;
+    double variance = 0.0;
+    for (int i = 0; i < m_numPoints; i++)
+    {
+        int index = (m_firstPoint + i) % DRIFT_NUM_WINDOWS;
+        double local = m_pointLocal[index] - meanLocal;
+        covariance += local * (m_pointOffset[index] - meanOffset);
+        variance += local * local;
+    }
+    
+    // the offset falls as the remote clock gains on the local one
+    m_drift = (variance > 0.0) ? -covariance / variance : 0.0;
+    m_lineLocal = meanLocal;
+    m_lineOffset = meanOffset;
+}
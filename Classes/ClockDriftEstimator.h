@@ -0,0 +1,112 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+/**
+ *  @file ClockDriftEstimator.h
+ *  iDiMP
+ *
+ *  This file defines the interface for the ClockDriftEstimator class, which measures how fast 
+ *  one clock runs against another from noisy readings of both.
+ */
+
+#ifndef CLOCK_DRIFT_ESTIMATOR_H
+#define CLOCK_DRIFT_ESTIMATOR_H
+
+static const double DRIFT_WINDOW_SECONDS   = 2.0;  ///< Readings are reduced to their least-delayed one per window
+static const int    DRIFT_NUM_WINDOWS      = 64;   ///< Windows the drift is fitted over (about two minutes)
+static const int    DRIFT_MIN_WINDOWS      = 8;    ///< Windows needed before the drift is trusted
+static const double DRIFT_RESET_SECONDS    = 1.0;  ///< An offset jump this big means a clock was restarted
+
+/** ClockDriftEstimator class.
+ * A ClockDriftEstimator is given pairs of readings of a local clock and a remote clock (e.g. the 
+ * arrival time of a packet and the sender's timestamp in it), both in seconds.  Delays such as 
+ * network queueing only ever make the local reading later, so in each window only the reading with 
+ * the smallest local - remote offset is kept, and a straight line is fitted through those minima.  
+ * The slope of the line is the drift.
+ *
+ * All memory is held in the object, and addReading does a fixed amount of work, so it may be 
+ * used on the audio thread.  Not thread-safe.
+ */
+class ClockDriftEstimator
+{
+public:
+   /**
+    * ClockDriftEstimator constructor
+    */
+    ClockDriftEstimator();
+    
+   /**
+    * Forget all readings.
+    */
+    void reset();
+    
+   /**
+    * Add a pair of readings.
+    * @param localSeconds the local clock
+    * @param remoteSeconds the remote clock at the same moment (give or take a delay)
+    */
+    void addReading(double localSeconds, double remoteSeconds);
+    
+   /**
+    * @return true once enough readings have been seen for getDrift to be meaningful
+    */
+    bool isValid() const { return m_numPoints >= DRIFT_MIN_WINDOWS; }
+    
+   /**
+    * @return how much faster the remote clock runs than the local one, as a fraction
+    *         (1e-6 is 1 ppm); 0 until isValid
+    */
+    double getDrift() const { return isValid() ? m_drift : 0.0; }
+    
+   /**
+    * How much a pair of readings is delayed beyond the least delay seen, e.g. the queueing part of
+    * the one-way network delay.
+    * @param localSeconds the local clock
+    * @param remoteSeconds the remote clock
+    * @return the extra delay in seconds
+    */
+    double getExcessDelay(double localSeconds, double remoteSeconds) const;
+    
+private:
+    void fit();
+    
+    bool m_hasReading;
+    double m_lastOffset;
+    
+    // the window being collected
+    double m_windowStart;
+    double m_windowMinLocal;
+    double m_windowMinOffset;
+    
+    // the least-offset reading from each recent window, oldest first
+    double m_pointLocal[DRIFT_NUM_WINDOWS];
+    double m_pointOffset[DRIFT_NUM_WINDOWS];
+    int m_firstPoint;
+    int m_numPoints;
+    
+    // the fitted line: offset = m_lineOffset - m_drift * (local - m_lineLocal)
+    double m_drift;
+    double m_lineLocal;
+    double m_lineOffset;
+};
+
+#endif // CLOCK_DRIFT_ESTIMATOR_H
@@ -0,0 +1,216 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/*
+ *  CongestionController.cpp
+ *  iDiMP
+ *
+ */
+
+#include "CongestionController.h"
+
+#include <string.h>
+
+#import "ForwardErrorCorrection.h"
+
+// ---- CongestionController public methods ----
+
+CongestionController::CongestionController() :
+    m_targetLossRate(CONGESTION_TARGET_LOSS),
+    m_version(0)
+{
+    reset();
+}
+
+void CongestionController::reset()
+{
+    m_hasPending = false;
+    m_lastReportSeconds = 0.0;
+    m_hasFeedback = false;
+    m_level = 0;
+    m_last.lossRate = 0.0;
+    m_last.residualLossRate = 0.0;
+    m_last.delayTrendSeconds = 0.0;
+    m_last.jitterSeconds = 0.0;
+    m_lossRate = 0.0;
+    FecEncoder::chooseGroupSize(m_lossRate, m_fecData, m_fecParity);
+    m_cleanSinceSeconds = 0.0;
+    m_lastDecreaseSeconds = 0.0;
+    m_lastIncreaseSeconds = 0.0;
+    m_probeSeconds = CONGESTION_PROBE_SECONDS;
+    m_numReports = 0;
+    m_numDecreases = 0;
+    m_numIncreases = 0;
+    m_numFailedProbes = 0;
+    publish();
+}
+
+void CongestionController::addReport(const CongestionReport& report, double nowSeconds)
+{
+    if (!m_hasPending)
+    {
+        m_pending = report;
+        m_hasPending = true;
+    }
+    else
+    {
+        // whoever is worst off decides
+        m_pending.lossRate = (report.lossRate > m_pending.lossRate) ? report.lossRate : m_pending.lossRate;
+        m_pending.residualLossRate = (report.residualLossRate > m_pending.residualLossRate) ? report.residualLossRate : m_pending.residualLossRate;
+        m_pending.delayTrendSeconds = (report.delayTrendSeconds > m_pending.delayTrendSeconds) ? report.delayTrendSeconds : m_pending.delayTrendSeconds;
+        m_pending.jitterSeconds = (report.jitterSeconds > m_pending.jitterSeconds) ? report.jitterSeconds : m_pending.jitterSeconds;
+    }
+    m_lastReportSeconds = nowSeconds;
+}
+
+bool CongestionController::update(double nowSeconds)
+{
+    if (!m_hasPending)
+    {
+        // receivers that have stopped reporting get what was asked for
+        if (m_hasFeedback && nowSeconds - m_lastReportSeconds >= CONGESTION_REPORT_TIMEOUT)
+        {
+            bool changed = (m_level != 0);
+            m_hasFeedback = false;
+            m_level = 0;
+            publish();
+            return changed;
+        }
+        return false;
+    }
+    m_hasPending = false;
+    if (!m_hasFeedback)
+    {
+        m_hasFeedback = true;
+        m_cleanSinceSeconds = nowSeconds;
+    }
+    m_last = m_pending;
+    m_numReports++;
+    
+    int level = m_level;
+    int fecData = m_fecData;
+    int fecParity = m_fecParity;
+    bool delayIsRising = (m_last.delayTrendSeconds > CONGESTION_DELAY_TREND_LIMIT);
+    
+    // FEC follows random loss, but parity is no cure for a queue that is filling
+    if (!delayIsRising)
+    {
+        if (m_last.lossRate > m_lossRate)
+        {
+            m_lossRate = m_last.lossRate;
+        }
+        else
+        {
+            m_lossRate += CONGESTION_LOSS_GAIN * (m_last.lossRate - m_lossRate);
+        }
+        FecEncoder::chooseGroupSize(m_lossRate, fecData, fecParity);
+    }
+    bool fecChanged = (fecData != m_fecData || fecParity != m_fecParity);
+    
+    // loss the FEC has just been changed for gets a chance to be recovered first
+    bool isCongested = delayIsRising || (m_last.residualLossRate > m_targetLossRate && !fecChanged);
+    if (isCongested)
+    {
+        if (nowSeconds - m_lastDecreaseSeconds >= CONGESTION_DECREASE_HOLD && level < CONGESTION_NUM_LEVELS - 1)
+        {
+            level++;
+            m_numDecreases++;
+            if (m_numIncreases > 0 && nowSeconds - m_lastIncreaseSeconds < CONGESTION_FAILED_PROBE_SECONDS)
+            {
+                m_probeSeconds = (2.0 * m_probeSeconds < CONGESTION_MAX_PROBE_SECONDS) ? 2.0 * m_probeSeconds : CONGESTION_MAX_PROBE_SECONDS;
+                m_numFailedProbes++;
+            }
+            m_lastDecreaseSeconds = nowSeconds;
+        }
+        m_cleanSinceSeconds = nowSeconds;
+    }
+    else if (m_last.residualLossRate > 0.5 * m_targetLossRate)
+    {
+        // near the target: stay put
+        m_cleanSinceSeconds = nowSeconds;
+    }
+    else
+    {
+        if (level > 0 && nowSeconds - m_cleanSinceSeconds >= m_probeSeconds)
+        {
+            level--;
+            m_numIncreases++;
+            m_lastIncreaseSeconds = nowSeconds;
+            m_cleanSinceSeconds = nowSeconds;
+        }
+        
+        // a long clean spell forgets the failed tries
+        if (nowSeconds - m_lastDecreaseSeconds >= CONGESTION_MAX_PROBE_SECONDS)
+        {
+            m_probeSeconds = CONGESTION_PROBE_SECONDS;
+        }
+    }
+    
+    bool changed = (level != m_level || fecChanged);
+    m_level = level;
+    m_fecData = fecData;
+    m_fecParity = fecParity;
+    publish();
+    return changed;
+}
+
+void CongestionController::getStats(CongestionStats& stats) const
+{
+    for (;;)
+    {
+        int32_t version = AtomicLoad32(&m_version);
+        if ((version & 1) == 0)
+        {
+            memcpy(&stats, (const void*)&m_stats, sizeof(stats));
+            if (AtomicLoad32(&m_version) == version)
+            {
+                return;
+            }
+        }
+    }
+}
+
+// ---- CongestionController private methods ----
+
+void CongestionController::publish()
+{
+    CongestionStats stats;
+    stats.hasFeedback = m_hasFeedback;
+    stats.level = m_level;
+    stats.targetLossRate = m_targetLossRate;
+    stats.lossRate = m_lossRate;
+    stats.residualLossRate = m_last.residualLossRate;
+    stats.delayTrendSeconds = m_last.delayTrendSeconds;
+    stats.jitterSeconds = m_last.jitterSeconds;
+    stats.fecData = m_fecData;
+    stats.fecParity = m_fecParity;
+    stats.probeSeconds = m_probeSeconds;
+    stats.numReports = m_numReports;
+    stats.numDecreases = m_numDecreases;
+    stats.numIncreases = m_numIncreases;
+    stats.numFailedProbes = m_numFailedProbes;
+    
+    AtomicIncrement32(&m_version);
+    memcpy((void*)&m_stats, &stats, sizeof(stats));
+    AtomicIncrement32(&m_version);
+}
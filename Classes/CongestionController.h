@@ -0,0 +1,185 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/**
+ *  @file CongestionController.h
+ *  iDiMP
+ *
+ *  This file defines the interface for the CongestionController class, which adapts what is sent 
+ *  to the loss and delay that receivers report.
+ */
+
+#ifndef CONGESTION_CONTROLLER_H
+#define CONGESTION_CONTROLLER_H
+
+#include <stdint.h>
+#import "AtomicOps.h"
+
+static const int    CONGESTION_NUM_LEVELS         = 5;      ///< levels from 0 (everything asked for) to 4 (least bandwidth and fewest packets)
+static const double CONGESTION_TARGET_LOSS        = 0.01;   ///< default fraction of frames that may go missing at playout
+static const double CONGESTION_DELAY_TREND_LIMIT  = 0.004;  ///< a report whose mean delay grew more than this means a queue is building
+static const double CONGESTION_DECREASE_HOLD      = 1.0;    ///< seconds after raising the level before raising it again, so the step shows in the reports
+static const double CONGESTION_PROBE_SECONDS      = 5.0;    ///< seconds of clean reports before the level falls back one
+static const double CONGESTION_MAX_PROBE_SECONDS  = 80.0;   ///< the wait before falling back, doubled by each failed try, goes no higher
+static const double CONGESTION_FAILED_PROBE_SECONDS = 5.0;  ///< a rise this soon after falling back means the fall back failed
+static const double CONGESTION_REPORT_TIMEOUT     = 10.0;   ///< without reports for this long, what was asked for is sent again
+static const double CONGESTION_LOSS_GAIN          = 0.25;   ///< smoothing of falling loss rates (rising ones are taken at once)
+
+/**
+ * What one receiver measured of what we sent, over the interval since its last report.
+ */
+struct CongestionReport
+{
+    double lossRate;          ///< fraction of data packets the network lost, before FEC recovery
+    double residualLossRate;  ///< fraction of frames missing when it was time to play them, after FEC recovery
+    double delayTrendSeconds; ///< mean one-way delay less that of the previous interval
+    double jitterSeconds;     ///< interarrival jitter (RFC 3550)
+};
+
+/**
+ * The state of a CongestionController.
+ */
+struct CongestionStats
+{
+    bool hasFeedback;         ///< whether receivers are reporting
+    int level;                ///< 0 (everything asked for) to CONGESTION_NUM_LEVELS - 1
+    double targetLossRate;
+    double lossRate;          ///< network loss the FEC is chosen for
+    double residualLossRate;  ///< worst of the last reports
+    double delayTrendSeconds; ///< worst of the last reports
+    double jitterSeconds;     ///< worst of the last reports
+    int fecData;              ///< FEC group chosen for lossRate
+    int fecParity;
+    double probeSeconds;      ///< clean time needed before the level falls back one
+    uint32_t numReports;      ///< reports acted on (several arriving together count once)
+    uint32_t numDecreases;    ///< steps to a higher level, sending less
+    uint32_t numIncreases;    ///< steps back toward level 0
+    uint32_t numFailedProbes; ///< steps back that were soon undone
+};
+
+/** CongestionController class.
+ * A CongestionController hears receivers' reports of loss and delay, and chooses a level of what
+ * to give up, from nothing at level 0 to as much as can be given up at the top level, along with 
+ * an FEC group size.  What each level gives up is the caller's choice: each should take less 
+ * bandwidth or fewer packets than the one below it.
+ *
+ * A growing delay is the first sign that a queue is filling, and loss soon follows, so a report 
+ * whose delay is rising, or which lost more frames than the target even with FEC, steps the level 
+ * up at once (then not again until the step has had time to show).  Only after a spell of clean 
+ * reports is the level stepped back down, toward the lowest latency; a step back down that is 
+ * soon undone doubles the wait before the next try.  Loss while the delay is steady is taken to 
+ * be random, and is left to FEC; loss while the delay is rising adds no parity, which would only 
+ * add to the load.  Several receivers' reports are combined by taking the worst of each.
+ *
+ * addReport, update, setTargetLossRate and reset are for one thread; getStats may be called from
+ * any thread, and never waits.
+ */
+class CongestionController
+{
+public:
+   /**
+    * CongestionController constructor
+    */
+    CongestionController();
+    
+   /**
+    * Forget all reports and go back to level 0.
+    */
+    void reset();
+    
+   /**
+    * Set the fraction of frames that may go missing at playout.
+    * @param lossRate the target (CONGESTION_TARGET_LOSS to start with)
+    */
+    void setTargetLossRate(double lossRate) { m_targetLossRate = lossRate; }
+    
+   /**
+    * Add a receiver's report, to be acted on by the next update.
+    * @param report what the receiver measured
+    * @param nowSeconds when it arrived
+    */
+    void addReport(const CongestionReport& report, double nowSeconds);
+    
+   /**
+    * Act on the reports added since the last update, if any.
+    * @param nowSeconds now
+    * @return true if the level or the FEC group size has changed
+    */
+    bool update(double nowSeconds);
+    
+   /**
+    * @return true while receivers are reporting
+    */
+    bool hasFeedback() const { return m_hasFeedback; }
+    
+   /**
+    * @return the level: 0 gives up nothing, CONGESTION_NUM_LEVELS - 1 the most
+    */
+    int getLevel() const { return m_level; }
+    
+   /**
+    * Get the FEC group size chosen for the reported loss (see FecEncoder::chooseGroupSize).
+    * @param numData receives the number of data blocks per group
+    * @param numParity receives the number of parity blocks per group
+    */
+    void getFecGroupSize(int& numData, int& numParity) const { numData = m_fecData; numParity = m_fecParity; }
+    
+   /**
+    * Get the state of the controller, as of the last update.
+    * @param stats receives the state
+    */
+    void getStats(CongestionStats& stats) const;
+    
+private:
+    CongestionController(const CongestionController&);
+    CongestionController& operator= (const CongestionController&);
+    
+    void publish();
+    
+    double m_targetLossRate;
+    
+    // the worst of the reports since the last update
+    bool m_hasPending;
+    CongestionReport m_pending;
+    double m_lastReportSeconds;
+    
+    bool m_hasFeedback;
+    int m_level;
+    CongestionReport m_last;
+    double m_lossRate;            ///< smoothed network loss, for choosing the FEC
+    int m_fecData;
+    int m_fecParity;
+    double m_cleanSinceSeconds;   ///< start of the current run of clean reports
+    double m_lastDecreaseSeconds; ///< when the level last rose, sending less
+    double m_lastIncreaseSeconds; ///< when the level last fell back
+    double m_probeSeconds;
+    uint32_t m_numReports;
+    uint32_t m_numDecreases;
+    uint32_t m_numIncreases;
+    uint32_t m_numFailedProbes;
+    
+    volatile int32_t m_version; ///< odd while m_stats is being changed
+    CongestionStats m_stats;
+};
+
+#endif // CONGESTION_CONTROLLER_H
@@ -0,0 +1,548 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+/*
+ *  ForwardErrorCorrection.cpp
+ *  iDiMP
+ *
+ */
+
+#include "ForwardErrorCorrection.h"
+
+#include <math.h>
+#include <string.h>
+
+// ---- GF(256) arithmetic ----
+
+static uint8_t s_gfExp[512];
+static uint8_t s_gfLog[256];
+static bool s_gfInitialized = false;
+
+static void gf_init()
+{
+    if (s_gfInitialized)
+    {
+        return;
+    }
+    
+    // powers of 2 modulo the polynomial x^8 + x^4 + x^3 + x^2 + 1
+    int value = 1;
+    for (int i = 0; i < 255; i++)
+    {
+        s_gfExp[i] = (uint8_t)value;
+        s_gfLog[value] = (uint8_t)i;
+        value <<= 1;
+        if (value & 0x100)
+        {
+            value ^= 0x11D;
+        }
+    }
+    for (int i = 255; i < 512; i++)
+    {
+        s_gfExp[i] = s_gfExp[i - 255];
+    }
+    s_gfInitialized = true;
+}
+
+static inline uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+    if (a == 0 || b == 0)
+    {
+        return 0;
+    }
+    return s_gfExp[s_gfLog[a] + s_gfLog[b]];
+}
+
+static inline uint8_t gf_div(uint8_t a, uint8_t b)
+{
+    if (a == 0)
+    {
+        return 0;
+    }
+    return s_gfExp[s_gfLog[a] + 255 - s_gfLog[b]];
+}
+
+/**
+ * The weight of data block 'position' in parity block 'index': the Cauchy matrix 1 / (x_j + y_i)
+ * with x_j = 255 - j and y_i = i, with each column divided by its first entry so parity block 0
+ * is the XOR of the data.  Every square submatrix of a Cauchy matrix is invertible, so any m lost
+ * blocks can be rebuilt from any m parity blocks.
+ */
+static inline uint8_t coefficient(int index, int position)
+{
+    return gf_div((uint8_t)(255 ^ position), (uint8_t)((255 - index) ^ position));
+}
+
+/** destination += factor * source */
+static void multiply_add(uint8_t* destination, const uint8_t* source, uint8_t factor, int numBytes)
+{
+    if (factor == 0)
+    {
+        return;
+    }
+    if (factor == 1)
+    {
+        for (int i = 0; i < numBytes; i++)
+        {
+            destination[i] ^= source[i];
+        }
+        return;
+    }
+    
+    uint8_t product[256];
+    for (int i = 0; i < 256; i++)
+    {
+        product[i] = gf_mul(factor, (uint8_t)i);
+    }
+    for (int i = 0; i < numBytes; i++)
+    {
+        destination[i] ^= product[source[i]];
+    }
+}
+
+/** inverts a square matrix in place, returning false if it is singular */
+static bool invert_matrix(uint8_t matrix[FEC_MAX_PARITY_BLOCKS][FEC_MAX_PARITY_BLOCKS], int size)
+{
+    uint8_t inverse[FEC_MAX_PARITY_BLOCKS][FEC_MAX_PARITY_BLOCKS];
+    memset(inverse, 0, sizeof(inverse));
+    for (int i = 0; i < size; i++)
+    {
+        inverse[i][i] = 1;
+    }
+    
+    for (int column = 0; column < size; column++)
+    {
+        int pivot = column;
+        while (pivot < size && matrix[pivot][column] == 0)
+        {
+            pivot++;
+        }
+        if (pivot == size)
+        {
+            return false;
+        }
+        for (int j = 0; j < size; j++)
+        {
+            uint8_t temp = matrix[column][j]; matrix[column][j] = matrix[pivot][j]; matrix[pivot][j] = temp;
+            temp = inverse[column][j]; inverse[column][j] = inverse[pivot][j]; inverse[pivot][j] = temp;
+        }
+        
+        uint8_t scale = gf_div(1, matrix[column][column]);
+        for (int j = 0; j < size; j++)
+        {
+            matrix[column][j] = gf_mul(matrix[column][j], scale);
+            inverse[column][j] = gf_mul(inverse[column][j], scale);
+        }
+        
+        for (int row = 0; row < size; row++)
+        {
+            uint8_t factor = matrix[row][column];
+            if (row == column || factor == 0)
+            {
+                continue;
+            }
+            for (int j = 0; j < size; j++)
+            {
+                matrix[row][j] ^= gf_mul(factor, matrix[column][j]);
+                inverse[row][j] ^= gf_mul(factor, inverse[column][j]);
+            }
+        }
+    }
+    
+    memcpy(matrix, inverse, sizeof(inverse));
+    return true;
+}
+
+static int count_bits(uint32_t bits)
+{
+    int count = 0;
+    for (; bits; bits &= bits - 1)
+    {
+        count++;
+    }
+    return count;
+}
+
+static int clamp(int value, int minimum, int maximum)
+{
+    return (value < minimum) ? minimum : ((value > maximum) ? maximum : value);
+}
+
+// ---- FecEncoder public methods ----
+
+FecEncoder::FecEncoder(int blockSize, int numData, int numParity) :
+    m_blockSize(blockSize),
+    m_numData(0),
+    m_numParity(0),
+    m_nextNumData(0),
+    m_nextNumParity(0),
+    m_position(0)
+{
+    gf_init();
+    for (int i = 0; i < FEC_MAX_PARITY_BLOCKS; i++)
+    {
+        m_parity[i] = new uint8_t[blockSize];
+    }
+    setGroupSize(numData, numParity);
+}
+
+FecEncoder::~FecEncoder()
+{
+    for (int i = 0; i < FEC_MAX_PARITY_BLOCKS; i++)
+    {
+        delete[] m_parity[i];
+    }
+}
+
+void FecEncoder::setGroupSize(int numData, int numParity)
+{
+    m_nextNumData = clamp(numData, 1, FEC_MAX_DATA_BLOCKS);
+    m_nextNumParity = clamp(numParity, 0, FEC_MAX_PARITY_BLOCKS);
+    if (m_position == 0)
+    {
+        m_numData = m_nextNumData;
+        m_numParity = m_nextNumParity;
+    }
+}
+
+bool FecEncoder::addData(const void* block)
+{
+    if (m_position == 0)
+    {
+        m_numData = m_nextNumData;
+        m_numParity = m_nextNumParity;
+        for (int i = 0; i < m_numParity; i++)
+        {
+            memset(m_parity[i], 0, m_blockSize);
+        }
+    }
+    
+    for (int i = 0; i < m_numParity; i++)
+    {
+        multiply_add(m_parity[i], (const uint8_t*)block, coefficient(i, m_position), m_blockSize);
+    }
+    
+    if (++m_position == m_numData)
+    {
+        m_position = 0;
+        return true;
+    }
+    return false;
+}
+
+void FecEncoder::chooseGroupSize(double lossRate, int& numData, int& numParity)
+{
+    double p = (lossRate > FEC_MIN_LOSS_RATE) ? lossRate : FEC_MIN_LOSS_RATE;
+    if (p > 0.5)
+    {
+        p = 0.5;
+    }
+    
+    bool foundTarget = false;
+    double bestOverhead = 0.0;
+    double bestResidual = 1.0;
+    numData = 1;
+    numParity = FEC_MAX_PARITY_BLOCKS;
+    
+    for (int k = 1; k <= FEC_MAX_DATA_BLOCKS; k++)
+    {
+        for (int m = 1; m <= FEC_MAX_PARITY_BLOCKS; m++)
+        {
+            // a data block stays lost if it is lost and at least m of the other k + m - 1 blocks are too
+            int n = k + m - 1;
+            double othersLost = 0.0;
+            for (int lost = m; lost <= n; lost++)
+            {
+                double ways = 1.0;
+                for (int i = 0; i < lost; i++)
+                {
+                    ways = ways * (n - i) / (i + 1);
+                }
+                othersLost += ways * pow(p, lost) * pow(1.0 - p, n - lost);
+            }
+            double residual = p * othersLost;
+            double overhead = (double)m / k;
+            
+            if (residual <= FEC_TARGET_RESIDUAL_LOSS)
+            {
+                // cheapest first, then the smaller group to wait less for recovery
+                if (!foundTarget || overhead < bestOverhead)
+                {
+                    foundTarget = true;
+                    bestOverhead = overhead;
+                    numData = k;
+                    numParity = m;
+                }
+            }
+            else if (!foundTarget && residual < bestResidual)
+            {
+                bestResidual = residual;
+                numData = k;
+                numParity = m;
+            }
+        }
+    }
+}
+
+// ---- FecDecoder public methods ----
+
+FecDecoder::FecDecoder(int blockSize) :
+    m_blockSize(blockSize),
+    m_hasRetired(false),
+    m_lastRetiredSequence(0),
+    m_recoveredGroup(NULL),
+    m_numRecovered(0),
+    m_numPopped(0)
+{
+    gf_init();
+    memset(&m_stats, 0, sizeof(m_stats));
+    for (int i = 0; i < FEC_DECODER_GROUPS; i++)
+    {
+        Group& group = m_groups[i];
+        group.isActive = false;
+        for (int j = 0; j < FEC_MAX_DATA_BLOCKS; j++)
+        {
+            group.data[j] = new uint8_t[blockSize];
+        }
+        for (int j = 0; j < FEC_MAX_PARITY_BLOCKS; j++)
+        {
+            group.parity[j] = new uint8_t[blockSize];
+        }
+    }
+    for (int i = 0; i < FEC_MAX_PARITY_BLOCKS; i++)
+    {
+        m_scratch[i] = new uint8_t[blockSize];
+    }
+}
+
+FecDecoder::~FecDecoder()
+{
+    for (int i = 0; i < FEC_DECODER_GROUPS; i++)
+    {
+        for (int j = 0; j < FEC_MAX_DATA_BLOCKS; j++)
+        {
+            delete[] m_groups[i].data[j];
+        }
+        for (int j = 0; j < FEC_MAX_PARITY_BLOCKS; j++)
+        {
+            delete[] m_groups[i].parity[j];
+        }
+    }
+    for (int i = 0; i < FEC_MAX_PARITY_BLOCKS; i++)
+    {
+        delete[] m_scratch[i];
+    }
+}
+
+void FecDecoder::addData(uint32_t sequence, int numData, int position, const void* block)
+{
+    m_numRecovered = 0;
+    m_numPopped = 0;
+    if (numData < 1 || numData > FEC_MAX_DATA_BLOCKS || position < 0 || position >= numData)
+    {
+        return;
+    }
+    
+    Group* group = find_group(sequence - position, numData);
+    if (group == NULL || (group->dataMask & (1 << position)))
+    {
+        return;
+    }
+    
+    memcpy(group->data[position], block, m_blockSize);
+    group->dataMask |= 1 << position;
+    group->numDataReceived++;
+    m_stats.numDataReceived++;
+    recover(*group);
+}
+
+void FecDecoder::addParity(uint32_t firstSequence, int numData, int index, const void* block)
+{
+    m_numRecovered = 0;
+    m_numPopped = 0;
+    if (numData < 1 || numData > FEC_MAX_DATA_BLOCKS || index < 0 || index >= FEC_MAX_PARITY_BLOCKS)
+    {
+        return;
+    }
+    
+    Group* group = find_group(firstSequence, numData);
+    if (group == NULL || (group->parityMask & (1 << index)))
+    {
+        return;
+    }
+    
+    memcpy(group->parity[index], block, m_blockSize);
+    group->parityMask |= 1 << index;
+    m_stats.numParityReceived++;
+    recover(*group);
+}
+
+bool FecDecoder::popRecovered(uint32_t& sequence, const uint8_t*& block)
+{
+    if (m_numPopped >= m_numRecovered)
+    {
+        return false;
+    }
+    int position = m_recoveredPositions[m_numPopped++];
+    sequence = m_recoveredGroup->firstSequence + position;
+    block = m_recoveredGroup->data[position];
+    return true;
+}
+
+// ---- FecDecoder private methods ----
+
+FecDecoder::Group* FecDecoder::find_group(uint32_t firstSequence, int numData)
+{
+    Group* oldest = NULL;
+    Group* unused = NULL;
+    for (int i = 0; i < FEC_DECODER_GROUPS; i++)
+    {
+        Group& group = m_groups[i];
+        if (!group.isActive)
+        {
+            unused = &group;
+        }
+        else if (group.firstSequence == firstSequence && group.numData == numData)
+        {
+            return &group;
+        }
+        else if (oldest == NULL || (int32_t)(group.firstSequence - oldest->firstSequence) < 0)
+        {
+            oldest = &group;
+        }
+    }
+    
+    // a straggler from a group we've already given up on
+    if (m_hasRetired && (int32_t)(firstSequence - m_lastRetiredSequence) <= 0)
+    {
+        return NULL;
+    }
+    
+    if (unused == NULL)
+    {
+        retire_group(*oldest);
+        unused = oldest;
+    }
+    
+    unused->isActive = true;
+    unused->isComplete = false;
+    unused->firstSequence = firstSequence;
+    unused->numData = numData;
+    unused->numDataReceived = 0;
+    unused->dataMask = 0;
+    unused->parityMask = 0;
+    return unused;
+}
+
+void FecDecoder::retire_group(Group& group)
+{
+    int numMissing = group.numData - group.numDataReceived;
+    if (!group.isComplete)
+    {
+        m_stats.numUnrecovered += group.numData - count_bits(group.dataMask);
+    }
+    double gain = 1.0 - pow(1.0 - FEC_LOSS_RATE_GAIN, group.numData);
+    m_stats.lossRate += gain * ((double)numMissing / group.numData - m_stats.lossRate);
+    m_stats.numGroups++;
+    
+    if (!m_hasRetired || (int32_t)(group.firstSequence - m_lastRetiredSequence) > 0)
+    {
+        m_lastRetiredSequence = group.firstSequence;
+        m_hasRetired = true;
+    }
+    group.isActive = false;
+}
+
+void FecDecoder::recover(Group& group)
+{
+    if (group.isComplete)
+    {
+        return;
+    }
+    
+    int numMissing = group.numData - count_bits(group.dataMask);
+    if (numMissing == 0)
+    {
+        group.isComplete = true;
+        return;
+    }
+    if (count_bits(group.parityMask) < numMissing)
+    {
+        return;
+    }
+    
+    // use the first numMissing parity blocks to solve for the missing data blocks
+    int rows[FEC_MAX_PARITY_BLOCKS];
+    int columns[FEC_MAX_PARITY_BLOCKS];
+    for (int i = 0, n = 0; n < numMissing; i++)
+    {
+        if (group.parityMask & (1 << i))
+        {
+            rows[n++] = i;
+        }
+    }
+    for (int i = 0, n = 0; n < numMissing; i++)
+    {
+        if (!(group.dataMask & (1 << i)))
+        {
+            columns[n++] = i;
+        }
+    }
+    
+    // remove the received data from each parity block, leaving only the missing blocks' part
+    uint8_t matrix[FEC_MAX_PARITY_BLOCKS][FEC_MAX_PARITY_BLOCKS];
+    for (int r = 0; r < numMissing; r++)
+    {
+        memcpy(m_scratch[r], group.parity[rows[r]], m_blockSize);
+        for (int i = 0; i < group.numData; i++)
+        {
+            if (group.dataMask & (1 << i))
+            {
+                multiply_add(m_scratch[r], group.data[i], coefficient(rows[r], i), m_blockSize);
+            }
+        }
+        for (int c = 0; c < numMissing; c++)
+        {
+            matrix[r][c] = coefficient(rows[r], columns[c]);
+        }
+    }
+    
+    if (!invert_matrix(matrix, numMissing))
+    {
+        return;
+    }
+    
+    m_recoveredGroup = &group;
+    for (int c = 0; c < numMissing; c++)
+    {
+        uint8_t* block = group.data[columns[c]];
+        memset(block, 0, m_blockSize);
+        for (int r = 0; r < numMissing; r++)
+        {
+            multiply_add(block, m_scratch[r], matrix[c][r], m_blockSize);
+        }
+        group.dataMask |= 1 << columns[c];
+        m_recoveredPositions[m_numRecovered++] = columns[c];
+    }
+    m_stats.numRecovered += numMissing;
+    group.isComplete = true;
+}
@@ -0,0 +1,229 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+/**
+ *  @file ForwardErrorCorrection.h
+ *  iDiMP
+ *
+ *  This file defines the interfaces for the FecEncoder and FecDecoder classes, which protect 
+ *  network audio with erasure-coded parity blocks.
+ */
+
+#ifndef FORWARD_ERROR_CORRECTION_H
+#define FORWARD_ERROR_CORRECTION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+static const int    FEC_MAX_DATA_BLOCKS       = 8;     ///< Most data blocks in a group (bounds the wait for a recovered block)
+static const int    FEC_MAX_PARITY_BLOCKS     = 4;     ///< Most parity blocks in a group
+static const int    FEC_DECODER_GROUPS        = 4;     ///< Groups a FecDecoder can be collecting at once
+static const double FEC_TARGET_RESIDUAL_LOSS  = 0.001; ///< Block loss left after recovery that chooseGroupSize aims for
+static const double FEC_MIN_LOSS_RATE         = 0.005; ///< chooseGroupSize plans for at least this much loss
+static const double FEC_LOSS_RATE_GAIN        = 0.01;  ///< Smoothing of the measured loss rate, per data block
+
+/**
+ * Statistics gathered by a FecDecoder.  Counts are totals since the FecDecoder was created.
+ */
+struct FecStats
+{
+    uint32_t numDataReceived;   ///< data blocks received
+    uint32_t numParityReceived; ///< parity blocks received
+    uint32_t numRecovered;      ///< data blocks rebuilt from parity
+    uint32_t numUnrecovered;    ///< data blocks lost with too little parity to rebuild them
+    uint32_t numGroups;         ///< groups finished with
+    double lossRate;            ///< smoothed fraction of data blocks lost on the network before recovery (groups lost outright are not seen)
+};
+
+/** FecEncoder class.
+ * A FecEncoder computes parity for groups of k equal-sized data blocks so that any m of the 
+ * k + m blocks in a group can be lost and still be rebuilt by a FecDecoder.  With one parity 
+ * block this is a plain XOR; with more it is a Reed-Solomon erasure code over GF(256) built from 
+ * a Cauchy matrix, scaled so that the first parity block is still the XOR.
+ *
+ * Parity is accumulated as each data block is added, so the work is spread evenly.
+ */
+class FecEncoder
+{
+public:
+   /**
+    * FecEncoder constructor.  All memory is allocated here.
+    * @param blockSize the number of bytes in each block
+    * @param numData the number of data blocks in each group
+    * @param numParity the number of parity blocks in each group
+    */
+    FecEncoder(int blockSize, int numData, int numParity);
+    
+   /**
+    * FecEncoder destructor
+    */
+    ~FecEncoder();
+    
+   /**
+    * Change the group size.  Takes effect when the next group starts.
+    * @param numData the number of data blocks in each group (1 to FEC_MAX_DATA_BLOCKS)
+    * @param numParity the number of parity blocks in each group (0 to FEC_MAX_PARITY_BLOCKS)
+    */
+    void setGroupSize(int numData, int numParity);
+    
+   /**
+    * Add the next data block to the current group.
+    * @param block blockSize bytes of data
+    * @return true if this completed the group, and its parity blocks are ready
+    */
+    bool addData(const void* block);
+    
+   /**
+    * @param index which parity block (less than getNumParity())
+    * @return the parity block of the group just completed
+    */
+    const uint8_t* getParity(int index) const { return m_parity[index]; }
+    
+   /**
+    * @return the number of data blocks in the current group
+    */
+    int getNumData() const { return m_numData; }
+    
+   /**
+    * @return the number of parity blocks in the current group
+    */
+    int getNumParity() const { return m_numParity; }
+    
+   /**
+    * @return the position in the current group that the next data block will take
+    */
+    int getPosition() const { return m_position; }
+    
+   /**
+    * Choose the group size that protects against a given loss rate at the least bandwidth.  
+    * Groups are chosen so that data blocks are lost after recovery no more often than 
+    * FEC_TARGET_RESIDUAL_LOSS, assuming independent losses; if that can't be met the most 
+    * protective group is chosen.
+    * @param lossRate the fraction of blocks the network loses
+    * @param numData receives the number of data blocks per group
+    * @param numParity receives the number of parity blocks per group
+    */
+    static void chooseGroupSize(double lossRate, int& numData, int& numParity);
+    
+private:
+    FecEncoder(const FecEncoder&);
+    FecEncoder& operator= (const FecEncoder&);
+    
+    int m_blockSize;
+    int m_numData;
+    int m_numParity;
+    int m_nextNumData;
+    int m_nextNumParity;
+    int m_position;
+    uint8_t* m_parity[FEC_MAX_PARITY_BLOCKS];
+};
+
+/** FecDecoder class.
+ * A FecDecoder collects the data and parity blocks of recent groups and rebuilds missing 
+ * data blocks as soon as enough of their group has arrived.  Blocks are identified by 
+ * sequence number: a group is named by the sequence number of its first data block.
+ *
+ * After each addData or addParity call, rebuilt blocks are collected with popRecovered.
+ */
+class FecDecoder
+{
+public:
+   /**
+    * FecDecoder constructor.  All memory is allocated here.
+    * @param blockSize the number of bytes in each block
+    */
+    FecDecoder(int blockSize);
+    
+   /**
+    * FecDecoder destructor
+    */
+    ~FecDecoder();
+    
+   /**
+    * Add a received data block.
+    * @param sequence the block's sequence number
+    * @param numData the number of data blocks in its group
+    * @param position the block's position in its group
+    * @param block blockSize bytes of data
+    */
+    void addData(uint32_t sequence, int numData, int position, const void* block);
+    
+   /**
+    * Add a received parity block.
+    * @param firstSequence the sequence number of the group's first data block
+    * @param numData the number of data blocks in the group
+    * @param index which of the group's parity blocks this is
+    * @param block blockSize bytes of parity
+    */
+    void addParity(uint32_t firstSequence, int numData, int index, const void* block);
+    
+   /**
+    * Take the next rebuilt data block.
+    * @param sequence receives the block's sequence number
+    * @param block receives a pointer to the block's data, valid until the next addData or addParity
+    * @return false if there are no more
+    */
+    bool popRecovered(uint32_t& sequence, const uint8_t*& block);
+    
+   /**
+    * Get a copy of the statistics.
+    * @param stats receives the statistics
+    */
+    void getStats(FecStats& stats) const { stats = m_stats; }
+    
+private:
+    FecDecoder(const FecDecoder&);
+    FecDecoder& operator= (const FecDecoder&);
+    
+    /** the blocks received for one group */
+    struct Group
+    {
+        bool isActive;
+        bool isComplete;          ///< all data blocks are present (received or rebuilt)
+        uint32_t firstSequence;
+        int numData;
+        int numDataReceived;
+        uint32_t dataMask;        ///< bit per data block present
+        uint32_t parityMask;      ///< bit per parity block present
+        uint8_t* data[FEC_MAX_DATA_BLOCKS];
+        uint8_t* parity[FEC_MAX_PARITY_BLOCKS];
+    };
+    
+    Group* find_group(uint32_t firstSequence, int numData);
+    void retire_group(Group& group);
+    void recover(Group& group);
+    
+    int m_blockSize;
+    Group m_groups[FEC_DECODER_GROUPS];
+    uint8_t* m_scratch[FEC_MAX_PARITY_BLOCKS];
+    bool m_hasRetired;
+    uint32_t m_lastRetiredSequence; ///< first sequence of the newest group retired
+    
+    Group* m_recoveredGroup;
+    int m_recoveredPositions[FEC_MAX_DATA_BLOCKS];
+    int m_numRecovered;
+    int m_numPopped;
+    
+    FecStats m_stats;
+};
+
+#endif // FORWARD_ERROR_CORRECTION_H
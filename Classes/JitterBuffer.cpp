@@ -0,0 +1,385 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/*
+ *  JitterBuffer.cpp
+ *  iDiMP
+ *
+ */
+
+#include "JitterBuffer.h"
+
+#include <math.h>
+#include <string.h>
+
+static const int32_t SEQUENCE_MASK = JITTER_BUFFER_CAPACITY - 1;
+static const double JITTER_GAIN = 1.0 / 16.0; ///< smoothing of the jitter estimate, from RFC 3550
+
+// ---- JitterBuffer public methods ----
+
+JitterBuffer::JitterBuffer(int samplesPerFrame, double frameDurationSeconds, int initialTargetFrames) :
+    m_samplesPerFrame(samplesPerFrame),
+    m_frameDurationSeconds(frameDurationSeconds),
+    m_isPlaying(0),
+    m_playhead(0),
+    m_highestSequence(0),
+    m_firstSequence(0),
+    m_needFirstSequence(1),
+    m_resetRequested(0),
+    m_jitterMicroseconds(0),
+    m_targetFrames(initialTargetFrames),
+    m_numReceived(0),
+    m_numPlayed(0),
+    m_numMissing(0),
+    m_numLate(0),
+    m_numDuplicate(0),
+    m_numTooEarly(0),
+    m_numDiscarded(0),
+    m_numStretched(0),
+    m_numRebuffers(0),
+    m_jitterSeconds(0.0),
+    m_lastTransitSeconds(0.0),
+    m_hasTransit(false),
+    m_numConsecutiveLate(0),
+    m_pendingStretchFrames(0),
+    m_pendingDiscardFrames(0),
+    m_numConsecutiveMissing(0),
+    m_shrinkHoldFrames(0),
+    m_shrinkHoldLimit((int)(JITTER_BUFFER_SHRINK_HOLD_SECONDS / frameDurationSeconds))
+{
+    if (m_targetFrames < JITTER_BUFFER_MIN_TARGET_FRAMES)
+    {
+        m_targetFrames = JITTER_BUFFER_MIN_TARGET_FRAMES;
+    }
+    else if (m_targetFrames > JITTER_BUFFER_MAX_TARGET_FRAMES)
+    {
+        m_targetFrames = JITTER_BUFFER_MAX_TARGET_FRAMES;
+    }
+    
+    for (int i = 0; i < JITTER_BUFFER_CAPACITY; i++)
+    {
+        m_slots[i].state = SlotEmpty;
+        m_slots[i].sequence = i - JITTER_BUFFER_CAPACITY; // matches no sequence we'll see soon
+        m_slots[i].samples = new short[samplesPerFrame];
+    }
+}
+
+JitterBuffer::~JitterBuffer()
+{
+    for (int i = 0; i < JITTER_BUFFER_CAPACITY; i++)
+    {
+        delete[] m_slots[i].samples;
+        m_slots[i].samples = NULL;
+    }
+}
+
+JitterBuffer::WriteResult JitterBuffer::write(uint32_t sequence, const short* samples, int numSamples, double arrivalSeconds)
+{
+    if (numSamples > m_samplesPerFrame)
+    {
+        return WriteInvalid;
+    }
+    
+    if (AtomicLoad32(&m_needFirstSequence))
+    {
+        // the audio thread is (re)starting - this frame anchors the new playout
+        m_firstSequence = sequence;
+        m_highestSequence = sequence;
+        AtomicStore32(&m_needFirstSequence, 0);
+    }
+    
+    Slot& slot = m_slots[sequence & SEQUENCE_MASK];
+    bool isPlaying = AtomicLoad32(&m_isPlaying) != 0;
+    
+    if (isPlaying)
+    {
+        int32_t ahead = (int32_t)(sequence - (uint32_t)AtomicLoad32(&m_playhead));
+        if (ahead < 0)
+        {
+            // the slot remembers the last frame it held, so a copy of a played frame is a duplicate
+            if (slot.sequence == sequence && AtomicLoad32(&slot.state) == SlotEmpty)
+            {
+                AtomicIncrement32(&m_numDuplicate);
+                return WriteDuplicate;
+            }
+            
+            AtomicIncrement32(&m_numLate);
+            if (++m_numConsecutiveLate >= JITTER_BUFFER_RESET_LATE_PACKETS)
+            {
+                // nothing has been on time for ages - the sender must have started over
+                AtomicStore32(&m_resetRequested, 1);
+                m_numConsecutiveLate = 0;
+            }
+            return WriteLate;
+        }
+        if (ahead >= JITTER_BUFFER_CAPACITY)
+        {
+            AtomicIncrement32(&m_numTooEarly);
+            if (++m_numConsecutiveLate >= JITTER_BUFFER_RESET_LATE_PACKETS)
+            {
+                AtomicStore32(&m_resetRequested, 1);
+                m_numConsecutiveLate = 0;
+            }
+            return WriteTooEarly;
+        }
+    }
+    else if ((int32_t)(sequence - (uint32_t)m_highestSequence) <= -JITTER_BUFFER_CAPACITY)
+    {
+        AtomicIncrement32(&m_numLate);
+        return WriteLate;
+    }
+    m_numConsecutiveLate = 0;
+    
+    // claim the slot
+    if (!AtomicCompareAndSwap32(SlotEmpty, SlotWriting, &slot.state))
+    {
+        int32_t state = AtomicLoad32(&slot.state);
+        if (state == SlotFull && slot.sequence == sequence)
+        {
+            AtomicIncrement32(&m_numDuplicate);
+            return WriteDuplicate;
+        }
+        
+        // a frame the audio thread never got to can be replaced by a newer one, and anything 
+        // left from before playout (re)started can be replaced
+        bool isStale = (state == SlotFull) && (!isPlaying || (int32_t)(slot.sequence - sequence) < 0);
+        if (!isStale || !AtomicCompareAndSwap32(SlotFull, SlotWriting, &slot.state))
+        {
+            // the audio thread is on this slot right now, so this frame is due now - too late
+            AtomicIncrement32(&m_numLate);
+            return WriteLate;
+        }
+    }
+    
+    memcpy(slot.samples, samples, numSamples * sizeof(short));
+    if (numSamples < m_samplesPerFrame)
+    {
+        memset(slot.samples + numSamples, 0, (m_samplesPerFrame - numSamples) * sizeof(short));
+    }
+    slot.sequence = sequence;
+    AtomicStore32(&slot.state, SlotFull);
+    AtomicIncrement32(&m_numReceived);
+    
+    if ((int32_t)(sequence - (uint32_t)m_highestSequence) > 0)
+    {
+        AtomicStore32(&m_highestSequence, (int32_t)sequence);
+    }
+    
+    // interarrival jitter (RFC 3550 section 6.4.1) with the sequence number as the media clock
+    double transit = arrivalSeconds - sequence * m_frameDurationSeconds;
+    if (m_hasTransit)
+    {
+        m_jitterSeconds += (fabs(transit - m_lastTransitSeconds) - m_jitterSeconds) * JITTER_GAIN;
+        AtomicStore32(&m_jitterMicroseconds, (int32_t)(m_jitterSeconds * 1.0e6));
+    }
+    m_lastTransitSeconds = transit;
+    m_hasTransit = true;
+    
+    return WriteStored;
+}
+
+JitterBuffer::ReadResult JitterBuffer::read(short* samples, uint32_t* sequence)
+{
+    if (AtomicLoad32(&m_resetRequested))
+    {
+        AtomicStore32(&m_resetRequested, 0);
+        start_buffering();
+    }
+    
+    update_target();
+    
+    if (!m_isPlaying)
+    {
+        // wait until the target delay's worth of frames has arrived
+        if (!AtomicLoad32(&m_needFirstSequence))
+        {
+            int32_t highest = AtomicLoad32(&m_highestSequence);
+            int32_t numArrived = highest - AtomicLoad32(&m_firstSequence) + 1;
+            if (numArrived >= m_targetFrames)
+            {
+                AtomicStore32(&m_playhead, highest - m_targetFrames + 1);
+                AtomicStore32(&m_isPlaying, 1);
+                m_pendingStretchFrames = 0;
+                m_pendingDiscardFrames = 0;
+            }
+        }
+        if (!m_isPlaying)
+        {
+            memset(samples, 0, m_samplesPerFrame * sizeof(short));
+            return ReadBuffering;
+        }
+    }
+    
+    uint32_t playhead = (uint32_t)m_playhead;
+    int32_t numBuffered = AtomicLoad32(&m_highestSequence) - (int32_t)playhead + 1;
+    if (sequence != NULL)
+    {
+        *sequence = playhead;
+    }
+    
+    if (m_pendingStretchFrames > 0)
+    {
+        // hold playout back a frame to lengthen the delay
+        m_pendingStretchFrames--;
+        AtomicIncrement32(&m_numStretched);
+        memset(samples, 0, m_samplesPerFrame * sizeof(short));
+        return ReadMissing;
+    }
+    
+    if (m_pendingDiscardFrames > 0)
+    {
+        m_pendingDiscardFrames--;
+        if (numBuffered > m_targetFrames)
+        {
+            // skip a frame to shorten the delay
+            Slot& skipped = m_slots[playhead & SEQUENCE_MASK];
+            if (AtomicCompareAndSwap32(SlotFull, SlotReading, &skipped.state))
+            {
+                AtomicStore32(&skipped.state, SlotEmpty);
+            }
+            playhead++;
+            numBuffered--;
+            AtomicIncrement32(&m_numDiscarded);
+            if (sequence != NULL)
+            {
+                *sequence = playhead;
+            }
+        }
+    }
+    
+    ReadResult result = ReadMissing;
+    Slot& slot = m_slots[playhead & SEQUENCE_MASK];
+    if (AtomicCompareAndSwap32(SlotFull, SlotReading, &slot.state))
+    {
+        if (slot.sequence == playhead)
+        {
+            memcpy(samples, slot.samples, m_samplesPerFrame * sizeof(short));
+            result = ReadPlayed;
+            AtomicStore32(&slot.state, SlotEmpty);
+        }
+        else if ((int32_t)(slot.sequence - playhead) < 0)
+        {
+            // left over from before a reset
+            AtomicStore32(&slot.state, SlotEmpty);
+        }
+        else
+        {
+            AtomicStore32(&slot.state, SlotFull);
+        }
+    }
+    
+    AtomicStore32(&m_playhead, (int32_t)(playhead + 1));
+    
+    if (result == ReadPlayed)
+    {
+        AtomicIncrement32(&m_numPlayed);
+        m_numConsecutiveMissing = 0;
+    }
+    else
+    {
+        AtomicIncrement32(&m_numMissing);
+        memset(samples, 0, m_samplesPerFrame * sizeof(short));
+        
+        // nothing has arrived for a whole target delay - stop and refill rather than play a string of gaps
+        if (++m_numConsecutiveMissing >= m_targetFrames && numBuffered <= 0)
+        {
+            start_buffering();
+        }
+    }
+    return result;
+}
+
+void JitterBuffer::getStats(JitterBufferStats& stats) const
+{
+    stats.numReceived = AtomicLoad32(&m_numReceived);
+    stats.numPlayed = AtomicLoad32(&m_numPlayed);
+    stats.numMissing = AtomicLoad32(&m_numMissing);
+    stats.numLate = AtomicLoad32(&m_numLate);
+    stats.numDuplicate = AtomicLoad32(&m_numDuplicate);
+    stats.numTooEarly = AtomicLoad32(&m_numTooEarly);
+    stats.numDiscarded = AtomicLoad32(&m_numDiscarded);
+    stats.numStretched = AtomicLoad32(&m_numStretched);
+    stats.numRebuffers = AtomicLoad32(&m_numRebuffers);
+    stats.jitterSeconds = AtomicLoad32(&m_jitterMicroseconds) * 1.0e-6;
+    stats.targetDelayFrames = AtomicLoad32(&m_targetFrames);
+    
+    int32_t numBuffered = AtomicLoad32(&m_highestSequence) - AtomicLoad32(&m_playhead) + 1;
+    stats.bufferedFrames = (AtomicLoad32(&m_isPlaying) && numBuffered > 0) ? numBuffered : 0;
+}
+
+// ---- JitterBuffer private methods ----
+
+void JitterBuffer::update_target()
+{
+    // cover a multiple of the jitter, plus one frame because arrivals don't line up with callbacks
+    double jitterSeconds = AtomicLoad32(&m_jitterMicroseconds) * 1.0e-6;
+    int wanted = (int)ceil(JITTER_BUFFER_JITTER_MULTIPLE * jitterSeconds / m_frameDurationSeconds) + 1;
+    if (wanted < JITTER_BUFFER_MIN_TARGET_FRAMES)
+    {
+        wanted = JITTER_BUFFER_MIN_TARGET_FRAMES;
+    }
+    else if (wanted > JITTER_BUFFER_MAX_TARGET_FRAMES)
+    {
+        wanted = JITTER_BUFFER_MAX_TARGET_FRAMES;
+    }
+    
+    int target = m_targetFrames;
+    if (wanted > target)
+    {
+        // grow right away
+        if (m_isPlaying)
+        {
+            m_pendingStretchFrames += wanted - target;
+        }
+        m_pendingDiscardFrames = 0;
+        m_shrinkHoldFrames = 0;
+        AtomicStore32(&m_targetFrames, wanted);
+    }
+    else if (wanted < target)
+    {
+        // shrink one frame at a time, and only once the jitter has stayed low
+        if (++m_shrinkHoldFrames >= m_shrinkHoldLimit)
+        {
+            m_shrinkHoldFrames = 0;
+            if (m_isPlaying)
+            {
+                m_pendingDiscardFrames++;
+            }
+            AtomicStore32(&m_targetFrames, target - 1);
+        }
+    }
+    else
+    {
+        m_shrinkHoldFrames = 0;
+    }
+}
+
+void JitterBuffer::start_buffering()
+{
+    AtomicStore32(&m_isPlaying, 0);
+    AtomicStore32(&m_needFirstSequence, 1);
+    m_numConsecutiveMissing = 0;
+    m_pendingStretchFrames = 0;
+    m_pendingDiscardFrames = 0;
+    AtomicIncrement32(&m_numRebuffers);
+}
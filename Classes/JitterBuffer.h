@@ -0,0 +1,209 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/**
+ *  @file JitterBuffer.h
+ *  iDiMP
+ *
+ *  This file defines the interface for the JitterBuffer class, which reorders and times the 
+ *  playout of audio frames received from the network.
+ */
+
+#ifndef JITTER_BUFFER_H
+#define JITTER_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#import "AtomicOps.h"
+
+static const int    JITTER_BUFFER_CAPACITY             = 64;   ///< Frames which can be held (must be a power of 2)
+static const int    JITTER_BUFFER_MIN_TARGET_FRAMES    = 2;    ///< Smallest playout delay, in frames (one for the frame being played, one for arrival phase)
+static const int    JITTER_BUFFER_MAX_TARGET_FRAMES    = 32;   ///< Largest playout delay, in frames (frames may be as short as 2.5 ms)
+static const double JITTER_BUFFER_JITTER_MULTIPLE      = 3.0;  ///< Playout delay covers this many times the measured jitter
+static const double JITTER_BUFFER_SHRINK_HOLD_SECONDS  = 5.0;  ///< How long jitter must stay low before the delay is reduced
+static const int    JITTER_BUFFER_RESET_LATE_PACKETS   = 2 * JITTER_BUFFER_CAPACITY; ///< Consecutive late packets that mean the sender has restarted
+
+/**
+ * Statistics gathered by a JitterBuffer.  Counts are totals since the JitterBuffer was created.
+ */
+struct JitterBufferStats
+{
+    uint32_t numReceived;     ///< frames stored for playout
+    uint32_t numPlayed;       ///< frames played on time
+    uint32_t numMissing;      ///< frames that weren't there when it was time to play them
+    uint32_t numLate;         ///< frames that arrived after their playout time
+    uint32_t numDuplicate;    ///< frames that arrived more than once (including deliberate redundancy)
+    uint32_t numTooEarly;     ///< frames that arrived too far ahead of playout to be held
+    uint32_t numDiscarded;    ///< frames skipped to reduce the playout delay
+    uint32_t numStretched;    ///< frames inserted to increase the playout delay
+    uint32_t numRebuffers;    ///< times playout stopped to refill the buffer
+    double jitterSeconds;     ///< interarrival jitter estimate (RFC 3550)
+    int targetDelayFrames;    ///< current playout delay target
+    int bufferedFrames;       ///< frames currently waiting to be played
+};
+
+/** JitterBuffer class.
+ * A JitterBuffer holds audio frames from the network, keyed by sequence number, and releases 
+ * them to the audio thread in order after an adaptive playout delay.
+ *
+ * The delay is chosen from the measured interarrival jitter (as in RFC 3550): it grows as soon as
+ * the jitter does, by holding playout back a frame, and shrinks only after the jitter has stayed 
+ * low for a while, by skipping a frame.  When the buffer runs dry, playout stops until it has 
+ * refilled to the target delay.
+ *
+ * write is called by exactly one network thread and read by exactly one audio thread.  They 
+ * never block each other: each slot is handed between them with an atomic state.
+ */
+class JitterBuffer
+{
+public:
+   /**
+    * What read produced.
+    */
+    enum ReadResult
+    {
+        ReadPlayed = 0,  /*!< a received frame was returned */
+        ReadMissing,     /*!< the frame due now is missing (lost or late) - the output is silence */
+        ReadBuffering    /*!< playout has not started - the output is silence */
+    };
+    
+   /**
+    * What write did with a frame.
+    */
+    enum WriteResult
+    {
+        WriteStored = 0, /*!< the frame will be played */
+        WriteDuplicate,  /*!< the frame is already stored or has been played */
+        WriteLate,       /*!< the frame's playout time has passed */
+        WriteTooEarly,   /*!< the frame is too far ahead of playout to hold */
+        WriteInvalid     /*!< the frame is bigger than the buffer's frame size */
+    };
+    
+   /**
+    * JitterBuffer constructor.  All memory is allocated here.
+    * @param samplesPerFrame the number of samples (all channels) in each frame
+    * @param frameDurationSeconds the playing time of one frame
+    * @param initialTargetFrames the playout delay to use until jitter has been measured
+    */
+    JitterBuffer(int samplesPerFrame, double frameDurationSeconds, int initialTargetFrames);
+    
+   /**
+    * JitterBuffer destructor
+    */
+    ~JitterBuffer();
+    
+   /**
+    * Store a frame received from the network.  Called from the network thread only.
+    * @param sequence the frame's sequence number (consecutive frames have consecutive numbers)
+    * @param samples the frame's samples
+    * @param numSamples the number of samples - frames shorter than samplesPerFrame are padded with silence
+    * @param arrivalSeconds the time the frame arrived, on any clock that counts seconds
+    * @return what was done with the frame
+    */
+    WriteResult write(uint32_t sequence, const short* samples, int numSamples, double arrivalSeconds);
+    
+   /**
+    * Get the next frame to play.  Called from the audio thread only.
+    * @param samples receives samplesPerFrame samples
+    * @param sequence if not NULL, receives the sequence number of the frame that was due
+    * @return whether a frame was played, missing, or playout hasn't started
+    */
+    ReadResult read(short* samples, uint32_t* sequence = NULL);
+    
+   /**
+    * Get a copy of the statistics.  May be called from any thread; the counts are each 
+    * consistent but are not captured at exactly the same instant.
+    * @param stats receives the statistics
+    */
+    void getStats(JitterBufferStats& stats) const;
+    
+   /**
+    * @return the number of samples in each frame
+    */
+    int getSamplesPerFrame() const { return m_samplesPerFrame; }
+    
+private:
+    JitterBuffer(const JitterBuffer&);
+    JitterBuffer& operator= (const JitterBuffer&);
+    
+    /** the hand-off states of a Slot */
+    enum SlotState
+    {
+        SlotEmpty = 0, /*!< free for the network thread */
+        SlotWriting,   /*!< being filled by the network thread */
+        SlotFull,      /*!< holds a frame for the audio thread */
+        SlotReading    /*!< being read (or cleared) by the audio thread */
+    };
+    
+    /** one frame of storage */
+    struct Slot
+    {
+        volatile int32_t state;
+        uint32_t sequence;
+        short* samples;
+    };
+    
+    void update_target();
+    void start_buffering();
+    
+    int m_samplesPerFrame;
+    double m_frameDurationSeconds;
+    Slot m_slots[JITTER_BUFFER_CAPACITY];
+    
+    // shared between the threads
+    volatile int32_t m_isPlaying;          ///< written by the audio thread
+    volatile int32_t m_playhead;           ///< next sequence to play - written by the audio thread
+    volatile int32_t m_highestSequence;    ///< newest sequence stored - written by the network thread
+    volatile int32_t m_firstSequence;      ///< first sequence stored since buffering started - written by the network thread
+    volatile int32_t m_needFirstSequence;  ///< set by the audio thread to ask for m_firstSequence
+    volatile int32_t m_resetRequested;     ///< set by the network thread when the sender seems to have restarted
+    volatile int32_t m_jitterMicroseconds; ///< written by the network thread
+    volatile int32_t m_targetFrames;       ///< written by the audio thread
+    
+    // statistics
+    volatile int32_t m_numReceived;
+    volatile int32_t m_numPlayed;
+    volatile int32_t m_numMissing;
+    volatile int32_t m_numLate;
+    volatile int32_t m_numDuplicate;
+    volatile int32_t m_numTooEarly;
+    volatile int32_t m_numDiscarded;
+    volatile int32_t m_numStretched;
+    volatile int32_t m_numRebuffers;
+    
+    // network thread only
+    double m_jitterSeconds;
+    double m_lastTransitSeconds;
+    bool m_hasTransit;
+    int m_numConsecutiveLate;
+    
+    // audio thread only
+    int m_pendingStretchFrames;
+    int m_pendingDiscardFrames;
+    int m_numConsecutiveMissing;
+    int m_shrinkHoldFrames;
+    int m_shrinkHoldLimit;
+};
+
+#endif // JITTER_BUFFER_H
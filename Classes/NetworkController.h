@@ -29,50 +29,284 @@
 //
 
 #import <Foundation/Foundation.h>
-#import "AsyncUdpSocket.h"
+#import <pthread.h>
+#import <sys/socket.h>
+#import "UdpTransport.h"
+#import "JitterBuffer.h"
+#import "PacketLossConcealer.h"
+#import "ForwardErrorCorrection.h"
+#import "AdpcmCodec.h"
+#import "ClockDriftEstimator.h"
+#import "AdaptiveResampler.h"
+#import "PacketRing.h"
+#import "NetworkTelemetry.h"
+#import "NetworkImpairment.h"
+#import "SynthEventStream.h"
+#import "SessionClock.h"
+#import "CongestionController.h"
+#import "PacketCapture.h"
 
-#define kNumSamplesPerChannel 1024
-#define kNumSlicesPerPacket 2
-// Make this a multiple of 2 for fast % computations
-#define kNumCachedReceiveBuffers 8
+#define kNumSamplesPerChannel 1024 // most frames in a buffer from the audio thread, and in one packet
+#define kFecDataBlocks 4   // data blocks per FEC group until loss has been measured
+#define kFecParityBlocks 1 // parity blocks per FEC group until loss has been measured
+#define kNumNetworkChannels 2 // most channels a stream carries
+#define kMaxPayloadBytes (kNumSamplesPerChannel * kNumNetworkChannels * sizeof(short))
+#define kMaxReceiveStreams 8 // most senders received and mixed at once
+#define kMinFrameDuration 0.0025 // shortest frame of audio sent, in seconds
+#define kMaxFrameDuration 0.02   // longest frame of audio sent, in seconds
+#define kDefaultFrameDuration 0.005
+#define kDefaultPathMtu 1280 // the least any IPv6 path carries, and well under Ethernet and Wi-Fi
 
 /**
- * Holds one buffer from Core Audio, along with a tag byte.
+ * How the audio in a DMPPayload is coded.
  */
-typedef struct DMPDataPacketSlice
+typedef enum
 {
-    uint8_t index; // maybe this should be 'tag'?
-    short data[kNumSamplesPerChannel];
-} DMPDataPacketSlice;
+    kDMPCodecPcm16 = 0, // 16-bit PCM
+    kDMPCodecAdpcm = 1  // IMA ADPCM, 4 bits per sample (see AdpcmEncoder)
+} DMPCodec;
 
 /**
- * For data redundancy, holds multiple DMPDataPacketSlice structs.
+ * How the channels in a DMPPayload are laid out.  The data for each part follows the previous one.
  */
-typedef struct DMPDataPacket {
-    DMPDataPacketSlice slices[kNumSlicesPerPacket];
+typedef enum
+{
+    kDMPLayoutMono = 0,    // one channel
+    kDMPLayoutStereo = 1,  // left and right, interleaved
+    kDMPLayoutMidSide = 2  // mid (L + R) / 2, then side (L - R) / 2 at half the sample rate
+} DMPLayout;
+
+/**
+ * What a DMPDataPacket holds.
+ */
+enum
+{
+    kDMPPacketTypeData = 0,  // one buffer of audio
+    kDMPPacketTypeParity = 1, // one FEC parity block, for rebuilding lost data packets
+    kDMPPacketTypeEvents = 2, // TouchSynth changes (a DMPEventPacket)
+    kDMPPacketTypeClockRequest = 3, // asks for a peer's clock (a DMPClockPacket)
+    kDMPPacketTypeClockReply = 4,   // answers a clock request
+    kDMPPacketTypeFeedback = 5      // a receiver's report of how a stream is arriving (a DMPFeedbackPacket)
+};
+
+/**
+ * What is sent.
+ */
+typedef enum
+{
+    kDMPSendAudio = 0,      // the audio we play
+    kDMPSendSynthEvents = 1 // only the TouchSynth's changes, which receivers play on their own TouchSynth
+} DMPSendMode;
+
+/**
+ * Holds one or more consecutive frames of audio, coded together.  This is the part of a packet that 
+ * FEC protects, so a rebuilt payload carries its own codec, framing and length.
+ */
+typedef struct DMPPayload
+{
+    uint8_t codec; // a DMPCodec
+    uint8_t layout; // a DMPLayout
+    uint8_t numFrames; // frames aggregated in this payload
+    uint8_t reserved;
+    uint16_t frameSize; // samples per channel in each frame (always even)
+    uint16_t length; // bytes of data used
+    uint32_t frameSequence; // sequence number of the first frame (frames are numbered separately from packets)
+    uint8_t data[kMaxPayloadBytes];
+} DMPPayload;
+
+/**
+ * Holds one payload of audio frames or one FEC parity block, along with its place in its FEC group.
+ * Only the used part of the payload is sent: a parity packet is as long as the longest payload in its group.
+ */
+typedef struct DMPDataPacket
+{
+    uint32_t sequence; // data: the packet's sequence number; parity: the sequence number of the group's first packet
+    uint32_t timestamp; // data: the sender's sample clock at the payload's first frame
+    uint8_t type; // kDMPPacketTypeData or kDMPPacketTypeParity
+    uint8_t groupSize; // number of data packets in the FEC group
+    uint8_t groupPosition; // data: position in the group; parity: which parity block
+    uint8_t reserved;
+    DMPPayload payload; // data: the coded audio; parity: FEC parity over the group's payloads
 } DMPDataPacket;
 
+/**
+ * Holds TouchSynth changes, or a snapshot of the whole TouchSynth, instead of audio.  Only the 
+ * events used are sent.  The header matches DMPDataPacket's up to the type.
+ */
+typedef struct DMPEventPacket
+{
+    uint32_t sequence; // counts the sender's event packets
+    uint32_t timestamp; // the sender's sample clock when the packet was sent
+    uint8_t type; // kDMPPacketTypeEvents
+    uint8_t numEvents;
+    uint8_t isSnapshot; // whether the events are a snapshot (see SynthEventSender::getSnapshot) rather than changes
+    uint8_t reserved;
+    uint32_t sessionMasterId; // the master of the sender's session clock
+    double sessionSeconds; // the session clock at timestamp
+    SynthEvent events[SYNTH_EVENT_HISTORY]; // oldest first
+} DMPEventPacket;
+
+/**
+ * One half of an exchange of timestamps between peers, from which each works out the other's 
+ * clock (see PeerClock).  The header matches DMPDataPacket's up to the type.  Times are host clock 
+ * seconds.
+ */
+typedef struct DMPClockPacket
+{
+    uint32_t nodeId; // the sender's node (see SessionClock)
+    uint32_t peerId; // reply: the node that asked
+    uint8_t type; // kDMPPacketTypeClockRequest or kDMPPacketTypeClockReply
+    uint8_t reserved[3];
+    uint32_t masterId; // the master of the sender's session clock
+    double originateSeconds; // the asker's clock when it sent the request
+    double receiveSeconds; // reply: the replier's clock when the request arrived
+    double transmitSeconds; // reply: the replier's clock when it replied
+} DMPClockPacket;
+
+/**
+ * What a receiver has measured of a stream since its last report, sent back to the stream's sender
+ * so it can adapt what it sends (see CongestionController).  The header matches DMPDataPacket's up 
+ * to the type.
+ */
+typedef struct DMPFeedbackPacket
+{
+    uint32_t sequence; // counts the receiver's reports on the stream
+    uint32_t numExpected; // data packets the sender sent in the interval, judging by their sequence numbers
+    uint8_t type; // kDMPPacketTypeFeedback
+    uint8_t reserved[3];
+    float lossRate; // fraction of the data packets the network lost, before FEC recovery
+    float residualLossRate; // fraction of frames missing when it was time to play them
+    float delayTrendSeconds; // mean one-way delay less that of the previous interval
+    float jitterSeconds; // interarrival jitter (RFC 3550)
+} DMPFeedbackPacket;
+
+/**
+ * Clock measurements of a received stream.
+ */
+typedef struct NetworkClockStats
+{
+    double senderDrift;       // how much faster the sender's sample clock runs than the host clock (1e-6 is 1 ppm)
+    double playbackDrift;     // how much faster our playback sample clock runs than the host clock
+    double resampleRatio;     // received frames played per output frame
+    double excessDelaySeconds; // one-way delay of the last packet beyond the least seen
+} NetworkClockStats;
+
+struct DMPReceiveStream;
 
 /**
  * The NetworkController class is a singleton, and it provides the following services:
  * - Bonjour advertising and browsing
  * - Sending and receiving audio data over UDP
+ * - Mixing the audio received from each sender
  */
 @interface NetworkController : NSObject {
-    AsyncUdpSocket *socket;
+    UdpTransport *transport; // the audio socket, used only by the network thread once it has started
     NSNetService *netService;
     BOOL serviceIsPublishing;
     NSNetServiceBrowser *browser;
     BOOL browserIsSearching;
     NSMutableArray *services; // Active NSNetServices
     NSData *savedAddress; // Current destination of network audio
+    NSString *multicastGroup; // group sent to instead of savedAddress, if any
+    NSData *multicastAddress; // multicastGroup's address on our port
+    int multicastTTL;
+    BOOL multicastLoopback;
+    NSString *multicastInterface; // local address of the interface used for the group, or nil for the default
     UITableView *clientTableView;
     
-    DMPDataPacket savedPacket;
-    uint8_t oldestSlice;
-    uint8_t currentSendBufferIndex;
-    DMPDataPacketSlice audioReceiveBuffers[kNumCachedReceiveBuffers];
-    NSUInteger currentReceiveBufferIndex;
+    // the network thread does all the socket's sending and receiving
+    pthread_t networkThread;
+    BOOL networkThreadStarted;
+    volatile int32_t networkThreadIsRunning;
+    
+    // sending - the audio thread queues buffers in sendRing, and the network thread cuts them into
+    // frames and codes and sends them
+    uint32_t sendTimestamp; // sample clock of the audio thread's sent buffers
+    PacketRing *sendRing;
+    int sendFrameMicroseconds; // frame duration asked for, set by the main thread
+    int sendAggregateMicroseconds; // longest frames may wait to share a packet, set by the main thread
+    int sendMaxDatagramBytes; // from the path MTU, set by the main thread
+    short sendPendingSamples[2 * kNumSamplesPerChannel * kNumNetworkChannels]; // not yet sent - network thread
+    int sendPendingFrames;
+    uint32_t sendPendingTimestamp; // sample clock at the first pending frame
+    uint32_t sendFrameSequence;
+    DMPSendMode sendMode;
+    double sendClockSeconds; // host time of the audio thread's latest buffer - network thread
+    uint32_t sendClockTimestamp; // and its timestamp
+    BOOL hasSendClock;
+    
+    // TouchSynth changes - the sender hears them on the main thread, and the network thread sends them
+    SynthEventSender *synthEventSender;
+    uint32_t sendEventSequence;
+    double lastEventPacketSeconds;
+    double lastSnapshotSeconds;
+    
+    // congestion control - receivers report how our audio arrives, and the network thread adapts
+    // what is sent: the codec, layout and packet duration, and the FEC group size
+    CongestionController *congestion; // fed and updated by the network thread
+    BOOL congestionControl; // set by the main thread
+    BOOL congestionControlApplied; // network thread
+    int congestionTargetLossPpm; // set by the main thread
+    DMPCodec sendCodecApplied; // sendCodec at the congestion level - network thread
+    int sendAggregateApplied; // sendAggregateMicroseconds at the congestion level - network thread
+    
+    // the clock shared by everyone in the session - the network thread exchanges timestamps with each peer
+    SessionClock *sessionClock;
+    double lastClockRequestSeconds;
+    pthread_mutex_t sendDestinationLock; // guards the send destination, which the main thread sets
+    struct sockaddr_storage sendDestination;
+    socklen_t sendDestinationLength; // 0 when there is nowhere to send
+    BOOL sendDestinationIsStereo;
+    
+    // impairment simulation of what we send
+    NetworkImpairment *impairment; // network thread
+    BOOL impairmentIsOn; // network thread
+    pthread_mutex_t impairmentLock; // guards the settings asked for by the main thread, and the stats handed back
+    NetworkImpairmentSettings impairmentSettings;
+    BOOL impairmentRequested;
+    volatile int32_t impairmentChanged;
+    NetworkImpairmentStats impairmentStats;
+    
+    // capture of what is sent and received, and replay of a capture into the receive path - the 
+    // main thread makes and frees them, and the network thread uses whichever are published
+    PacketCaptureWriter *volatile captureWriter;
+    PacketReplayer *volatile replayer;
+    volatile int32_t networkEpoch; // odd while the network thread may be using them (see stopCapture)
+    uint32_t sendSequence;
+    FecEncoder *fecEncoder;
+    volatile int32_t fecGroupSizeRequest; // (data << 8) | parity, as last chosen on the main thread
+    int32_t fecGroupSizeApplied;
+    BOOL fecAutoTune;
+    int fecGroupPayloadLength; // longest payload in the FEC group being sent
+    DMPCodec sendCodec;
+    DMPLayout sendLayout;
+    AdpcmEncoder *adpcmEncoder;
+    AdpcmEncoder *adpcmSideEncoder;
+    short sendMidFrame[kNumSamplesPerChannel]; // one packet's worth
+    short sendSideFrame[kNumSamplesPerChannel];
+    
+    NSMutableDictionary *peerChannels; // NSNumber channel count advertised by each resolved address
+    short decodedFrame[kNumSamplesPerChannel * kNumNetworkChannels];
+    short midFrame[kNumSamplesPerChannel];
+    short sideFrame[kNumSamplesPerChannel];
+    
+    // one stream per sender, mixed together
+    struct DMPReceiveStream *volatile receiveStreams[kMaxReceiveStreams]; // published to the audio thread
+    NSMutableDictionary *streamGains; // NSNumber gain for each stream name, kept when a stream goes quiet
+    pthread_mutex_t receiveStreamsLock; // taken by the network thread while it handles packets, and by the main thread to look at the streams
+    NetworkTelemetry *streamTelemetry[kMaxReceiveStreams]; // one per slot of receiveStreams, read without the lock
+    int telemetryLogMilliseconds; // 0 for no logging - set by the main thread
+    double lastTelemetryLogSeconds; // network thread
+    volatile int32_t mixEpoch; // odd while the audio thread is mixing (see retireReceiveStream:)
+    BOOL reportedStreamLimit;
+    short receivedFrame[kNumSamplesPerChannel * kNumNetworkChannels];
+    short mixedFrame[kNumSamplesPerChannel * kNumNetworkChannels];
+    float synthFrame[kNumSamplesPerChannel * kNumNetworkChannels]; // a received stream's TouchSynth - audio thread
+    
+    // clock drift compensation
+    ClockDriftEstimator *playbackClock; // our playback sample clock against host time - audio thread
+    volatile int32_t playbackDriftPpb;
+    double playbackSamples;
 }
 
 /**
@@ -95,13 +329,218 @@ typedef struct DMPDataPacket {
 + (NetworkController *)sharedInstance;
 
 /**
- * Called by AudioEngine to queue a buffer for network transmit.
+ * Whether audio can be sent to an address, such as one a Bonjour service resolved to: IPv6 
+ * addresses need the socket to have IPv6.
+ */
+- (BOOL)canSendToAddress:(NSData *)address;
+/**
+ * Called by AudioEngine to queue a buffer for network transmit.  It is sent from a dedicated 
+ * thread, so never waits on the main thread or the network.
  */
 - (void)sendAudioBuffer:(short*)buffer length:(int)length channels:(int)numChannels;
 /**
  * Called by AudioEngine to obtain received network audio.
  */
 - (void)fillAudioBuffer:(short*)buffer samplesPerChannel:(int)samplesPerChannel channels:(int)numChannels;
+/**
+ * Chooses how sent audio is coded.  Received audio is decoded with whatever codec each packet names.
+ */
+- (void)setSendCodec:(DMPCodec)codec;
+/**
+ * Chooses how sent channels are laid out.  A stereo layout is only used if the destination advertises 
+ * that it plays stereo, and mid/side falls back to mono whenever the two channels are identical.
+ */
+- (void)setSendLayout:(DMPLayout)layout;
+/**
+ * Sets how much audio is sent in each frame: shorter frames cut the delay before audio can be sent,
+ * and a lost packet loses less.  Frames are shortened further if one wouldn't fit in a datagram.  
+ * Receivers follow whatever frame size arrives.
+ * @param seconds kMinFrameDuration to kMaxFrameDuration (kDefaultFrameDuration to start with)
+ */
+- (void)setFrameDuration:(double)seconds;
+/**
+ * Sets how long frames may be held back so several can share one packet, which saves the header
+ * overhead of many small packets.  As many frames are sent together as fit in this time and in a
+ * datagram.
+ * @param seconds 0 (the default) sends every frame as soon as it is ready
+ */
+- (void)setAggregationDelay:(double)seconds;
+/**
+ * Sets the path MTU, which datagrams are kept under (less the IP and UDP headers) so they are 
+ * never fragmented: a fragmented datagram is lost if any fragment is.
+ * @param mtu bytes (kDefaultPathMtu to start with)
+ */
+- (void)setPathMtu:(int)mtu;
+/**
+ * Chooses what is sent.  Sending only the TouchSynth's changes takes far less bandwidth than audio,
+ * and nothing is lost to coding, but nothing else we play is heard (nor the synth's effects): it 
+ * is for sessions where the synth is all that is played.  Each change is timestamped on our sample
+ * clock, and receivers play it at that sample, plus a fixed delay, on their own TouchSynth.
+ * @param mode kDMPSendAudio (the default) or kDMPSendSynthEvents
+ */
+- (void)setSendMode:(DMPSendMode)mode;
+/**
+ * The listener that hears the changes to the TouchSynth we play, for sending.  AudioEngine sets it 
+ * on its TouchSynth.
+ */
+- (TouchSynthListener *)synthListener;
+/**
+ * The clock shared by every device in the session: that of the peer with the lowest node, kept by 
+ * exchanging timestamps with each peer (the destination, or the multicast group, and every 
+ * sender) every half a second.  TouchSynth changes from a sender on the same session clock are 
+ * played at the same instant on every device.
+ */
+- (SessionClock *)sessionClock;
+/**
+ * Gets the state of the session clock: which node is the master, and our offset from it.
+ */
+- (void)getSessionClockStats:(SessionClockStats *)stats;
+/**
+ * Names the streams being received, one per sender, as "host:port" NSStrings.  A stream 
+ * is dropped once its sender has been quiet for a while.
+ */
+- (NSArray *)receiveStreamNames;
+/**
+ * Sets the gain a received stream is mixed with (1.0 by default).  The gain is remembered, so it 
+ * may be set before the stream starts and is kept if the stream drops out and comes back.
+ */
+- (void)setGain:(float)gain forStream:(NSString *)name;
+/**
+ * Gets the gain a received stream is mixed with.
+ */
+- (float)gainForStream:(NSString *)name;
+/**
+ * Gets a received stream's jitter buffer statistics (loss, lateness, playout delay).
+ * Buffers rebuilt by FEC count as received.
+ * @return NO if there is no such stream
+ */
+- (BOOL)getJitterBufferStats:(JitterBufferStats *)stats forStream:(NSString *)name;
+/**
+ * Gets the drift and delay measurements of a received stream.
+ * @return NO if there is no such stream
+ */
+- (BOOL)getClockStats:(NetworkClockStats *)stats forStream:(NSString *)name;
+/**
+ * Gets a received stream's FEC statistics (network loss, blocks rebuilt).
+ * @return NO if there is no such stream
+ */
+- (BOOL)getFecStats:(FecStats *)stats forStream:(NSString *)name;
+/**
+ * Gets the statistics of the TouchSynth changes received on a stream.
+ * @return NO if there is no such stream, or it has had no changes
+ */
+- (BOOL)getSynthEventStats:(SynthEventStats *)stats forStream:(NSString *)name;
+/**
+ * Gets a received stream's network telemetry: loss, loss bursts, reordering, duplicates, jitter, 
+ * one-way delay and jitter buffer fill, with histograms.  Never waits for the network thread.
+ * @return NO if there is no such stream
+ */
+- (BOOL)getTelemetry:(NetworkTelemetryStats *)stats forStream:(NSString *)name;
+/**
+ * Sets how often each received stream's telemetry is written to the log.
+ * @param seconds the interval (a minute to start with), or 0 for none
+ */
+- (void)setTelemetryLogInterval:(double)seconds;
+/**
+ * Simulates a poor network on everything we send, between the send path and the socket: seeded 
+ * random and bursty (Gilbert-Elliott) loss, delay, jitter, reordering, duplication and a bandwidth
+ * cap.  The same seed and settings give the same impairments to the same packets, so receiving 
+ * changes can be compared under identical conditions.  Starting, stopping or changing the 
+ * simulation discards anything it is holding back.
+ * @param settings what to do, or NULL to stop simulating
+ */
+- (void)setImpairment:(const NetworkImpairmentSettings *)settings;
+/**
+ * Simulates one of NetworkImpairment's presets ("wifi", "cellular", "congested" or "lossy").
+ * @return NO if there is no such preset
+ */
+- (BOOL)setImpairmentPreset:(NSString *)name seed:(uint32_t)seed;
+/**
+ * Gets what the impairment simulation has done since it was last set.
+ */
+- (void)getImpairmentStats:(NetworkImpairmentStats *)stats;
+/**
+ * Starts capturing every datagram received, and every one sent (as the send path made it, before any
+ * impairment simulation), with the time it arrived or was sent, to a compact binary file (see 
+ * PacketCaptureWriter).  The file is written by a thread of its own, so the network thread never 
+ * waits on the disk.  Replaces any capture already going.
+ * @param path capture file path
+ * @return NO if the file could not be created
+ */
+- (BOOL)startCaptureToFile:(NSString *)path;
+/**
+ * Stops capturing, and finishes writing the file.
+ */
+- (void)stopCapture;
+/**
+ * Replays what a capture received into the receive path, as if it were arriving now, with each 
+ * packet's arrival time taken from the capture (see PacketReplayer).  Jitter buffers, FEC and 
+ * telemetry see the same arrivals on every replay of the same capture.  Anything the receive path 
+ * sends in answer goes to the captured addresses, so it is best done with no one else sending.  
+ * Replaces any replay already going.
+ * @param path capture file path
+ * @param speed 1 for the captured timing, or more to replay faster (playout still runs in real 
+ *        time, so jitter buffers will overflow, but everything up to them sees the arrivals as captured)
+ * @return NO if the file is not a capture
+ */
+- (BOOL)startReplayOfFile:(NSString *)path speed:(double)speed;
+/**
+ * Stops replaying.
+ */
+- (void)stopReplay;
+/**
+ * Gets the socket's packet and system call counts, and its buffer sizes.
+ */
+- (void)getTransportStats:(UdpTransportStats *)stats;
+/**
+ * Sets the FEC group size for sending, and stops it being tuned automatically.
+ * Takes effect at the start of the next group.
+ * @param numData data packets per group (1 to FEC_MAX_DATA_BLOCKS)
+ * @param numParity parity packets per group (0 to FEC_MAX_PARITY_BLOCKS)
+ */
+- (void)setFecGroupSize:(int)numData parity:(int)numParity;
+/**
+ * Turns automatic FEC tuning on or off.  When on (the default), the sending group size is 
+ * chosen from the worst loss measured on the received streams, on the assumption that each 
+ * path loses about as much in each direction.
+ */
+- (void)setFecAutoTune:(BOOL)autoTune;
+/**
+ * Turns congestion control on or off.  When on (the default), each receiver reports the loss and 
+ * delay of our audio twice a second, and when a queue starts to build or too many frames go missing
+ * less is sent: ADPCM rather than PCM, then frames held back to share longer packets, then mono, 
+ * then longer packets still.  Clean reports bring back what was asked for, a step at a time.  The 
+ * frame size never changes, so receivers carry on without a break.  While receivers report, the FEC
+ * group size is chosen from the loss they see rather than the loss we see (unless it has been set 
+ * with setFecGroupSize:parity:).
+ */
+- (void)setCongestionControl:(BOOL)on;
+/**
+ * Sets the fraction of frames that congestion control lets go missing at receivers, after FEC.
+ * @param lossRate 0 to 1 (CONGESTION_TARGET_LOSS to start with)
+ */
+- (void)setTargetLossRate:(double)lossRate;
+/**
+ * Gets the state of congestion control: the level, and the worst of the receivers' last reports.
+ */
+- (void)getCongestionStats:(CongestionStats *)stats;
+
+/**
+ * Sends to a multicast group instead of to savedAddress, so one send reaches every listener, and
+ * receives what the group's other members send.  Each member's audio arrives as its own stream.
+ * @param group an IPv4 or IPv6 multicast address, such as @"239.255.77.77"
+ * @param ttl how many routers the audio may cross (1 keeps it on the local network)
+ * @param loopback whether our own audio is delivered back to this host (only useful for testing
+ *        several instances on one machine, since we would otherwise receive ourselves)
+ * @param interfaceAddr the local IPv4 address of the interface to use, such as @"127.0.0.1" to test 
+ *        over loopback, or nil to let the OS choose
+ * @return NO if the group could not be joined
+ */
+- (BOOL)startMulticastToGroup:(NSString *)group ttl:(int)ttl loopback:(BOOL)loopback interface:(NSString *)interfaceAddr;
+/**
+ * Leaves the multicast group and goes back to sending to savedAddress.
+ */
+- (void)stopMulticast;
 
 /**
  * Creates and binds the UDP socket, and starts Bonjour publishing and searching.
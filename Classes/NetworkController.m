@@ -29,11 +29,105 @@
 //
 
 #import "NetworkController.h"
+#import "AudioBasics.h"
+#import "HostTime.h"
+#import <math.h>
+#import <netdb.h>
 
 #define kBonjourServiceType @"_idimp._udp"
 #define kiDiMPSocketPort 23711
-#define kSendDataTimeout 1.0 // in seconds
-#define kNetBufferLatency 4  // play four silent buffers before playing network audio
+#define kNetworkPollMilliseconds 2 // how often the network thread checks for buffers from the audio thread
+#define kSendRingSlots 16    // buffers queued between the audio thread and the network thread
+#define kNetBufferLatencySeconds 0.05 // playout delay until network jitter has been measured
+#define kFecTuneGroups 16    // received FEC groups between adjustments of the sending group size
+#define kPacketHeaderSize offsetof(DMPDataPacket, payload)
+#define kPayloadHeaderSize offsetof(DMPPayload, data)
+#define kDepthSmoothingSeconds 10.0  // averaging time of the playout depth measurement
+#define kDepthSettleSeconds 5.0      // the depth is left to settle this long after the jitter buffer changes it
+#define kDepthCorrectionSeconds 60.0 // a depth error is worked off by the resampler over about this long
+#define kMaxDepthCorrection 0.001    // most the resampler's ratio is trimmed to hold the depth
+#define kChannelsTXTRecordKey @"channels" // Bonjour TXT record entry giving the channels we play
+#define kStreamTimeoutSeconds 10.0   // a received stream is dropped after its sender has been quiet this long
+#define kRenderGracePeriodPollUsec 1000
+#define kIpUdpHeaderBytes 48 // IPv6 and UDP headers (IPv4's are smaller)
+#define kMinPathMtu 576      // the least any IPv4 path carries
+#define kTelemetryLogSeconds 60.0 // how often each stream's telemetry is logged, until changed
+#define kImpairmentMaxPending 256 // most sent datagrams the impairment simulator can be holding back
+#define kEventPacketHeaderSize offsetof(DMPEventPacket, events)
+#define kEventPlayoutDelaySeconds 0.04 // how long after a sender made a TouchSynth change (with the least delay seen) it is played
+#define kEventRepeatSeconds 0.02   // spacing of the packets that repeat TouchSynth changes, so one loss burst doesn't take every copy
+#define kEventSnapshotSeconds 0.25 // how often a snapshot of the whole TouchSynth is sent, which also keeps the stream alive
+#define kClockSyncSeconds 0.5 // how often timestamps are exchanged with each peer
+#define kEventTimeoutSeconds 1.0   // a received TouchSynth is silenced after its sender has sent no changes or snapshots for this long
+#define kFeedbackSeconds 0.5       // how often the sender of each received stream is told how it is arriving
+#define kCongestionPacketSeconds 0.01     // frames are held back to make packets of about this long from congestion level 2
+#define kCongestionLongPacketSeconds 0.02 // and this long from level 4
+
+/**
+ * A buffer handed from the audio thread to the network thread for sending.
+ */
+typedef struct DMPSendBuffer
+{
+    uint32_t timestamp; // sample clock at the first frame
+    double hostSeconds; // host time when the audio thread handed it over
+    int numFrames;
+    short samples[kNumSamplesPerChannel * kNumNetworkChannels];
+} DMPSendBuffer;
+
+/**
+ * Everything kept for the audio received from one sender.  Streams are created and retired on 
+ * the network thread (holding receiveStreamsLock, which the main thread takes to look at them); 
+ * the audio thread only uses the ones published in receiveStreams.
+ */
+typedef struct DMPReceiveStream
+{
+    struct sockaddr_storage address; // the sender's
+    NSString *name; // "host:port" of the sender
+    double lastArrivalSeconds;
+    int frameSize; // samples per channel in each of the sender's frames, fixed for the stream's life
+    volatile float gain; // a single aligned word, so the audio thread always reads it whole
+    
+    // network thread
+    NetworkTelemetry *telemetry; // the one for the stream's slot
+    FecDecoder *fecDecoder;
+    uint32_t fecGroupsAtLastTune;
+    ClockDriftEstimator *senderClock; // sender's sample clock against host time
+    BOOL hasReceivedTimestamp;
+    uint32_t lastReceivedTimestamp;
+    double receivedSamples; // sender's sample clock, unwrapped
+    double excessDelaySeconds;
+    volatile int32_t senderDriftPpb; // parts per billion, handed to the audio thread
+    
+    // reports to the sender of how the stream is arriving - network thread
+    double lastFeedbackSeconds;
+    uint32_t feedbackSequence;
+    uint32_t feedbackExpected; // telemetry counts at the last report
+    uint32_t feedbackLost;
+    uint32_t feedbackPlayed; // jitter buffer counts at the last report
+    uint32_t feedbackMissing;
+    double feedbackDelaySum; // excess delay of the data packets since the last report
+    int feedbackDelayCount;
+    double feedbackMeanDelay; // of the data packets before the last report
+    BOOL hasFeedbackMeanDelay;
+    
+    // written by the network thread, read by the audio thread
+    JitterBuffer *jitterBuffer;
+    SynthEventPlayer *volatile eventPlayer; // made when the sender's first TouchSynth changes arrive
+    double lastEventSeconds; // arrival of the last TouchSynth events
+    BOOL eventsArePlaying; // whether the sender's TouchSynth changes are still arriving
+    
+    // audio thread
+    PacketLossConcealer *lossConcealer;
+    AdaptiveResampler *resampler;
+    volatile int32_t resampleDeviationPpb;
+    double smoothedDepth; // received frames waiting to be played, in frames
+    double depthReference; // the depth the resampler holds, in frames
+    int depthSettleCount;
+    int lastTargetDelay;
+    uint32_t lastPlayoutChanges;
+    uint32_t lastNumPlayedOrMissing;
+    short resampledFrame[kNumSamplesPerChannel * kNumNetworkChannels];
+} DMPReceiveStream;
 
 @implementation NetworkController
 
@@ -109,259 +203,2112 @@ static NetworkController *sharedNetworkController = nil;
         {
             [netService scheduleInRunLoop:[NSRunLoop currentRunLoop] forMode:NSRunLoopCommonModes];
             [netService setDelegate:self];
+            
+            // advertise how many channels we play, so senders know whether stereo is worth sending
+            NSData *channels = [[NSString stringWithFormat:@"%d", kNumNetworkChannels] dataUsingEncoding:NSUTF8StringEncoding];
+            [netService setTXTRecordData:[NSNetService dataFromTXTRecordDictionary:[NSDictionary dictionaryWithObject:channels forKey:kChannelsTXTRecordKey]]];
         }
         
         // Prepare Bonjour browser
         browser = [[NSNetServiceBrowser alloc] init];
         [browser setDelegate:self];
         browserIsSearching = NO;
+        
+        // Prepare receiving (streams are created as senders turn up)
+        for (int i = 0; i < kMaxReceiveStreams; i++)
+        {
+            receiveStreams[i] = NULL;
+        }
+        streamGains = [[NSMutableDictionary alloc] init];
+        pthread_mutex_init(&receiveStreamsLock, NULL);
+        for (int i = 0; i < kMaxReceiveStreams; i++)
+        {
+            streamTelemetry[i] = new NetworkTelemetry();
+        }
+        telemetryLogMilliseconds = (int)(kTelemetryLogSeconds * 1000.0);
+        lastTelemetryLogSeconds = 0.0;
+        mixEpoch = 0;
+        reportedStreamLimit = NO;
+        
+        // Prepare clock drift compensation
+        playbackClock = new ClockDriftEstimator();
+        playbackDriftPpb = 0;
+        playbackSamples = 0.0;
+        
+        // Prepare forward error correction
+        fecEncoder = new FecEncoder(sizeof(DMPPayload), kFecDataBlocks, kFecParityBlocks);
+        fecGroupSizeRequest = (kFecDataBlocks << 8) | kFecParityBlocks;
+        fecGroupSizeApplied = fecGroupSizeRequest;
+        fecAutoTune = YES;
+        
+        // Prepare congestion control, which does nothing until receivers report
+        congestion = new CongestionController();
+        congestionControl = YES;
+        congestionControlApplied = YES;
+        congestionTargetLossPpm = (int)(CONGESTION_TARGET_LOSS * 1e6);
+        
+        // Prepare the network thread, which runs while the socket is open
+        transport = new UdpTransport();
+        sendRing = new PacketRing(sizeof(DMPSendBuffer), kSendRingSlots);
+        networkThreadStarted = NO;
+        networkThreadIsRunning = 0;
+        sendFrameMicroseconds = (int)(kDefaultFrameDuration * 1e6);
+        sendAggregateMicroseconds = 0;
+        sendMaxDatagramBytes = kDefaultPathMtu - kIpUdpHeaderBytes;
+        sendPendingFrames = 0;
+        sendMode = kDMPSendAudio;
+        hasSendClock = NO;
+        pthread_mutex_init(&sendDestinationLock, NULL);
+        
+        // TouchSynth changes are always followed, so switching to sending them starts from the right state
+        synthEventSender = new SynthEventSender(AUDIO_SAMPLE_RATE);
+        sendEventSequence = 0;
+        lastEventPacketSeconds = 0.0;
+        lastSnapshotSeconds = 0.0;
+        
+        // a random node, so that peers' differ; the lowest in a session is its clock
+        uint32_t nodeId = 0;
+        while (nodeId == 0)
+        {
+            nodeId = arc4random();
+        }
+        sessionClock = new SessionClock(nodeId);
+        lastClockRequestSeconds = 0.0;
+        
+        // No impairment simulation until asked (the simulator is only made then)
+        impairment = NULL;
+        impairmentIsOn = NO;
+        pthread_mutex_init(&impairmentLock, NULL);
+        impairmentRequested = NO;
+        impairmentChanged = 0;
+        memset(&impairmentStats, 0, sizeof(impairmentStats));
+        
+        // No capture or replay until asked
+        captureWriter = NULL;
+        replayer = NULL;
+        networkEpoch = 0;
+        sendDestinationLength = 0;
+        sendDestinationIsStereo = NO;
+        
+        // Prepare audio coding
+        sendCodec = kDMPCodecAdpcm;
+        sendLayout = kDMPLayoutMidSide;
+        sendCodecApplied = sendCodec;
+        sendAggregateApplied = 0;
+        adpcmEncoder = new AdpcmEncoder();
+        adpcmSideEncoder = new AdpcmEncoder();
+        peerChannels = [[NSMutableDictionary alloc] init];
+        
+        // Not multicasting until asked
+        multicastGroup = nil;
+        multicastAddress = nil;
+        multicastInterface = nil;
     }
     return self;
 }
 
-- (void)dealloc
+/**
+ * Creates the receiving state for a new sender, whose frames hold frameSize samples per channel, and
+ * publishes it to the audio thread.  Returns NULL if all kMaxReceiveStreams are in use.  Called from 
+ * the network thread with receiveStreamsLock held.
+ */
+- (DMPReceiveStream *)addReceiveStream:(const struct sockaddr *)address frameSize:(int)frameSize
 {
-    NSLog(@"%@ %s", [self class], _cmd);
+    char addressText[64];
+    UdpTransport::formatAddress(address, addressText, sizeof(addressText));
+    NSString *name = [NSString stringWithUTF8String:addressText];
+    
 
-    [socket close];
-    [socket release];
-    [services release];
-    [netService release];
-    [browser release];
+    int slot = 0;
+    while (slot < kMaxReceiveStreams && receiveStreams[slot])
+    {
+        slot++;
+    }
+    if (slot == kMaxReceiveStreams)
+    {
+        if (!reportedStreamLimit)
+        {
+            NSLog(@"already receiving %d streams; ignoring %@", kMaxReceiveStreams, name);
+            reportedStreamLimit = YES;
+        }
+        return NULL;
+    }
     
-    [super dealloc];
+    DMPReceiveStream *stream = new DMPReceiveStream;
+    memcpy(&stream->address, address, UdpTransport::getAddressLength(address));
+    stream->name = [name copy];
+    stream->frameSize = frameSize;
+    stream->telemetry = streamTelemetry[slot];
+    stream->telemetry->reset(addressText);
+    NSNumber *gain = [streamGains objectForKey:name];
+    stream->gain = gain ? [gain floatValue] : 1.0f;
+    stream->fecDecoder = new FecDecoder(sizeof(DMPPayload));
+    stream->fecGroupsAtLastTune = 0;
+    stream->senderClock = new ClockDriftEstimator();
+    stream->hasReceivedTimestamp = NO;
+    stream->excessDelaySeconds = 0.0;
+    stream->senderDriftPpb = 0;
+    stream->lastFeedbackSeconds = 0.0;
+    stream->feedbackSequence = 0;
+    stream->feedbackExpected = 0;
+    stream->feedbackLost = 0;
+    stream->feedbackPlayed = 0;
+    stream->feedbackMissing = 0;
+    stream->feedbackDelaySum = 0.0;
+    stream->feedbackDelayCount = 0;
+    stream->feedbackMeanDelay = 0.0;
+    stream->hasFeedbackMeanDelay = NO;
+    double frameSeconds = frameSize / AUDIO_SAMPLE_RATE;
+    int initialDelayFrames = MIN((int)ceil(kNetBufferLatencySeconds / frameSeconds), JITTER_BUFFER_MAX_TARGET_FRAMES);
+    stream->jitterBuffer = new JitterBuffer(frameSize * kNumNetworkChannels, frameSeconds, initialDelayFrames);
+    stream->eventPlayer = NULL;
+    stream->eventsArePlaying = NO;
+    stream->lossConcealer = new PacketLossConcealer(frameSize, kNumNetworkChannels, AUDIO_SAMPLE_RATE);
+    stream->resampler = new AdaptiveResampler(kNumNetworkChannels, 3 * kNumSamplesPerChannel);
+    stream->resampleDeviationPpb = 0;
+    stream->depthSettleCount = 0;
+    stream->lastTargetDelay = 0;
+    stream->lastPlayoutChanges = 0;
+    stream->lastNumPlayedOrMissing = 0;
+    
+    NSLog(@"receiving a new stream from %@ (%.1f ms frames)", name, frameSeconds * 1000.0);
+    AtomicExchangePtr(&receiveStreams[slot], stream);
+    return stream;
 }
 
-- (void)sendAudioBuffer:(short*)buffer length:(int)length channels:(int)numChannels
+/**
+ * Unpublishes a received stream and frees it once the audio thread can no longer be mixing it.
+ * Called from the network thread with receiveStreamsLock held, or once the network thread has stopped.
+ */
+- (void)retireReceiveStream:(int)slot
 {
-    // chop down to mono
-    int numSamplesMono = length / numChannels;
-    for (int i = 0; i < numSamplesMono; i++) {
-        savedPacket.slices[oldestSlice].data[i] = buffer[numChannels * i];
+    DMPReceiveStream *stream = AtomicExchangePtr(&receiveStreams[slot], (DMPReceiveStream *)NULL);
+    if (stream == NULL)
+    {
+        return;
     }
     
-    // tag the latest slice with a new index (don't worry about currentSendBufferIndex wrapping around)
-    savedPacket.slices[oldestSlice].index = currentSendBufferIndex++;
-    
-    // increment oldestSlice
-    oldestSlice = (oldestSlice + 1) % kNumSlicesPerPacket;
+    // mixEpoch is odd while the audio thread is mixing.  A mix that starts after the swap 
+    // won't see the stream, so we only have to wait for the one (if any) running right now.
+    int32_t epoch = AtomicLoad32(&mixEpoch);
+    if (epoch & 1)
+    {
+        while (AtomicLoad32(&mixEpoch) == epoch)
+        {
+            usleep(kRenderGracePeriodPollUsec);
+        }
+    }
     
-    [self performSelectorOnMainThread:@selector(sendSavedPacket) withObject:nil waitUntilDone:NO];
+    NSLog(@"stopped receiving the stream from %@", stream->name);
+    stream->telemetry->reset(NULL);
+    [stream->name release];
+    delete stream->fecDecoder;
+    delete stream->senderClock;
+    delete stream->jitterBuffer;
+    delete stream->eventPlayer;
+    delete stream->lossConcealer;
+    delete stream->resampler;
+    delete stream;
+    reportedStreamLimit = NO;
 }
 
-- (void)sendSavedPacket
+/**
+ * Stops the network thread.  It is always stopped before the socket it uses is closed.
+ */
+- (void)stopNetworkThread
 {
-    if (savedAddress)
+    AtomicStore32(&networkThreadIsRunning, 0);
+    if (networkThreadStarted)
     {
-        //NSLog(@"sending data!");
-        [socket sendData:[NSData dataWithBytes:&savedPacket length:sizeof(savedPacket)] toAddress:savedAddress withTimeout:kSendDataTimeout tag:0];
+        pthread_join(networkThread, NULL);
+        networkThreadStarted = NO;
     }
 }
 
-- (void)fillAudioBuffer:(short*)buffer samplesPerChannel:(int)samplesPerChannel channels:(int)numChannels
+- (void)dealloc
 {
-    // TODO: wait <latency> before starting through our cache
-    
-    // grab from big receive buffer
-    for (int i = 0; i < samplesPerChannel; i++) {
-        // copy into buffer, mirror into all channels
-        for (int j = 0; j < numChannels; j++) {
-            buffer[(numChannels * i) + j] = audioReceiveBuffers[currentReceiveBufferIndex].data[i];
-        }
+    NSLog(@"%@ %s", [self class], _cmd);
+
+    [self stopNetworkThread];
+    [self stopCapture];
+    [self stopReplay];
+    delete transport;
+    [services release];
+    [netService release];
+    [browser release];
+    for (int i = 0; i < kMaxReceiveStreams; i++)
+    {
+        [self retireReceiveStream:i];
     }
+    [streamGains release];
+    pthread_mutex_destroy(&receiveStreamsLock);
+    for (int i = 0; i < kMaxReceiveStreams; i++)
+    {
+        delete streamTelemetry[i];
+    }
+    delete playbackClock;
+    delete fecEncoder;
+    delete congestion;
+    delete sendRing;
+    delete synthEventSender;
+    delete sessionClock;
+    pthread_mutex_destroy(&sendDestinationLock);
+    delete impairment;
+    pthread_mutex_destroy(&impairmentLock);
+    delete adpcmEncoder;
+    delete adpcmSideEncoder;
+    [peerChannels release];
+    [multicastGroup release];
+    [multicastAddress release];
+    [multicastInterface release];
     
-    currentReceiveBufferIndex = (currentReceiveBufferIndex + 1) % kNumCachedReceiveBuffers;
+    [super dealloc];
 }
 
-- (void)startAudioServer
+- (void)sendAudioBuffer:(short*)buffer length:(int)length channels:(int)numChannels
 {
-    // Initialize UDP socket
-    socket = [[AsyncUdpSocket alloc] initWithDelegate:self];
-
-    NSError *error = nil;
-    if (![socket bindToPort:kiDiMPSocketPort error:&error])
+    // the timestamp counts every frame we've played, so it runs at our sample clock's rate
+    uint32_t timestamp = sendTimestamp;
+    sendTimestamp += length / numChannels;
+    
+    // the buffer goes straight into a ring slot; if the network thread has fallen that far behind 
+    // (or isn't running) the buffer is dropped, and counted by the ring
+    DMPSendBuffer *sendBuffer = (DMPSendBuffer *)sendRing->beginWrite();
+    if (sendBuffer == NULL)
     {
-        NSLog(@"could not bindToPort. %@", error);
+        return;
     }
-    NSLog(@"created socket. host: %@, port: %d", [socket localHost], [socket localPort]);
-    [socket receiveWithTimeout:-1 tag:0];
-
-    [self startBonjourPublishing];
-    [self startBonjourSearch];
+    sendBuffer->timestamp = timestamp;
+    sendBuffer->hostSeconds = HostTimeToSeconds(HostTimeNow());
+    short *samples = sendBuffer->samples;
+    
+    // keep the first two channels (or mirror a single one)
+    int numFrames = MIN(length / numChannels, kNumSamplesPerChannel);
+    int rightChannel = (numChannels > 1) ? 1 : 0;
+    for (int i = 0; i < numFrames; i++) {
+        samples[2 * i] = buffer[numChannels * i];
+        samples[2 * i + 1] = buffer[numChannels * i + rightChannel];
+    }
+    sendBuffer->numFrames = numFrames;
+    
+    // the network thread cuts it into frames, and codes and sends them
+    sendRing->endWrite();
 }
 
-- (void)stopAudioServer
+/**
+ * Codes samples into data with the send codec (as congestion control has left it), returning the 
+ * number of bytes used.  Called from the network thread.
+ */
+- (int)encodeSamples:(const short *)samples frames:(int)numFrames channels:(int)numChannels encoder:(AdpcmEncoder *)encoder into:(uint8_t *)data
 {
-    [self stopBonjourSearch];
-    [self stopBonjourPublishing];
-    [socket close];
-    [socket release];
-    socket = nil;
+    if (sendCodecApplied == kDMPCodecAdpcm)
+    {
+        return encoder->encode(samples, numFrames, numChannels, data);
+    }
+    int length = numFrames * numChannels * sizeof(short);
+    memcpy(data, samples, length);
+    return length;
 }
 
-#pragma mark Bonjour Controls
-- (void)startBonjourPublishing
+/**
+ * Queues a datagram made of a header followed by a payload for the transport to send - or hands it
+ * to the impairment simulator, which copies it and sends it later (or never).  Called from the 
+ * network thread.
+ */
+- (void)queueHeader:(const void *)header length:(size_t)headerLength payload:(const void *)payload length:(size_t)payloadLength 
+          toAddress:(const struct sockaddr *)address length:(socklen_t)addressLength
 {
-    if (!serviceIsPublishing)
+    PacketCaptureWriter *capture = AtomicLoadPtr(&captureWriter);
+    if (capture)
     {
-        [netService publish];
-        serviceIsPublishing = YES;
+        capture->addPacket(PACKET_CAPTURE_SENT, HostTimeToSeconds(HostTimeNow()), address, addressLength, 
+                           header, headerLength, payload, payloadLength);
+    }
+    if (impairmentIsOn)
+    {
+        impairment->submit(header, headerLength, payload, payloadLength, address, addressLength, HostTimeToSeconds(HostTimeNow()));
+        return;
     }
+    transport->queue(header, headerLength, payload, payloadLength, address, addressLength);
 }
 
-- (void)stopBonjourPublishing
+/**
+ * Queues a packet's header followed by payloadLength bytes of payload, which needn't lie in the packet.
+ * Called from the network thread.
+ */
+- (void)queuePacket:(const DMPDataPacket *)packet payload:(const void *)payload length:(int)payloadLength 
+          toAddress:(const struct sockaddr *)address length:(socklen_t)addressLength
 {
-    if (serviceIsPublishing)
+    [self queueHeader:packet length:kPacketHeaderSize payload:payload length:kPayloadHeaderSize + payloadLength 
+            toAddress:address length:addressLength];
+}
+
+/**
+ * Takes up impairment settings the main thread has changed.  Called from the network thread.
+ */
+- (void)updateImpairment
+{
+    if (!AtomicLoad32(&impairmentChanged))
     {
-        // Note: you must send a 'stop' for every 'publish' message, or it won't work.
-        [netService stop];
-        serviceIsPublishing = NO;
+        return;
+    }
+    pthread_mutex_lock(&impairmentLock);
+    AtomicStore32(&impairmentChanged, 0);
+    BOOL isOn = impairmentRequested;
+    NetworkImpairmentSettings settings = impairmentSettings;
+    pthread_mutex_unlock(&impairmentLock);
+    
+    if (isOn && impairment == NULL)
+    {
+        impairment = new NetworkImpairment(kPacketHeaderSize + sizeof(DMPPayload), kImpairmentMaxPending);
     }
+    if (impairment)
+    {
+        // whatever was being held back goes with the old settings
+        impairment->configure(settings);
+    }
+    impairmentIsOn = isOn;
 }
 
-- (void)startBonjourSearch
+/**
+ * Sends the datagrams the impairment simulator has held back for long enough.  Called from the 
+ * network thread.
+ */
+- (void)sendImpairedPackets:(double)nowSeconds
 {
-    if (!browserIsSearching)
+    if (!impairmentIsOn)
     {
-        [browser searchForServicesOfType:kBonjourServiceType inDomain:@"local."];
-        browserIsSearching = YES;
-        // reset found services
-        [services removeAllObjects];
+        return;
     }
+    const uint8_t *data;
+    size_t length;
+    const struct sockaddr *address;
+    socklen_t addressLength;
+    while (impairment->pop(nowSeconds, data, length, address, addressLength))
+    {
+        // the data stays put until the next submit, which is after the flush
+        transport->queue(data, 0, data, length, address, addressLength);
+    }
+    transport->flush();
+    
+    pthread_mutex_lock(&impairmentLock);
+    impairment->getStats(impairmentStats);
+    pthread_mutex_unlock(&impairmentLock);
 }
 
-- (void)stopBonjourSearch
+/**
+ * Returns the number of bytes numFrames frames take when coded with codec in layout.
+ */
+- (int)codedSizeOfFrames:(int)numFrames codec:(DMPCodec)codec layout:(DMPLayout)layout
 {
-    if (browserIsSearching)
+    int numChannels = (layout == kDMPLayoutStereo) ? 2 : 1;
+    if (codec == kDMPCodecAdpcm)
     {
-        [browser stop];
-        browserIsSearching = NO;
+        int size = AdpcmEncoder::getEncodedSize(numFrames, numChannels);
+        return (layout == kDMPLayoutMidSide) ? size + AdpcmEncoder::getEncodedSize(numFrames / 2, 1) : size;
     }
+    int size = numFrames * numChannels * sizeof(short);
+    return (layout == kDMPLayoutMidSide) ? size + (numFrames / 2) * sizeof(short) : size;
 }
 
-
-#pragma mark NSNetService Delegate Methods
-
-- (void)netService:(NSNetService *)sender didNotPublish:(NSDictionary *)errorDict
+/**
+ * Works out the frame size and how many frames go in each packet from the settings, so that a 
+ * packet fits in a datagram.  The frame size is worked out for the send codec in layout, so that 
+ * congestion control, which only ever sends less, never changes it; the number of frames is worked 
+ * out for what congestion control has left, coded in appliedLayout.  Called from the network thread.
+ */
+- (void)getFrameSize:(int *)frameSize framesPerPacket:(int *)framesPerPacket layout:(DMPLayout)layout appliedLayout:(DMPLayout)appliedLayout
 {
-	NSLog(@"%@ %s", [self class], _cmd);
+    int maxPayloadBytes = MIN(sendMaxDatagramBytes - (int)(kPacketHeaderSize + kPayloadHeaderSize), (int)kMaxPayloadBytes);
+    
+    // an even number of samples, so mid/side can halve the side's rate
+    int size = 2 * (int)lrint(sendFrameMicroseconds * 1e-6 * AUDIO_SAMPLE_RATE / 2);
+    while (size > 2 && [self codedSizeOfFrames:size codec:sendCodec layout:layout] > maxPayloadBytes)
+    {
+        size -= 2;
+    }
+    
+    int count = (int)(sendAggregateApplied * 1e-6 * AUDIO_SAMPLE_RATE) / size;
+    count = MAX(1, MIN(count, MIN(kNumSamplesPerChannel / size, 255)));
+    while (count > 1 && [self codedSizeOfFrames:count * size codec:sendCodecApplied layout:appliedLayout] > maxPayloadBytes)
+    {
+        count--;
+    }
+    
+    *frameSize = size;
+    *framesPerPacket = count;
 }
 
-- (void)netServiceDidPublish:(NSNetService *)sender
+/**
+ * Codes numFrames frames of frameSize stereo samples into one packet, and sends it (and any FEC 
+ * parity it completes) to destination in one batch.  Called from the network thread.
+ */
+- (void)sendFrames:(const short *)samples frameSize:(int)frameSize count:(int)numFrames timestamp:(uint32_t)timestamp 
+            layout:(DMPLayout)layout toAddress:(const struct sockaddr *)destination length:(socklen_t)destinationLength
 {
-	NSLog(@"%@ %s", [self class], _cmd);
+    // group size changes asked for by the main thread take effect at the start of the next group
+    int32_t groupSizeRequest = AtomicLoad32(&fecGroupSizeRequest);
+    if (groupSizeRequest != fecGroupSizeApplied)
+    {
+        fecEncoder->setGroupSize(groupSizeRequest >> 8, groupSizeRequest & 0xff);
+        fecGroupSizeApplied = groupSizeRequest;
+    }
+    
+    DMPDataPacket packet;
+    int numSamplesPerChannel = frameSize * numFrames;
+    
+    packet.sequence = sendSequence++;
+    packet.timestamp = timestamp;
+    packet.type = kDMPPacketTypeData;
+    packet.reserved = 0;
+    
+    if (layout != kDMPLayoutStereo)
+    {
+        AudioSamplesStereoToMidSide(samples, sendMidFrame, sendSideFrame, numSamplesPerChannel);
+    }
+    if (layout == kDMPLayoutMidSide)
+    {
+        // identical channels need no side at all
+        BOOL hasSide = NO;
+        for (int i = 0; i < numSamplesPerChannel && !hasSide; i++)
+        {
+            hasSide = (sendSideFrame[i] != 0);
+        }
+        if (!hasSide)
+        {
+            layout = kDMPLayoutMono;
+        }
+    }
+    
+    // code the audio, zeroing the unused part of the payload so it doesn't disturb the parity
+    memset(&packet.payload, 0, sizeof(packet.payload));
+    packet.payload.codec = sendCodecApplied;
+    packet.payload.layout = layout;
+    packet.payload.numFrames = numFrames;
+    packet.payload.frameSize = frameSize;
+    packet.payload.frameSequence = sendFrameSequence;
+    sendFrameSequence += numFrames;
+    if (layout == kDMPLayoutStereo)
+    {
+        packet.payload.length = [self encodeSamples:samples frames:numSamplesPerChannel channels:2 encoder:adpcmEncoder into:packet.payload.data];
+    }
+    else
+    {
+        packet.payload.length = [self encodeSamples:sendMidFrame frames:numSamplesPerChannel channels:1 encoder:adpcmEncoder into:packet.payload.data];
+        if (layout == kDMPLayoutMidSide)
+        {
+            // the stereo image needs far less bandwidth than the signal, so halve the side's sample rate
+            int numSideFrames = numSamplesPerChannel / 2;
+            for (int i = 0; i < numSideFrames; i++)
+            {
+                sendSideFrame[i] = (short)((sendSideFrame[2 * i] + sendSideFrame[2 * i + 1]) >> 1);
+            }
+            packet.payload.length += [self encodeSamples:sendSideFrame frames:numSideFrames channels:1 encoder:adpcmSideEncoder into:packet.payload.data + packet.payload.length];
+        }
+    }
+    
+    int position = fecEncoder->getPosition();
+    if (position == 0)
+    {
+        fecGroupPayloadLength = 0;
+    }
+    fecGroupPayloadLength = MAX(fecGroupPayloadLength, packet.payload.length);
+    packet.groupSize = fecEncoder->getNumData();
+    packet.groupPosition = position;
+    BOOL groupComplete = fecEncoder->addData(&packet.payload);
+    
+    [self queuePacket:&packet payload:&packet.payload length:packet.payload.length 
+            toAddress:destination length:destinationLength];
+    
+    if (groupComplete)
+    {
+        // follow the group with its parity, sent from where the encoder keeps it
+        DMPDataPacket parityHeader;
+        parityHeader.sequence = packet.sequence - position;
+        parityHeader.timestamp = 0;
+        parityHeader.type = kDMPPacketTypeParity;
+        parityHeader.reserved = 0;
+        parityHeader.groupSize = packet.groupSize;
+        for (int i = 0; i < fecEncoder->getNumParity(); i++)
+        {
+            parityHeader.groupPosition = i;
+            [self queuePacket:&parityHeader payload:fecEncoder->getParity(i) length:fecGroupPayloadLength 
+                    toAddress:destination length:destinationLength];
+        }
+    }
+    
+    // the packet and the parity blocks are about to be reused, so they go now
+    transport->flush();
 }
 
-- (void)netServiceDidResolveAddress:(NSNetService *)sender
+/**
+ * Copies the send destination, which the main thread may change at any time, returning its length 
+ * (0 if there is nowhere to send).  Called from the network thread.
+ */
+- (socklen_t)copySendDestination:(struct sockaddr_storage *)destination isStereo:(BOOL *)isStereo
 {
-    const char *firstAddressData = (const char *)[[[sender addresses] objectAtIndex:0] bytes];
-    NSLog(@"address resolved. %@ = %@ (%hhu.%hhu.%hhu.%hhu) (1 of %d)",
-        [sender name],
-        [[sender addresses] objectAtIndex:0],
-        firstAddressData[4], firstAddressData[5], firstAddressData[6], firstAddressData[7],
-        [[sender addresses] count]);
+    pthread_mutex_lock(&sendDestinationLock);
+    socklen_t destinationLength = sendDestinationLength;
+    memcpy(destination, &sendDestination, destinationLength);
+    *isStereo = sendDestinationIsStereo;
+    pthread_mutex_unlock(&sendDestinationLock);
+    return destinationLength;
 }
 
-- (void)netService:(NSNetService *)sender didNotResolve:(NSDictionary *)errorDict
+/**
+ * Sets sendCodecApplied and sendAggregateApplied from the main thread's settings and the congestion
+ * level, and returns the layout to send instead of layout.  Each level gives up one more thing, so 
+ * packets get smaller or fewer: ADPCM, then about kCongestionPacketSeconds of audio per packet, then
+ * mono, then about kCongestionLongPacketSeconds.  Every one of these can change from one packet to 
+ * the next without a receiver noticing.  Called from the network thread.
+ */
+- (DMPLayout)applyCongestionLevel:(DMPLayout)layout
 {
-    NSLog(@"did not resolve address for %@.", [sender name]);
+    int level = congestionControlApplied ? congestion->getLevel() : 0;
+    sendCodecApplied = (level >= 1) ? kDMPCodecAdpcm : sendCodec;
+    sendAggregateApplied = sendAggregateMicroseconds;
+    if (level >= 2)
+    {
+        double packetSeconds = (level >= 4) ? kCongestionLongPacketSeconds : kCongestionPacketSeconds;
+        sendAggregateApplied = MAX(sendAggregateApplied, (int)(packetSeconds * 1e6));
+    }
+    return (level >= 3) ? kDMPLayoutMono : layout;
 }
 
-- (void)netServiceDidStop:(NSNetService *)sender
+/**
+ * Adds one buffer from the audio thread, where it lies in its ring slot, to the audio waiting to be 
+ * sent, and sends as many packets of frames as are ready.  Called from the network thread.
+ */
+- (void)packetizeSendBuffer:(const DMPSendBuffer *)sendBuffer
 {
-	NSLog(@"%@ %s", [self class], _cmd);
+    // every buffer times the TouchSynth's changes, whatever is sent
+    sendClockSeconds = sendBuffer->hostSeconds;
+    sendClockTimestamp = sendBuffer->timestamp;
+    hasSendClock = YES;
+    
+    struct sockaddr_storage destination;
+    BOOL destinationIsStereo;
+    socklen_t destinationLength = [self copySendDestination:&destination isStereo:&destinationIsStereo];
+    if (destinationLength == 0 || sendMode != kDMPSendAudio)
+    {
+        sendPendingFrames = 0;
+        return;
+    }
+    
+    // frames must be contiguous, so if the ring dropped a buffer start again from this one
+    if (sendPendingFrames > 0 && sendPendingTimestamp + sendPendingFrames != sendBuffer->timestamp)
+    {
+        sendPendingFrames = 0;
+    }
+    if (sendPendingFrames == 0)
+    {
+        sendPendingTimestamp = sendBuffer->timestamp;
+    }
+    memcpy(sendPendingSamples + sendPendingFrames * kNumNetworkChannels, sendBuffer->samples, 
+           sendBuffer->numFrames * kNumNetworkChannels * sizeof(short));
+    sendPendingFrames += sendBuffer->numFrames;
+    
+    // only send stereo to a destination that has said it plays it
+    DMPLayout layout = destinationIsStereo ? sendLayout : kDMPLayoutMono;
+    DMPLayout appliedLayout = [self applyCongestionLevel:layout];
+    int frameSize, framesPerPacket;
+    [self getFrameSize:&frameSize framesPerPacket:&framesPerPacket layout:layout appliedLayout:appliedLayout];
+    int packetFrames = frameSize * framesPerPacket;
+    
+    int sent = 0;
+    while (sendPendingFrames - sent >= packetFrames)
+    {
+        [self sendFrames:sendPendingSamples + sent * kNumNetworkChannels frameSize:frameSize count:framesPerPacket 
+               timestamp:sendPendingTimestamp + sent layout:appliedLayout 
+               toAddress:(const struct sockaddr *)&destination length:destinationLength];
+        sent += packetFrames;
+    }
+    
+    // keep the rest for the next buffer
+    sendPendingFrames -= sent;
+    sendPendingTimestamp += sent;
+    memmove(sendPendingSamples, sendPendingSamples + sent * kNumNetworkChannels, sendPendingFrames * kNumNetworkChannels * sizeof(short));
 }
 
-#pragma mark NSNetServiceBrowser Delegate Methods
-
-- (void)netServiceBrowserWillSearch:(NSNetServiceBrowser *)aNetServiceBrowser
+/**
+ * Sends one packet of TouchSynth events to destination.  Called from the network thread.
+ */
+- (void)sendEvents:(const SynthEvent *)events count:(int)numEvents isSnapshot:(BOOL)isSnapshot timestamp:(uint32_t)timestamp 
+         toAddress:(const struct sockaddr *)destination length:(socklen_t)destinationLength
 {
-    NSLog(@"%@ %s", [self class], _cmd);
+    DMPEventPacket packet;
+    packet.sequence = sendEventSequence++;
+    packet.timestamp = timestamp;
+    packet.type = kDMPPacketTypeEvents;
+    packet.numEvents = numEvents;
+    packet.isSnapshot = isSnapshot ? 1 : 0;
+    packet.reserved = 0;
+    packet.sessionMasterId = sessionClock->getMasterId();
+    packet.sessionSeconds = sessionClock->toSessionSeconds(sendClockSeconds + (int32_t)(timestamp - sendClockTimestamp) / AUDIO_SAMPLE_RATE);
+    [self queueHeader:&packet length:kEventPacketHeaderSize payload:events length:numEvents * sizeof(SynthEvent) 
+            toAddress:destination length:destinationLength];
+    transport->flush();
 }
 
-- (void)netServiceBrowser:(NSNetServiceBrowser *)aNetServiceBrowser didFindService:(NSNetService *)aNetService moreComing:(BOOL)moreComing
+/**
+ * Takes the TouchSynth's latest changes and, when they are what we send, sends them: new changes 
+ * straight away, then repeated a couple of times, with a snapshot of the whole TouchSynth every so
+ * often.  Called from the network thread.
+ */
+- (void)sendSynthEvents:(double)nowSeconds
 {
-	//NSLog(@"netservice found: %@ %@", [aNetService name], moreComing ? @"(moreComing)" : @"");
+    if (!hasSendClock)
+    {
+        // nothing to timestamp the changes with until the audio thread starts
+        return;
+    }
+    int numNew = synthEventSender->takeEvents(sendClockSeconds, sendClockTimestamp);
     
-    [services addObject:aNetService];
-    if (clientTableView)
+    struct sockaddr_storage destination;
+    BOOL destinationIsStereo;
+    socklen_t destinationLength = [self copySendDestination:&destination isStereo:&destinationIsStereo];
+    if (destinationLength == 0 || sendMode != kDMPSendSynthEvents)
     {
-        [clientTableView reloadData];
+        return;
+    }
+    uint32_t timestamp = sendClockTimestamp + (uint32_t)lrint((nowSeconds - sendClockSeconds) * AUDIO_SAMPLE_RATE);
+    
+    SynthEvent events[SYNTH_EVENT_HISTORY];
+    if (numNew > 0 || nowSeconds - lastEventPacketSeconds >= kEventRepeatSeconds)
+    {
+        int numEvents = synthEventSender->getChanges(events);
+        if (numEvents > 0)
+        {
+            [self sendEvents:events count:numEvents isSnapshot:NO timestamp:timestamp 
+                   toAddress:(const struct sockaddr *)&destination length:destinationLength];
+            lastEventPacketSeconds = nowSeconds;
+        }
+    }
+    if (nowSeconds - lastSnapshotSeconds >= kEventSnapshotSeconds)
+    {
+        int numEvents = synthEventSender->getSnapshot(timestamp, events);
+        [self sendEvents:events count:numEvents isSnapshot:YES timestamp:timestamp 
+               toAddress:(const struct sockaddr *)&destination length:destinationLength];
+        lastSnapshotSeconds = nowSeconds;
     }
-    [aNetService setDelegate:self];
-    [aNetService resolveWithTimeout:5];
 }
 
-- (void)netServiceBrowser:(NSNetServiceBrowser *)aNetServiceBrowser didRemoveService:(NSNetService *)aNetService moreComing:(BOOL)moreComing
+/**
+ * Hands the network thread the current destination: the multicast group if there is one, or else 
+ * savedAddress.  Called from the main thread whenever either (or what we know of them) changes.
+ */
+- (void)updateSendDestination
 {
-    BOOL foundService = NO;
+    NSData *destination = multicastAddress ? multicastAddress : savedAddress;
     
-    for (NSNetService *currentService in services)
+    // a group's members may play anything, but all of them can take stereo
+    NSNumber *destinationChannels = savedAddress ? [peerChannels objectForKey:savedAddress] : nil;
+    BOOL isStereo = (multicastAddress != nil) || (destinationChannels != nil && [destinationChannels intValue] >= 2);
+    
+    if (destination && transport->isOpen() && ![self canSendToAddress:destination])
     {
-        if ([[currentService name] isEqual:[aNetService name]] &&
-            [[currentService type] isEqual:[aNetService type]] &&
-            [[currentService domain] isEqual:[aNetService domain]])
-        {
-            [services removeObject:currentService];
-            if (clientTableView)
-            {
-                [clientTableView reloadData];
-            }
-            foundService = YES;
-            break;
-        }
+        NSLog(@"can't send to %@ without IPv6", destination);
+        destination = nil;
     }
     
-	NSLog(@"netservice removed: %@ (%@)", [aNetService name], foundService ? @"successfully" : @"unsuccessfully");
+    pthread_mutex_lock(&sendDestinationLock);
+    sendDestinationLength = 0;
+    if (destination && [destination length] <= sizeof(sendDestination))
+    {
+        memcpy(&sendDestination, [destination bytes], [destination length]);
+        sendDestinationLength = [destination length];
+    }
+    sendDestinationIsStereo = isStereo;
+    pthread_mutex_unlock(&sendDestinationLock);
 }
 
-#pragma mark AsyncUdpSocket Delegate Methods
-- (void)onUdpSocket:(AsyncUdpSocket *)sock didSendDataWithTag:(long)tag
+- (BOOL)canSendToAddress:(NSData *)address
 {
-    //NSLog(@"%@ %s", [self class], _cmd);
+    const struct sockaddr *socketAddress = (const struct sockaddr *)[address bytes];
+    return [address length] >= sizeof(struct sockaddr) && 
+           (transport->isOpen() ? transport->canSendTo(socketAddress) : UdpTransport::getAddressLength(socketAddress) > 0);
 }
 
-- (void)onUdpSocket:(AsyncUdpSocket *)sock didNotSendDataWithTag:(long)tag dueToError:(NSError *)error
+- (void)setSavedAddress:(NSData *)address
 {
-    NSLog(@"%@ %s", [self class], _cmd);
+    [address retain];
+    [savedAddress release];
+    savedAddress = address;
+    [self updateSendDestination];
 }
 
-- (BOOL)onUdpSocket:(AsyncUdpSocket *)sock didReceiveData:(NSData *)data withTag:(long)tag fromHost:(NSString *)host port:(UInt16)port
+/**
+ * Measures how fast our playback sample clock really runs, against the same host clock the senders' 
+ * timestamps are compared with.  Called from the audio thread.
+ */
+- (void)updatePlaybackClock:(double)hostSeconds samplesPerChannel:(int)samplesPerChannel
 {
-    //NSLog(@"%@ %s", [self class], _cmd);
-    
-    DMPDataPacket *packet = (DMPDataPacket *)[data bytes];
+    playbackClock->addReading(hostSeconds, playbackSamples / AUDIO_SAMPLE_RATE);
+    playbackSamples += samplesPerChannel;
+    AtomicStore32(&playbackDriftPpb, (int32_t)(playbackClock->getDrift() * 1e9));
+}
+
+/**
+ * Steers a stream's resampler so its audio is played exactly as fast as the sender makes it.  Called
+ * from the audio thread.
+ */
+- (void)updateResampleRatio:(DMPReceiveStream *)stream samplesPerChannel:(int)samplesPerChannel
+{
+    // the drift estimates leave a small error, which would slowly fill or drain the jitter buffer,
+    // so hold the depth where it settled after the jitter buffer last changed it
+    JitterBufferStats stats;
+    stream->jitterBuffer->getStats(stats);
+    double depth = stats.bufferedFrames + stream->resampler->getNumBuffered() / stream->frameSize;
+    uint32_t playoutChanges = stats.numRebuffers + stats.numDiscarded + stats.numStretched;
+    uint32_t numPlayedOrMissing = stats.numPlayed + stats.numMissing;
+    double callbackSeconds = samplesPerChannel / AUDIO_SAMPLE_RATE;
+    if (stats.targetDelayFrames != stream->lastTargetDelay || playoutChanges != stream->lastPlayoutChanges || 
+        numPlayedOrMissing == stream->lastNumPlayedOrMissing)
+    {
+        // the jitter buffer has moved the depth, or isn't playing
+        stream->lastTargetDelay = stats.targetDelayFrames;
+        stream->lastPlayoutChanges = playoutChanges;
+        stream->smoothedDepth = depth;
+        stream->depthSettleCount = 0;
+    }
+    stream->lastNumPlayedOrMissing = numPlayedOrMissing;
     
-    // throw each buffer into the big received buffer at index % kNumCachedReceiveBuffers
-    int bufferIndexToWrite = 0;
-    for (int i = 0; i < kNumSlicesPerPacket; i++)
+    double correction = 0.0;
+    int settleCount = (int)(kDepthSettleSeconds / callbackSeconds);
+    if (stream->depthSettleCount < settleCount)
     {
-        bufferIndexToWrite = packet->slices[i].index % kNumCachedReceiveBuffers;
-        
-        // don't overwrite the same data
-        if (packet->slices[i].index != audioReceiveBuffers[bufferIndexToWrite].index)
+        // a plain average while settling, so the reference is taken from the new depth only
+        stream->smoothedDepth += (depth - stream->smoothedDepth) / (stream->depthSettleCount + 1);
+        if (++stream->depthSettleCount == settleCount)
         {
-            memcpy(&audioReceiveBuffers[bufferIndexToWrite] ,
-                &(packet->slices[i]),
-                sizeof(DMPDataPacketSlice));
+            stream->depthReference = stream->smoothedDepth;
         }
     }
-
-    [sock receiveWithTimeout:-1 tag:0];
+    else
+    {
+        stream->smoothedDepth += (callbackSeconds / kDepthSmoothingSeconds) * (depth - stream->smoothedDepth);
+        double excessSeconds = (stream->smoothedDepth - stream->depthReference) * stream->frameSize / AUDIO_SAMPLE_RATE;
+        correction = excessSeconds / kDepthCorrectionSeconds;
+        correction = MAX(-kMaxDepthCorrection, MIN(kMaxDepthCorrection, correction));
+    }
     
-    return YES;
+    double senderDrift = AtomicLoad32(&stream->senderDriftPpb) * 1e-9;
+    double ratio = (1.0 + senderDrift) / (1.0 + playbackClock->getDrift()) * (1.0 + correction);
+    stream->resampler->setRatio(ratio);
+    AtomicStore32(&stream->resampleDeviationPpb, (int32_t)((stream->resampler->getRatio() - 1.0) * 1e9));
 }
 
-- (void)onUdpSocket:(AsyncUdpSocket *)sock didNotReceiveDataWithTag:(long)tag dueToError:(NSError *)error
+/**
+ * Plays numFrames stereo frames of a stream into its resampledFrame.  Called from the audio thread.
+ */
+- (void)renderReceiveStream:(DMPReceiveStream *)stream frames:(int)numFrames
 {
-    NSLog(@"%@ %s", [self class], _cmd);
+    // feed the resampler whole received frames until it has enough
+    while (stream->resampler->getNumInputNeeded(numFrames) > 0)
+    {
+        // fill in for missing frames (and for the silence while the jitter buffer refills) 
+        // by continuing the waveform, fading out if the gap goes on
+        if (stream->jitterBuffer->read(receivedFrame) == JitterBuffer::ReadPlayed)
+        {
+            stream->lossConcealer->processReceived(receivedFrame);
+        }
+        else
+        {
+            stream->lossConcealer->conceal(receivedFrame);
+        }
+        stream->resampler->write(receivedFrame, stream->frameSize);
+    }
+    stream->resampler->read(stream->resampledFrame, numFrames);
 }
 
-- (void)onUdpSocketDidClose:(AsyncUdpSocket *)sock
+/**
+ * Plays a stream's TouchSynth (if it has one) and adds it to the numFrames stereo frames in its 
+ * resampledFrame.  Called from the audio thread.
+ */
+- (void)renderStreamEvents:(DMPReceiveStream *)stream frames:(int)numFrames startSeconds:(double)startSeconds
 {
-    NSLog(@"%@ %s", [self class], _cmd);
+    SynthEventPlayer *player = AtomicLoadPtr(&stream->eventPlayer);
+    if (player == NULL || player->isQuiet())
+    {
+        return;
+    }
+    player->render(synthFrame, numFrames, kNumNetworkChannels, startSeconds);
+    
+    short *samples = stream->resampledFrame;
+    for (int i = 0; i < numFrames * kNumNetworkChannels; i++)
+    {
+        int sum = samples[i] + (int)(synthFrame[i] * AUDIO_MAX_AMPLITUDE);
+        samples[i] = (short)MAX(-32768, MIN(sum, 32767));
+    }
 }
 
-
+- (void)fillAudioBuffer:(short*)buffer samplesPerChannel:(int)samplesPerChannel channels:(int)numChannels
+{
+    double hostSeconds = HostTimeToSeconds(HostTimeNow());
+    [self updatePlaybackClock:hostSeconds samplesPerChannel:samplesPerChannel];
+    
+    // enter the read-side critical section for receiveStreams (see retireReceiveStream:)
+    AtomicIncrement32(&mixEpoch);
+    
+    DMPReceiveStream *streams[kMaxReceiveStreams];
+    const short *mixInputs[kMaxReceiveStreams];
+    float mixGains[kMaxReceiveStreams];
+    int numStreams = 0;
+    for (int i = 0; i < kMaxReceiveStreams; i++)
+    {
+        DMPReceiveStream *stream = AtomicLoadPtr(&receiveStreams[i]);
+        if (stream)
+        {
+            streams[numStreams] = stream;
+            mixInputs[numStreams] = stream->resampledFrame;
+            mixGains[numStreams] = stream->gain;
+            numStreams++;
+        }
+    }
+    
+    for (int done = 0; done < samplesPerChannel; )
+    {
+        int numFrames = MIN(samplesPerChannel - done, kNumSamplesPerChannel);
+        
+        for (int i = 0; i < numStreams; i++)
+        {
+            [self renderReceiveStream:streams[i] frames:numFrames];
+            [self renderStreamEvents:streams[i] frames:numFrames startSeconds:hostSeconds + done / AUDIO_SAMPLE_RATE];
+        }
+        AudioSamplesMixShortNToShort(mixInputs, mixGains, numStreams, mixedFrame, numFrames * kNumNetworkChannels);
+        
+        short *out = buffer + done * numChannels;
+        if (numChannels == 1)
+        {
+            for (int i = 0; i < numFrames; i++) {
+                out[i] = (short)((mixedFrame[2 * i] + mixedFrame[2 * i + 1]) >> 1);
+            }
+        }
+        else
+        {
+            for (int i = 0; i < numFrames; i++) {
+                // copy left and right into alternate channels
+                for (int j = 0; j < numChannels; j++) {
+                    out[(numChannels * i) + j] = mixedFrame[2 * i + (j & 1)];
+                }
+            }
+        }
+        done += numFrames;
+    }
+    
+    for (int i = 0; i < numStreams; i++)
+    {
+        [self updateResampleRatio:streams[i] samplesPerChannel:samplesPerChannel];
+    }
+    
+    AtomicIncrement32(&mixEpoch);
+}
+
+- (void)setSendCodec:(DMPCodec)codec
+{
+    sendCodec = codec;
+}
+
+- (void)setSendLayout:(DMPLayout)layout
+{
+    sendLayout = layout;
+}
+
+- (void)setSendMode:(DMPSendMode)mode
+{
+    sendMode = mode;
+}
+
+- (TouchSynthListener *)synthListener
+{
+    return synthEventSender;
+}
+
+- (SessionClock *)sessionClock
+{
+    return sessionClock;
+}
+
+- (void)getSessionClockStats:(SessionClockStats *)stats
+{
+    sessionClock->getStats(*stats);
+}
+
+- (void)setFrameDuration:(double)seconds
+{
+    sendFrameMicroseconds = (int)(MAX(kMinFrameDuration, MIN(seconds, kMaxFrameDuration)) * 1e6);
+}
+
+- (void)setAggregationDelay:(double)seconds
+{
+    sendAggregateMicroseconds = (int)(MAX(0.0, MIN(seconds, kNumSamplesPerChannel / AUDIO_SAMPLE_RATE)) * 1e6);
+}
+
+- (void)setPathMtu:(int)mtu
+{
+    sendMaxDatagramBytes = MAX(kMinPathMtu, MIN(mtu, UDP_TRANSPORT_MAX_DATAGRAM_BYTES)) - kIpUdpHeaderBytes;
+}
+
+/**
+ * Finds the received stream with the given name, or returns NULL.  Called with receiveStreamsLock held.
+ */
+- (DMPReceiveStream *)receiveStreamNamed:(NSString *)name
+{
+    for (int i = 0; i < kMaxReceiveStreams; i++)
+    {
+        if (receiveStreams[i] && [receiveStreams[i]->name isEqualToString:name])
+        {
+            return receiveStreams[i];
+        }
+    }
+    return NULL;
+}
+
+- (NSArray *)receiveStreamNames
+{
+    NSMutableArray *names = [NSMutableArray array];
+    pthread_mutex_lock(&receiveStreamsLock);
+    for (int i = 0; i < kMaxReceiveStreams; i++)
+    {
+        if (receiveStreams[i])
+        {
+            [names addObject:receiveStreams[i]->name];
+        }
+    }
+    pthread_mutex_unlock(&receiveStreamsLock);
+    return names;
+}
+
+- (void)setGain:(float)gain forStream:(NSString *)name
+{
+    pthread_mutex_lock(&receiveStreamsLock);
+    [streamGains setObject:[NSNumber numberWithFloat:gain] forKey:name];
+    DMPReceiveStream *stream = [self receiveStreamNamed:name];
+    if (stream)
+    {
+        stream->gain = gain;
+    }
+    pthread_mutex_unlock(&receiveStreamsLock);
+}
+
+- (float)gainForStream:(NSString *)name
+{
+    pthread_mutex_lock(&receiveStreamsLock);
+    NSNumber *gain = [streamGains objectForKey:name];
+    float value = gain ? [gain floatValue] : 1.0f;
+    pthread_mutex_unlock(&receiveStreamsLock);
+    return value;
+}
+
+- (BOOL)getJitterBufferStats:(JitterBufferStats *)stats forStream:(NSString *)name
+{
+    pthread_mutex_lock(&receiveStreamsLock);
+    DMPReceiveStream *stream = [self receiveStreamNamed:name];
+    if (stream)
+    {
+        stream->jitterBuffer->getStats(*stats);
+    }
+    pthread_mutex_unlock(&receiveStreamsLock);
+    return stream != NULL;
+}
+
+- (BOOL)getClockStats:(NetworkClockStats *)stats forStream:(NSString *)name
+{
+    pthread_mutex_lock(&receiveStreamsLock);
+    DMPReceiveStream *stream = [self receiveStreamNamed:name];
+    if (stream)
+    {
+        stats->senderDrift = AtomicLoad32(&stream->senderDriftPpb) * 1e-9;
+        stats->playbackDrift = AtomicLoad32(&playbackDriftPpb) * 1e-9;
+        stats->resampleRatio = 1.0 + AtomicLoad32(&stream->resampleDeviationPpb) * 1e-9;
+        stats->excessDelaySeconds = stream->excessDelaySeconds;
+    }
+    pthread_mutex_unlock(&receiveStreamsLock);
+    return stream != NULL;
+}
+
+- (BOOL)getFecStats:(FecStats *)stats forStream:(NSString *)name
+{
+    pthread_mutex_lock(&receiveStreamsLock);
+    DMPReceiveStream *stream = [self receiveStreamNamed:name];
+    if (stream)
+    {
+        stream->fecDecoder->getStats(*stats);
+    }
+    pthread_mutex_unlock(&receiveStreamsLock);
+    return stream != NULL;
+}
+
+- (BOOL)getSynthEventStats:(SynthEventStats *)stats forStream:(NSString *)name
+{
+    pthread_mutex_lock(&receiveStreamsLock);
+    DMPReceiveStream *stream = [self receiveStreamNamed:name];
+    BOOL hasEvents = (stream != NULL && stream->eventPlayer != NULL);
+    if (hasEvents)
+    {
+        stream->eventPlayer->getStats(*stats);
+    }
+    pthread_mutex_unlock(&receiveStreamsLock);
+    return hasEvents;
+}
+
+- (BOOL)getTelemetry:(NetworkTelemetryStats *)stats forStream:(NSString *)name
+{
+    // no lock: each slot's telemetry lives as long as we do, and names the stream it is counting
+    const char *source = [name UTF8String];
+    for (int i = 0; i < kMaxReceiveStreams; i++)
+    {
+        streamTelemetry[i]->getStats(*stats);
+        if (stats->source[0] != '\0' && strcmp(stats->source, source) == 0)
+        {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+- (void)setTelemetryLogInterval:(double)seconds
+{
+    telemetryLogMilliseconds = (int)(MAX(0.0, seconds) * 1000.0);
+}
+
+- (void)setImpairment:(const NetworkImpairmentSettings *)settings
+{
+    pthread_mutex_lock(&impairmentLock);
+    impairmentRequested = (settings != NULL);
+    if (settings)
+    {
+        impairmentSettings = *settings;
+    }
+    memset(&impairmentStats, 0, sizeof(impairmentStats));
+    AtomicStore32(&impairmentChanged, 1);
+    pthread_mutex_unlock(&impairmentLock);
+}
+
+- (BOOL)setImpairmentPreset:(NSString *)name seed:(uint32_t)seed
+{
+    NetworkImpairmentSettings settings;
+    if (!NetworkImpairment::getPreset([name UTF8String], seed, settings))
+    {
+        NSLog(@"no network impairment preset called %@", name);
+        return NO;
+    }
+    [self setImpairment:&settings];
+    return YES;
+}
+
+- (void)getImpairmentStats:(NetworkImpairmentStats *)stats
+{
+    pthread_mutex_lock(&impairmentLock);
+    *stats = impairmentStats;
+    pthread_mutex_unlock(&impairmentLock);
+}
+
+/**
+ * Waits until the network thread can no longer be using a capture or replay that has just been 
+ * unpublished.
+ */
+- (void)waitForNetworkEpoch
+{
+    // networkEpoch is odd while the network thread may be using them.  An iteration of its loop that 
+    // starts after they were unpublished won't see them, so we only have to wait for the one (if any)
+    // running right now.
+    int32_t epoch = AtomicLoad32(&networkEpoch);
+    if (epoch & 1)
+    {
+        while (AtomicLoad32(&networkEpoch) == epoch)
+        {
+            usleep(kRenderGracePeriodPollUsec);
+        }
+    }
+}
+
+- (BOOL)startCaptureToFile:(NSString *)path
+{
+    // the old capture is finished first, in case it is going to the same file
+    [self stopCapture];
+    PacketCaptureWriter *capture = new PacketCaptureWriter([path fileSystemRepresentation], HostTimeToSeconds(HostTimeNow()));
+    if (!capture->isOpen())
+    {
+        delete capture;
+        return NO;
+    }
+    AtomicExchangePtr(&captureWriter, capture);
+    NSLog(@"capturing network packets to %@", path);
+    return YES;
+}
+
+- (void)stopCapture
+{
+    PacketCaptureWriter *capture = AtomicExchangePtr(&captureWriter, (PacketCaptureWriter *)NULL);
+    if (capture)
+    {
+        [self waitForNetworkEpoch];
+        NSLog(@"captured %u network packets (%u dropped)", capture->getNumPackets(), capture->getNumDropped());
+        delete capture;
+    }
+}
+
+- (BOOL)startReplayOfFile:(NSString *)path speed:(double)speed
+{
+    PacketReplayer *replay = new PacketReplayer(speed);
+    if (!replay->open([path fileSystemRepresentation]))
+    {
+        delete replay;
+        return NO;
+    }
+    [self stopReplay];
+    AtomicExchangePtr(&replayer, replay);
+    return YES;
+}
+
+- (void)stopReplay
+{
+    PacketReplayer *replay = AtomicExchangePtr(&replayer, (PacketReplayer *)NULL);
+    if (replay)
+    {
+        [self waitForNetworkEpoch];
+        delete replay;
+    }
+}
+
+- (void)getTransportStats:(UdpTransportStats *)stats
+{
+    transport->getStats(*stats);
+}
+
+- (void)setFecGroupSize:(int)numData parity:(int)numParity
+{
+    fecAutoTune = NO;
+    AtomicStore32(&fecGroupSizeRequest, (MAX(1, MIN(numData, FEC_MAX_DATA_BLOCKS)) << 8) | MAX(0, MIN(numParity, FEC_MAX_PARITY_BLOCKS)));
+}
+
+- (void)setFecAutoTune:(BOOL)autoTune
+{
+    fecAutoTune = autoTune;
+}
+
+- (void)setCongestionControl:(BOOL)on
+{
+    congestionControl = on;
+}
+
+- (void)setTargetLossRate:(double)lossRate
+{
+    congestionTargetLossPpm = (int)(MAX(0.0, MIN(lossRate, 1.0)) * 1e6);
+}
+
+- (void)getCongestionStats:(CongestionStats *)stats
+{
+    congestion->getStats(*stats);
+}
+
+/**
+ * Chooses the sending FEC group size once a stream has received enough groups since the last choice.
+ * Whoever we send to, the worst loss measured on any stream decides it - unless receivers are 
+ * reporting the loss of what we send, in which case congestion control chooses it from that.
+ */
+- (void)tuneFec:(DMPReceiveStream *)stream
+{
+    FecStats stats;
+    stream->fecDecoder->getStats(stats);
+    BOOL hasFeedback = congestionControlApplied && congestion->hasFeedback();
+    if (fecAutoTune && !hasFeedback && stats.numGroups - stream->fecGroupsAtLastTune >= kFecTuneGroups)
+    {
+        stream->fecGroupsAtLastTune = stats.numGroups;
+        
+        double lossRate = 0.0;
+        for (int i = 0; i < kMaxReceiveStreams; i++)
+        {
+            if (receiveStreams[i])
+            {
+                receiveStreams[i]->fecDecoder->getStats(stats);
+                lossRate = MAX(lossRate, stats.lossRate);
+            }
+        }
+        
+        int numData, numParity;
+        FecEncoder::chooseGroupSize(lossRate, numData, numParity);
+        AtomicStore32(&fecGroupSizeRequest, (numData << 8) | numParity);
+    }
+}
+
+/**
+ * Decodes numFrames frames of numChannels channels, coded with codec, from the start of data.
+ * Returns the number of bytes used, or 0 if data is too short.
+ */
+- (int)decodeData:(const uint8_t *)data length:(int)length codec:(int)codec frames:(int)numFrames channels:(int)numChannels into:(short *)samples
+{
+    if (codec == kDMPCodecAdpcm)
+    {
+        int used = AdpcmEncoder::getEncodedSize(numFrames, numChannels);
+        return AdpcmDecoder::decode(data, length, samples, numFrames, numChannels) ? used : 0;
+    }
+    else if (codec == kDMPCodecPcm16)
+    {
+        int used = numFrames * numChannels * sizeof(short);
+        if (length < used)
+        {
+            return 0;
+        }
+        memcpy(samples, data, used);
+        return used;
+    }
+    return 0;
+}
+
+- (void)receiveTimestamp:(uint32_t)timestamp stream:(DMPReceiveStream *)stream arrivalSeconds:(double)arrivalSeconds
+{
+    // unwrap the sender's sample clock, and compare it with ours
+    if (stream->hasReceivedTimestamp)
+    {
+        stream->receivedSamples += (int32_t)(timestamp - stream->lastReceivedTimestamp);
+    }
+    else
+    {
+        stream->receivedSamples = timestamp;
+        stream->hasReceivedTimestamp = YES;
+    }
+    stream->lastReceivedTimestamp = timestamp;
+    
+    double remoteSeconds = stream->receivedSamples / AUDIO_SAMPLE_RATE;
+    stream->senderClock->addReading(arrivalSeconds, remoteSeconds);
+    stream->excessDelaySeconds = stream->senderClock->getExcessDelay(arrivalSeconds, remoteSeconds);
+    AtomicStore32(&stream->senderDriftPpb, (int32_t)(stream->senderClock->getDrift() * 1e9));
+}
+
+- (void)receivePayload:(const DMPPayload *)payload sequence:(uint32_t)sequence stream:(DMPReceiveStream *)stream arrivalSeconds:(double)arrivalSeconds
+{
+    // a rebuilt payload may be from before the sender changed its frame size
+    int numSamplesPerChannel = payload->numFrames * payload->frameSize;
+    if (payload->frameSize != stream->frameSize || payload->numFrames == 0 || numSamplesPerChannel > kNumSamplesPerChannel)
+    {
+        return;
+    }
+    
+    // everything is buffered as stereo, whatever the sender's layout
+    int length = MIN(payload->length, kMaxPayloadBytes);
+    int used = 0;
+    if (payload->layout == kDMPLayoutStereo)
+    {
+        used = [self decodeData:payload->data length:length codec:payload->codec frames:numSamplesPerChannel channels:2 into:decodedFrame];
+    }
+    else if (payload->layout == kDMPLayoutMono)
+    {
+        used = [self decodeData:payload->data length:length codec:payload->codec frames:numSamplesPerChannel channels:1 into:midFrame];
+        memset(sideFrame, 0, sizeof(sideFrame));
+        AudioSamplesMidSideToStereo(midFrame, sideFrame, decodedFrame, numSamplesPerChannel);
+    }
+    else if (payload->layout == kDMPLayoutMidSide)
+    {
+        int numSideFrames = numSamplesPerChannel / 2;
+        used = [self decodeData:payload->data length:length codec:payload->codec frames:numSamplesPerChannel channels:1 into:midFrame];
+        int sideUsed = (used > 0) ? [self decodeData:payload->data + used length:length - used codec:payload->codec frames:numSideFrames channels:1 into:sideFrame] : 0;
+        used = (sideUsed > 0) ? used + sideUsed : 0;
+        
+        // back to the full rate by linear interpolation, working down so nothing is overwritten before it's used
+        for (int i = numSideFrames - 1; i >= 0; i--)
+        {
+            short next = (i + 1 < numSideFrames) ? sideFrame[i + 1] : sideFrame[i];
+            sideFrame[2 * i + 1] = (short)((sideFrame[i] + next) >> 1);
+            sideFrame[2 * i] = sideFrame[i];
+        }
+        AudioSamplesMidSideToStereo(midFrame, sideFrame, decodedFrame, numSamplesPerChannel);
+    }
+    
+    // the jitter buffer sorts out order and timing, frame by frame
+    if (used > 0)
+    {
+        int frameSamples = payload->frameSize * kNumNetworkChannels;
+        for (int i = 0; i < payload->numFrames; i++)
+        {
+            stream->jitterBuffer->write(payload->frameSequence + i, decodedFrame + i * frameSamples, frameSamples, arrivalSeconds);
+        }
+    }
+}
+
+/**
+ * Finds the stream for a sender, creating it if need be, or starting it again if the sender's frames 
+ * have changed size.  A frameSize of 0 (for packets that don't say) only finds an existing stream.
+ * Returns NULL if there is no such stream or no room for a new one.  Called from the network thread 
+ * with receiveStreamsLock held.
+ */
+- (DMPReceiveStream *)receiveStreamForAddress:(const struct sockaddr *)address frameSize:(int)frameSize arrivalSeconds:(double)arrivalSeconds
+{
+    DMPReceiveStream *stream = NULL;
+    for (int i = 0; i < kMaxReceiveStreams && stream == NULL; i++)
+    {
+        if (receiveStreams[i] && UdpTransport::isSameAddress((const struct sockaddr *)&receiveStreams[i]->address, address))
+        {
+            stream = receiveStreams[i];
+            if (frameSize != 0 && frameSize != stream->frameSize)
+            {
+                // the jitter buffer and everything after it work in whole frames
+                NSLog(@"%@ changed its frame size; restarting its stream", stream->name);
+                [self retireReceiveStream:i];
+                stream = NULL;
+                break;
+            }
+        }
+    }
+    if (stream == NULL && frameSize != 0)
+    {
+        stream = [self addReceiveStream:address frameSize:frameSize];
+    }
+    if (stream)
+    {
+        stream->lastArrivalSeconds = arrivalSeconds;
+    }
+    return stream;
+}
+
+/**
+ * Drops the streams whose senders have gone quiet, and silences the TouchSynths of those that have 
+ * stopped sending changes.  Called from the network thread with 
+ * receiveStreamsLock held.
+ */
+- (void)retireQuietStreams:(double)nowSeconds
+{
+    for (int i = 0; i < kMaxReceiveStreams; i++)
+    {
+        DMPReceiveStream *stream = receiveStreams[i];
+        if (stream && nowSeconds - stream->lastArrivalSeconds > kStreamTimeoutSeconds)
+        {
+            [self retireReceiveStream:i];
+        }
+        else if (stream && stream->eventsArePlaying && nowSeconds - stream->lastEventSeconds > kEventTimeoutSeconds)
+        {
+            // the sender has gone back to sending audio, or gone altogether - don't leave its Voices on
+            stream->eventPlayer->stop(nowSeconds);
+            stream->eventsArePlaying = NO;
+        }
+    }
+}
+
+/**
+ * Hands a packet of TouchSynth events to its sender's stream, which is started if need be, to be 
+ * played on the stream's own TouchSynth.  Called from the network thread with receiveStreamsLock held.
+ */
+- (void)receiveEvents:(const DMPEventPacket *)packet length:(size_t)length fromAddress:(const struct sockaddr *)address arrivalSeconds:(double)arrivalSeconds
+{
+    int numEvents = packet->numEvents;
+    if (numEvents == 0 || numEvents > SYNTH_EVENT_HISTORY || kEventPacketHeaderSize + numEvents * sizeof(SynthEvent) > length)
+    {
+        return;
+    }
+    
+    // a sender that only sends events still gets a whole stream, with frames of the default size
+    DMPReceiveStream *stream = [self receiveStreamForAddress:address frameSize:0 arrivalSeconds:arrivalSeconds];
+    if (stream == NULL)
+    {
+        stream = [self addReceiveStream:address frameSize:2 * (int)lrint(kDefaultFrameDuration * AUDIO_SAMPLE_RATE / 2)];
+        if (stream == NULL)
+        {
+            return;
+        }
+        stream->lastArrivalSeconds = arrivalSeconds;
+    }
+    if (stream->eventPlayer == NULL)
+    {
+        NSLog(@"%@ is sending TouchSynth changes", stream->name);
+        AtomicExchangePtr(&stream->eventPlayer, new SynthEventPlayer(AUDIO_SAMPLE_RATE, kEventPlayoutDelaySeconds));
+    }
+    
+    // the events are timed by the sender's sample clock.  If we share a session clock, the packet 
+    // says when its timestamp was on that, so every device plays each change at the same instant; 
+    // if not, the timestamp arrives (with the least delay seen) excessDelaySeconds before the packet did
+    [self receiveTimestamp:packet->timestamp stream:stream arrivalSeconds:arrivalSeconds];
+    double timestampSeconds = arrivalSeconds - stream->excessDelaySeconds;
+    if (packet->sessionSeconds != 0.0 && packet->sessionMasterId == sessionClock->getMasterId())
+    {
+        timestampSeconds = sessionClock->toLocalSeconds(packet->sessionSeconds);
+    }
+    stream->lastEventSeconds = arrivalSeconds;
+    stream->eventsArePlaying = YES;
+    stream->eventPlayer->addEvents(packet->events, numEvents, packet->isSnapshot != 0, packet->timestamp, timestampSeconds);
+}
+
+/**
+ * Sends a clock packet straight away, so the time in it is as fresh as it can be.  Called from the 
+ * network thread.
+ */
+- (void)sendClockPacket:(const DMPClockPacket *)packet toAddress:(const struct sockaddr *)address length:(socklen_t)addressLength
+{
+    [self queueHeader:packet length:kPacketHeaderSize payload:(const uint8_t *)packet + kPacketHeaderSize 
+               length:sizeof(DMPClockPacket) - kPacketHeaderSize toAddress:address length:addressLength];
+    transport->flush();
+}
+
+/**
+ * Answers a peer's clock request, or adds the exchange a reply completes to the session clock.  
+ * Clock packets don't start streams.  Called from the network thread.
+ */
+- (void)receiveClockPacket:(const DMPClockPacket *)packet fromAddress:(const struct sockaddr *)address arrivalSeconds:(double)arrivalSeconds
+{
+    uint32_t nodeId = sessionClock->getNodeId();
+    if (packet->nodeId == nodeId)
+    {
+        // our own, looped back by the multicast group
+        return;
+    }
+    
+    if (packet->type == kDMPPacketTypeClockRequest)
+    {
+        DMPClockPacket reply;
+        memset(&reply, 0, sizeof(reply));
+        reply.nodeId = nodeId;
+        reply.peerId = packet->nodeId;
+        reply.type = kDMPPacketTypeClockReply;
+        reply.masterId = sessionClock->getMasterId();
+        reply.originateSeconds = packet->originateSeconds;
+        reply.receiveSeconds = arrivalSeconds;
+        reply.transmitSeconds = HostTimeToSeconds(HostTimeNow());
+        [self sendClockPacket:&reply toAddress:address length:UdpTransport::getAddressLength(address)];
+    }
+    else if (packet->peerId == nodeId)
+    {
+        if (!sessionClock->addExchange(packet->nodeId, packet->originateSeconds, packet->receiveSeconds, 
+                                       packet->transmitSeconds, arrivalSeconds))
+        {
+            NSLog(@"already following the clocks of %d peers; ignoring another", SESSION_CLOCK_MAX_PEERS);
+        }
+    }
+}
+
+/**
+ * Hands a receiver's report on our audio to congestion control.  Reports don't start streams.  
+ * Called from the network thread.
+ */
+- (void)receiveFeedback:(const DMPFeedbackPacket *)packet arrivalSeconds:(double)arrivalSeconds
+{
+    if (!congestionControlApplied || sendMode != kDMPSendAudio)
+    {
+        return;
+    }
+    
+    CongestionReport report;
+    report.lossRate = MAX(0.0, MIN(packet->lossRate, 1.0));
+    report.residualLossRate = MAX(0.0, MIN(packet->residualLossRate, 1.0));
+    report.delayTrendSeconds = MAX(-1.0, MIN(packet->delayTrendSeconds, 1.0));
+    report.jitterSeconds = MAX(0.0, MIN(packet->jitterSeconds, 1.0));
+    congestion->addReport(report, arrivalSeconds);
+}
+
+/**
+ * Follows the main thread's congestion control settings, and acts on the reports that have arrived.
+ * A new level takes effect from the next packet, and a new FEC group size from the start of the 
+ * next group.  Called from the network thread.
+ */
+- (void)controlCongestion:(double)nowSeconds
+{
+    if (congestionControl != congestionControlApplied)
+    {
+        congestionControlApplied = congestionControl;
+        congestion->reset();
+    }
+    if (!congestionControlApplied)
+    {
+        return;
+    }
+    
+    congestion->setTargetLossRate(congestionTargetLossPpm * 1e-6);
+    int level = congestion->getLevel();
+    BOOL hadFeedback = congestion->hasFeedback();
+    BOOL changed = congestion->update(nowSeconds);
+    if (congestion->getLevel() != level)
+    {
+        NSLog(@"congestion level is now %d", congestion->getLevel());
+    }
+    
+    // while receivers report, the loss they see chooses the FEC rather than the loss we see (see tuneFec:)
+    if (fecAutoTune && congestion->hasFeedback() && (changed || !hadFeedback))
+    {
+        int numData, numParity;
+        congestion->getFecGroupSize(numData, numParity);
+        AtomicStore32(&fecGroupSizeRequest, (numData << 8) | numParity);
+    }
+}
+
+/**
+ * Hands the packets of the capture being replayed to the receive path as they come due.  Called 
+ * from the network thread with receiveStreamsLock held.
+ */
+- (void)replayCapturedPackets:(double)nowSeconds
+{
+    PacketReplayer *replay = AtomicLoadPtr(&replayer);
+    if (replay == NULL || replay->isFinished())
+    {
+        return;
+    }
+    const uint8_t *data;
+    size_t length;
+    const struct sockaddr *address;
+    double arrivalSeconds;
+    while (replay->pop(nowSeconds, data, length, address, arrivalSeconds))
+    {
+        [self receivePacket:data length:length fromAddress:address arrivalSeconds:arrivalSeconds];
+    }
+    if (replay->isFinished())
+    {
+        NSLog(@"finished replaying a capture of %u packets", replay->getNumReplayed());
+    }
+}
+
+/**
+ * Handles one datagram.  Called from the network thread with receiveStreamsLock held.
+ */
+- (void)receivePacket:(const uint8_t *)bytes length:(size_t)length fromAddress:(const struct sockaddr *)address arrivalSeconds:(double)arrivalSeconds
+{
+    uint8_t type = (length >= kPacketHeaderSize) ? ((const DMPDataPacket *)bytes)->type : kDMPPacketTypeData;
+    if ((type == kDMPPacketTypeClockRequest || type == kDMPPacketTypeClockReply) && length >= sizeof(DMPClockPacket))
+    {
+        [self receiveClockPacket:(const DMPClockPacket *)bytes fromAddress:address arrivalSeconds:arrivalSeconds];
+        return;
+    }
+    if (type == kDMPPacketTypeFeedback && length >= sizeof(DMPFeedbackPacket))
+    {
+        [self receiveFeedback:(const DMPFeedbackPacket *)bytes arrivalSeconds:arrivalSeconds];
+        return;
+    }
+    if (length >= kEventPacketHeaderSize && ((const DMPEventPacket *)bytes)->type == kDMPPacketTypeEvents)
+    {
+        [self receiveEvents:(const DMPEventPacket *)bytes length:length fromAddress:address arrivalSeconds:arrivalSeconds];
+        return;
+    }
+    if (length < kPacketHeaderSize + kPayloadHeaderSize)
+    {
+        return;
+    }
+    const DMPDataPacket *packet = (const DMPDataPacket *)bytes;
+    
+    // each sender's packets go to its own stream, which data packets start
+    int frameSize = 0;
+    if (packet->type == kDMPPacketTypeData)
+    {
+        frameSize = packet->payload.frameSize;
+        if ((frameSize & 1) || frameSize < 2 || frameSize > kNumSamplesPerChannel)
+        {
+            return;
+        }
+    }
+    DMPReceiveStream *stream = [self receiveStreamForAddress:address frameSize:frameSize arrivalSeconds:arrivalSeconds];
+    if (stream == NULL)
+    {
+        return;
+    }
+    
+    // FEC works on whole payloads, so pad out the part that wasn't sent with zeros
+    DMPPayload payload;
+    size_t payloadBytes = MIN(length - kPacketHeaderSize, sizeof(payload));
+    memcpy(&payload, &packet->payload, payloadBytes);
+    memset((uint8_t *)&payload + payloadBytes, 0, sizeof(payload) - payloadBytes);
+    
+    if (packet->type == kDMPPacketTypeData)
+    {
+        if (kPayloadHeaderSize + payload.length <= payloadBytes)
+        {
+            [self receiveTimestamp:packet->timestamp stream:stream arrivalSeconds:arrivalSeconds];
+            [self receivePayload:&payload sequence:packet->sequence stream:stream arrivalSeconds:arrivalSeconds];
+            stream->fecDecoder->addData(packet->sequence, packet->groupSize, packet->groupPosition, &payload);
+            
+            JitterBufferStats bufferStats;
+            stream->jitterBuffer->getStats(bufferStats);
+            stream->telemetry->addPacket(packet->sequence, stream->receivedSamples / AUDIO_SAMPLE_RATE, arrivalSeconds, stream->excessDelaySeconds);
+            stream->telemetry->addBufferFill(bufferStats.bufferedFrames);
+            stream->feedbackDelaySum += stream->excessDelaySeconds;
+            stream->feedbackDelayCount++;
+        }
+    }
+    else if (packet->type == kDMPPacketTypeParity)
+    {
+        stream->fecDecoder->addParity(packet->sequence, packet->groupSize, packet->groupPosition, &payload);
+    }
+    
+    // rebuilt buffers are decoded and buffered like any other arrival
+    uint32_t recoveredSequence;
+    const uint8_t *recoveredBlock;
+    while (stream->fecDecoder->popRecovered(recoveredSequence, recoveredBlock))
+    {
+        [self receivePayload:(const DMPPayload *)recoveredBlock sequence:recoveredSequence stream:stream arrivalSeconds:arrivalSeconds];
+    }
+    
+    [self tuneFec:stream];
+}
+
+/**
+ * Asks a peer for its clock.  Called from the network thread.
+ */
+- (void)sendClockRequestTo:(const struct sockaddr *)address length:(socklen_t)addressLength
+{
+    DMPClockPacket request;
+    memset(&request, 0, sizeof(request));
+    request.nodeId = sessionClock->getNodeId();
+    request.type = kDMPPacketTypeClockRequest;
+    request.masterId = sessionClock->getMasterId();
+    request.originateSeconds = HostTimeToSeconds(HostTimeNow());
+    [self sendClockPacket:&request toAddress:address length:addressLength];
+}
+
+/**
+ * Every kClockSyncSeconds, asks each peer for its clock: the destination (which may be the multicast 
+ * group, reaching everyone in it) and every sender we receive.  Then brings the session clock up to 
+ * date.  Called from the network thread.
+ */
+- (void)syncSessionClock:(double)nowSeconds
+{
+    if (nowSeconds - lastClockRequestSeconds >= kClockSyncSeconds)
+    {
+        lastClockRequestSeconds = nowSeconds;
+        
+        struct sockaddr_storage destination;
+        BOOL destinationIsStereo;
+        socklen_t destinationLength = [self copySendDestination:&destination isStereo:&destinationIsStereo];
+        if (destinationLength > 0)
+        {
+            [self sendClockRequestTo:(const struct sockaddr *)&destination length:destinationLength];
+        }
+        for (int i = 0; i < kMaxReceiveStreams; i++)
+        {
+            // the network thread is the only one that changes receiveStreams, so needs no lock to look
+            const struct sockaddr *address = receiveStreams[i] ? (const struct sockaddr *)&receiveStreams[i]->address : NULL;
+            if (address && !(destinationLength > 0 && UdpTransport::isSameAddress(address, (const struct sockaddr *)&destination)))
+            {
+                [self sendClockRequestTo:address length:UdpTransport::getAddressLength(address)];
+            }
+        }
+    }
+    
+    if (sessionClock->update(nowSeconds))
+    {
+        SessionClockStats stats;
+        sessionClock->getStats(stats);
+        NSLog(@"session clock master is now %08x%s", stats.masterId, (stats.masterId == stats.nodeId) ? " (us)" : "");
+    }
+}
+
+/**
+ * Every kFeedbackSeconds, tells the sender of each stream whose audio is arriving how much of it is
+ * lost, before and after FEC, and whether its delay is growing.  Called from the network thread.
+ */
+- (void)sendFeedback:(double)nowSeconds
+{
+    for (int i = 0; i < kMaxReceiveStreams; i++)
+    {
+        // the network thread is the only one that changes receiveStreams, so needs no lock to look
+        DMPReceiveStream *stream = receiveStreams[i];
+        if (stream == NULL || nowSeconds - stream->lastFeedbackSeconds < kFeedbackSeconds)
+        {
+            continue;
+        }
+        stream->lastFeedbackSeconds = nowSeconds;
+        
+        NetworkTelemetryStats telemetry;
+        stream->telemetry->getStats(telemetry);
+        JitterBufferStats bufferStats;
+        stream->jitterBuffer->getStats(bufferStats);
+        int32_t numExpected = (int32_t)(telemetry.numExpected - stream->feedbackExpected);
+        if (numExpected <= 0 || stream->feedbackDelayCount == 0)
+        {
+            // no audio since the last report (perhaps only TouchSynth changes)
+            continue;
+        }
+        int32_t numLost = (int32_t)(telemetry.numLost - stream->feedbackLost);
+        uint32_t numPlayed = bufferStats.numPlayed - stream->feedbackPlayed;
+        uint32_t numMissing = bufferStats.numMissing - stream->feedbackMissing;
+        double meanDelay = stream->feedbackDelaySum / stream->feedbackDelayCount;
+        
+        DMPFeedbackPacket packet;
+        memset(&packet, 0, sizeof(packet));
+        packet.sequence = stream->feedbackSequence++;
+        packet.numExpected = numExpected;
+        packet.type = kDMPPacketTypeFeedback;
+        packet.lossRate = MAX(0, numLost) / (float)numExpected;
+        packet.residualLossRate = (numPlayed + numMissing > 0) ? numMissing / (float)(numPlayed + numMissing) : 0.0f;
+        packet.delayTrendSeconds = stream->hasFeedbackMeanDelay ? meanDelay - stream->feedbackMeanDelay : 0.0f;
+        packet.jitterSeconds = telemetry.jitterSeconds;
+        
+        stream->feedbackExpected = telemetry.numExpected;
+        stream->feedbackLost = telemetry.numLost;
+        stream->feedbackPlayed = bufferStats.numPlayed;
+        stream->feedbackMissing = bufferStats.numMissing;
+        stream->feedbackDelaySum = 0.0;
+        stream->feedbackDelayCount = 0;
+        stream->feedbackMeanDelay = meanDelay;
+        stream->hasFeedbackMeanDelay = YES;
+        
+        const struct sockaddr *address = (const struct sockaddr *)&stream->address;
+        [self queueHeader:&packet length:kPacketHeaderSize payload:(const uint8_t *)&packet + kPacketHeaderSize 
+                   length:sizeof(packet) - kPacketHeaderSize toAddress:address length:UdpTransport::getAddressLength(address)];
+    }
+    transport->flush();
+}
+
+/**
+ * Logs a line of telemetry for each stream being received.  Called from the network thread.
+ */
+- (void)logTelemetry
+{
+    for (int i = 0; i < kMaxReceiveStreams; i++)
+    {
+        NetworkTelemetryStats stats;
+        streamTelemetry[i]->getStats(stats);
+        if (stats.source[0] != '\0')
+        {
+            char text[1024];
+            NetworkTelemetry::format(stats, text, sizeof(text));
+            NSLog(@"telemetry %s", text);
+        }
+    }
+}
+
+/**
+ * The network thread's loop: receives whatever has arrived (waiting briefly if nothing has), then
+ * sends whatever the audio thread has queued.
+ */
+- (void)runNetworkThread
+{
+    // anything left in the ring from before the thread started is stale
+    while (sendRing->beginRead())
+    {
+        sendRing->endRead();
+    }
+    sendPendingFrames = 0;
+    uint32_t numReportedDropped = sendRing->getNumDropped();
+    BOOL receiveIsFailing = NO;
+    
+    while (AtomicLoad32(&networkThreadIsRunning))
+    {
+        NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+        
+        int numReceived = transport->receive(kNetworkPollMilliseconds);
+        double nowSeconds = HostTimeToSeconds(HostTimeNow());
+        if (numReceived < 0)
+        {
+            // don't spin on a broken socket
+            if (!receiveIsFailing)
+            {
+                NSLog(@"network receive failed: %s", strerror(errno));
+                receiveIsFailing = YES;
+            }
+            usleep(kNetworkPollMilliseconds * 1000);
+        }
+        else
+        {
+            receiveIsFailing = NO;
+        }
+        
+        // from here until the end of the loop the capture and the replay may be in use
+        AtomicIncrement32(&networkEpoch);
+        PacketCaptureWriter *capture = AtomicLoadPtr(&captureWriter);
+        
+        pthread_mutex_lock(&receiveStreamsLock);
+        for (int i = 0; i < numReceived; i++)
+        {
+            size_t length;
+            const uint8_t *bytes = transport->getDatagram(i, length);
+            const struct sockaddr *address = transport->getDatagramAddress(i);
+            if (capture)
+            {
+                capture->addPacket(PACKET_CAPTURE_RECEIVED, nowSeconds, address, UdpTransport::getAddressLength(address), bytes, length, NULL, 0);
+            }
+            [self receivePacket:bytes length:length fromAddress:address arrivalSeconds:nowSeconds];
+        }
+        [self replayCapturedPackets:nowSeconds];
+        [self retireQuietStreams:nowSeconds];
+        pthread_mutex_unlock(&receiveStreamsLock);
+        
+        int logMilliseconds = telemetryLogMilliseconds;
+        if (logMilliseconds > 0 && nowSeconds - lastTelemetryLogSeconds >= logMilliseconds * 0.001)
+        {
+            [self logTelemetry];
+            lastTelemetryLogSeconds = nowSeconds;
+        }
+        
+        [self updateImpairment];
+        [self controlCongestion:nowSeconds];
+        const void *slot;
+        while ((slot = sendRing->beginRead()) != NULL)
+        {
+            [self packetizeSendBuffer:(const DMPSendBuffer *)slot];
+            sendRing->endRead();
+        }
+        double sendSeconds = HostTimeToSeconds(HostTimeNow());
+        [self syncSessionClock:sendSeconds];
+        [self sendFeedback:sendSeconds];
+        [self sendSynthEvents:sendSeconds];
+        [self sendImpairedPackets:sendSeconds];
+        
+        uint32_t numDropped = sendRing->getNumDropped();
+        if (numDropped != numReportedDropped)
+        {
+            NSLog(@"network thread is not keeping up - %u buffers dropped so far", numDropped);
+            numReportedDropped = numDropped;
+        }
+        
+        AtomicIncrement32(&networkEpoch);
+        [pool release];
+    }
+}
+
+static void *NetworkThreadMain(void *arg)
+{
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    [(NetworkController *)arg runNetworkThread];
+    [pool release];
+    return NULL;
+}
+
+/**
+ * Starts the network thread on the socket that has just been opened.
+ */
+- (void)startNetworkThread
+{
+    AtomicStore32(&networkThreadIsRunning, 1);
+    if (pthread_create(&networkThread, NULL, NetworkThreadMain, self) != 0)
+    {
+        NSLog(@"could not create the network thread");
+        networkThreadStarted = NO;
+    }
+    else
+    {
+        networkThreadStarted = YES;
+    }
+}
+
+/**
+ * Joins multicastGroup on the socket and applies the multicast options.
+ */
+- (BOOL)joinMulticastGroup
+{
+    const char *interfaceAddress = multicastInterface ? [multicastInterface UTF8String] : NULL;
+    if (!transport->joinMulticastGroup([multicastGroup UTF8String], interfaceAddress) ||
+        (interfaceAddress && !transport->setMulticastInterface(interfaceAddress)) ||
+        !transport->setMulticastTTL(multicastTTL) ||
+        !transport->setMulticastLoopback(multicastLoopback))
+    {
+        NSLog(@"could not join multicast group %@", multicastGroup);
+        return NO;
+    }
+    NSLog(@"joined multicast group %@ (ttl %d)", multicastGroup, multicastTTL);
+    return YES;
+}
+
+- (BOOL)startMulticastToGroup:(NSString *)group ttl:(int)ttl loopback:(BOOL)loopback interface:(NSString *)interfaceAddr
+{
+    [self stopMulticast];
+    
+    // work out the address once, rather than on every send
+    struct addrinfo hints, *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = PF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICHOST;
+    NSString *port = [NSString stringWithFormat:@"%d", kiDiMPSocketPort];
+    if (getaddrinfo([group UTF8String], [port UTF8String], &hints, &result) != 0)
+    {
+        NSLog(@"%@ is not an IP address", group);
+        return NO;
+    }
+    BOOL isMulticast = (result->ai_family == AF_INET) ? 
+        IN_MULTICAST(ntohl(((const struct sockaddr_in *)result->ai_addr)->sin_addr.s_addr)) : 
+        IN6_IS_ADDR_MULTICAST(&((const struct sockaddr_in6 *)result->ai_addr)->sin6_addr);
+    NSData *address = [NSData dataWithBytes:result->ai_addr length:result->ai_addrlen];
+    freeaddrinfo(result);
+    if (!isMulticast)
+    {
+        NSLog(@"%@ is not a multicast address", group);
+        return NO;
+    }
+    
+    multicastGroup = [group copy];
+    multicastTTL = ttl;
+    multicastLoopback = loopback;
+    multicastInterface = [interfaceAddr copy];
+    if (transport->isOpen() && ![self joinMulticastGroup])
+    {
+        [self stopMulticast];
+        return NO;
+    }
+    multicastAddress = [address retain];
+    [self updateSendDestination];
+    return YES;
+}
+
+- (void)stopMulticast
+{
+    if (multicastGroup)
+    {
+        if (transport->isOpen())
+        {
+            transport->leaveMulticastGroup([multicastGroup UTF8String], multicastInterface ? [multicastInterface UTF8String] : NULL);
+        }
+        [multicastGroup release];
+        multicastGroup = nil;
+        [multicastInterface release];
+        multicastInterface = nil;
+        [multicastAddress release];
+        multicastAddress = nil;
+        [self updateSendDestination];
+    }
+}
+
+- (void)startAudioServer
+{
+    // Open the UDP socket, and start sending and receiving on it.  A dual-stack socket reaches 
+    // whichever addresses Bonjour resolves; without IPv6 we make do with IPv4 alone.
+    if (!transport->open(kiDiMPSocketPort, true) && !transport->open(kiDiMPSocketPort))
+    {
+        NSLog(@"could not open the socket on port %d", kiDiMPSocketPort);
+    }
+    else
+    {
+        NSLog(@"created socket. port: %d", transport->getLocalPort());
+        if (multicastGroup)
+        {
+            [self joinMulticastGroup];
+        }
+        [self startNetworkThread];
+    }
+
+    [self startBonjourPublishing];
+    [self startBonjourSearch];
+}
+
+- (void)stopAudioServer
+{
+    [self stopBonjourSearch];
+    [self stopBonjourPublishing];
+    [self stopNetworkThread];
+    transport->close();
+}
+
+#pragma mark Bonjour Controls
+- (void)startBonjourPublishing
+{
+    if (!serviceIsPublishing)
+    {
+        [netService publish];
+        serviceIsPublishing = YES;
+    }
+}
+
+- (void)stopBonjourPublishing
+{
+    if (serviceIsPublishing)
+    {
+        // Note: you must send a 'stop' for every 'publish' message, or it won't work.
+        [netService stop];
+        serviceIsPublishing = NO;
+    }
+}
+
+- (void)startBonjourSearch
+{
+    if (!browserIsSearching)
+    {
+        [browser searchForServicesOfType:kBonjourServiceType inDomain:@"local."];
+        browserIsSearching = YES;
+        // reset found services
+        [services removeAllObjects];
+    }
+}
+
+- (void)stopBonjourSearch
+{
+    if (browserIsSearching)
+    {
+        [browser stop];
+        browserIsSearching = NO;
+    }
+}
+
+
+#pragma mark NSNetService Delegate Methods
+
+- (void)netService:(NSNetService *)sender didNotPublish:(NSDictionary *)errorDict
+{
+	NSLog(@"%@ %s", [self class], _cmd);
+}
+
+- (void)netServiceDidPublish:(NSNetService *)sender
+{
+	NSLog(@"%@ %s", [self class], _cmd);
+}
+
+- (void)netServiceDidResolveAddress:(NSNetService *)sender
+{
+    // remember how many channels this peer plays, by address, since that's how destinations are chosen
+    NSData *channelsData = [[NSNetService dictionaryFromTXTRecordData:[sender TXTRecordData]] objectForKey:kChannelsTXTRecordKey];
+    if (channelsData)
+    {
+        NSString *channelsString = [[[NSString alloc] initWithData:channelsData encoding:NSUTF8StringEncoding] autorelease];
+        for (NSData *address in [sender addresses])
+        {
+            [peerChannels setObject:[NSNumber numberWithInt:[channelsString intValue]] forKey:address];
+        }
+        [self updateSendDestination];
+    }
+    
+
+    const char *firstAddressData = (const char *)[[[sender addresses] objectAtIndex:0] bytes];
+    NSLog(@"address resolved. %@ = %@ (%hhu.%hhu.%hhu.%hhu) (1 of %d)",
+        [sender name],
+        [[sender addresses] objectAtIndex:0],
+        firstAddressData[4], firstAddressData[5], firstAddressData[6], firstAddressData[7],
+        [[sender addresses] count]);
+}
+
+- (void)netService:(NSNetService *)sender didNotResolve:(NSDictionary *)errorDict
+{
+    NSLog(@"did not resolve address for %@.", [sender name]);
+}
+
+- (void)netServiceDidStop:(NSNetService *)sender
+{
+	NSLog(@"%@ %s", [self class], _cmd);
+}
+
+#pragma mark NSNetServiceBrowser Delegate Methods
+
+- (void)netServiceBrowserWillSearch:(NSNetServiceBrowser *)aNetServiceBrowser
+{
+    NSLog(@"%@ %s", [self class], _cmd);
+}
+
+- (void)netServiceBrowser:(NSNetServiceBrowser *)aNetServiceBrowser didFindService:(NSNetService *)aNetService moreComing:(BOOL)moreComing
+{
+	//NSLog(@"netservice found: %@ %@", [aNetService name], moreComing ? @"(moreComing)" : @"");
+    
+    [services addObject:aNetService];
+    if (clientTableView)
+    {
+        [clientTableView reloadData];
+    }
+    [aNetService setDelegate:self];
+    [aNetService resolveWithTimeout:5];
+}
+
+- (void)netServiceBrowser:(NSNetServiceBrowser *)aNetServiceBrowser didRemoveService:(NSNetService *)aNetService moreComing:(BOOL)moreComing
+{
+    BOOL foundService = NO;
+    
+    for (NSNetService *currentService in services)
+    {
+        if ([[currentService name] isEqual:[aNetService name]] &&
+            [[currentService type] isEqual:[aNetService type]] &&
+            [[currentService domain] isEqual:[aNetService domain]])
+        {
+            [services removeObject:currentService];
+            if (clientTableView)
+            {
+                [clientTableView reloadData];
+            }
+            foundService = YES;
+            break;
+        }
+    }
+    
+	NSLog(@"netservice removed: %@ (%@)", [aNetService name], foundService ? @"successfully" : @"unsuccessfully");
+}
 
 @end
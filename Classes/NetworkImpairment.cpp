@@ -0,0 +1,354 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+/*
+ *  NetworkImpairment.cpp
+ *  iDiMP
+ *
+ */
+
+#include "NetworkImpairment.h"
+
+#include <math.h>
+#include <string.h>
+
+static const int NUM_DRAWS = 6; ///< random numbers drawn for every datagram, whatever happens to it
+
+// ---- NetworkImpairment public methods ----
+
+NetworkImpairment::NetworkImpairment(int maxDatagramBytes, int maxPending) :
+    m_maxDatagramBytes(maxDatagramBytes),
+    m_maxPending(maxPending)
+{
+    m_pending = new Pending[m_maxPending];
+    for (int i = 0; i < m_maxPending; i++)
+    {
+        m_pending[i].data = new uint8_t[m_maxDatagramBytes];
+    }
+    m_freeList = new int[m_maxPending];
+    m_heap = new int[m_maxPending];
+    
+    NetworkImpairmentSettings settings;
+    memset(&settings, 0, sizeof(settings));
+    settings.lossBadToGood = 1.0;
+    configure(settings);
+}
+
+NetworkImpairment::~NetworkImpairment()
+{
+    for (int i = 0; i < m_maxPending; i++)
+    {
+        delete[] m_pending[i].data;
+    }
+    delete[] m_pending;
+    delete[] m_freeList;
+    delete[] m_heap;
+}
+
+void NetworkImpairment::configure(const NetworkImpairmentSettings& settings)
+{
+    m_settings = settings;
+    memset(&m_stats, 0, sizeof(m_stats));
+    for (int i = 0; i < m_maxPending; i++)
+    {
+        m_freeList[i] = m_maxPending - 1 - i;
+    }
+    m_numFree = m_maxPending;
+    m_numPending = 0;
+    m_nextOrder = 0;
+    m_isBadState = false;
+    m_linkFreeSeconds = 0.0;
+    m_lastDueSeconds = 0.0;
+    
+    // spread the seed over the whole state (which must not be all zero)
+    uint32_t x = settings.seed;
+    for (int i = 0; i < 4; i++)
+    {
+        x += 0x9e3779b9;
+        uint32_t z = x;
+        z = (z ^ (z >> 16)) * 0x85ebca6b;
+        z = (z ^ (z >> 13)) * 0xc2b2ae35;
+        m_random[i] = z ^ (z >> 16);
+    }
+    if ((m_random[0] | m_random[1] | m_random[2] | m_random[3]) == 0)
+    {
+        m_random[0] = 1;
+    }
+}
+
+bool NetworkImpairment::submit(const void* header, size_t headerLength, const void* payload, size_t payloadLength,
+                               const struct sockaddr* address, socklen_t addressLength, double nowSeconds)
+{
+    m_stats.numSubmitted++;
+    
+    double draws[NUM_DRAWS];
+    for (int i = 0; i < NUM_DRAWS; i++)
+    {
+        draws[i] = next_random();
+    }
+    
+    // Gilbert-Elliott loss: move between the good and bad states, then lose at that state's rate
+    if (m_isBadState)
+    {
+        m_isBadState = (draws[0] >= m_settings.lossBadToGood);
+    }
+    else
+    {
+        m_isBadState = (draws[0] < m_settings.lossGoodToBad);
+    }
+    if (draws[1] < (m_isBadState ? m_settings.lossRateBad : m_settings.lossRateGood))
+    {
+        m_stats.numLost++;
+        if (m_isBadState)
+        {
+            m_stats.numLostInBurst++;
+        }
+        return false;
+    }
+    
+    size_t length = headerLength + payloadLength;
+    if (length > (size_t)m_maxDatagramBytes || addressLength > (socklen_t)sizeof(struct sockaddr_storage) || m_numFree == 0)
+    {
+        m_stats.numQueueDropped++;
+        return false;
+    }
+    
+    // wait for the link, if it's narrow, dropping the datagram if too much is queued already
+    double departureSeconds = nowSeconds;
+    if (m_settings.bandwidthBitsPerSecond > 0.0)
+    {
+        double startSeconds = (m_linkFreeSeconds > nowSeconds) ? m_linkFreeSeconds : nowSeconds;
+        double queuedBytes = (startSeconds - nowSeconds) * m_settings.bandwidthBitsPerSecond / 8.0;
+        if (m_settings.queueLimitBytes > 0 && queuedBytes + length > m_settings.queueLimitBytes)
+        {
+            m_stats.numQueueDropped++;
+            return false;
+        }
+        m_linkFreeSeconds = startSeconds + length * 8.0 / m_settings.bandwidthBitsPerSecond;
+        departureSeconds = m_linkFreeSeconds;
+    }
+    
+    // jitter alone keeps datagrams in order, as a real queue does
+    double dueSeconds = departureSeconds + m_settings.delaySeconds + m_settings.jitterSeconds * next_gaussian(draws[2], draws[3]);
+    if (dueSeconds < departureSeconds)
+    {
+        dueSeconds = departureSeconds;
+    }
+    if (dueSeconds < m_lastDueSeconds)
+    {
+        dueSeconds = m_lastDueSeconds;
+    }
+    m_lastDueSeconds = dueSeconds;
+    
+    if (draws[4] < m_settings.reorderRate)
+    {
+        dueSeconds += m_settings.reorderDelaySeconds;
+        m_stats.numReordered++;
+    }
+    
+    int index = m_freeList[--m_numFree];
+    Pending& pending = m_pending[index];
+    memcpy(pending.data, header, headerLength);
+    memcpy(pending.data + headerLength, payload, payloadLength);
+    pending.length = length;
+    memcpy(&pending.address, address, addressLength);
+    pending.addressLength = addressLength;
+    schedule(index, dueSeconds);
+    
+    if (draws[5] < m_settings.duplicateRate)
+    {
+        if (m_numFree > 0)
+        {
+            int copy = m_freeList[--m_numFree];
+            memcpy(m_pending[copy].data, pending.data, length);
+            m_pending[copy].length = length;
+            memcpy(&m_pending[copy].address, address, addressLength);
+            m_pending[copy].addressLength = addressLength;
+            schedule(copy, dueSeconds);
+            m_stats.numDuplicated++;
+        }
+    }
+    return true;
+}
+
+bool NetworkImpairment::pop(double nowSeconds, const uint8_t*& data, size_t& length, const struct sockaddr*& address, socklen_t& addressLength)
+{
+    if (m_numPending == 0 || m_pending[m_heap[0]].dueSeconds > nowSeconds)
+    {
+        return false;
+    }
+    int index = heap_pop();
+    m_freeList[m_numFree++] = index;
+    
+    // the entry is only reused by a later submit
+    const Pending& pending = m_pending[index];
+    data = pending.data;
+    length = pending.length;
+    address = (const struct sockaddr*)&pending.address;
+    addressLength = pending.addressLength;
+    m_stats.numDelivered++;
+    return true;
+}
+
+double NetworkImpairment::getNextDueSeconds() const
+{
+    return (m_numPending > 0) ? m_pending[m_heap[0]].dueSeconds : -1.0;
+}
+
+bool NetworkImpairment::getPreset(const char* name, uint32_t seed, NetworkImpairmentSettings& settings)
+{
+    memset(&settings, 0, sizeof(settings));
+    settings.seed = seed;
+    settings.lossBadToGood = 1.0;
+    if (strcmp(name, "wifi") == 0)
+    {
+        settings.lossGoodToBad = 0.01;
+        settings.lossBadToGood = 0.3;
+        settings.lossRateGood = 0.002;
+        settings.lossRateBad = 0.3;
+        settings.delaySeconds = 0.002;
+        settings.jitterSeconds = 0.008;
+        settings.reorderRate = 0.002;
+        settings.reorderDelaySeconds = 0.01;
+    }
+    else if (strcmp(name, "cellular") == 0)
+    {
+        settings.lossGoodToBad = 0.02;
+        settings.lossBadToGood = 0.2;
+        settings.lossRateGood = 0.01;
+        settings.lossRateBad = 0.5;
+        settings.delaySeconds = 0.04;
+        settings.jitterSeconds = 0.015;
+        settings.reorderRate = 0.01;
+        settings.reorderDelaySeconds = 0.02;
+        settings.duplicateRate = 0.001;
+        settings.bandwidthBitsPerSecond = 1e6;
+        settings.queueLimitBytes = 64 * 1024;
+    }
+    else if (strcmp(name, "congested") == 0)
+    {
+        settings.delaySeconds = 0.005;
+        settings.jitterSeconds = 0.002;
+        settings.bandwidthBitsPerSecond = 256e3;
+        settings.queueLimitBytes = 8 * 1024;
+    }
+    else if (strcmp(name, "lossy") == 0)
+    {
+        settings.lossGoodToBad = 0.05;
+        settings.lossBadToGood = 0.25;
+        settings.lossRateGood = 0.02;
+        settings.lossRateBad = 0.6;
+        settings.delaySeconds = 0.01;
+        settings.jitterSeconds = 0.01;
+        settings.reorderRate = 0.05;
+        settings.reorderDelaySeconds = 0.015;
+        settings.duplicateRate = 0.02;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+// ---- NetworkImpairment private methods ----
+
+double NetworkImpairment::next_random()
+{
+    // xorshift128: fast, and the same on every platform
+    uint32_t t = m_random[0] ^ (m_random[0] << 11);
+    m_random[0] = m_random[1];
+    m_random[1] = m_random[2];
+    m_random[2] = m_random[3];
+    m_random[3] = m_random[3] ^ (m_random[3] >> 19) ^ t ^ (t >> 8);
+    return m_random[3] * (1.0 / 4294967296.0);
+}
+
+double NetworkImpairment::next_gaussian(double u1, double u2)
+{
+    // Box-Muller, from two of the datagram's draws
+    return sqrt(-2.0 * log(1.0 - u1)) * cos(2.0 * M_PI * u2);
+}
+
+void NetworkImpairment::schedule(int index, double dueSeconds)
+{
+    m_pending[index].dueSeconds = dueSeconds;
+    m_pending[index].order = m_nextOrder++;
+    heap_push(index);
+}
+
+bool NetworkImpairment::is_before(int a, int b) const
+{
+    const Pending& first = m_pending[a];
+    const Pending& second = m_pending[b];
+    if (first.dueSeconds != second.dueSeconds)
+    {
+        return first.dueSeconds < second.dueSeconds;
+    }
+    return (int32_t)(first.order - second.order) < 0;
+}
+
+void NetworkImpairment::heap_push(int index)
+{
+    int child = m_numPending++;
+    m_heap[child] = index;
+    while (child > 0)
+    {
+        int parent = (child - 1) / 2;
+        if (!is_before(m_heap[child], m_heap[parent]))
+        {
+            break;
+        }
+        int swap = m_heap[parent];
+        m_heap[parent] = m_heap[child];
+        m_heap[child] = swap;
+        child = parent;
+    }
+}
+
+int NetworkImpairment::heap_pop()
+{
+    int top = m_heap[0];
+    m_heap[0] = m_heap[--m_numPending];
+    int parent = 0;
+    for (;;)
+    {
+        int child = 2 * parent + 1;
+        if (child >= m_numPending)
+        {
+            break;
+        }
+        if (child + 1 < m_numPending && is_before(m_heap[child + 1], m_heap[child]))
+        {
+            child++;
+        }
+        if (!is_before(m_heap[child], m_heap[parent]))
+        {
+            break;
+        }
+        int swap = m_heap[parent];
+        m_heap[parent] = m_heap[child];
+        m_heap[child] = swap;
+        parent = child;
+    }
+    return top;
+}
@@ -0,0 +1,196 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+/**
+ *  @file NetworkImpairment.h
+ *  iDiMP
+ *
+ *  This file defines the interface for the NetworkImpairment class, which reproducibly loses, 
+ *  delays, reorders, duplicates and rate-limits datagrams on their way to the socket.
+ */
+
+#ifndef NETWORK_IMPAIRMENT_H
+#define NETWORK_IMPAIRMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+/**
+ * What a NetworkImpairment does to datagrams.  Rates are probabilities per datagram, from 0 to 1.
+ * Everything zero (with lossBadToGood at 1) passes datagrams straight through.
+ */
+struct NetworkImpairmentSettings
+{
+    uint32_t seed;              ///< starts the random numbers - the same seed and settings give the same impairments
+    double lossGoodToBad;       ///< Gilbert-Elliott chance of going from the good state to the bad (bursty) state
+    double lossBadToGood;       ///< chance of going back to the good state
+    double lossRateGood;        ///< loss in the good state (for plain random loss, with lossGoodToBad at 0)
+    double lossRateBad;         ///< loss in the bad state
+    double delaySeconds;        ///< one-way delay added to every datagram
+    double jitterSeconds;       ///< standard deviation of a further random delay, which never reorders datagrams by itself
+    double reorderRate;         ///< chance of a datagram being held back by reorderDelaySeconds, letting later ones overtake it
+    double reorderDelaySeconds;
+    double duplicateRate;       ///< chance of a datagram being delivered twice
+    double bandwidthBitsPerSecond; ///< link rate datagrams are queued behind, or 0 for no limit
+    int queueLimitBytes;        ///< most bytes waiting for the link before datagrams are dropped, or 0 for no limit
+};
+
+/**
+ * Statistics gathered by a NetworkImpairment since it was last configured.
+ */
+struct NetworkImpairmentStats
+{
+    uint32_t numSubmitted;  ///< datagrams given to submit
+    uint32_t numDelivered;  ///< datagrams (including duplicates) returned by pop
+    uint32_t numLost;       ///< datagrams dropped by the loss model
+    uint32_t numLostInBurst; ///< of those, the ones dropped in the bad state
+    uint32_t numQueueDropped; ///< datagrams dropped because the link queue or the store was full
+    uint32_t numReordered;  ///< datagrams held back to be overtaken
+    uint32_t numDuplicated; ///< extra copies made
+};
+
+/** NetworkImpairment class.
+ * A NetworkImpairment sits between a sender and its socket.  Datagrams are copied in with submit, 
+ * which decides their fate, and come out of pop once they are due.  Time is whatever the caller 
+ * says it is, and the random numbers come from the seed alone, so an offline run that submits the 
+ * same datagrams at the same times sees exactly the same losses and delays as any other - and the 
+ * same datagrams are lost whatever the delay settings, since every datagram draws the same random 
+ * numbers.
+ *
+ * All memory is allocated when the object is created.  Not thread-safe.
+ */
+class NetworkImpairment
+{
+public:
+   /**
+    * NetworkImpairment constructor.  It starts out with settings that change nothing.
+    * @param maxDatagramBytes the longest datagram that can be submitted
+    * @param maxPending the most datagrams that can be waiting to be delivered
+    */
+    NetworkImpairment(int maxDatagramBytes, int maxPending);
+    
+   /**
+    * NetworkImpairment destructor
+    */
+    ~NetworkImpairment();
+    
+   /**
+    * Start again with new settings, discarding anything waiting and restarting the random numbers.
+    * @param settings what to do to datagrams
+    */
+    void configure(const NetworkImpairmentSettings& settings);
+    
+   /**
+    * Submit a datagram made of a header followed by a payload.  Both are copied.
+    * @param header the header
+    * @param headerLength its length
+    * @param payload the payload
+    * @param payloadLength its length
+    * @param address where the datagram is going
+    * @param addressLength the length of address
+    * @param nowSeconds the time of sending
+    * @return false if the datagram was lost or dropped
+    */
+    bool submit(const void* header, size_t headerLength, const void* payload, size_t payloadLength,
+                const struct sockaddr* address, socklen_t addressLength, double nowSeconds);
+    
+   /**
+    * Take the next datagram that is due, in order of delivery time.
+    * @param nowSeconds the time now
+    * @param data receives a pointer to the datagram, valid until the next submit
+    * @param length receives its length
+    * @param address receives a pointer to its destination, valid until the next submit
+    * @param addressLength receives the length of the destination
+    * @return false if nothing is due
+    */
+    bool pop(double nowSeconds, const uint8_t*& data, size_t& length, const struct sockaddr*& address, socklen_t& addressLength);
+    
+   /**
+    * @return the number of datagrams waiting to be delivered
+    */
+    int getNumPending() const { return m_numPending; }
+    
+   /**
+    * @return when the next datagram is due, or a negative number if none is waiting
+    */
+    double getNextDueSeconds() const;
+    
+   /**
+    * Get a copy of the statistics.
+    * @param stats receives the statistics
+    */
+    void getStats(NetworkImpairmentStats& stats) const { stats = m_stats; }
+    
+   /**
+    * Get settings for a named preset, to reproduce typical conditions the same way each time:
+    * "wifi" (light random loss, bursts of loss and tens of ms of jitter), "cellular" (more loss 
+    * and delay, a narrower link), "congested" (a narrow link with a short queue) or "lossy" 
+    * (heavy bursty loss and some reordering and duplication).
+    * @param name the preset
+    * @param seed the seed to use
+    * @param settings receives the settings
+    * @return false if there is no such preset
+    */
+    static bool getPreset(const char* name, uint32_t seed, NetworkImpairmentSettings& settings);
+    
+private:
+    NetworkImpairment(const NetworkImpairment&);
+    NetworkImpairment& operator= (const NetworkImpairment&);
+    
+    /** one datagram waiting to be delivered */
+    struct Pending
+    {
+        double dueSeconds;
+        uint32_t order;     ///< breaks ties in dueSeconds, so delivery doesn't depend on the heap
+        size_t length;
+        struct sockaddr_storage address;
+        socklen_t addressLength;
+        uint8_t* data;
+    };
+    
+    double next_random();
+    double next_gaussian(double u1, double u2);
+    void schedule(int index, double dueSeconds);
+    bool is_before(int a, int b) const;
+    void heap_push(int index);
+    int heap_pop();
+    
+    NetworkImpairmentSettings m_settings;
+    NetworkImpairmentStats m_stats;
+    int m_maxDatagramBytes;
+    int m_maxPending;
+    Pending* m_pending;
+    int* m_freeList;    ///< indexes of unused entries of m_pending
+    int m_numFree;
+    int* m_heap;        ///< indexes of waiting entries, earliest first
+    int m_numPending;
+    uint32_t m_nextOrder;
+    
+    uint32_t m_random[4]; ///< xorshift128 state
+    bool m_isBadState;
+    double m_linkFreeSeconds; ///< when the link finishes sending what is queued on it
+    double m_lastDueSeconds;  ///< latest delivery scheduled, which jitter doesn't go before
+};
+
+#endif // NETWORK_IMPAIRMENT_H
@@ -0,0 +1,235 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+/*
+ *  NetworkTelemetry.cpp
+ *  iDiMP
+ *
+ */
+
+#include "NetworkTelemetry.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/// upper edges of the jitter and delay histogram bins, in seconds
+static const double TIME_BIN_EDGES[TELEMETRY_NUM_TIME_BINS - 1] = 
+{
+    0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1.0
+};
+
+// ---- NetworkTelemetry public methods ----
+
+NetworkTelemetry::NetworkTelemetry() :
+    m_version(0)
+{
+    reset(NULL);
+}
+
+void NetworkTelemetry::reset(const char* source)
+{
+    begin_update();
+    memset(&m_stats, 0, sizeof(m_stats));
+    if (source)
+    {
+        strncpy(m_stats.source, source, TELEMETRY_SOURCE_LENGTH - 1);
+    }
+    end_update();
+    
+    m_hasPacket = false;
+    m_firstArrivalSeconds = 0.0;
+    m_firstSequence = 0;
+    m_highestSequence = 0;
+    m_seenMask = 0;
+    m_expectedBeforeRestart = 0;
+    m_lastTransitSeconds = 0.0;
+    m_delaySumSeconds = 0.0;
+    m_numDelays = 0;
+}
+
+void NetworkTelemetry::addPacket(uint32_t sequence, double remoteSeconds, double arrivalSeconds, double excessDelaySeconds)
+{
+    begin_update();
+    
+    int32_t ahead = (int32_t)(sequence - m_highestSequence);
+    if (m_hasPacket && (ahead > TELEMETRY_RESTART_DISTANCE || ahead < -TELEMETRY_RESTART_DISTANCE))
+    {
+        // the sender has started again - count on from its new sequence numbers
+        m_expectedBeforeRestart += m_highestSequence - m_firstSequence + 1;
+        m_hasPacket = false;
+    }
+    
+    bool isDuplicate = false;
+    if (!m_hasPacket)
+    {
+        if (m_stats.numReceived == 0)
+        {
+            m_firstArrivalSeconds = arrivalSeconds;
+        }
+        m_hasPacket = true;
+        m_firstSequence = sequence;
+        m_highestSequence = sequence;
+        m_seenMask = 1;
+    }
+    else if (ahead > 0)
+    {
+        // anything skipped over is a loss burst, unless it turns up later
+        int gap = ahead - 1;
+        if (gap > 0)
+        {
+            m_stats.lossBursts[(gap < TELEMETRY_NUM_BURST_BINS) ? gap - 1 : TELEMETRY_NUM_BURST_BINS - 1]++;
+        }
+        m_seenMask = (ahead < TELEMETRY_REORDER_WINDOW) ? (m_seenMask << ahead) | 1 : 1;
+        m_highestSequence = sequence;
+    }
+    else
+    {
+        uint32_t behind = (uint32_t)-ahead;
+        if (behind < (uint32_t)TELEMETRY_REORDER_WINDOW && (m_seenMask & (1u << behind)))
+        {
+            isDuplicate = true;
+        }
+        else
+        {
+            // too far back to tell is counted as reordered
+            if (behind < (uint32_t)TELEMETRY_REORDER_WINDOW)
+            {
+                m_seenMask |= 1u << behind;
+            }
+            if ((int32_t)(sequence - m_firstSequence) < 0)
+            {
+                // overtaken by the first packet we counted, so expected after all
+                m_firstSequence = sequence;
+            }
+            m_stats.numReordered++;
+            if (behind > m_stats.maxReorderDistance)
+            {
+                m_stats.maxReorderDistance = behind;
+            }
+        }
+    }
+    
+    if (isDuplicate)
+    {
+        m_stats.numDuplicate++;
+    }
+    else
+    {
+        m_stats.numReceived++;
+        
+        // RFC 3550 interarrival jitter, from the change in transit time between packets
+        double transitSeconds = arrivalSeconds - remoteSeconds;
+        if (m_stats.numReceived > 1)
+        {
+            double difference = fabs(transitSeconds - m_lastTransitSeconds);
+            m_stats.jitterSeconds += TELEMETRY_JITTER_GAIN * (difference - m_stats.jitterSeconds);
+            add_time(m_stats.jitterHistogram, difference);
+        }
+        m_lastTransitSeconds = transitSeconds;
+        
+        add_time(m_stats.delayHistogram, excessDelaySeconds);
+        if (excessDelaySeconds > m_stats.maxDelaySeconds)
+        {
+            m_stats.maxDelaySeconds = excessDelaySeconds;
+        }
+        m_delaySumSeconds += excessDelaySeconds;
+        m_numDelays++;
+        m_stats.meanDelaySeconds = m_delaySumSeconds / m_numDelays;
+    }
+    
+    m_stats.numExpected = m_expectedBeforeRestart + (m_highestSequence - m_firstSequence + 1);
+    m_stats.numLost = (m_stats.numExpected > m_stats.numReceived) ? m_stats.numExpected - m_stats.numReceived : 0;
+    m_stats.elapsedSeconds = arrivalSeconds - m_firstArrivalSeconds;
+    
+    end_update();
+}
+
+void NetworkTelemetry::addBufferFill(int numFrames)
+{
+    begin_update();
+    if (numFrames < 0)
+    {
+        numFrames = 0;
+    }
+    m_stats.fillHistogram[(numFrames < TELEMETRY_NUM_FILL_BINS) ? numFrames : TELEMETRY_NUM_FILL_BINS - 1]++;
+    end_update();
+}
+
+void NetworkTelemetry::getStats(NetworkTelemetryStats& stats) const
+{
+    for (;;)
+    {
+        int32_t version = AtomicLoad32(&m_version);
+        if ((version & 1) == 0)
+        {
+            memcpy(&stats, (const void*)&m_stats, sizeof(stats));
+            if (AtomicLoad32(&m_version) == version)
+            {
+                return;
+            }
+        }
+    }
+}
+
+double NetworkTelemetry::getTimeBinEdge(int bin)
+{
+    return (bin >= 0 && bin < TELEMETRY_NUM_TIME_BINS - 1) ? TIME_BIN_EDGES[bin] : 0.0;
+}
+
+void NetworkTelemetry::format(const NetworkTelemetryStats& stats, char* text, size_t size)
+{
+    // the bursts and histograms go in as lists of counts, so the line stays one line
+    int used = snprintf(text, size, 
+        "%s: %.0f s, %u/%u received, %u lost, %u duplicate, %u reordered (max %u), "
+        "jitter %.2f ms, delay mean %.2f ms max %.2f ms; bursts", 
+        stats.source, stats.elapsedSeconds, stats.numReceived, stats.numExpected, stats.numLost, 
+        stats.numDuplicate, stats.numReordered, stats.maxReorderDistance, 
+        stats.jitterSeconds * 1000.0, stats.meanDelaySeconds * 1000.0, stats.maxDelaySeconds * 1000.0);
+    
+    const char* names[3] = { "; jitter", "; delay", "; fill" };
+    const uint32_t* histograms[4] = { stats.lossBursts, stats.jitterHistogram, stats.delayHistogram, stats.fillHistogram };
+    const int lengths[4] = { TELEMETRY_NUM_BURST_BINS, TELEMETRY_NUM_TIME_BINS, TELEMETRY_NUM_TIME_BINS, TELEMETRY_NUM_FILL_BINS };
+    for (int h = 0; h < 4; h++)
+    {
+        if (h > 0 && used >= 0 && (size_t)used < size)
+        {
+            used += snprintf(text + used, size - used, "%s", names[h - 1]);
+        }
+        for (int i = 0; i < lengths[h] && used >= 0 && (size_t)used < size; i++)
+        {
+            used += snprintf(text + used, size - used, " %u", histograms[h][i]);
+        }
+    }
+}
+
+// ---- NetworkTelemetry private methods ----
+
+void NetworkTelemetry::add_time(uint32_t* histogram, double seconds)
+{
+    int bin = 0;
+    while (bin < TELEMETRY_NUM_TIME_BINS - 1 && seconds > TIME_BIN_EDGES[bin])
+    {
+        bin++;
+    }
+    histogram[bin]++;
+}
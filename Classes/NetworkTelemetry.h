@@ -0,0 +1,151 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+/**
+ *  @file NetworkTelemetry.h
+ *  iDiMP
+ *
+ *  This file defines the interface for the NetworkTelemetry class, which gathers loss, jitter, 
+ *  delay and reordering statistics for one received stream.
+ */
+
+#ifndef NETWORK_TELEMETRY_H
+#define NETWORK_TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#import "AtomicOps.h"
+
+static const int    TELEMETRY_SOURCE_LENGTH      = 64;   ///< Longest source name kept, including the terminator
+static const int    TELEMETRY_NUM_BURST_BINS     = 8;    ///< Loss bursts of 1 to 7 packets, then 8 or more
+static const int    TELEMETRY_NUM_TIME_BINS      = 12;   ///< Bins of the jitter and delay histograms (see NetworkTelemetry::getTimeBinEdge)
+static const int    TELEMETRY_NUM_FILL_BINS      = 17;   ///< Jitter buffer fill of 0 to 15 frames, then 16 or more
+static const int    TELEMETRY_REORDER_WINDOW     = 32;   ///< Packets behind the newest that can still be told apart as reordered or duplicate
+static const int    TELEMETRY_RESTART_DISTANCE   = 1000; ///< A sequence jump this big means the sender has restarted
+static const double TELEMETRY_JITTER_GAIN        = 1.0 / 16.0; ///< Smoothing of the interarrival jitter (as in RFC 3550)
+
+/**
+ * A snapshot of a NetworkTelemetry.  Counts are totals since the stream started; packets 
+ * are data packets as they arrived from the network, before FEC recovery.
+ */
+struct NetworkTelemetryStats
+{
+    char source[TELEMETRY_SOURCE_LENGTH]; ///< who the stream is from - empty if the telemetry isn't in use
+    double elapsedSeconds;     ///< time from the first packet to the last
+    uint32_t numReceived;      ///< packets received, not counting duplicates
+    uint32_t numExpected;      ///< packets sent, judging by their sequence numbers (as in RFC 3550)
+    uint32_t numLost;          ///< numExpected - numReceived, or 0 if reordering has made that negative
+    uint32_t numDuplicate;     ///< packets received more than once
+    uint32_t numReordered;     ///< packets that arrived after a later one
+    uint32_t maxReorderDistance; ///< furthest a packet has arrived behind a later one, in packets
+    uint32_t lossBursts[TELEMETRY_NUM_BURST_BINS]; ///< gaps in the sequence as packets arrived, by length (a reordered packet still leaves its gap counted)
+    double jitterSeconds;      ///< interarrival jitter (RFC 3550)
+    double maxDelaySeconds;    ///< greatest one-way delay beyond the least seen
+    double meanDelaySeconds;   ///< average one-way delay beyond the least seen
+    uint32_t jitterHistogram[TELEMETRY_NUM_TIME_BINS]; ///< per-packet transit time differences |D| (RFC 3550)
+    uint32_t delayHistogram[TELEMETRY_NUM_TIME_BINS];  ///< per-packet one-way delay beyond the least seen
+    uint32_t fillHistogram[TELEMETRY_NUM_FILL_BINS];   ///< jitter buffer fill, in frames, as each packet arrived
+};
+
+/** NetworkTelemetry class.
+ * A NetworkTelemetry is told about each data packet of one stream as it arrives, and keeps counts
+ * and streaming histograms of what the network did to the stream.  Everything has a fixed size, so
+ * addPacket does a fixed amount of work.
+ *
+ * Only one thread may call reset, addPacket and addBufferFill.  getStats may be called from any 
+ * thread at any time without blocking that thread: the statistics carry a version number which 
+ * is odd while they are being changed, and a reader copies them again if the version moved.
+ */
+class NetworkTelemetry
+{
+public:
+   /**
+    * NetworkTelemetry constructor.  The telemetry starts out not in use.
+    */
+    NetworkTelemetry();
+    
+   /**
+    * Start again for a new stream.
+    * @param source who the stream is from, or NULL when the telemetry is no longer in use
+    */
+    void reset(const char* source);
+    
+   /**
+    * Record a data packet's arrival.
+    * @param sequence the packet's sequence number
+    * @param remoteSeconds the sender's clock at the packet's timestamp
+    * @param arrivalSeconds the local clock at the packet's arrival
+    * @param excessDelaySeconds the one-way delay beyond the least seen
+    */
+    void addPacket(uint32_t sequence, double remoteSeconds, double arrivalSeconds, double excessDelaySeconds);
+    
+   /**
+    * Record how full the jitter buffer was.
+    * @param numFrames frames waiting to be played
+    */
+    void addBufferFill(int numFrames);
+    
+   /**
+    * Get a consistent copy of the statistics.  Never blocks the writing thread.
+    * @param stats receives the statistics
+    */
+    void getStats(NetworkTelemetryStats& stats) const;
+    
+   /**
+    * @param bin a bin of a jitter or delay histogram
+    * @return the upper edge of the bin in seconds (the last bin has no upper edge, and returns 0)
+    */
+    static double getTimeBinEdge(int bin);
+    
+   /**
+    * Write a one-line summary of some statistics, for logging.
+    * @param stats the statistics
+    * @param text receives the summary
+    * @param size the size of text
+    */
+    static void format(const NetworkTelemetryStats& stats, char* text, size_t size);
+    
+private:
+    NetworkTelemetry(const NetworkTelemetry&);
+    NetworkTelemetry& operator= (const NetworkTelemetry&);
+    
+    void begin_update() { AtomicIncrement32(&m_version); }
+    void end_update() { AtomicIncrement32(&m_version); }
+    void add_time(uint32_t* histogram, double seconds);
+    
+    volatile int32_t m_version; ///< odd while m_stats is being changed
+    NetworkTelemetryStats m_stats;
+    
+    // writing thread only
+    bool m_hasPacket;
+    double m_firstArrivalSeconds;
+    uint32_t m_firstSequence;    ///< of the sequence numbers counted since the last restart
+    uint32_t m_highestSequence;
+    uint32_t m_seenMask;         ///< bit n set if m_highestSequence - n has arrived
+    uint32_t m_expectedBeforeRestart;
+    double m_lastTransitSeconds;
+    double m_delaySumSeconds;
+    uint32_t m_numDelays;
+};
+
+#endif // NETWORK_TELEMETRY_H
@@ -211,13 +211,24 @@ enum NetworkTableViewSections {
 {
     NSLog(@"%@ %s", [self class], _cmd);
         
-    if (![[[services objectAtIndex:indexPath.row] addresses] count])
+    // the first address we can reach (an IPv6 one needs our socket to have IPv6)
+    NSData *address = nil;
+    for (NSData *candidate in [[services objectAtIndex:indexPath.row] addresses])
     {
-        NSLog(@"oops, can't send because we haven't resolved addresses for this service");
+        if ([_networkController canSendToAddress:candidate])
+        {
+            address = candidate;
+            break;
+        }
+    }
+    
+    if (address == nil)
+    {
+        NSLog(@"oops, can't send because we haven't resolved a usable address for this service");
     }
     else
     {
-        _networkController.savedAddress = [[[services objectAtIndex:indexPath.row] addresses] objectAtIndex:0];
+        _networkController.savedAddress = address;
         // add a checkmark to this one
         if (selectedServiceIndex != -1)
         {
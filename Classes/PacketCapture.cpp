@@ -0,0 +1,299 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/*
+ *  PacketCapture.cpp
+ *  iDiMP
+ *
+ */
+
+#include "PacketCapture.h"
+
+#include <string.h>
+#include <unistd.h>
+
+static const int MAX_RECORD_BYTES = sizeof(PacketCaptureRecord) + PACKET_CAPTURE_MAX_ADDRESS_BYTES + PACKET_CAPTURE_MAX_PACKET_BYTES;
+
+// ---- PacketCaptureWriter public methods ----
+
+PacketCaptureWriter::PacketCaptureWriter(const char* filename, double startSeconds) :
+    m_file(NULL),
+    m_startSeconds(startSeconds),
+    m_ring(PACKET_CAPTURE_RING_BYTES),
+    m_chunk(new char[PACKET_CAPTURE_CHUNK_BYTES]),
+    m_record(new uint8_t[MAX_RECORD_BYTES]),
+    m_writerThreadStarted(false),
+    m_isRunning(1),
+    m_numPackets(0),
+    m_numDropped(0),
+    m_numReportedDropped(0)
+{
+    m_file = fopen(filename, "wb");
+    if (m_file == NULL)
+    {
+        printf("PacketCaptureWriter::PacketCaptureWriter could not create %s\n", filename);
+        return;
+    }
+    
+    PacketCaptureFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PACKET_CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = PACKET_CAPTURE_VERSION;
+    header.startSeconds = startSeconds;
+    fwrite(&header, sizeof(header), 1, m_file);
+    
+    if (pthread_create(&m_writerThread, NULL, writer_thread_main, this) != 0)
+    {
+        printf("PacketCaptureWriter::PacketCaptureWriter could not create writer thread\n");
+    }
+    else
+    {
+        m_writerThreadStarted = true;
+    }
+}
+
+PacketCaptureWriter::~PacketCaptureWriter()
+{
+    AtomicStore32(&m_isRunning, 0);
+    if (m_writerThreadStarted)
+    {
+        pthread_join(m_writerThread, NULL);
+    }
+    
+    if (m_file != NULL)
+    {
+        // whatever the thread didn't get to
+        write_pending(true);
+        fclose(m_file);
+        m_file = NULL;
+    }
+    
+    if (m_numDropped > 0)
+    {
+        printf("PacketCaptureWriter::~PacketCaptureWriter %d of %d packets were dropped in total\n", (int)m_numDropped, (int)m_numPackets);
+    }
+    
+    delete[] m_chunk;
+    m_chunk = NULL;
+    delete[] m_record;
+    m_record = NULL;
+}
+
+void PacketCaptureWriter::addPacket(int direction, double seconds, const struct sockaddr* address, socklen_t addressLength, 
+                                    const void* header, size_t headerLength, const void* payload, size_t payloadLength)
+{
+    if (m_file == NULL)
+    {
+        return;
+    }
+    size_t length = headerLength + payloadLength;
+    if (addressLength > (socklen_t)PACKET_CAPTURE_MAX_ADDRESS_BYTES || length > (size_t)PACKET_CAPTURE_MAX_PACKET_BYTES)
+    {
+        AtomicIncrement32(&m_numDropped);
+        return;
+    }
+    
+    PacketCaptureRecord record;
+    record.seconds = seconds - m_startSeconds;
+    record.length = (uint16_t)length;
+    record.direction = (uint8_t)direction;
+    record.addressLength = (uint8_t)addressLength;
+    
+    uint8_t* p = m_record;
+    memcpy(p, &record, sizeof(record));
+    p += sizeof(record);
+    memcpy(p, address, addressLength);
+    p += addressLength;
+    memcpy(p, header, headerLength);
+    p += headerLength;
+    if (payloadLength > 0)
+    {
+        memcpy(p, payload, payloadLength);
+        p += payloadLength;
+    }
+    
+    AtomicIncrement32(&m_numPackets);
+    if (!m_ring.write(m_record, (uint32_t)(p - m_record)))
+    {
+        // disk can't keep up - drop the whole record so the file stays readable
+        AtomicIncrement32(&m_numDropped);
+    }
+}
+
+// ---- PacketCaptureWriter private methods ----
+
+void* PacketCaptureWriter::writer_thread_main(void* arg)
+{
+    PacketCaptureWriter* writer = (PacketCaptureWriter*)arg;
+    while (AtomicLoad32(&writer->m_isRunning))
+    {
+        writer->write_pending(false);
+        
+        int32_t dropped = AtomicLoad32(&writer->m_numDropped);
+        if (dropped != writer->m_numReportedDropped)
+        {
+            printf("PacketCaptureWriter: disk is not keeping up - %d packets dropped so far\n", (int)dropped);
+            writer->m_numReportedDropped = dropped;
+        }
+        
+        usleep(PACKET_CAPTURE_POLL_USEC);
+    }
+    return NULL;
+}
+
+void PacketCaptureWriter::write_pending(bool flushAll)
+{
+    // write whole chunks only, unless we are closing
+    while (m_ring.getReadAvailable() >= PACKET_CAPTURE_CHUNK_BYTES || (flushAll && m_ring.getReadAvailable() > 0))
+    {
+        uint32_t numBytes = m_ring.read(m_chunk, PACKET_CAPTURE_CHUNK_BYTES);
+        fwrite(m_chunk, 1, numBytes, m_file);
+    }
+}
+
+// ---- PacketCaptureReader public methods ----
+
+PacketCaptureReader::PacketCaptureReader() :
+    m_file(NULL)
+{
+    memset(&m_header, 0, sizeof(m_header));
+}
+
+PacketCaptureReader::~PacketCaptureReader()
+{
+    close();
+}
+
+bool PacketCaptureReader::open(const char* filename)
+{
+    close();
+    m_file = fopen(filename, "rb");
+    if (m_file == NULL)
+    {
+        printf("PacketCaptureReader::open could not open %s\n", filename);
+        return false;
+    }
+    if (fread(&m_header, sizeof(m_header), 1, m_file) != 1 || 
+        memcmp(m_header.magic, PACKET_CAPTURE_MAGIC, sizeof(m_header.magic)) != 0 || 
+        m_header.version != PACKET_CAPTURE_VERSION)
+    {
+        printf("PacketCaptureReader::open %s is not a packet capture\n", filename);
+        close();
+        return false;
+    }
+    return true;
+}
+
+void PacketCaptureReader::close()
+{
+    if (m_file != NULL)
+    {
+        fclose(m_file);
+        m_file = NULL;
+    }
+}
+
+bool PacketCaptureReader::read(PacketCaptureRecord& record, struct sockaddr_storage& address, uint8_t* data)
+{
+    if (m_file == NULL || fread(&record, sizeof(record), 1, m_file) != 1)
+    {
+        return false;
+    }
+    if (record.addressLength > PACKET_CAPTURE_MAX_ADDRESS_BYTES || record.length > PACKET_CAPTURE_MAX_PACKET_BYTES)
+    {
+        return false;
+    }
+    memset(&address, 0, sizeof(address));
+    return fread(&address, 1, record.addressLength, m_file) == record.addressLength && 
+           fread(data, 1, record.length, m_file) == record.length;
+}
+
+// ---- PacketReplayer public methods ----
+
+PacketReplayer::PacketReplayer(double speed) :
+    m_speed(speed > 0.0 ? speed : 1.0),
+    m_isStarted(false),
+    m_offsetSeconds(0.0),
+    m_hasNext(false),
+    m_numReplayed(0)
+{
+    memset(&m_next, 0, sizeof(m_next));
+}
+
+bool PacketReplayer::open(const char* filename)
+{
+    m_isStarted = false;
+    m_hasNext = false;
+    m_numReplayed = 0;
+    if (!m_reader.open(filename))
+    {
+        return false;
+    }
+    read_next();
+    return true;
+}
+
+void PacketReplayer::start(double nowSeconds)
+{
+    m_offsetSeconds = nowSeconds - m_next.seconds / m_speed;
+    m_isStarted = true;
+}
+
+bool PacketReplayer::pop(double nowSeconds, const uint8_t*& data, size_t& length, const struct sockaddr*& address, double& arrivalSeconds)
+{
+    if (!m_hasNext)
+    {
+        return false;
+    }
+    if (!m_isStarted)
+    {
+        start(nowSeconds);
+    }
+    double dueSeconds = getNextArrival();
+    if (dueSeconds > nowSeconds)
+    {
+        return false;
+    }
+    
+    memcpy(&m_address, &m_nextAddress, sizeof(m_address));
+    memcpy(m_data, m_nextData, m_next.length);
+    data = m_data;
+    length = m_next.length;
+    address = (const struct sockaddr*)&m_address;
+    arrivalSeconds = dueSeconds;
+    m_numReplayed++;
+    
+    read_next();
+    return true;
+}
+
+// ---- PacketReplayer private methods ----
+
+void PacketReplayer::read_next()
+{
+    // only what was received is replayed
+    do
+    {
+        m_hasNext = m_reader.read(m_next, m_nextAddress, m_nextData);
+    } while (m_hasNext && m_next.direction != PACKET_CAPTURE_RECEIVED);
+}
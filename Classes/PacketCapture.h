@@ -0,0 +1,287 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/**
+ *  @file PacketCapture.h
+ *  iDiMP
+ *
+ *  This file defines the interfaces for the PacketCaptureWriter class, which records the datagrams
+ *  sent and received to a file without slowing the network thread, the PacketCaptureReader class,
+ *  which reads such a file back, and the PacketReplayer class, which plays one back in time.
+ */
+
+#ifndef PACKET_CAPTURE_H
+#define PACKET_CAPTURE_H
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#import "AtomicOps.h"
+#import "LockFreeRingBuffer.h"
+#import "UdpTransport.h"
+
+static const uint32_t PACKET_CAPTURE_RING_BYTES     = 1 << 20;   ///< records buffered between the network thread and the disk (several seconds of audio)
+static const uint32_t PACKET_CAPTURE_CHUNK_BYTES    = 64 * 1024; ///< size of each write to disk
+static const int      PACKET_CAPTURE_POLL_USEC      = 20000;     ///< how often the writer thread checks for a full chunk
+static const int      PACKET_CAPTURE_MAX_ADDRESS_BYTES = 28;     ///< longest address kept (a sockaddr_in6)
+static const int      PACKET_CAPTURE_MAX_PACKET_BYTES  = UDP_TRANSPORT_MAX_DATAGRAM_BYTES; ///< longest datagram kept
+static const uint32_t PACKET_CAPTURE_VERSION        = 1;
+static const char     PACKET_CAPTURE_MAGIC[8]       = { 'D', 'M', 'P', 'C', 'A', 'P', 0, 0 };
+
+/**
+ * Which way a captured datagram went.
+ */
+enum PacketCaptureDirection
+{
+    PACKET_CAPTURE_RECEIVED = 0,
+    PACKET_CAPTURE_SENT = 1
+};
+
+/**
+ * The start of a capture file.  Everything in the file is in the byte order of the host that made it.
+ */
+struct PacketCaptureFileHeader
+{
+    char magic[8];         ///< PACKET_CAPTURE_MAGIC
+    uint32_t version;      ///< PACKET_CAPTURE_VERSION
+    uint32_t reserved;
+    double startSeconds;   ///< host clock when the capture started
+};
+
+/**
+ * The start of each record in a capture file.  The address follows, then the datagram.
+ */
+struct PacketCaptureRecord
+{
+    double seconds;        ///< when the datagram arrived or was sent, from the start of the capture
+    uint16_t length;       ///< bytes of datagram
+    uint8_t direction;     ///< a PacketCaptureDirection
+    uint8_t addressLength; ///< bytes of address: where a received datagram came from, or where a sent one went
+};
+
+/** PacketCaptureWriter class.
+ * PacketCaptureWriter records datagrams, with the time each arrived or was sent, to a compact 
+ * binary file, without doing file I/O on the thread that hands them over.  That thread only copies
+ * each datagram into a lock-free ring buffer; a writer thread drains the ring in large sequential 
+ * chunks.  If the disk falls so far behind that the ring fills up, datagrams are dropped and counted
+ * instead of blocking.  addPacket is for one thread only.
+ */
+class PacketCaptureWriter
+{
+public:
+   /**
+    * PacketCaptureWriter constructor.
+    * Creates (or overwrites) the file and starts the writer thread.
+    * @param filename capture file path
+    * @param startSeconds host clock at the start of the capture, which records are timed from
+    */
+    PacketCaptureWriter(const char* filename, double startSeconds);
+    
+   /**
+    * PacketCaptureWriter destructor.
+    * Stops the writer thread, writes everything still buffered, and closes the file.
+    */
+    ~PacketCaptureWriter();
+    
+   /**
+    * @return true if the file could be created
+    */
+    bool isOpen() const { return m_file != NULL; }
+    
+   /**
+    * Queue a datagram, given as a header followed by a payload, to be written.  Never waits.
+    * @param direction a PacketCaptureDirection
+    * @param seconds host clock when the datagram arrived or was sent
+    * @param address where it came from or went
+    * @param addressLength bytes of address
+    * @param header the start of the datagram
+    * @param headerLength bytes of header
+    * @param payload the rest of the datagram (may be NULL if payloadLength is 0)
+    * @param payloadLength bytes of payload
+    */
+    void addPacket(int direction, double seconds, const struct sockaddr* address, socklen_t addressLength, 
+                   const void* header, size_t headerLength, const void* payload, size_t payloadLength);
+    
+   /**
+    * @return the number of datagrams handed over, including any dropped
+    */
+    uint32_t getNumPackets() const { return (uint32_t)AtomicLoad32(&m_numPackets); }
+    
+   /**
+    * @return the number of datagrams dropped because the disk could not keep up
+    */
+    uint32_t getNumDropped() const { return (uint32_t)AtomicLoad32(&m_numDropped); }
+    
+private:
+    PacketCaptureWriter(const PacketCaptureWriter&);
+    PacketCaptureWriter& operator= (const PacketCaptureWriter&);
+    
+    static void* writer_thread_main(void* arg);
+    
+    void write_pending(bool flushAll);
+    
+    FILE* m_file;
+    double m_startSeconds;
+    LockFreeRingBuffer m_ring;
+    char* m_chunk;
+    uint8_t* m_record; ///< a record being put together, so it goes into the ring whole
+    pthread_t m_writerThread;
+    bool m_writerThreadStarted;
+    volatile int32_t m_isRunning;
+    volatile int32_t m_numPackets;
+    volatile int32_t m_numDropped;
+    int32_t m_numReportedDropped;
+};
+
+/** PacketCaptureReader class.
+ * PacketCaptureReader reads back the records of a file made by a PacketCaptureWriter, in order.
+ */
+class PacketCaptureReader
+{
+public:
+   /**
+    * PacketCaptureReader constructor
+    */
+    PacketCaptureReader();
+    
+   /**
+    * PacketCaptureReader destructor
+    */
+    ~PacketCaptureReader();
+    
+   /**
+    * Open a capture file.
+    * @param filename capture file path
+    * @return false if it can't be opened or isn't a capture
+    */
+    bool open(const char* filename);
+    
+   /**
+    * Close the file, if one is open.
+    */
+    void close();
+    
+   /**
+    * @return host clock (of the host that made the capture) when it started
+    */
+    double getStartSeconds() const { return m_header.startSeconds; }
+    
+   /**
+    * Read the next record.
+    * @param record receives the record's header
+    * @param address receives the address
+    * @param data receives the datagram, and must hold PACKET_CAPTURE_MAX_PACKET_BYTES
+    * @return false at the end of the file, or at a damaged record (as an interrupted capture may end with)
+    */
+    bool read(PacketCaptureRecord& record, struct sockaddr_storage& address, uint8_t* data);
+    
+private:
+    PacketCaptureReader(const PacketCaptureReader&);
+    PacketCaptureReader& operator= (const PacketCaptureReader&);
+    
+    FILE* m_file;
+    PacketCaptureFileHeader m_header;
+};
+
+/** PacketReplayer class.
+ * PacketReplayer plays back the received datagrams of a capture at their original spacing, or
+ * faster.  The first is due as soon as the replay starts, and each of the rest that much later 
+ * than the first (divided by the speed) as it was captured.  The arrival time handed out with each
+ * datagram is when it was due, not when it was popped, so the same capture always gives the same 
+ * arrivals however the replay is driven: by a real clock, or by a simulated one stepped straight
+ * to getNextArrival.  Not thread-safe.
+ */
+class PacketReplayer
+{
+public:
+   /**
+    * PacketReplayer constructor
+    * @param speed 1 for the captured timing, more to replay faster
+    */
+    PacketReplayer(double speed);
+    
+   /**
+    * Open a capture file.
+    * @param filename capture file path
+    * @return false if it can't be opened or isn't a capture
+    */
+    bool open(const char* filename);
+    
+   /**
+    * Start the replay.  Called by the first pop if need be.
+    * @param nowSeconds when the first datagram is due
+    */
+    void start(double nowSeconds);
+    
+   /**
+    * Get the next received datagram, if it is due.
+    * @param nowSeconds now
+    * @param data receives a pointer to the datagram, valid until the next pop
+    * @param length receives its length
+    * @param address receives a pointer to where it came from, valid until the next pop
+    * @param arrivalSeconds receives when it was due
+    * @return false if none is due yet, or the capture has run out
+    */
+    bool pop(double nowSeconds, const uint8_t*& data, size_t& length, const struct sockaddr*& address, double& arrivalSeconds);
+    
+   /**
+    * @return when the next datagram is due (once started)
+    */
+    double getNextArrival() const { return m_offsetSeconds + m_next.seconds / m_speed; }
+    
+   /**
+    * @return true once every received datagram has been popped
+    */
+    bool isFinished() const { return !m_hasNext; }
+    
+   /**
+    * @return the number of datagrams popped
+    */
+    uint32_t getNumReplayed() const { return m_numReplayed; }
+    
+private:
+    PacketReplayer(const PacketReplayer&);
+    PacketReplayer& operator= (const PacketReplayer&);
+    
+    void read_next();
+    
+    PacketCaptureReader m_reader;
+    double m_speed;
+    bool m_isStarted;
+    double m_offsetSeconds; ///< a datagram is due at m_offsetSeconds + seconds / m_speed
+    
+    // the next received datagram, read ahead so its time is known
+    bool m_hasNext;
+    PacketCaptureRecord m_next;
+    struct sockaddr_storage m_nextAddress;
+    uint8_t m_nextData[PACKET_CAPTURE_MAX_PACKET_BYTES];
+    
+    // the one last popped
+    struct sockaddr_storage m_address;
+    uint8_t m_data[PACKET_CAPTURE_MAX_PACKET_BYTES];
+    uint32_t m_numReplayed;
+};
+
+#endif // PACKET_CAPTURE_H
@@ -0,0 +1,379 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+/*
+ *  PacketLossConcealer.cpp
+ *  iDiMP
+ *
+ */
+
+#include "PacketLossConcealer.h"
+
+#include <math.h>
+#include <string.h>
+
+static const int PITCH_COARSE_STEP = 4; ///< decimation of the first pass of the pitch search
+
+static inline short to_short(float value)
+{
+    if (value > 32767.0f)
+    {
+        return 32767;
+    }
+    if (value < -32768.0f)
+    {
+        return -32768;
+    }
+    return (short)lrintf(value);
+}
+
+// ---- PacketLossConcealer public methods ----
+
+PacketLossConcealer::PacketLossConcealer(int samplesPerChannel, int numChannels, double sampleRate) :
+    m_samplesPerChannel(samplesPerChannel),
+    m_numChannels(numChannels),
+    m_minPeriod((int)(CONCEALMENT_MIN_PERIOD_SECONDS * sampleRate)),
+    m_maxPeriod((int)(CONCEALMENT_MAX_PERIOD_SECONDS * sampleRate)),
+    m_periodStepSamples((int)(CONCEALMENT_PERIOD_STEP_SECONDS * sampleRate)),
+    m_fadeStartSamples((int)(CONCEALMENT_FADE_START_SECONDS * sampleRate)),
+    m_fadeSamples((int)(CONCEALMENT_FADE_SECONDS * sampleRate)),
+    m_recoverySamples((int)(CONCEALMENT_RECOVERY_SECONDS * sampleRate)),
+    m_longRecoverySamples((int)(CONCEALMENT_LONG_RECOVERY_SECONDS * sampleRate)),
+    m_loopLength(0),
+    m_loopPosition(0),
+    m_fadeLength(0),
+    m_fadePosition(0),
+    m_isConcealing(false),
+    m_period(0),
+    m_overlap(0),
+    m_numPeriods(0),
+    m_numConcealedSamples(0)
+{
+    if (m_numChannels < 1)
+    {
+        m_numChannels = 1;
+    }
+    else if (m_numChannels > CONCEALMENT_MAX_CHANNELS)
+    {
+        m_numChannels = CONCEALMENT_MAX_CHANNELS;
+    }
+    if (m_minPeriod < PITCH_COARSE_STEP)
+    {
+        m_minPeriod = PITCH_COARSE_STEP;
+    }
+    if (m_maxPeriod < m_minPeriod)
+    {
+        m_maxPeriod = m_minPeriod;
+    }
+    if (m_fadeSamples < 1)
+    {
+        m_fadeSamples = 1;
+    }
+    
+    // enough for the pitch search (a period's worth compared one period back) 
+    // and for repeating the most periods with a crossfade before them
+    m_maxFadeLength = m_maxPeriod / 4 + 1;
+    m_maxLoopLength = CONCEALMENT_MAX_PERIODS * m_maxPeriod;
+    m_lossSourceLength = m_maxLoopLength + m_maxFadeLength;
+    m_historyLength = 2 * m_maxPeriod;
+    if (m_historyLength < m_lossSourceLength)
+    {
+        m_historyLength = m_lossSourceLength;
+    }
+    
+    m_history = new float[m_numChannels * m_historyLength];
+    m_mix = new float[2 * m_maxPeriod];
+    m_lossSource = new float[m_numChannels * m_lossSourceLength];
+    m_loop = new float[m_numChannels * m_maxLoopLength];
+    m_fade = new float[m_numChannels * m_maxFadeLength];
+    
+    reset();
+}
+
+PacketLossConcealer::~PacketLossConcealer()
+{
+    delete[] m_history;
+    delete[] m_mix;
+    delete[] m_lossSource;
+    delete[] m_loop;
+    delete[] m_fade;
+}
+
+void PacketLossConcealer::processReceived(short* samples)
+{
+    if (m_isConcealing)
+    {
+        m_isConcealing = false;
+        
+        // crossfade from where the synthesized signal would have gone - 
+        // a longer fade in when concealment had already faded out
+        int numRecovery = (m_numConcealedSamples > m_fadeStartSamples) ? m_longRecoverySamples : m_recoverySamples;
+        if (numRecovery > m_samplesPerChannel)
+        {
+            numRecovery = m_samplesPerChannel;
+        }
+        float synthesized[CONCEALMENT_MAX_CHANNELS];
+        short* frame = samples;
+        for (int i = 0; i < numRecovery; i++, frame += m_numChannels)
+        {
+            next_loop_frame(synthesized);
+            float gain = gain_at(m_numConcealedSamples + i);
+            float weight = (float)(i + 1) / (float)(numRecovery + 1);
+            for (int c = 0; c < m_numChannels; c++)
+            {
+                float value = synthesized[c] * gain;
+                frame[c] = to_short(value + weight * ((float)frame[c] - value));
+            }
+        }
+    }
+    
+    append_history(samples, m_samplesPerChannel);
+}
+
+void PacketLossConcealer::conceal(short* samples)
+{
+    if (!m_isConcealing)
+    {
+        start_loss();
+    }
+    else if (gain_at(m_numConcealedSamples) > 0.0f)
+    {
+        // repeat more periods as the loss goes on, so it doesn't become a buzz
+        int numPeriods = 1 + m_numConcealedSamples / m_periodStepSamples;
+        if (numPeriods > CONCEALMENT_MAX_PERIODS)
+        {
+            numPeriods = CONCEALMENT_MAX_PERIODS;
+        }
+        if (numPeriods > m_numPeriods)
+        {
+            // keep the old loop's continuation to crossfade from, then pick up 
+            // the longer loop at the same point in the waveform
+            int position = m_loopPosition + (numPeriods - m_numPeriods) * m_period;
+            m_fadeLength = m_overlap;
+            m_fadePosition = 0;
+            float values[CONCEALMENT_MAX_CHANNELS];
+            for (int i = 0; i < m_fadeLength; i++)
+            {
+                next_loop_frame(values);
+                for (int c = 0; c < m_numChannels; c++)
+                {
+                    m_fade[c * m_maxFadeLength + i] = values[c];
+                }
+            }
+            build_loop(numPeriods);
+            m_loopPosition = position % m_loopLength;
+        }
+    }
+    
+    if (gain_at(m_numConcealedSamples) <= 0.0f)
+    {
+        // faded out - nothing left to synthesize
+        memset(samples, 0, m_samplesPerChannel * m_numChannels * sizeof(short));
+    }
+    else
+    {
+        float values[CONCEALMENT_MAX_CHANNELS];
+        short* frame = samples;
+        for (int i = 0; i < m_samplesPerChannel; i++, frame += m_numChannels)
+        {
+            next_loop_frame(values);
+            if (m_fadePosition < m_fadeLength)
+            {
+                float weight = (float)(m_fadePosition + 1) / (float)(m_fadeLength + 1);
+                for (int c = 0; c < m_numChannels; c++)
+                {
+                    float fade = m_fade[c * m_maxFadeLength + m_fadePosition];
+                    values[c] = fade + weight * (values[c] - fade);
+                }
+                m_fadePosition++;
+            }
+            float gain = gain_at(m_numConcealedSamples + i);
+            for (int c = 0; c < m_numChannels; c++)
+            {
+                frame[c] = to_short(values[c] * gain);
+            }
+        }
+    }
+    
+    m_numConcealedSamples += m_samplesPerChannel;
+    append_history(samples, m_samplesPerChannel);
+}
+
+void PacketLossConcealer::reset()
+{
+    memset(m_history, 0, m_numChannels * m_historyLength * sizeof(float));
+    m_isConcealing = false;
+    m_numConcealedSamples = 0;
+}
+
+// ---- PacketLossConcealer private methods ----
+
+void PacketLossConcealer::start_loss()
+{
+    // the channels share one period, found from their sum, so they stay in step
+    int mixLength = 2 * m_maxPeriod;
+    memcpy(m_mix, m_history + m_historyLength - mixLength, mixLength * sizeof(float));
+    for (int c = 1; c < m_numChannels; c++)
+    {
+        const float* channel = m_history + c * m_historyLength + m_historyLength - mixLength;
+        for (int i = 0; i < mixLength; i++)
+        {
+            m_mix[i] += channel[i];
+        }
+    }
+    m_period = find_period();
+    m_overlap = m_period / 4 + 1;
+    
+    for (int c = 0; c < m_numChannels; c++)
+    {
+        memcpy(m_lossSource + c * m_lossSourceLength, 
+               m_history + c * m_historyLength + m_historyLength - m_lossSourceLength, 
+               m_lossSourceLength * sizeof(float));
+    }
+    build_loop(1);
+    m_loopPosition = 0;
+    m_fadeLength = 0;
+    m_fadePosition = 0;
+    m_numConcealedSamples = 0;
+    m_isConcealing = true;
+}
+
+int PacketLossConcealer::find_period() const
+{
+    // compare the last m_maxPeriod samples against the same length one candidate period back,
+    // first at every PITCH_COARSE_STEP'th lag and sample, then around the best of those
+    const int windowLength = m_maxPeriod;
+    const float* window = m_mix + m_maxPeriod;
+    
+    int bestPeriod = m_maxPeriod;
+    float bestScore = 0.0f;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        int step = (pass == 0) ? PITCH_COARSE_STEP : 1;
+        int minPeriod = m_minPeriod;
+        int maxPeriod = m_maxPeriod;
+        if (pass == 1)
+        {
+            if (bestScore <= 0.0f)
+            {
+                break; // silence or nothing periodic - any period will do
+            }
+            minPeriod = (bestPeriod - PITCH_COARSE_STEP + 1 > m_minPeriod) ? bestPeriod - PITCH_COARSE_STEP + 1 : m_minPeriod;
+            maxPeriod = (bestPeriod + PITCH_COARSE_STEP - 1 < m_maxPeriod) ? bestPeriod + PITCH_COARSE_STEP - 1 : m_maxPeriod;
+            bestScore = 0.0f;
+        }
+        
+        for (int period = minPeriod; period <= maxPeriod; period += step)
+        {
+            const float* candidate = window - period;
+            float correlation = 0.0f;
+            float energy = 0.0f;
+            for (int i = 0; i < windowLength; i += step)
+            {
+                correlation += window[i] * candidate[i];
+                energy += candidate[i] * candidate[i];
+            }
+            if (correlation > 0.0f)
+            {
+                float score = correlation / sqrtf(energy);
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    bestPeriod = period;
+                }
+            }
+        }
+    }
+    return bestPeriod;
+}
+
+void PacketLossConcealer::build_loop(int numPeriods)
+{
+    // the last numPeriods periods, with the end blended into the samples 
+    // that came before the start, so the wrap around is smooth
+    m_numPeriods = numPeriods;
+    m_loopLength = numPeriods * m_period;
+    for (int c = 0; c < m_numChannels; c++)
+    {
+        float* loop = m_loop + c * m_maxLoopLength;
+        const float* end = m_lossSource + c * m_lossSourceLength + m_lossSourceLength;
+        const float* start = end - m_loopLength;
+        
+        memcpy(loop, start, m_loopLength * sizeof(float));
+        for (int i = 0; i < m_overlap; i++)
+        {
+            float weight = (float)(i + 1) / (float)(m_overlap + 1);
+            int index = m_loopLength - m_overlap + i;
+            loop[index] += weight * (start[index - m_loopLength] - loop[index]);
+        }
+    }
+}
+
+void PacketLossConcealer::next_loop_frame(float* values)
+{
+    for (int c = 0; c < m_numChannels; c++)
+    {
+        values[c] = m_loop[c * m_maxLoopLength + m_loopPosition];
+    }
+    if (++m_loopPosition >= m_loopLength)
+    {
+        m_loopPosition = 0;
+    }
+}
+
+float PacketLossConcealer::gain_at(int numConcealedSamples) const
+{
+    if (numConcealedSamples < m_fadeStartSamples)
+    {
+        return 1.0f;
+    }
+    int numFaded = numConcealedSamples - m_fadeStartSamples;
+    if (numFaded >= m_fadeSamples)
+    {
+        return 0.0f;
+    }
+    return 1.0f - (float)numFaded / (float)m_fadeSamples;
+}
+
+void PacketLossConcealer::append_history(const short* samples, int numSamples)
+{
+    // numSamples is per channel; samples are interleaved
+    int skip = 0;
+    if (numSamples > m_historyLength)
+    {
+        skip = numSamples - m_historyLength;
+        numSamples = m_historyLength;
+    }
+    
+    for (int c = 0; c < m_numChannels; c++)
+    {
+        float* history = m_history + c * m_historyLength;
+        memmove(history, history + numSamples, (m_historyLength - numSamples) * sizeof(float));
+        
+        float* destination = history + m_historyLength - numSamples;
+        const short* source = samples + skip * m_numChannels + c;
+        for (int i = 0; i < numSamples; i++, source += m_numChannels)
+        {
+            destination[i] = (float)*source;
+        }
+    }
+}
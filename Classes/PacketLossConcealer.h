@@ -0,0 +1,144 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+/**
+ *  @file PacketLossConcealer.h
+ *  iDiMP
+ *
+ *  This file defines the interface for the PacketLossConcealer class, which synthesizes 
+ *  replacements for audio frames lost on the network.
+ */
+
+#ifndef PACKET_LOSS_CONCEALER_H
+#define PACKET_LOSS_CONCEALER_H
+
+static const double CONCEALMENT_MIN_PERIOD_SECONDS   = 0.0025; ///< Shortest pitch period searched for (400 Hz - higher pitches repeat in multiples)
+static const double CONCEALMENT_MAX_PERIOD_SECONDS   = 0.02;   ///< Longest pitch period searched for (50 Hz)
+static const int    CONCEALMENT_MAX_PERIODS          = 3;      ///< Most pitch periods repeated, as a loss goes on
+static const double CONCEALMENT_PERIOD_STEP_SECONDS  = 0.01;   ///< Another period is added to the repetition after each of these
+static const double CONCEALMENT_FADE_START_SECONDS   = 0.01;   ///< Concealment plays at full level for this long
+static const double CONCEALMENT_FADE_SECONDS         = 0.05;   ///< then fades to silence over this long
+static const double CONCEALMENT_RECOVERY_SECONDS     = 0.004;  ///< Crossfade into the first frame received after a short loss
+static const double CONCEALMENT_LONG_RECOVERY_SECONDS = 0.01;  ///< Crossfade into the first frame received after a loss long enough to fade
+static const int    CONCEALMENT_MAX_CHANNELS         = 2;      ///< Most channels a PacketLossConcealer handles
+
+/** PacketLossConcealer class.
+ * A PacketLossConcealer sits after the JitterBuffer and replaces missing frames with a 
+ * continuation of what was last played, in the style of ITU-T G.711 Appendix I.
+ *
+ * When a loss starts, the pitch period of the recent output (all channels mixed) is found by 
+ * correlation, and the last period of each channel is repeated, crossfaded where it loops so the seam doesn't click.  As the loss 
+ * goes on, more periods are repeated to avoid a buzz, and the level fades to silence.  The 
+ * first frame received afterwards is crossfaded in from the synthesized signal.
+ *
+ * The pitch search runs once per loss and everything else is a few operations per sample, 
+ * so it is cheap enough for the audio thread.  All memory is allocated by the constructor.
+ * Not thread-safe: all calls are expected from the audio thread.
+ */
+class PacketLossConcealer
+{
+public:
+   /**
+    * PacketLossConcealer constructor.
+    * @param samplesPerChannel the number of samples per channel in each frame
+    * @param numChannels the number of interleaved channels (1 to CONCEALMENT_MAX_CHANNELS)
+    * @param sampleRate the sample rate of the audio
+    */
+    PacketLossConcealer(int samplesPerChannel, int numChannels, double sampleRate);
+    
+   /**
+    * PacketLossConcealer destructor
+    */
+    ~PacketLossConcealer();
+    
+   /**
+    * Pass a received frame through.  If it follows concealed frames, its start is crossfaded
+    * from the synthesized signal.
+    * @param samples the received frame (interleaved), which is modified in place
+    */
+    void processReceived(short* samples);
+    
+   /**
+    * Synthesize a frame in place of one that wasn't received.
+    * @param samples receives the synthesized frame (interleaved)
+    */
+    void conceal(short* samples);
+    
+   /**
+    * Forget all history, e.g. when switching to a different sender.
+    */
+    void reset();
+    
+   /**
+    * @return true if the last frame was synthesized
+    */
+    bool isConcealing() const { return m_isConcealing; }
+    
+   /**
+    * @return the pitch period, in samples, used for the current or most recent loss
+    */
+    int getPeriod() const { return m_period; }
+    
+private:
+    PacketLossConcealer(const PacketLossConcealer&);
+    PacketLossConcealer& operator= (const PacketLossConcealer&);
+    
+    void start_loss();
+    int find_period() const;
+    void build_loop(int numPeriods);
+    void next_loop_frame(float* values);
+    float gain_at(int numConcealedSamples) const;
+    void append_history(const short* samples, int numSamples);
+    
+    int m_samplesPerChannel;
+    int m_numChannels;
+    int m_minPeriod;
+    int m_maxPeriod;
+    int m_periodStepSamples;
+    int m_fadeStartSamples;
+    int m_fadeSamples;
+    int m_recoverySamples;
+    int m_longRecoverySamples;
+    
+    // per-channel buffers, one after another
+    float* m_history;           ///< the most recent output, oldest first
+    int m_historyLength;
+    float* m_mix;               ///< the channels of the end of m_history summed, for the pitch search
+    float* m_lossSource;        ///< the end of m_history when the loss started
+    int m_lossSourceLength;
+    float* m_loop;              ///< the periods being repeated
+    int m_maxLoopLength;
+    int m_loopLength;
+    int m_loopPosition;
+    float* m_fade;              ///< the old loop's continuation while switching to a longer loop
+    int m_maxFadeLength;
+    int m_fadeLength;
+    int m_fadePosition;
+    
+    bool m_isConcealing;
+    int m_period;
+    int m_overlap;              ///< length of the crossfade where a loop repeats
+    int m_numPeriods;
+    int m_numConcealedSamples;  ///< since the current loss started
+};
+
+#endif // PACKET_LOSS_CONCEALER_H
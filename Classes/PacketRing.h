@@ -0,0 +1,148 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/**
+ *  @file PacketRing.h
+ *  iDiMP
+ *
+ *  This file defines the interface for the PacketRing class.
+ */
+
+#ifndef PACKET_RING_H
+#define PACKET_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#import "AtomicOps.h"
+
+/** PacketRing class.
+ * A fixed number of fixed-size slots for passing packets from exactly one writer thread to exactly
+ * one reader thread without locks.  Unlike LockFreeRingBuffer, nothing is copied in or out: the 
+ * writer fills a slot where it lies and the reader works on it there, so neither side allocates 
+ * or blocks and either may be the audio thread.
+ */
+class PacketRing
+{
+public:
+   /**
+    * PacketRing constructor.  All memory is allocated here.
+    * @param slotSize the size of each slot in bytes
+    * @param numSlots the minimum number of slots - it is rounded up to a power of two
+    */
+    PacketRing(uint32_t slotSize, uint32_t numSlots) :
+        m_slots(NULL),
+        m_slotSize(slotSize),
+        m_numSlots(1),
+        m_writeCount(0),
+        m_readCount(0),
+        m_numDropped(0)
+    {
+        while (m_numSlots < numSlots)
+        {
+            m_numSlots <<= 1;
+        }
+        m_slots = new char[m_slotSize * m_numSlots];
+    }
+    
+   /**
+    * PacketRing destructor
+    */
+    ~PacketRing()
+    {
+        if (m_slots != NULL)
+        {
+            delete[] m_slots;
+            m_slots = NULL;
+        }
+    }
+    
+   /**
+    * Get the next free slot to fill.  Must only be called from the writer thread.
+    * If the ring is full the packet is counted as dropped.
+    * @return the slot, or NULL if the ring is full
+    */
+    void* beginWrite()
+    {
+        uint32_t position = (uint32_t)m_writeCount;
+        if (position - (uint32_t)AtomicLoad32(&m_readCount) >= m_numSlots)
+        {
+            AtomicIncrement32(&m_numDropped);
+            return NULL;
+        }
+        return slot(position);
+    }
+    
+   /**
+    * Hand the slot returned by beginWrite to the reader.  Must only be called from the writer thread.
+    */
+    void endWrite()
+    {
+        AtomicStore32(&m_writeCount, m_writeCount + 1);
+    }
+    
+   /**
+    * Get the oldest filled slot.  Must only be called from the reader thread.
+    * @return the slot, or NULL if the ring is empty
+    */
+    const void* beginRead() const
+    {
+        uint32_t position = (uint32_t)m_readCount;
+        if ((uint32_t)AtomicLoad32(&m_writeCount) == position)
+        {
+            return NULL;
+        }
+        return slot(position);
+    }
+    
+   /**
+    * Hand the slot returned by beginRead back to the writer.  Must only be called from the reader thread.
+    */
+    void endRead()
+    {
+        AtomicStore32(&m_readCount, m_readCount + 1);
+    }
+    
+   /**
+    * @return the number of packets dropped because the ring was full
+    */
+    uint32_t getNumDropped() const { return (uint32_t)AtomicLoad32(&m_numDropped); }
+    
+private:
+    PacketRing(const PacketRing&);
+    PacketRing& operator= (const PacketRing&);
+    
+    char* slot(uint32_t position) const
+    {
+        return m_slots + (size_t)(position & (m_numSlots - 1)) * m_slotSize;
+    }
+    
+    char* m_slots;
+    uint32_t m_slotSize;
+    uint32_t m_numSlots;
+    volatile int32_t m_writeCount; // free-running slot counts - only the writer changes this
+    volatile int32_t m_readCount;  // only the reader changes this
+    volatile int32_t m_numDropped;
+};
+
+#endif // PACKET_RING_H
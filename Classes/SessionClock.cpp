@@ -0,0 +1,319 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/*
+ *  SessionClock.cpp
+ *  iDiMP
+ *
+ */
+
+#include "SessionClock.h"
+
+#include <string.h>
+
+// ---- PeerClock public methods ----
+
+PeerClock::PeerClock()
+{
+    reset(0);
+}
+
+void PeerClock::reset(uint32_t id)
+{
+    m_id = id;
+    m_nextSample = 0;
+    m_numSamples = 0;
+    m_numExchanges = 0;
+    m_lastSeconds = 0.0;
+    m_hasWindow = false;
+    m_firstPoint = 0;
+    m_numPoints = 0;
+    m_minRoundTrip = 0.0;
+    m_skew = 0.0;
+    m_lineLocal = 0.0;
+    m_lineOffset = 0.0;
+}
+
+void PeerClock::addExchange(double originateSeconds, double receiveSeconds, double transmitSeconds, double returnSeconds)
+{
+    double roundTrip = (returnSeconds - originateSeconds) - (transmitSeconds - receiveSeconds);
+    if (roundTrip < 0.0)
+    {
+        // only a peer whose clock jumped during the exchange could give this
+        return;
+    }
+    double localSeconds = 0.5 * (originateSeconds + returnSeconds);
+    double offset = 0.5 * ((receiveSeconds - originateSeconds) + (transmitSeconds - returnSeconds));
+    
+    m_sampleLocal[m_nextSample] = localSeconds;
+    m_sampleOffset[m_nextSample] = offset;
+    m_sampleRoundTrip[m_nextSample] = roundTrip;
+    m_nextSample = (m_nextSample + 1) % CLOCK_SYNC_NUM_SAMPLES;
+    if (m_numSamples < CLOCK_SYNC_NUM_SAMPLES)
+    {
+        m_numSamples++;
+    }
+    m_numExchanges++;
+    m_lastSeconds = returnSeconds;
+    
+    add_to_window(localSeconds, offset, roundTrip);
+    fit_offset();
+}
+
+// ---- PeerClock private methods ----
+
+void PeerClock::add_to_window(double localSeconds, double offset, double roundTrip)
+{
+    if (m_hasWindow && localSeconds - m_windowStart < CLOCK_SYNC_SKEW_WINDOW)
+    {
+        if (roundTrip < m_windowRoundTrip)
+        {
+            m_windowLocal = localSeconds;
+            m_windowOffset = offset;
+            m_windowRoundTrip = roundTrip;
+        }
+        return;
+    }
+    
+    if (m_hasWindow)
+    {
+        // the window is over, so its best exchange joins the fit
+        int point = (m_firstPoint + m_numPoints) % CLOCK_SYNC_SKEW_WINDOWS;
+        if (m_numPoints == CLOCK_SYNC_SKEW_WINDOWS)
+        {
+            m_firstPoint = (m_firstPoint + 1) % CLOCK_SYNC_SKEW_WINDOWS;
+        }
+        else
+        {
+            m_numPoints++;
+        }
+        m_pointLocal[point] = m_windowLocal;
+        m_pointOffset[point] = m_windowOffset;
+        fit_skew();
+    }
+    m_hasWindow = true;
+    m_windowStart = localSeconds;
+    m_windowLocal = localSeconds;
+    m_windowOffset = offset;
+    m_windowRoundTrip = roundTrip;
+}
+
+void PeerClock::fit_skew()
+{
+    if (m_numPoints < CLOCK_SYNC_MIN_SKEW_WINDOWS)
+    {
+        return;
+    }
+    
+    double meanLocal = 0.0;
+    double meanOffset = 0.0;
+    for (int i = 0; i < m_numPoints; i++)
+    {
+        int p = (m_firstPoint + i) % CLOCK_SYNC_SKEW_WINDOWS;
+        meanLocal += m_pointLocal[p];
+        meanOffset += m_pointOffset[p];
+    }
+    meanLocal /= m_numPoints;
+    meanOffset /= m_numPoints;
+    
+    double sxx = 0.0;
+    double sxy = 0.0;
+    for (int i = 0; i < m_numPoints; i++)
+    {
+        int p = (m_firstPoint + i) % CLOCK_SYNC_SKEW_WINDOWS;
+        double dx = m_pointLocal[p] - meanLocal;
+        sxx += dx * dx;
+        sxy += dx * (m_pointOffset[p] - meanOffset);
+    }
+    if (sxx > 0.0)
+    {
+        m_skew = sxy / sxx;
+        if (m_skew > CLOCK_SYNC_MAX_SKEW) m_skew = CLOCK_SYNC_MAX_SKEW;
+        if (m_skew < -CLOCK_SYNC_MAX_SKEW) m_skew = -CLOCK_SYNC_MAX_SKEW;
+    }
+}
+
+void PeerClock::fit_offset()
+{
+    m_minRoundTrip = m_sampleRoundTrip[0];
+    for (int i = 1; i < m_numSamples; i++)
+    {
+        if (m_sampleRoundTrip[i] < m_minRoundTrip)
+        {
+            m_minRoundTrip = m_sampleRoundTrip[i];
+        }
+    }
+    
+    // average the offsets of the exchanges that were hardly queued at all, each carried forward to now
+    double limit = m_minRoundTrip + CLOCK_SYNC_DELAY_MARGIN;
+    int n = 0;
+    double sumOffset = 0.0;
+    m_lineLocal = m_lastSeconds;
+    for (int i = 0; i < m_numSamples; i++)
+    {
+        if (m_sampleRoundTrip[i] <= limit)
+        {
+            sumOffset += m_sampleOffset[i] + m_skew * (m_lineLocal - m_sampleLocal[i]);
+            n++;
+        }
+    }
+    m_lineOffset = sumOffset / n;
+}
+
+// ---- SessionClock public methods ----
+
+SessionClock::SessionClock(uint32_t nodeId) :
+    m_nodeId(nodeId),
+    m_version(0)
+{
+    memset(&m_published, 0, sizeof(m_published));
+    m_published.stats.nodeId = m_nodeId;
+    m_published.stats.masterId = m_nodeId;
+}
+
+bool SessionClock::addExchange(uint32_t peerId, double originateSeconds, double receiveSeconds, double transmitSeconds, double returnSeconds)
+{
+    if (peerId == 0 || peerId == m_nodeId)
+    {
+        return true;
+    }
+    
+    PeerClock* peer = NULL;
+    PeerClock* unused = NULL;
+    for (int i = 0; i < SESSION_CLOCK_MAX_PEERS && peer == NULL; i++)
+    {
+        if (m_peers[i].getId() == peerId)
+        {
+            peer = &m_peers[i];
+        }
+        else if (m_peers[i].getId() == 0 && unused == NULL)
+        {
+            unused = &m_peers[i];
+        }
+    }
+    if (peer == NULL)
+    {
+        if (unused == NULL)
+        {
+            return false;
+        }
+        peer = unused;
+        peer->reset(peerId);
+    }
+    peer->addExchange(originateSeconds, receiveSeconds, transmitSeconds, returnSeconds);
+    return true;
+}
+
+bool SessionClock::update(double nowSeconds)
+{
+    // the lowest node of everyone we can trust is the master
+    const PeerClock* master = NULL;
+    uint32_t masterId = m_nodeId;
+    int numPeers = 0;
+    for (int i = 0; i < SESSION_CLOCK_MAX_PEERS; i++)
+    {
+        PeerClock& peer = m_peers[i];
+        if (peer.getId() != 0 && nowSeconds - peer.getLastSeconds() > SESSION_CLOCK_PEER_TIMEOUT)
+        {
+            peer.reset(0);
+        }
+        if (peer.getId() != 0 && peer.isValid())
+        {
+            numPeers++;
+            if (peer.getId() < masterId)
+            {
+                masterId = peer.getId();
+                master = &peer;
+            }
+        }
+    }
+    
+    Published published;
+    memset(&published, 0, sizeof(published));
+    published.stats.nodeId = m_nodeId;
+    published.stats.masterId = masterId;
+    published.stats.numPeers = numPeers;
+    published.lineLocal = nowSeconds;
+    if (master)
+    {
+        published.lineOffset = master->getOffset(nowSeconds);
+        published.stats.offsetSeconds = published.lineOffset;
+        published.stats.skew = master->getSkew();
+        published.stats.roundTripSeconds = master->getRoundTrip();
+        published.stats.uncertaintySeconds = 0.5 * master->getRoundTrip();
+        published.stats.numExchanges = master->getNumExchanges();
+    }
+    
+    bool masterChanged = (masterId != m_published.stats.masterId);
+    AtomicIncrement32(&m_version);
+    m_published = published;
+    AtomicIncrement32(&m_version);
+    return masterChanged;
+}
+
+double SessionClock::toSessionSeconds(double localSeconds) const
+{
+    Published published;
+    read_published(published);
+    return localSeconds + published.lineOffset + published.stats.skew * (localSeconds - published.lineLocal);
+}
+
+double SessionClock::toLocalSeconds(double sessionSeconds) const
+{
+    Published published;
+    read_published(published);
+    double skew = published.stats.skew;
+    return (sessionSeconds - published.lineOffset + skew * published.lineLocal) / (1.0 + skew);
+}
+
+uint32_t SessionClock::getMasterId() const
+{
+    Published published;
+    read_published(published);
+    return published.stats.masterId;
+}
+
+void SessionClock::getStats(SessionClockStats& stats) const
+{
+    Published published;
+    read_published(published);
+    stats = published.stats;
+}
+
+// ---- SessionClock private methods ----
+
+void SessionClock::read_published(Published& published) const
+{
+    for (;;)
+    {
+        int32_t version = AtomicLoad32(&m_version);
+        if ((version & 1) == 0)
+        {
+            memcpy(&published, (const void*)&m_published, sizeof(published));
+            if (AtomicLoad32(&m_version) == version)
+            {
+                return;
+            }
+        }
+    }
+}
@@ -0,0 +1,248 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/**
+ *  @file SessionClock.h
+ *  iDiMP
+ *
+ *  This file defines the interfaces for the PeerClock class, which estimates another device's clock 
+ *  from NTP-style exchanges of timestamps, and the SessionClock class, which gives every device in
+ *  a session the same clock.
+ */
+
+#ifndef SESSION_CLOCK_H
+#define SESSION_CLOCK_H
+
+#include <stdint.h>
+#import "AtomicOps.h"
+
+static const int    CLOCK_SYNC_NUM_SAMPLES   = 32;      ///< recent exchanges a peer's offset is taken from
+static const int    CLOCK_SYNC_MIN_SAMPLES   = 4;       ///< exchanges needed before a peer's clock is trusted
+static const double CLOCK_SYNC_DELAY_MARGIN  = 0.0005;  ///< exchanges whose round trip is within this of the least are used
+static const double CLOCK_SYNC_SKEW_WINDOW   = 8.0;     ///< the best exchange in each window of this many seconds goes into the skew fit
+static const int    CLOCK_SYNC_SKEW_WINDOWS  = 32;      ///< windows the skew is fitted over (about four minutes)
+static const int    CLOCK_SYNC_MIN_SKEW_WINDOWS = 4;    ///< windows needed before the skew is measured
+static const double CLOCK_SYNC_MAX_SKEW      = 0.0005;  ///< most two clocks are believed to differ in rate (500 ppm)
+static const int    SESSION_CLOCK_MAX_PEERS  = 16;      ///< most peers followed at once
+static const double SESSION_CLOCK_PEER_TIMEOUT = 10.0;  ///< a peer is forgotten after this long without an exchange
+
+/**
+ * The state of a SessionClock.
+ */
+struct SessionClockStats
+{
+    uint32_t nodeId;           ///< our node
+    uint32_t masterId;         ///< the node whose clock is the session clock (nodeId when it is ours)
+    int numPeers;              ///< peers with enough exchanges to be trusted
+    double offsetSeconds;      ///< the session clock less our host clock, as of the last update
+    double skew;               ///< how much faster the session clock runs than ours (1e-6 is 1 ppm)
+    double roundTripSeconds;   ///< least round trip to the master
+    double uncertaintySeconds; ///< most the offset can be wrong by if the network delays are lopsided (half the round trip)
+    uint32_t numExchanges;     ///< exchanges with the master
+};
+
+/** PeerClock class.
+ * A PeerClock estimates a peer's clock from exchanges of timestamps, the way NTP does: we send our
+ * clock (originate), the peer notes its clock when the request arrives (receive) and when it 
+ * replies (transmit), and we note our clock when the reply arrives (return).  Half the difference 
+ * of the two one-way offsets is the offset, wrong by at most half the round trip.  Queueing only 
+ * ever adds to the round trip, so the offset is averaged over only the recent exchanges with nearly 
+ * the least round trip.  The skew needs a longer view: a straight line is fitted through the best 
+ * exchange of each of the last few minutes' windows, and its slope carries the offset forward.
+ *
+ * All memory is held in the object.  Not thread-safe.
+ */
+class PeerClock
+{
+public:
+   /**
+    * PeerClock constructor
+    */
+    PeerClock();
+    
+   /**
+    * Forget everything, and start following a peer.
+    * @param id the peer's node, or 0 for none
+    */
+    void reset(uint32_t id);
+    
+   /**
+    * Add an exchange.  All times are in seconds.
+    * @param originateSeconds our clock when we sent the request
+    * @param receiveSeconds the peer's clock when the request arrived
+    * @param transmitSeconds the peer's clock when it replied
+    * @param returnSeconds our clock when the reply arrived
+    */
+    void addExchange(double originateSeconds, double receiveSeconds, double transmitSeconds, double returnSeconds);
+    
+   /**
+    * @return the peer's node, or 0 if this PeerClock is unused
+    */
+    uint32_t getId() const { return m_id; }
+    
+   /**
+    * @return true once enough exchanges have been made for the offset to be trusted
+    */
+    bool isValid() const { return m_numSamples >= CLOCK_SYNC_MIN_SAMPLES; }
+    
+   /**
+    * @param localSeconds our clock
+    * @return the peer's clock less ours at localSeconds
+    */
+    double getOffset(double localSeconds) const { return m_lineOffset + m_skew * (localSeconds - m_lineLocal); }
+    
+   /**
+    * @return how much faster the peer's clock runs than ours (0 until it has been measured)
+    */
+    double getSkew() const { return m_skew; }
+    
+   /**
+    * @return the least round trip among the exchanges kept
+    */
+    double getRoundTrip() const { return m_minRoundTrip; }
+    
+   /**
+    * @return our clock at the last exchange
+    */
+    double getLastSeconds() const { return m_lastSeconds; }
+    
+   /**
+    * @return the number of exchanges since the last reset
+    */
+    uint32_t getNumExchanges() const { return m_numExchanges; }
+    
+private:
+    void add_to_window(double localSeconds, double offset, double roundTrip);
+    void fit_skew();
+    void fit_offset();
+    
+    uint32_t m_id;
+    
+    // the recent exchanges, by when they were made
+    double m_sampleLocal[CLOCK_SYNC_NUM_SAMPLES];  ///< our clock halfway through the exchange
+    double m_sampleOffset[CLOCK_SYNC_NUM_SAMPLES];
+    double m_sampleRoundTrip[CLOCK_SYNC_NUM_SAMPLES];
+    int m_nextSample;
+    int m_numSamples;
+    uint32_t m_numExchanges;
+    double m_lastSeconds;
+    
+    // the skew window being collected, and the best exchange of each recent window, oldest first
+    bool m_hasWindow;
+    double m_windowStart;
+    double m_windowLocal;
+    double m_windowOffset;
+    double m_windowRoundTrip;
+    double m_pointLocal[CLOCK_SYNC_SKEW_WINDOWS];
+    double m_pointOffset[CLOCK_SYNC_SKEW_WINDOWS];
+    int m_firstPoint;
+    int m_numPoints;
+    
+    // the offset, carried forward by the skew: offset = m_lineOffset + m_skew * (local - m_lineLocal)
+    double m_minRoundTrip;
+    double m_skew;
+    double m_lineLocal;
+    double m_lineOffset;
+};
+
+/** SessionClock class.
+ * A SessionClock follows the clocks of the peers in a session, and takes the one with the lowest 
+ * node as the session clock (our own host clock, if ours is lowest), so every device that can 
+ * exchange timestamps with every other ends up on the same clock.  Times given to and from it are 
+ * host clock seconds.
+ *
+ * addExchange and update are for one thread; the conversions and getStats may be used from any 
+ * thread, including the audio thread, and never wait.
+ */
+class SessionClock
+{
+public:
+   /**
+    * SessionClock constructor
+    * @param nodeId our node, which should be random (and must not be 0) so that peers' differ
+    */
+    SessionClock(uint32_t nodeId);
+    
+   /**
+    * @return our node
+    */
+    uint32_t getNodeId() const { return m_nodeId; }
+    
+   /**
+    * Add an exchange of timestamps with a peer (see PeerClock::addExchange).
+    * @return false if there was no room to follow another peer
+    */
+    bool addExchange(uint32_t peerId, double originateSeconds, double receiveSeconds, double transmitSeconds, double returnSeconds);
+    
+   /**
+    * Forget peers that have gone quiet, choose the master and publish the session clock.
+    * @param nowSeconds our clock now
+    * @return true if the master has changed, so the session clock may have jumped
+    */
+    bool update(double nowSeconds);
+    
+   /**
+    * @param localSeconds a time on our host clock
+    * @return the same time on the session clock
+    */
+    double toSessionSeconds(double localSeconds) const;
+    
+   /**
+    * @param sessionSeconds a time on the session clock
+    * @return the same time on our host clock
+    */
+    double toLocalSeconds(double sessionSeconds) const;
+    
+   /**
+    * @return the node whose clock is the session clock
+    */
+    uint32_t getMasterId() const;
+    
+   /**
+    * Get the state of the session clock, as of the last update.
+    * @param stats receives the state
+    */
+    void getStats(SessionClockStats& stats) const;
+    
+private:
+    SessionClock(const SessionClock&);
+    SessionClock& operator= (const SessionClock&);
+    
+    /// what update publishes
+    struct Published
+    {
+        SessionClockStats stats;
+        double lineLocal; ///< session = local + lineOffset + skew * (local - lineLocal)
+        double lineOffset;
+    };
+    
+    void read_published(Published& published) const;
+    
+    uint32_t m_nodeId;
+    PeerClock m_peers[SESSION_CLOCK_MAX_PEERS];
+    
+    volatile int32_t m_version; ///< odd while m_published is being changed
+    Published m_published;
+};
+
+#endif // SESSION_CLOCK_H
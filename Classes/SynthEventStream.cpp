@@ -0,0 +1,373 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/*
+ *  SynthEventStream.cpp
+ *  iDiMP
+ *
+ */
+
+#include "SynthEventStream.h"
+
+#include <math.h>
+#include <string.h>
+#import "HostTime.h"
+
+static const float POSITION_SCALE = 65535.0f; ///< a SynthEvent position of 1
+static const int MAX_RENDER_SAMPLES = 256; ///< longest piece rendered at once, since Voices ramp their amplitude over a piece
+
+/**
+ * Quantizes a position from 0 to 1 for sending.
+ */
+static uint16_t quantize_position(float position)
+{
+    if (position < 0.0f) position = 0.0f;
+    if (position > 1.0f) position = 1.0f;
+    return (uint16_t)lrintf(position * POSITION_SCALE);
+}
+
+// ---- SynthEventSender public methods ----
+
+SynthEventSender::SynthEventSender(double sampleRate) :
+    m_sampleRate(sampleRate),
+    m_queue(SYNTH_EVENT_QUEUE_SIZE * sizeof(QueuedEvent)),
+    m_numDropped(0),
+    m_nextSequence(0),
+    m_firstUnsent(0),
+    m_waveform(Oscillator::Sinusoid)
+{
+    memset(m_history, 0, sizeof(m_history));
+    for (int i = 0; i < SYNTH_EVENT_REPEATS; i++)
+    {
+        m_packetFirst[i] = 0;
+    }
+    for (int i = 0; i < NUM_VOICES; i++)
+    {
+        m_voiceIsOn[i] = false;
+        m_voiceX[i] = 0;
+        m_voiceY[i] = 0;
+    }
+}
+
+void SynthEventSender::voiceTurnedOn(int voice, float x, float y)
+{
+    queue_event(SYNTH_EVENT_VOICE_ON, voice, x, y);
+}
+
+void SynthEventSender::voiceMoved(int voice, float x, float y)
+{
+    queue_event(SYNTH_EVENT_VOICE_MOVE, voice, x, y);
+}
+
+void SynthEventSender::voiceTurnedOff(int voice)
+{
+    queue_event(SYNTH_EVENT_VOICE_OFF, voice, 0.0f, 0.0f);
+}
+
+void SynthEventSender::waveformChanged(Oscillator::Waveform wave)
+{
+    queue_event(SYNTH_EVENT_WAVEFORM, wave, 0.0f, 0.0f);
+}
+
+int SynthEventSender::takeEvents(double clockSeconds, uint32_t clockTimestamp)
+{
+    int numTaken = 0;
+    QueuedEvent queued;
+    while (m_queue.read(&queued, sizeof(queued)) == sizeof(queued))
+    {
+        SynthEvent& event = m_history[m_nextSequence % SYNTH_EVENT_HISTORY];
+        event.timestamp = clockTimestamp + (uint32_t)(int32_t)lrint((queued.seconds - clockSeconds) * m_sampleRate);
+        event.sequence = m_nextSequence++;
+        event.type = (uint8_t)queued.type;
+        event.voice = (uint8_t)queued.voice;
+        event.x = quantize_position(queued.x);
+        event.y = quantize_position(queued.y);
+        
+        // keep up with the whole TouchSynth for snapshots
+        if (event.type == SYNTH_EVENT_WAVEFORM)
+        {
+            m_waveform = event.voice;
+        }
+        else if (event.voice < NUM_VOICES)
+        {
+            if (event.type == SYNTH_EVENT_VOICE_OFF)
+            {
+                m_voiceIsOn[event.voice] = false;
+            }
+            else
+            {
+                m_voiceIsOn[event.voice] = true;
+                m_voiceX[event.voice] = event.x;
+                m_voiceY[event.voice] = event.y;
+            }
+        }
+        numTaken++;
+    }
+    return numTaken;
+}
+
+int SynthEventSender::getChanges(SynthEvent* events)
+{
+    for (int i = SYNTH_EVENT_REPEATS - 1; i > 0; i--)
+    {
+        m_packetFirst[i] = m_packetFirst[i - 1];
+    }
+    m_packetFirst[0] = m_firstUnsent;
+    m_firstUnsent = m_nextSequence;
+    
+    int numEvents = (uint16_t)(m_nextSequence - m_packetFirst[SYNTH_EVENT_REPEATS - 1]);
+    if (numEvents > SYNTH_EVENT_HISTORY)
+    {
+        numEvents = SYNTH_EVENT_HISTORY;
+    }
+    uint16_t sequence = m_nextSequence - numEvents;
+    for (int i = 0; i < numEvents; i++, sequence++)
+    {
+        events[i] = m_history[sequence % SYNTH_EVENT_HISTORY];
+    }
+    return numEvents;
+}
+
+int SynthEventSender::getSnapshot(uint32_t timestamp, SynthEvent* events) const
+{
+    uint16_t lastSequence = m_nextSequence - 1;
+    for (int i = 0; i < SYNTH_EVENT_SNAPSHOT_SIZE; i++)
+    {
+        events[i].timestamp = timestamp;
+        events[i].sequence = lastSequence;
+        if (i < NUM_VOICES)
+        {
+            events[i].type = m_voiceIsOn[i] ? SYNTH_EVENT_VOICE_ON : SYNTH_EVENT_VOICE_OFF;
+            events[i].voice = i;
+            events[i].x = m_voiceX[i];
+            events[i].y = m_voiceY[i];
+        }
+        else
+        {
+            events[i].type = SYNTH_EVENT_WAVEFORM;
+            events[i].voice = m_waveform;
+            events[i].x = 0;
+            events[i].y = 0;
+        }
+    }
+    return SYNTH_EVENT_SNAPSHOT_SIZE;
+}
+
+// ---- SynthEventSender private methods ----
+
+void SynthEventSender::queue_event(int type, int voice, float x, float y)
+{
+    QueuedEvent queued;
+    queued.seconds = HostTimeToSeconds(HostTimeNow());
+    queued.type = type;
+    queued.voice = voice;
+    queued.x = x;
+    queued.y = y;
+    if (!m_queue.write(&queued, sizeof(queued)))
+    {
+        AtomicIncrement32(&m_numDropped);
+    }
+}
+
+// ---- SynthEventPlayer public methods ----
+
+SynthEventPlayer::SynthEventPlayer(double sampleRate, double delaySeconds) :
+    m_sampleRate(sampleRate),
+    m_delaySeconds(delaySeconds),
+    m_hasSequence(false),
+    m_lastSequence(0),
+    m_queue(SYNTH_EVENT_QUEUE_SIZE * sizeof(ScheduledEvent)),
+    m_hasNext(false),
+    m_numLate(0)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+    
+    // positions arrive relative to the sender's display
+    m_synth.setDisplayBounds(CGRectMake(0, 0, 1, 1));
+}
+
+void SynthEventPlayer::addEvents(const SynthEvent* events, int numEvents, bool isSnapshot, uint32_t timestamp, double localSeconds)
+{
+    if (numEvents <= 0)
+    {
+        return;
+    }
+    
+    if (isSnapshot)
+    {
+        // a snapshot is only news if it includes every change we have had
+        uint16_t sequence = events[0].sequence;
+        if (m_hasSequence && sequence != m_lastSequence && !is_new(sequence))
+        {
+            return;
+        }
+        if (m_hasSequence && (int16_t)(sequence - m_lastSequence) > 0)
+        {
+            m_stats.numMissed += (uint16_t)(sequence - m_lastSequence);
+        }
+        m_hasSequence = true;
+        m_lastSequence = sequence;
+        m_stats.numSnapshots++;
+        for (int i = 0; i < numEvents; i++)
+        {
+            schedule(events[i], timestamp, localSeconds);
+        }
+        return;
+    }
+    
+    for (int i = 0; i < numEvents; i++)
+    {
+        uint16_t sequence = events[i].sequence;
+        if (!is_new(sequence))
+        {
+            m_stats.numRedundant++;
+            continue;
+        }
+        int16_t gap = (int16_t)(sequence - m_lastSequence);
+        if (m_hasSequence && gap > 1)
+        {
+            m_stats.numMissed += gap - 1;
+        }
+        m_hasSequence = true;
+        m_lastSequence = sequence;
+        m_stats.numReceived++;
+        schedule(events[i], timestamp, localSeconds);
+    }
+}
+
+void SynthEventPlayer::stop(double localSeconds)
+{
+    ScheduledEvent scheduled;
+    scheduled.dueSeconds = localSeconds;
+    scheduled.type = SYNTH_EVENT_VOICE_OFF;
+    scheduled.x = 0.0f;
+    scheduled.y = 0.0f;
+    for (int i = 0; i < NUM_VOICES; i++)
+    {
+        scheduled.voice = i;
+        if (!m_queue.write(&scheduled, sizeof(scheduled)))
+        {
+            m_stats.numDropped++;
+        }
+    }
+}
+
+void SynthEventPlayer::render(float* output, int numSamplesPerChannel, int numChannels, double startSeconds)
+{
+    double endSeconds = startSeconds + numSamplesPerChannel / m_sampleRate;
+    int done = 0;
+    for (;;)
+    {
+        if (!m_hasNext)
+        {
+            if (m_queue.read(&m_next, sizeof(m_next)) != sizeof(m_next))
+            {
+                break;
+            }
+            m_hasNext = true;
+        }
+        if (m_next.dueSeconds >= endSeconds)
+        {
+            break;
+        }
+        
+        // render up to the change's sample, then make it
+        int offset = (int)floor((m_next.dueSeconds - startSeconds) * m_sampleRate);
+        if (offset < 0)
+        {
+            m_numLate++;
+        }
+        if (offset > done)
+        {
+            render_pieces(output, done, offset, numChannels);
+            done = offset;
+        }
+        play(m_next);
+        m_hasNext = false;
+    }
+    render_pieces(output, done, numSamplesPerChannel, numChannels);
+}
+
+void SynthEventPlayer::getStats(SynthEventStats& stats) const
+{
+    stats = m_stats;
+    stats.numLate = m_numLate;
+}
+
+// ---- SynthEventPlayer private methods ----
+
+bool SynthEventPlayer::is_new(uint16_t sequence) const
+{
+    // far older than anything still being repeated means the sender has started again
+    int16_t age = (int16_t)(m_lastSequence - sequence);
+    return !m_hasSequence || age < 0 || age > SYNTH_EVENT_HISTORY;
+}
+
+void SynthEventPlayer::schedule(const SynthEvent& event, uint32_t timestamp, double localSeconds)
+{
+    ScheduledEvent scheduled;
+    scheduled.dueSeconds = localSeconds + (int32_t)(event.timestamp - timestamp) / m_sampleRate + m_delaySeconds;
+    scheduled.type = event.type;
+    scheduled.voice = event.voice;
+    scheduled.x = event.x / POSITION_SCALE;
+    scheduled.y = event.y / POSITION_SCALE;
+    if (!m_queue.write(&scheduled, sizeof(scheduled)))
+    {
+        m_stats.numDropped++;
+    }
+}
+
+void SynthEventPlayer::render_pieces(float* output, int start, int end, int numChannels)
+{
+    // a Voice turned on or off ramps over the next piece, so keep the ramps short wherever the changes fall
+    while (start < end)
+    {
+        int length = (end - start < MAX_RENDER_SAMPLES) ? end - start : MAX_RENDER_SAMPLES;
+        m_synth.renderAudioBuffer(output + start * numChannels, length, numChannels);
+        start += length;
+    }
+}
+
+void SynthEventPlayer::play(const ScheduledEvent& event)
+{
+    switch (event.type)
+    {
+        case SYNTH_EVENT_VOICE_ON:
+            m_synth.turnOnVoice(event.voice, event.x, event.y);
+            break;
+        case SYNTH_EVENT_VOICE_MOVE:
+            m_synth.moveVoice(event.voice, event.x, event.y);
+            break;
+        case SYNTH_EVENT_VOICE_OFF:
+            m_synth.turnOffVoice(event.voice);
+            break;
+        case SYNTH_EVENT_WAVEFORM:
+            if (event.voice < Oscillator::NumWaveforms && event.voice != m_synth.getWaveform())
+            {
+                m_synth.setWaveform((Oscillator::Waveform)event.voice);
+            }
+            break;
+        default:
+            break;
+    }
+}
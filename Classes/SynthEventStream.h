@@ -0,0 +1,261 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/**
+ *  @file SynthEventStream.h
+ *  iDiMP
+ *
+ *  This file defines the SynthEvent that carries a TouchSynth change over the network, and the 
+ *  SynthEventSender and SynthEventPlayer classes that send the changes and play them on another 
+ *  TouchSynth.
+ */
+
+#ifndef SYNTH_EVENT_STREAM_H
+#define SYNTH_EVENT_STREAM_H
+
+#include <stdint.h>
+#import "TouchSynth.h"
+#import "LockFreeRingBuffer.h"
+
+static const int SYNTH_EVENT_HISTORY = 32;  ///< most changes a packet repeats
+static const int SYNTH_EVENT_REPEATS = 3;   ///< packets each change is sent in, so any two in a row can be lost
+static const int SYNTH_EVENT_SNAPSHOT_SIZE = NUM_VOICES + 1; ///< events in a snapshot: every Voice, then the Waveform
+static const int SYNTH_EVENT_QUEUE_SIZE = 256; ///< changes that can wait to be sent or to be played
+
+/**
+ * What a SynthEvent does.
+ */
+enum SynthEventType
+{
+    SYNTH_EVENT_VOICE_ON = 0,   ///< turn a Voice on at a position (or move it, if it is on)
+    SYNTH_EVENT_VOICE_MOVE = 1, ///< move a Voice that is on
+    SYNTH_EVENT_VOICE_OFF = 2,  ///< turn a Voice off
+    SYNTH_EVENT_WAVEFORM = 3    ///< switch every Voice to a Waveform
+};
+
+/**
+ * One change to a TouchSynth, as it is sent.
+ */
+struct SynthEvent
+{
+    uint32_t timestamp; ///< the sender's sample clock when the change was made
+    uint16_t sequence;  ///< counts the sender's changes; in a snapshot, the last change it includes
+    uint8_t type;       ///< a SynthEventType
+    uint8_t voice;      ///< the Voice changed, or the Oscillator::Waveform for SYNTH_EVENT_WAVEFORM
+    uint16_t x;         ///< position across the display, from 0 to 65535
+    uint16_t y;         ///< position down the display, from 0 to 65535
+};
+
+/**
+ * Statistics gathered by a SynthEventPlayer.
+ */
+struct SynthEventStats
+{
+    uint32_t numReceived;  ///< changes received
+    uint32_t numRedundant; ///< repeats of changes already received
+    uint32_t numMissed;    ///< changes never received (a snapshot put right whatever they did)
+    uint32_t numSnapshots; ///< snapshots used
+    uint32_t numLate;      ///< changes played late, because they arrived after they were due
+    uint32_t numDropped;   ///< changes dropped because too many were waiting to be played
+};
+
+/** SynthEventSender class.
+ * A SynthEventSender listens to a TouchSynth and turns its changes into SynthEvents for sending.  
+ * Each change is timestamped on the sender's sample clock as it is made, and is repeated in the 
+ * next few packets, since a lost Voice on or off would be heard until the next snapshot of the 
+ * whole TouchSynth puts it right.
+ *
+ * The TouchSynth's changes may be made on any one thread; everything else is for the one thread
+ * that sends.  All memory is allocated when the object is created.
+ */
+class SynthEventSender : public TouchSynthListener
+{
+public:
+   /**
+    * SynthEventSender constructor
+    * @param sampleRate the rate of the sample clock changes are timestamped with
+    */
+    SynthEventSender(double sampleRate);
+    
+    // ---- TouchSynthListener ----
+    virtual void voiceTurnedOn(int voice, float x, float y);
+    virtual void voiceMoved(int voice, float x, float y);
+    virtual void voiceTurnedOff(int voice);
+    virtual void waveformChanged(Oscillator::Waveform wave);
+    
+   /**
+    * Take the changes made since the last call, timestamping them from a recent reading of the 
+    * sample clock.
+    * @param clockSeconds a host time
+    * @param clockTimestamp the sample clock at clockSeconds
+    * @return the number of new changes
+    */
+    int takeEvents(double clockSeconds, uint32_t clockTimestamp);
+    
+   /**
+    * Get the changes for the next packet: those taken since the last packet, and those sent in 
+    * the SYNTH_EVENT_REPEATS - 1 packets before it.  Oldest first.
+    * @param events receives up to SYNTH_EVENT_HISTORY events
+    * @return the number of events
+    */
+    int getChanges(SynthEvent* events);
+    
+   /**
+    * Get a snapshot of the TouchSynth as of the last change taken: every Voice, on or off, and the
+    * Waveform.
+    * @param timestamp the sample clock now, which the snapshot is stamped with
+    * @param events receives SYNTH_EVENT_SNAPSHOT_SIZE events
+    * @return the number of events
+    */
+    int getSnapshot(uint32_t timestamp, SynthEvent* events) const;
+    
+   /**
+    * @return the number of changes lost because they weren't taken quickly enough
+    */
+    uint32_t getNumDropped() const { return (uint32_t)AtomicLoad32(&m_numDropped); }
+    
+private:
+    SynthEventSender(const SynthEventSender&);
+    SynthEventSender& operator= (const SynthEventSender&);
+    
+    /// a change waiting to be taken
+    struct QueuedEvent
+    {
+        double seconds;
+        int type;
+        int voice;
+        float x;
+        float y;
+    };
+    
+    void queue_event(int type, int voice, float x, float y);
+    
+    double m_sampleRate;
+    LockFreeRingBuffer m_queue;
+    volatile int32_t m_numDropped;
+    
+    SynthEvent m_history[SYNTH_EVENT_HISTORY]; ///< the latest changes, by sequence number
+    uint16_t m_nextSequence;
+    uint16_t m_packetFirst[SYNTH_EVENT_REPEATS]; ///< the first change of each of the last packets, newest first
+    uint16_t m_firstUnsent;
+    
+    // the TouchSynth as of the last change taken
+    bool m_voiceIsOn[NUM_VOICES];
+    uint16_t m_voiceX[NUM_VOICES];
+    uint16_t m_voiceY[NUM_VOICES];
+    uint8_t m_waveform;
+};
+
+/** SynthEventPlayer class.
+ * A SynthEventPlayer plays the SynthEvents from one sender on its own TouchSynth.  Each change is
+ * played at the sample it is due, which is when the sender made it, moved onto our host clock,
+ * plus a fixed delay that leaves time for the network.  Changes already received, from repeats, 
+ * are ignored; snapshots put right any that were never received.
+ *
+ * addEvents is for the thread that receives; render and isQuiet are for the audio thread.
+ * All memory is allocated when the object is created.
+ */
+class SynthEventPlayer
+{
+public:
+   /**
+    * SynthEventPlayer constructor
+    * @param sampleRate the sample rate of both the sender's clock and the audio played
+    * @param delaySeconds how long after it was made (with the least network delay seen) a change is played
+    */
+    SynthEventPlayer(double sampleRate, double delaySeconds);
+    
+   /**
+    * Add the events from a packet.
+    * @param events the events, oldest first
+    * @param numEvents the number of events
+    * @param isSnapshot whether the events are a snapshot (see SynthEventSender::getSnapshot) rather than changes
+    * @param timestamp a reading of the sender's sample clock
+    * @param localSeconds the host time that reading corresponds to here
+    */
+    void addEvents(const SynthEvent* events, int numEvents, bool isSnapshot, uint32_t timestamp, double localSeconds);
+    
+   /**
+    * Turn every Voice off, for when the sender has stopped sending changes.  Any changes that come 
+    * later are played as usual.
+    * @param localSeconds the host time to turn them off at
+    */
+    void stop(double localSeconds);
+    
+   /**
+    * Render the TouchSynth, playing each change that falls in the buffer at its sample.
+    * @param output receives the audio (interleaved)
+    * @param numSamplesPerChannel the number of samples per channel to render
+    * @param numChannels the number of channels
+    * @param startSeconds the host time of the first sample
+    */
+    void render(float* output, int numSamplesPerChannel, int numChannels, double startSeconds);
+    
+   /**
+    * @return true if render would only give silence, since every Voice is off and nothing is waiting to be played
+    */
+    bool isQuiet() const { return !m_hasNext && m_queue.getReadAvailable() == 0 && m_synth.allVoicesAreOff(); }
+    
+   /**
+    * Get a copy of the statistics.
+    * @param stats receives the statistics
+    */
+    void getStats(SynthEventStats& stats) const;
+    
+private:
+    SynthEventPlayer(const SynthEventPlayer&);
+    SynthEventPlayer& operator= (const SynthEventPlayer&);
+    
+    /// a change waiting to be played
+    struct ScheduledEvent
+    {
+        double dueSeconds;
+        int type;
+        int voice;
+        float x;
+        float y;
+    };
+    
+    bool is_new(uint16_t sequence) const;
+    void schedule(const SynthEvent& event, uint32_t timestamp, double localSeconds);
+    void render_pieces(float* output, int start, int end, int numChannels);
+    void play(const ScheduledEvent& event);
+    
+    double m_sampleRate;
+    double m_delaySeconds;
+    
+    // receiving thread
+    bool m_hasSequence;
+    uint16_t m_lastSequence; ///< the newest change received
+    SynthEventStats m_stats;
+    
+    LockFreeRingBuffer m_queue;
+    
+    // audio thread
+    TouchSynth m_synth;
+    ScheduledEvent m_next; ///< taken from the queue, but not yet due
+    bool m_hasNext;
+    volatile uint32_t m_numLate;
+};
+
+#endif // SYNTH_EVENT_STREAM_H
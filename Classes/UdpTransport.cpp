@@ -0,0 +1,599 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/*
+ *  UdpTransport.cpp
+ *  iDiMP
+ *
+ */
+
+#include "UdpTransport.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// ---- UdpTransport public methods ----
+
+UdpTransport::UdpTransport() :
+    m_socket(-1),
+    m_family(AF_INET),
+    m_numQueued(0),
+    m_numReceived(0),
+    m_receiveBuffers(new uint8_t[UDP_TRANSPORT_BATCH_SIZE * UDP_TRANSPORT_MAX_DATAGRAM_BYTES]),
+    m_numSent(0),
+    m_numSendCalls(0),
+    m_numSendFailures(0),
+    m_numReceivedTotal(0),
+    m_numReceiveCalls(0),
+    m_numTruncated(0),
+    m_sendBufferBytes(0),
+    m_receiveBufferBytes(0)
+{
+}
+
+UdpTransport::~UdpTransport()
+{
+    close();
+    delete[] m_receiveBuffers;
+    m_receiveBuffers = NULL;
+}
+
+bool UdpTransport::open(uint16_t port, bool ipv6)
+{
+    close();
+    
+    m_family = ipv6 ? AF_INET6 : AF_INET;
+    m_socket = socket(m_family, SOCK_DGRAM, IPPROTO_UDP);
+    if (m_socket < 0)
+    {
+        report_error("open could not create socket");
+        return false;
+    }
+    
+    // sends and receives never block the thread driving us
+    fcntl(m_socket, F_SETFL, fcntl(m_socket, F_GETFL, 0) | O_NONBLOCK);
+    
+    int on = 1;
+    setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+#ifdef SO_REUSEPORT
+    // so that several instances on one host can all receive a multicast group
+    setsockopt(m_socket, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+#endif
+    
+    // bigger buffers than the default ride out bursts and scheduling hiccups without loss
+    int bufferBytes = UDP_TRANSPORT_SOCKET_BUFFER_BYTES;
+    setsockopt(m_socket, SOL_SOCKET, SO_SNDBUF, &bufferBytes, sizeof(bufferBytes));
+    setsockopt(m_socket, SOL_SOCKET, SO_RCVBUF, &bufferBytes, sizeof(bufferBytes));
+    socklen_t optionLength = sizeof(m_sendBufferBytes);
+    getsockopt(m_socket, SOL_SOCKET, SO_SNDBUF, &m_sendBufferBytes, &optionLength);
+    optionLength = sizeof(m_receiveBufferBytes);
+    getsockopt(m_socket, SOL_SOCKET, SO_RCVBUF, &m_receiveBufferBytes, &optionLength);
+    
+    struct sockaddr_storage address;
+    memset(&address, 0, sizeof(address));
+    socklen_t addressLength;
+    if (ipv6)
+    {
+        int off = 0;
+        setsockopt(m_socket, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        
+        struct sockaddr_in6* address6 = (struct sockaddr_in6*)&address;
+        address6->sin6_family = AF_INET6;
+        address6->sin6_port = htons(port);
+        address6->sin6_addr = in6addr_any;
+        addressLength = sizeof(*address6);
+    }
+    else
+    {
+        struct sockaddr_in* address4 = (struct sockaddr_in*)&address;
+        address4->sin_family = AF_INET;
+        address4->sin_port = htons(port);
+        address4->sin_addr.s_addr = htonl(INADDR_ANY);
+        addressLength = sizeof(*address4);
+    }
+    if (bind(m_socket, (struct sockaddr*)&address, addressLength) < 0)
+    {
+        report_error("open could not bind socket");
+        close();
+        return false;
+    }
+    return true;
+}
+
+void UdpTransport::close()
+{
+    if (m_socket >= 0)
+    {
+        ::close(m_socket);
+        m_socket = -1;
+    }
+    m_numQueued = 0;
+    m_numReceived = 0;
+}
+
+uint16_t UdpTransport::getLocalPort() const
+{
+    struct sockaddr_storage address;
+    socklen_t addressLength = sizeof(address);
+    if (m_socket < 0 || getsockname(m_socket, (struct sockaddr*)&address, &addressLength) < 0)
+    {
+        return 0;
+    }
+    if (address.ss_family == AF_INET6)
+    {
+        return ntohs(((struct sockaddr_in6*)&address)->sin6_port);
+    }
+    return ntohs(((struct sockaddr_in*)&address)->sin_port);
+}
+
+bool UdpTransport::canSendTo(const struct sockaddr* address) const
+{
+    return address->sa_family == AF_INET || (address->sa_family == AF_INET6 && m_family == AF_INET6);
+}
+
+bool UdpTransport::joinMulticastGroup(const char* group, const char* interfaceAddress)
+{
+    return change_membership(true, group, interfaceAddress);
+}
+
+bool UdpTransport::leaveMulticastGroup(const char* group, const char* interfaceAddress)
+{
+    return change_membership(false, group, interfaceAddress);
+}
+
+bool UdpTransport::setMulticastTTL(int ttl)
+{
+    // IP_MULTICAST_TTL takes a byte on BSD (Linux takes either), while IPV6_MULTICAST_HOPS takes an int
+    unsigned char ttl4 = (unsigned char)ttl;
+    if (setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl4, sizeof(ttl4)) < 0)
+    {
+        report_error("setMulticastTTL could not set the IPv4 TTL");
+        return false;
+    }
+    if (m_family == AF_INET6 && setsockopt(m_socket, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &ttl, sizeof(ttl)) < 0)
+    {
+        report_error("setMulticastTTL could not set the IPv6 hop limit");
+        return false;
+    }
+    return true;
+}
+
+bool UdpTransport::setMulticastLoopback(bool loopback)
+{
+    unsigned char loop4 = loopback ? 1 : 0;
+    unsigned int loop6 = loopback ? 1 : 0;
+    if (setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop4, sizeof(loop4)) < 0)
+    {
+        report_error("setMulticastLoopback could not set IPv4 loopback");
+        return false;
+    }
+    if (m_family == AF_INET6 && setsockopt(m_socket, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, &loop6, sizeof(loop6)) < 0)
+    {
+        report_error("setMulticastLoopback could not set IPv6 loopback");
+        return false;
+    }
+    return true;
+}
+
+bool UdpTransport::setMulticastInterface(const char* interfaceAddress)
+{
+    struct in_addr address;
+    if (inet_pton(AF_INET, interfaceAddress, &address) != 1)
+    {
+        printf("UdpTransport::setMulticastInterface %s is not an IPv4 address\n", interfaceAddress);
+        return false;
+    }
+    if (setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_IF, &address, sizeof(address)) < 0)
+    {
+        report_error("setMulticastInterface could not set the interface");
+        return false;
+    }
+    return true;
+}
+
+bool UdpTransport::queue(const void* header, size_t headerLength, const void* payload, size_t payloadLength, 
+                         const struct sockaddr* address, socklen_t addressLength)
+{
+    if (headerLength > UDP_TRANSPORT_MAX_HEADER_BYTES || addressLength > sizeof(struct sockaddr_storage))
+    {
+        return false;
+    }
+    if (!canSendTo(address))
+    {
+        if (AtomicIncrement32(&m_numSendFailures) == 1)
+        {
+            printf("UdpTransport::queue an IPv4 socket can't send to an IPv6 address\n");
+        }
+        return false;
+    }
+    if (m_numQueued == UDP_TRANSPORT_BATCH_SIZE)
+    {
+        flush();
+    }
+    
+    int i = m_numQueued++;
+    memcpy(m_headers[i], header, headerLength);
+    if (m_family == AF_INET6 && address->sa_family == AF_INET)
+    {
+        // a dual-stack socket reaches IPv4 hosts through their v4-mapped addresses (::ffff:a.b.c.d)
+        const struct sockaddr_in* address4 = (const struct sockaddr_in*)address;
+        struct sockaddr_in6* address6 = (struct sockaddr_in6*)&m_sendAddresses[i];
+        memset(address6, 0, sizeof(*address6));
+        address6->sin6_family = AF_INET6;
+        address6->sin6_port = address4->sin_port;
+        address6->sin6_addr.s6_addr[10] = 0xff;
+        address6->sin6_addr.s6_addr[11] = 0xff;
+        memcpy(&address6->sin6_addr.s6_addr[12], &address4->sin_addr, sizeof(address4->sin_addr));
+        m_sendAddressLengths[i] = sizeof(*address6);
+    }
+    else
+    {
+        memcpy(&m_sendAddresses[i], address, addressLength);
+        m_sendAddressLengths[i] = addressLength;
+    }
+    m_sendParts[i][0].iov_base = m_headers[i];
+    m_sendParts[i][0].iov_len = headerLength;
+    m_sendParts[i][1].iov_base = (void*)payload;
+    m_sendParts[i][1].iov_len = payloadLength;
+    return true;
+}
+
+int UdpTransport::flush()
+{
+    int numQueued = m_numQueued;
+    m_numQueued = 0;
+    if (numQueued == 0 || m_socket < 0)
+    {
+        AtomicAdd32(numQueued, &m_numSendFailures);
+        return 0;
+    }
+    
+    int numSent = 0;
+#if defined(__linux__)
+    struct mmsghdr messages[UDP_TRANSPORT_BATCH_SIZE];
+    memset(messages, 0, numQueued * sizeof(messages[0]));
+    for (int i = 0; i < numQueued; i++)
+    {
+        messages[i].msg_hdr.msg_name = &m_sendAddresses[i];
+        messages[i].msg_hdr.msg_namelen = m_sendAddressLengths[i];
+        messages[i].msg_hdr.msg_iov = m_sendParts[i];
+        messages[i].msg_hdr.msg_iovlen = 2;
+    }
+    while (numSent < numQueued)
+    {
+        AtomicIncrement32(&m_numSendCalls);
+        int result = sendmmsg(m_socket, messages + numSent, numQueued - numSent, 0);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // the first datagram failed - drop it, and carry on with the rest
+            if (AtomicIncrement32(&m_numSendFailures) == 1)
+            {
+                report_error("flush could not send");
+            }
+            numQueued--;
+            memmove(messages + numSent, messages + numSent + 1, (numQueued - numSent) * sizeof(messages[0]));
+            continue;
+        }
+        numSent += result;
+    }
+#else
+    for (int i = 0; i < numQueued; i++)
+    {
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_name = &m_sendAddresses[i];
+        message.msg_namelen = m_sendAddressLengths[i];
+        message.msg_iov = m_sendParts[i];
+        message.msg_iovlen = 2;
+        
+        AtomicIncrement32(&m_numSendCalls);
+        if (sendmsg(m_socket, &message, 0) < 0)
+        {
+            if (AtomicIncrement32(&m_numSendFailures) == 1)
+            {
+                report_error("flush could not send");
+            }
+        }
+        else
+        {
+            numSent++;
+        }
+    }
+#endif
+    AtomicAdd32(numSent, &m_numSent);
+    return numSent;
+}
+
+int UdpTransport::receive(int timeoutMilliseconds)
+{
+    m_numReceived = 0;
+    if (m_socket < 0)
+    {
+        return -1;
+    }
+    
+    struct pollfd waitFor;
+    waitFor.fd = m_socket;
+    waitFor.events = POLLIN;
+    waitFor.revents = 0;
+    int ready = poll(&waitFor, 1, timeoutMilliseconds);
+    if (ready < 0)
+    {
+        return (errno == EINTR) ? 0 : -1;
+    }
+    if (ready == 0)
+    {
+        return 0;
+    }
+    
+    int numReceived = 0;
+#if defined(__linux__)
+    struct mmsghdr messages[UDP_TRANSPORT_BATCH_SIZE];
+    struct iovec parts[UDP_TRANSPORT_BATCH_SIZE];
+    memset(messages, 0, sizeof(messages));
+    for (int i = 0; i < UDP_TRANSPORT_BATCH_SIZE; i++)
+    {
+        parts[i].iov_base = m_receiveBuffers + i * UDP_TRANSPORT_MAX_DATAGRAM_BYTES;
+        parts[i].iov_len = UDP_TRANSPORT_MAX_DATAGRAM_BYTES;
+        messages[i].msg_hdr.msg_name = &m_receiveAddresses[i];
+        messages[i].msg_hdr.msg_namelen = sizeof(m_receiveAddresses[i]);
+        messages[i].msg_hdr.msg_iov = &parts[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    AtomicIncrement32(&m_numReceiveCalls);
+    int result = recvmmsg(m_socket, messages, UDP_TRANSPORT_BATCH_SIZE, MSG_DONTWAIT, NULL);
+    if (result < 0)
+    {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    }
+    for (int i = 0; i < result; i++)
+    {
+        if (messages[i].msg_hdr.msg_flags & MSG_TRUNC)
+        {
+            AtomicIncrement32(&m_numTruncated);
+            continue;
+        }
+        // keep the datagrams packed at the front
+        if (numReceived != i)
+        {
+            memcpy(m_receiveBuffers + numReceived * UDP_TRANSPORT_MAX_DATAGRAM_BYTES, parts[i].iov_base, messages[i].msg_len);
+            memcpy(&m_receiveAddresses[numReceived], &m_receiveAddresses[i], sizeof(m_receiveAddresses[i]));
+        }
+        unmap_address(m_receiveAddresses[numReceived]);
+        m_receiveLengths[numReceived++] = messages[i].msg_len;
+    }
+#else
+    while (numReceived < UDP_TRANSPORT_BATCH_SIZE)
+    {
+        struct iovec part;
+        part.iov_base = m_receiveBuffers + numReceived * UDP_TRANSPORT_MAX_DATAGRAM_BYTES;
+        part.iov_len = UDP_TRANSPORT_MAX_DATAGRAM_BYTES;
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_name = &m_receiveAddresses[numReceived];
+        message.msg_namelen = sizeof(m_receiveAddresses[numReceived]);
+        message.msg_iov = &part;
+        message.msg_iovlen = 1;
+        
+        AtomicIncrement32(&m_numReceiveCalls);
+        ssize_t length = recvmsg(m_socket, &message, MSG_DONTWAIT);
+        if (length < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            {
+                break;
+            }
+            return (numReceived > 0) ? numReceived : -1;
+        }
+        if (message.msg_flags & MSG_TRUNC)
+        {
+            AtomicIncrement32(&m_numTruncated);
+            continue;
+        }
+        unmap_address(m_receiveAddresses[numReceived]);
+        m_receiveLengths[numReceived++] = (size_t)length;
+    }
+#endif
+    m_numReceived = numReceived;
+    AtomicAdd32(numReceived, &m_numReceivedTotal);
+    return numReceived;
+}
+
+const uint8_t* UdpTransport::getDatagram(int index, size_t& length) const
+{
+    length = m_receiveLengths[index];
+    return m_receiveBuffers + index * UDP_TRANSPORT_MAX_DATAGRAM_BYTES;
+}
+
+const struct sockaddr* UdpTransport::getDatagramAddress(int index) const
+{
+    return (const struct sockaddr*)&m_receiveAddresses[index];
+}
+
+void UdpTransport::getStats(UdpTransportStats& stats) const
+{
+    stats.numSent = AtomicLoad32(&m_numSent);
+    stats.numSendCalls = AtomicLoad32(&m_numSendCalls);
+    stats.numSendFailures = AtomicLoad32(&m_numSendFailures);
+    stats.numReceived = AtomicLoad32(&m_numReceivedTotal);
+    stats.numReceiveCalls = AtomicLoad32(&m_numReceiveCalls);
+    stats.numTruncated = AtomicLoad32(&m_numTruncated);
+    stats.sendBufferBytes = m_sendBufferBytes;
+    stats.receiveBufferBytes = m_receiveBufferBytes;
+}
+
+bool UdpTransport::parseAddress(const char* host, uint16_t port, struct sockaddr_storage& address, socklen_t& addressLength)
+{
+    memset(&address, 0, sizeof(address));
+    struct sockaddr_in* address4 = (struct sockaddr_in*)&address;
+    struct sockaddr_in6* address6 = (struct sockaddr_in6*)&address;
+    if (inet_pton(AF_INET, host, &address4->sin_addr) == 1)
+    {
+        address4->sin_family = AF_INET;
+        address4->sin_port = htons(port);
+        addressLength = sizeof(*address4);
+        return true;
+    }
+    if (inet_pton(AF_INET6, host, &address6->sin6_addr) == 1)
+    {
+        address6->sin6_family = AF_INET6;
+        address6->sin6_port = htons(port);
+        addressLength = sizeof(*address6);
+        return true;
+    }
+    return false;
+}
+
+void UdpTransport::formatAddress(const struct sockaddr* address, char* text, size_t textLength)
+{
+    char host[INET6_ADDRSTRLEN];
+    if (address->sa_family == AF_INET6)
+    {
+        const struct sockaddr_in6* address6 = (const struct sockaddr_in6*)address;
+        inet_ntop(AF_INET6, &address6->sin6_addr, host, sizeof(host));
+        snprintf(text, textLength, "[%s]:%u", host, ntohs(address6->sin6_port));
+    }
+    else if (address->sa_family == AF_INET)
+    {
+        const struct sockaddr_in* address4 = (const struct sockaddr_in*)address;
+        inet_ntop(AF_INET, &address4->sin_addr, host, sizeof(host));
+        snprintf(text, textLength, "%s:%u", host, ntohs(address4->sin_port));
+    }
+    else
+    {
+        snprintf(text, textLength, "(family %d)", address->sa_family);
+    }
+}
+
+bool UdpTransport::isSameAddress(const struct sockaddr* a, const struct sockaddr* b)
+{
+    if (a->sa_family != b->sa_family)
+    {
+        return false;
+    }
+    if (a->sa_family == AF_INET6)
+    {
+        const struct sockaddr_in6* a6 = (const struct sockaddr_in6*)a;
+        const struct sockaddr_in6* b6 = (const struct sockaddr_in6*)b;
+        return a6->sin6_port == b6->sin6_port && memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr)) == 0;
+    }
+    if (a->sa_family == AF_INET)
+    {
+        const struct sockaddr_in* a4 = (const struct sockaddr_in*)a;
+        const struct sockaddr_in* b4 = (const struct sockaddr_in*)b;
+        return a4->sin_port == b4->sin_port && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+    }
+    return false;
+}
+
+socklen_t UdpTransport::getAddressLength(const struct sockaddr* address)
+{
+    if (address->sa_family == AF_INET6)
+    {
+        return sizeof(struct sockaddr_in6);
+    }
+    if (address->sa_family == AF_INET)
+    {
+        return sizeof(struct sockaddr_in);
+    }
+    return 0;
+}
+
+// ---- UdpTransport private methods ----
+
+bool UdpTransport::change_membership(bool join, const char* group, const char* interfaceAddress)
+{
+    struct sockaddr_storage groupAddress;
+    socklen_t groupAddressLength;
+    if (!parseAddress(group, 0, groupAddress, groupAddressLength))
+    {
+        printf("UdpTransport::change_membership %s is not a numeric address\n", group);
+        return false;
+    }
+    
+    if (groupAddress.ss_family == AF_INET)
+    {
+        struct ip_mreq request;
+        request.imr_multiaddr = ((struct sockaddr_in*)&groupAddress)->sin_addr;
+        request.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (interfaceAddress != NULL && inet_pton(AF_INET, interfaceAddress, &request.imr_interface) != 1)
+        {
+            printf("UdpTransport::change_membership %s is not an IPv4 address\n", interfaceAddress);
+            return false;
+        }
+        if (setsockopt(m_socket, IPPROTO_IP, join ? IP_ADD_MEMBERSHIP : IP_DROP_MEMBERSHIP, &request, sizeof(request)) < 0)
+        {
+            report_error(join ? "joinMulticastGroup could not join" : "leaveMulticastGroup could not leave");
+            return false;
+        }
+    }
+    else
+    {
+        if (m_family != AF_INET6)
+        {
+            printf("UdpTransport::change_membership %s needs an IPv6 socket\n", group);
+            return false;
+        }
+        struct ipv6_mreq request;
+        request.ipv6mr_multiaddr = ((struct sockaddr_in6*)&groupAddress)->sin6_addr;
+        request.ipv6mr_interface = 0;
+        if (setsockopt(m_socket, IPPROTO_IPV6, join ? IPV6_JOIN_GROUP : IPV6_LEAVE_GROUP, &request, sizeof(request)) < 0)
+        {
+            report_error(join ? "joinMulticastGroup could not join" : "leaveMulticastGroup could not leave");
+            return false;
+        }
+    }
+    return true;
+}
+
+void UdpTransport::unmap_address(struct sockaddr_storage& address)
+{
+    const struct sockaddr_in6* address6 = (const struct sockaddr_in6*)&address;
+    if (address.ss_family != AF_INET6 || !IN6_IS_ADDR_V4MAPPED(&address6->sin6_addr))
+    {
+        return;
+    }
+    struct sockaddr_in address4;
+    memset(&address4, 0, sizeof(address4));
+    address4.sin_family = AF_INET;
+    address4.sin_port = address6->sin6_port;
+    memcpy(&address4.sin_addr, &address6->sin6_addr.s6_addr[12], sizeof(address4.sin_addr));
+    memset(&address, 0, sizeof(address));
+    memcpy(&address, &address4, sizeof(address4));
+}
+
+void UdpTransport::report_error(const char* what) const
+{
+    printf("UdpTransport::%s: %s\n", what, strerror(errno));
+}
@@ -0,0 +1,260 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/**
+ *  @file UdpTransport.h
+ *  iDiMP
+ *
+ *  This file defines the interface for the UdpTransport class, which sends and receives 
+ *  datagrams in batches over a plain BSD socket.
+ */
+
+#ifndef UDP_TRANSPORT_H
+#define UDP_TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#import "AtomicOps.h"
+
+static const int UDP_TRANSPORT_BATCH_SIZE         = 16;         ///< Most datagrams sent or received per system call
+static const int UDP_TRANSPORT_MAX_DATAGRAM_BYTES = 9216;       ///< Largest datagram received (longer ones are truncated and dropped)
+static const int UDP_TRANSPORT_MAX_HEADER_BYTES   = 64;         ///< Largest header queue will copy
+static const int UDP_TRANSPORT_SOCKET_BUFFER_BYTES = 256 * 1024; ///< Kernel send and receive buffer size asked for, enough for several hundred ms of audio
+
+/**
+ * Statistics gathered by a UdpTransport.  Counts are totals since the UdpTransport was created.
+ */
+struct UdpTransportStats
+{
+    uint32_t numSent;          ///< datagrams sent
+    uint32_t numSendCalls;     ///< system calls made to send them
+    uint32_t numSendFailures;  ///< datagrams that could not be sent (no route, full buffer...)
+    uint32_t numReceived;      ///< datagrams received
+    uint32_t numReceiveCalls;  ///< system calls made to receive them
+    uint32_t numTruncated;     ///< datagrams dropped for being longer than UDP_TRANSPORT_MAX_DATAGRAM_BYTES
+    int sendBufferBytes;       ///< the kernel send buffer size actually granted
+    int receiveBufferBytes;    ///< the kernel receive buffer size actually granted
+};
+
+/** UdpTransport class.
+ * A UdpTransport owns one UDP socket, bound to a port on every interface.  Datagrams are queued 
+ * and then sent together by flush, and received together by receive, so that on Linux a whole 
+ * batch takes a single sendmmsg or recvmmsg call.  Elsewhere the batch is sent or received one 
+ * datagram at a time with the same interface.  All memory is allocated when the object is created.
+ *
+ * It is not tied to a run loop, so it can be driven from any one thread (and tested off-device 
+ * over localhost).  The multicast options may be set from another thread while that one is 
+ * sending and receiving.
+ */
+class UdpTransport
+{
+public:
+   /**
+    * UdpTransport constructor
+    */
+    UdpTransport();
+    
+   /**
+    * UdpTransport destructor.  Closes the socket.
+    */
+    ~UdpTransport();
+    
+   /**
+    * Create the socket and bind it to the given port on every interface.
+    * @param port the local port, or 0 for any free port
+    * @param ipv6 true for a dual-stack IPv6 socket (which also carries IPv4), false for IPv4 only
+    * @return false if the socket could not be created or bound
+    */
+    bool open(uint16_t port, bool ipv6 = false);
+    
+   /**
+    * Close the socket.  Anything still queued is discarded.
+    */
+    void close();
+    
+   /**
+    * @return whether the socket is open
+    */
+    bool isOpen() const { return m_socket >= 0; }
+    
+   /**
+    * @return the local port the socket is bound to, or 0 if it isn't open
+    */
+    uint16_t getLocalPort() const;
+    
+   /**
+    * @param address a destination
+    * @return whether the socket can send to it: a dual-stack socket can send to either family
+    */
+    bool canSendTo(const struct sockaddr* address) const;
+    
+   /**
+    * Join or leave a multicast group, such as "239.255.77.77" or "ff02::7777".  An IPv6 group 
+    * needs an IPv6 socket; an IPv4 group may be joined on either.
+    * @param group the group's numeric address
+    * @param interfaceAddress the local IPv4 address of the interface to use, or NULL to let the OS choose
+    * @return false if the group could not be joined or left
+    */
+    bool joinMulticastGroup(const char* group, const char* interfaceAddress = NULL);
+    bool leaveMulticastGroup(const char* group, const char* interfaceAddress = NULL);
+    
+   /**
+    * Set how many routers sent multicast datagrams may cross (1 keeps them on the local network).
+    * On a dual-stack socket this and the other multicast options are set for both families.
+    * @return false if the option could not be set
+    */
+    bool setMulticastTTL(int ttl);
+    
+   /**
+    * Set whether sent multicast datagrams are also delivered back to this host.
+    * @return false if the option could not be set
+    */
+    bool setMulticastLoopback(bool loopback);
+    
+   /**
+    * Send IPv4 multicast datagrams out of the interface with the given local address, 
+    * such as "127.0.0.1" to test over loopback.
+    * @return false if the option could not be set
+    */
+    bool setMulticastInterface(const char* interfaceAddress);
+    
+   /**
+    * Queue a datagram made of a header followed by a payload.  The header and address are 
+    * copied, but the payload is sent from where it lies, so it must stay unchanged until flush.
+    * If the queue is already full, it is flushed first.  An IPv4 destination is sent to as a 
+    * v4-mapped IPv6 address on a dual-stack socket.  Call from the sending thread only.
+    * @param header the first part of the datagram (at most UDP_TRANSPORT_MAX_HEADER_BYTES)
+    * @param headerLength the header's length in bytes
+    * @param payload the rest of the datagram
+    * @param payloadLength the payload's length in bytes
+    * @param address the destination
+    * @param addressLength the destination's length
+    * @return false if the datagram could not be queued, or the socket can't send to the address
+    */
+    bool queue(const void* header, size_t headerLength, const void* payload, size_t payloadLength, 
+               const struct sockaddr* address, socklen_t addressLength);
+    
+   /**
+    * Send everything queued, in as few system calls as possible.  Never blocks: datagrams the 
+    * kernel won't take right now are dropped and counted.  Call from the sending thread only.
+    * @return the number of datagrams sent
+    */
+    int flush();
+    
+   /**
+    * Wait for datagrams to arrive, then receive as many as are waiting (up to UDP_TRANSPORT_BATCH_SIZE).
+    * They stay available through getDatagram until the next call.  Call from the receiving thread only.
+    * @param timeoutMilliseconds the longest to wait, or 0 not to wait
+    * @return the number of datagrams received, 0 if none arrived in time, or -1 if the socket failed
+    */
+    int receive(int timeoutMilliseconds);
+    
+   /**
+    * Get a datagram from the last receive.
+    * @param index which datagram (0 to the number received - 1)
+    * @param length receives the datagram's length in bytes
+    * @return the datagram's bytes
+    */
+    const uint8_t* getDatagram(int index, size_t& length) const;
+    
+   /**
+    * Get the address a datagram from the last receive came from.  On a dual-stack socket, an IPv4
+    * sender's address is given as IPv4, not v4-mapped, so it matches the address sent to.
+    * @param index which datagram (0 to the number received - 1)
+    * @return the sender's address
+    */
+    const struct sockaddr* getDatagramAddress(int index) const;
+    
+   /**
+    * Get a copy of the statistics.  May be called from any thread.
+    * @param stats receives the statistics
+    */
+    void getStats(UdpTransportStats& stats) const;
+    
+   /**
+    * Convert a numeric host and a port into a socket address.
+    * @param host an IPv4 or IPv6 numeric address
+    * @param port the port
+    * @param address receives the address
+    * @param addressLength receives the address's length
+    * @return false if host is not a numeric address
+    */
+    static bool parseAddress(const char* host, uint16_t port, struct sockaddr_storage& address, socklen_t& addressLength);
+    
+   /**
+    * Write an address as "host:port" (or "[host]:port" for IPv6).
+    * @param address the address
+    * @param text receives the text
+    * @param textLength the size of text in bytes
+    */
+    static void formatAddress(const struct sockaddr* address, char* text, size_t textLength);
+    
+   /**
+    * @return whether two addresses have the same family, host and port
+    */
+    static bool isSameAddress(const struct sockaddr* a, const struct sockaddr* b);
+    
+   /**
+    * @return the length of an IPv4 or IPv6 address, or 0 for any other family
+    */
+    static socklen_t getAddressLength(const struct sockaddr* address);
+    
+private:
+    UdpTransport(const UdpTransport&);
+    UdpTransport& operator= (const UdpTransport&);
+    
+    bool change_membership(bool join, const char* group, const char* interfaceAddress);
+    static void unmap_address(struct sockaddr_storage& address);
+    void report_error(const char* what) const;
+    
+    int m_socket;
+    int m_family;
+    
+    // send queue
+    int m_numQueued;
+    uint8_t m_headers[UDP_TRANSPORT_BATCH_SIZE][UDP_TRANSPORT_MAX_HEADER_BYTES];
+    struct sockaddr_storage m_sendAddresses[UDP_TRANSPORT_BATCH_SIZE];
+    socklen_t m_sendAddressLengths[UDP_TRANSPORT_BATCH_SIZE];
+    struct iovec m_sendParts[UDP_TRANSPORT_BATCH_SIZE][2];
+    
+    // received batch
+    int m_numReceived;
+    uint8_t* m_receiveBuffers; // UDP_TRANSPORT_BATCH_SIZE * UDP_TRANSPORT_MAX_DATAGRAM_BYTES
+    size_t m_receiveLengths[UDP_TRANSPORT_BATCH_SIZE];
+    struct sockaddr_storage m_receiveAddresses[UDP_TRANSPORT_BATCH_SIZE];
+    
+    volatile int32_t m_numSent;
+    volatile int32_t m_numSendCalls;
+    volatile int32_t m_numSendFailures;
+    volatile int32_t m_numReceivedTotal;
+    volatile int32_t m_numReceiveCalls;
+    volatile int32_t m_numTruncated;
+    int m_sendBufferBytes;
+    int m_receiveBufferBytes;
+};
+
+#endif // UDP_TRANSPORT_H
@@ -0,0 +1,237 @@
+// Copyright (c) 2009 Michelle Daniels and John Kooker
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+/*
+ *  UdpTransportTest.cpp
+ *  iDiMP
+ *
+ *  Exercises UdpTransport over loopback, off-device: unicast throughput and the system calls 
+ *  batching saves, IPv4 through a dual-stack socket, and joining and receiving a multicast group.
+ *  Exits with a failure status if anything doesn't arrive as it should.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "UdpTransport.h"
+
+static const int NUM_DATAGRAMS    = 5000;  ///< sent in the unicast test
+static const int DATAGRAM_BYTES   = 512;   ///< about an ADPCM stereo packet
+static const int RECEIVE_WAIT_MS  = 200;   ///< longest a test waits for a datagram that should be on its way
+static const uint16_t MULTICAST_PORT = 23799;
+static const char* MULTICAST_GROUP = "239.255.77.77";
+
+static int s_numFailures = 0;
+
+static void check(bool passed, const char* what)
+{
+    printf("%s: %s\n", passed ? "pass" : "FAIL", what);
+    if (!passed)
+    {
+        s_numFailures++;
+    }
+}
+
+static double now_seconds()
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec + now.tv_usec * 1e-6;
+}
+
+/**
+ * Receives until count datagrams have arrived or nothing more does, returning how many did.
+ * Each datagram's first word is its number, which must come in order.
+ */
+static int receive_numbered(UdpTransport& transport, int count, uint32_t& next, bool& inOrder)
+{
+    int numReceived = 0;
+    while (numReceived < count)
+    {
+        int n = transport.receive(RECEIVE_WAIT_MS);
+        if (n <= 0)
+        {
+            break;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            size_t length;
+            const uint8_t* data = transport.getDatagram(i, length);
+            uint32_t number;
+            memcpy(&number, data, sizeof(number));
+            inOrder = inOrder && (number == next) && (length == (size_t)DATAGRAM_BYTES);
+            next = number + 1;
+        }
+        numReceived += n;
+    }
+    return numReceived;
+}
+
+static void test_unicast(bool senderIsDualStack)
+{
+    printf("-- unicast over loopback, %s sender\n", senderIsDualStack ? "dual-stack" : "IPv4");
+    UdpTransport sender;
+    UdpTransport receiver;
+    if (!sender.open(0, senderIsDualStack) || !receiver.open(0))
+    {
+        check(false, "open sockets");
+        return;
+    }
+    struct sockaddr_storage destination;
+    socklen_t destinationLength;
+    UdpTransport::parseAddress("127.0.0.1", receiver.getLocalPort(), destination, destinationLength);
+    
+    uint8_t payload[DATAGRAM_BYTES];
+    memset(payload, 0x5a, sizeof(payload));
+    uint32_t next = 0;
+    bool inOrder = true;
+    int numReceived = 0;
+    double startSeconds = now_seconds();
+    for (uint32_t number = 0; number < (uint32_t)NUM_DATAGRAMS; )
+    {
+        // a batch at a time, so the receiver's buffer never overflows
+        int batch = 0;
+        for (; batch < UDP_TRANSPORT_BATCH_SIZE && number < (uint32_t)NUM_DATAGRAMS; batch++, number++)
+        {
+            sender.queue(&number, sizeof(number), payload + sizeof(number), sizeof(payload) - sizeof(number), 
+                         (const struct sockaddr*)&destination, destinationLength);
+        }
+        sender.flush();
+        numReceived += receive_numbered(receiver, batch, next, inOrder);
+    }
+    double elapsedSeconds = now_seconds() - startSeconds;
+    
+    UdpTransportStats sendStats, receiveStats;
+    sender.getStats(sendStats);
+    receiver.getStats(receiveStats);
+    printf("%d datagrams in %.1f ms (%.0f per second, %.1f MB/s)\n", numReceived, elapsedSeconds * 1000.0, 
+           numReceived / elapsedSeconds, numReceived * DATAGRAM_BYTES / elapsedSeconds / 1e6);
+    printf("%u send calls, %u receive calls, %u send failures; buffers %d/%d bytes\n", sendStats.numSendCalls, 
+           receiveStats.numReceiveCalls, sendStats.numSendFailures, sendStats.sendBufferBytes, receiveStats.receiveBufferBytes);
+    
+    check(numReceived == NUM_DATAGRAMS && sendStats.numSent == (uint32_t)NUM_DATAGRAMS, "every datagram arrived");
+    check(inOrder, "datagrams arrived whole and in order");
+#if defined(__linux__)
+    int numBatches = (NUM_DATAGRAMS + UDP_TRANSPORT_BATCH_SIZE - 1) / UDP_TRANSPORT_BATCH_SIZE;
+    check(sendStats.numSendCalls == (uint32_t)numBatches, "one send call per batch");
+    check(receiveStats.numReceiveCalls < (uint32_t)NUM_DATAGRAMS, "fewer receive calls than datagrams");
+#endif
+}
+
+static void test_dual_stack()
+{
+    printf("-- IPv4 and IPv6 through a dual-stack socket\n");
+    UdpTransport dual;
+    UdpTransport ipv4;
+    if (!dual.open(0, true) || !ipv4.open(0))
+    {
+        check(false, "open sockets");
+        return;
+    }
+    
+    // IPv4 in: the sender's address comes back as IPv4, so it can be matched and replied to
+    struct sockaddr_storage address;
+    socklen_t addressLength;
+    UdpTransport::parseAddress("127.0.0.1", dual.getLocalPort(), address, addressLength);
+    uint32_t number = 0;
+    ipv4.queue(&number, sizeof(number), NULL, 0, (const struct sockaddr*)&address, addressLength);
+    ipv4.flush();
+    struct sockaddr_storage ipv4Address;
+    socklen_t ipv4AddressLength;
+    UdpTransport::parseAddress("127.0.0.1", ipv4.getLocalPort(), ipv4Address, ipv4AddressLength);
+    bool arrived = dual.receive(RECEIVE_WAIT_MS) == 1;
+    check(arrived && UdpTransport::isSameAddress(dual.getDatagramAddress(0), (const struct sockaddr*)&ipv4Address), 
+          "an IPv4 sender's address is given as IPv4");
+    
+    // IPv4 out, to a v4-mapped address
+    check(dual.canSendTo((const struct sockaddr*)&ipv4Address), "a dual-stack socket can send to IPv4");
+    dual.queue(&number, sizeof(number), NULL, 0, (const struct sockaddr*)&ipv4Address, ipv4AddressLength);
+    dual.flush();
+    check(ipv4.receive(RECEIVE_WAIT_MS) == 1, "an IPv4 destination receives from a dual-stack socket");
+    
+    // IPv6, which only the dual-stack socket can reach
+    UdpTransport::parseAddress("::1", dual.getLocalPort(), address, addressLength);
+    check(!ipv4.canSendTo((const struct sockaddr*)&address), "an IPv4 socket can't send to IPv6");
+    UdpTransport other;
+    if (other.open(0, true))
+    {
+        other.queue(&number, sizeof(number), NULL, 0, (const struct sockaddr*)&address, addressLength);
+        other.flush();
+        check(dual.receive(RECEIVE_WAIT_MS) == 1 && dual.getDatagramAddress(0)->sa_family == AF_INET6, 
+              "IPv6 arrives over ::1");
+    }
+    else
+    {
+        printf("skip: no IPv6 on this host\n");
+    }
+}
+
+static void test_multicast(bool firstIsDualStack)
+{
+    printf("-- multicast over loopback, %s first member\n", firstIsDualStack ? "dual-stack" : "IPv4");
+    UdpTransport members[2];
+    bool joined = members[0].open(MULTICAST_PORT, firstIsDualStack) && members[1].open(MULTICAST_PORT);
+    for (int i = 0; i < 2 && joined; i++)
+    {
+        joined = members[i].joinMulticastGroup(MULTICAST_GROUP, "127.0.0.1") && 
+                 members[i].setMulticastInterface("127.0.0.1") && 
+                 members[i].setMulticastTTL(1) && 
+                 members[i].setMulticastLoopback(true);
+    }
+    check(joined, "both members joined the group");
+    if (!joined)
+    {
+        return;
+    }
+    
+    struct sockaddr_storage group;
+    socklen_t groupLength;
+    UdpTransport::parseAddress(MULTICAST_GROUP, MULTICAST_PORT, group, groupLength);
+    uint32_t number = 0;
+    members[0].queue(&number, sizeof(number), NULL, 0, (const struct sockaddr*)&group, groupLength);
+    members[0].flush();
+    for (int i = 0; i < 2; i++)
+    {
+        char what[64];
+        snprintf(what, sizeof(what), "member %d received the group's datagram", i);
+        check(members[i].receive(RECEIVE_WAIT_MS) == 1, what);
+    }
+    
+    for (int i = 0; i < 2; i++)
+    {
+        members[i].leaveMulticastGroup(MULTICAST_GROUP, "127.0.0.1");
+    }
+}
+
+int main()
+{
+    test_unicast(false);
+    test_unicast(true);
+    test_dual_stack();
+    test_multicast(false);
+    test_multicast(true);
+    
+    printf("%s (%d failures)\n", (s_numFailures == 0) ? "all passed" : "FAILED", s_numFailures);
+    return (s_numFailures == 0) ? 0 : 1;
+}